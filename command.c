@@ -78,9 +78,13 @@
 #ifdef HAVE_NETPLAY
 #include "network/netplay/netplay.h"
 #endif
+#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+#include "network/net_memwatch.h"
+#endif
 
 #ifdef HAVE_NETWORKING
 #include <net/net_compat.h>
+#include <net/net_http.h>
 #endif
 
 #define DEFAULT_NETWORK_CMD_PORT 55355
@@ -110,6 +114,7 @@ static enum cmd_source_t lastcmd_source;
 static int lastcmd_net_fd;
 static struct sockaddr_storage lastcmd_net_source;
 static socklen_t lastcmd_net_source_len;
+static net_memwatch_t *command_memwatch;
 #endif
 
 #ifdef HAVE_CHEEVOS
@@ -244,12 +249,114 @@ static bool command_write_ram(const char *arg)
 }
 #endif
 
+#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+static void command_memwatch_reply(const char *cmd, const char *arg, int ret)
+{
+   char reply[256];
+   int len = snprintf(reply, sizeof(reply), "%s %s %d\n", cmd, arg, ret);
+
+   if (len > 0 && len < (int)sizeof(reply))
+      sendto(lastcmd_net_fd, reply, len, 0,
+            (struct sockaddr*)&lastcmd_net_source, lastcmd_net_source_len);
+}
+
+static int command_memwatch_add(enum net_memwatch_space space,
+      unsigned bank, const char *arg)
+{
+   unsigned offset = strtoul(arg, (char**)&arg, 16);
+   unsigned size   = strtoul(arg, NULL, 10);
+
+   /* Subscriptions are sent back to the network client. */
+   if (lastcmd_source != cmd_network)
+      return -1;
+
+   return net_memwatch_add(command_memwatch,
+         &lastcmd_net_source, lastcmd_net_source_len,
+         space, bank, offset, size);
+}
+
+#ifdef HAVE_CHEEVOS
+static bool command_memwatch_add_address(const char *arg)
+{
+   int ret = command_memwatch_add(NET_MEMWATCH_SPACE_ADDRESS, 0, arg);
+
+   command_memwatch_reply("MEMWATCH_ADD", arg, ret);
+   return ret >= 0;
+}
+#endif
+
+static bool command_memwatch_add_descriptor(const char *arg)
+{
+   const char *range = arg;
+   unsigned bank     = strtoul(arg, (char**)&range, 10);
+   int ret           = command_memwatch_add(NET_MEMWATCH_SPACE_DESCRIPTOR,
+         bank, range);
+
+   command_memwatch_reply("MEMWATCH_ADD_DESC", arg, ret);
+   return ret >= 0;
+}
+
+static bool command_memwatch_interval(const char *arg)
+{
+   return net_memwatch_set_interval(command_memwatch,
+         &lastcmd_net_source, lastcmd_net_source_len,
+         strtoul(arg, NULL, 10));
+}
+
+static bool command_memwatch_rate(const char *arg)
+{
+   return net_memwatch_set_rate(command_memwatch,
+         &lastcmd_net_source, lastcmd_net_source_len,
+         strtoul(arg, NULL, 10));
+}
+
+static bool command_memwatch_sync(const char *arg)
+{
+   return net_memwatch_sync(command_memwatch,
+         &lastcmd_net_source, lastcmd_net_source_len);
+}
+
+static bool command_memwatch_clear(const char *arg)
+{
+   net_memwatch_clear(command_memwatch,
+         &lastcmd_net_source, lastcmd_net_source_len);
+   return true;
+}
+
+void command_memwatch_frame(void)
+{
+   net_memwatch_frame(command_memwatch);
+}
+#endif
+
+/* Always writes to the configured path, network and stdin
+ * commands aren't authenticated and mustn't choose a file. */
+static bool command_perfcnt_trace_dump(const char *arg)
+{
+   settings_t *settings = config_get_ptr();
+
+   (void)arg;
+
+   return performance_counters_trace_dump(settings->path.perfcnt_trace);
+}
+
 static const struct cmd_action_map action_map[] = {
    { "SET_SHADER", command_set_shader, "<shader path>" },
+   { "PERFCNT_TRACE_DUMP", command_perfcnt_trace_dump, "" },
 #ifdef HAVE_CHEEVOS
    { "READ_CORE_RAM", command_read_ram, "<address> <number of bytes>" },
    { "WRITE_CORE_RAM", command_write_ram, "<address> <byte1> <byte2> ..." },
 #endif
+#if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+#ifdef HAVE_CHEEVOS
+   { "MEMWATCH_ADD", command_memwatch_add_address, "<address> <number of bytes>" },
+#endif
+   { "MEMWATCH_ADD_DESC", command_memwatch_add_descriptor, "<descriptor> <offset> <number of bytes>" },
+   { "MEMWATCH_INTERVAL", command_memwatch_interval, "<frames>" },
+   { "MEMWATCH_RATE", command_memwatch_rate, "<bytes per second>" },
+   { "MEMWATCH_SYNC", command_memwatch_sync, "" },
+   { "MEMWATCH_CLEAR", command_memwatch_clear, "" },
+#endif
 };
 
 static const struct cmd_map map[] = {
@@ -318,11 +425,16 @@ static bool command_get_arg(const char *tok,
       if (str == tok)
       {
          const char *argument = str + strlen(action_map[i].str);
-         if (*argument != ' ')
-            return false;
+
+         /* Longer command with the same prefix. */
+         if (*argument != ' ' && *argument != '\0')
+            continue;
+
+         if (*argument == ' ')
+            argument++;
 
          if (arg)
-            *arg = argument + 1;
+            *arg = argument;
 
          if (index)
             *index = i;
@@ -397,6 +509,9 @@ static bool command_network_init(command_t *handle, uint16_t port)
    }
 
    freeaddrinfo_retro(res);
+
+   net_memwatch_free(command_memwatch);
+   command_memwatch = net_memwatch_new(handle->net_fd);
    return true;
 
 error:
@@ -812,7 +927,11 @@ bool command_free(command_t *handle)
 {
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
    if (handle && handle->net_fd >= 0)
+   {
+      net_memwatch_free(command_memwatch);
+      command_memwatch = NULL;
       socket_close(handle->net_fd);
+   }
 #endif
 
    free(handle);
@@ -2314,6 +2433,7 @@ bool command_event(enum event_command cmd, void *data)
          break;
       case CMD_EVENT_NETWORK_DEINIT:
 #ifdef HAVE_NETWORKING
+         net_http_pool_clear();
          network_deinit();
 #endif
          break;
@@ -2473,6 +2593,17 @@ bool command_event(enum event_command cmd, void *data)
          break;
       case CMD_EVENT_PERFCNT_REPORT_FRONTEND_LOG:
          rarch_perf_log();
+         if (settings->video.frame_delay_auto
+               && runloop_ctl(RUNLOOP_CTL_IS_PERFCNT_ENABLE, NULL))
+         {
+            unsigned misses = 0;
+            unsigned delay  = video_driver_frame_delay_auto_get(&misses);
+
+            RARCH_LOG("[PERF]: Automatic frame delay: %u ms, %u missed VSyncs.\n",
+                  delay, misses);
+         }
+         if (!string_is_empty(settings->path.perfcnt_trace))
+            performance_counters_trace_dump(settings->path.perfcnt_trace);
          break;
       case CMD_EVENT_VOLUME_UP:
          command_event_set_volume(0.5f);
@@ -218,6 +218,9 @@ enum event_command
 #ifdef HAVE_COMMAND
 #if defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
 bool command_network_send(const char *cmd_);
+
+/* Sends the memory watch updates, once per frame after the core ran. */
+void command_memwatch_frame(void);
 #endif
 #endif
 
@@ -429,6 +429,13 @@ static const unsigned hard_sync_frames = 0;
  */
 static const unsigned frame_delay = 0;
 
+/* Picks the frame delay by itself, from how long the core takes
+ * to run a frame. Backs off as soon as a VSync is missed.
+ * The video driver is assumed to need 2 ms to submit a frame,
+ * a fixed guess as that time isn't measured apart from the wait
+ * for VSync. Overrides frame_delay. */
+static const bool frame_delay_auto = false;
+
 /* Inserts a black frame inbetween frames.
  * Useful for 120 Hz monitors who want to play 60 Hz material with eliminated
  * ghosting. video_refresh_rate should still be configured as if it
@@ -479,6 +486,9 @@ static const bool shader_enable = true;
 static const bool shader_enable = false;
 #endif
 
+/* Keeps linked GLSL programs in the cache directory. */
+static const bool shader_binary_cache = true;
+
 /* Only scale in integer steps.
  * The base size depends on system-reported geometry and aspect ratio.
  * If video_force_aspect is not set, X/Y will be integer scaled independently.
@@ -603,6 +613,14 @@ static const bool gpu_screenshot = true;
 /* Screenshots named automatically. */
 static const bool auto_screenshot_filename = true;
 
+/* zlib level screenshots are compressed with, 1 is fastest,
+ * 9 smallest. */
+static const unsigned screenshot_compression = 6;
+
+/* Threads screenshots are encoded with in the background,
+ * 0 uses one per CPU core. */
+static const unsigned screenshot_threads = 0;
+
 /* Record post-shaded GPU output instead of raw game footage if available. */
 static const bool gpu_record = false;
 
@@ -735,9 +753,17 @@ static const uint16_t network_cmd_port = 55355;
 static const bool stdin_cmd_enable = false;
 
 static const uint16_t network_remote_base_port = 55400;
+
+/* Number of HTTP transfers (core updater, thumbnails, ...)
+ * running at the same time. 0 means no limit. */
+static const unsigned network_http_max_transfers = 4;
 /* Number of entries that will be kept in content history playlist file. */
 static const unsigned default_content_history_size = 100;
 
+/* Size limit (in MB) of the cache of content extracted from archives
+ * for cores that need a full path. 0 disables the cache. */
+static const unsigned default_extraction_cache_size = 1024;
+
 /* Show Menu start-up screen on boot. */
 static const bool default_menu_show_start_screen = true;
 
@@ -774,6 +800,11 @@ static const unsigned turbo_duty_cycle = 3;
  * gamepads, plug-and-play style. */
 static const bool input_autodetect_enable = true;
 
+/* Read keyboard, mouse and touchpad events on a thread of
+ * their own as they arrive, instead of once per frame.
+ * Only used by the udev input driver. */
+static const bool input_thread_enable = false;
+
 /* Show the input descriptors set by the core instead
  * of the default ones. */
 static const bool input_descriptor_label_show = true;
@@ -788,6 +819,17 @@ static const unsigned input_bind_timeout = 5;
 
 static const unsigned menu_thumbnails_default = 3;
 
+/* Number of thumbnail textures kept around after
+ * the cursor moved away from their entry. */
+static const unsigned menu_thumbnail_cache_size = 32;
+
+/* Thumbnails of this many entries above and below
+ * the cursor are loaded ahead of time. */
+static const unsigned menu_thumbnail_prefetch = 4;
+
+/* Keeps the downscaled thumbnails in the cache directory. */
+static const bool menu_thumbnail_disk_cache = false;
+
 #ifdef IOS
 static const bool ui_companion_start_on_boot = false;
 #else
@@ -39,6 +39,7 @@
 #include "system.h"
 #include "verbosity.h"
 #include "lakka.h"
+#include "performance_counters.h"
 
 #include "tasks/tasks_internal.h"
 
@@ -499,6 +500,7 @@ static void config_set_defaults(void)
    settings->video.hard_sync             = hard_sync;
    settings->video.hard_sync_frames      = hard_sync_frames;
    settings->video.frame_delay           = frame_delay;
+   settings->video.frame_delay_auto      = frame_delay_auto;
    settings->video.black_frame_insertion = black_frame_insertion;
    settings->video.swap_interval         = swap_interval;
    settings->video.threaded              = video_threaded;
@@ -524,6 +526,7 @@ static void config_set_defaults(void)
    settings->video.aspect_ratio_auto           = aspect_ratio_auto; /* Let implementation decide if automatic, or 1:1 PAR. */
    settings->video.aspect_ratio_idx            = aspect_ratio_idx;
    settings->video.shader_enable               = shader_enable;
+   settings->video.shader_binary_cache         = shader_binary_cache;
    settings->video.allow_rotate                = allow_rotate;
 
    settings->video.font_enable                 = font_enable;
@@ -545,6 +548,8 @@ static void config_set_defaults(void)
    settings->video.gpu_record                  = gpu_record;
    settings->video.gpu_screenshot              = gpu_screenshot;
    settings->auto_screenshot_filename          = auto_screenshot_filename;
+   settings->screenshot_compression            = screenshot_compression;
+   settings->screenshot_threads                = screenshot_threads;
    settings->video.rotation                    = ORIENTATION_NORMAL;
 
    settings->audio.enable                      = audio_enable;
@@ -584,6 +589,7 @@ static void config_set_defaults(void)
    settings->network_remote_base_port           = network_remote_base_port;
    settings->stdin_cmd_enable                  = stdin_cmd_enable;
    settings->content_history_size              = default_content_history_size;
+   settings->extraction_cache_size             = default_extraction_cache_size;
    settings->libretro_log_level                = libretro_log_level;
 
 #ifdef HAVE_LAKKA
@@ -602,6 +608,9 @@ static void config_set_defaults(void)
    settings->menu.core_enable                  = true;
    settings->menu.dynamic_wallpaper_enable     = false;
    settings->menu.thumbnails                   = menu_thumbnails_default;
+   settings->menu.thumbnail_cache_size         = menu_thumbnail_cache_size;
+   settings->menu.thumbnail_prefetch           = menu_thumbnail_prefetch;
+   settings->menu.thumbnail_disk_cache         = menu_thumbnail_disk_cache;
    settings->menu.show_advanced_settings       = show_advanced_settings;
    settings->menu.entry_normal_color           = menu_entry_normal_color;
    settings->menu.entry_hover_color            = menu_entry_hover_color;
@@ -679,6 +688,7 @@ static void config_set_defaults(void)
    strlcpy(settings->network.buildbot_assets_url, buildbot_assets_server_url,
          sizeof(settings->network.buildbot_assets_url));
    settings->network.buildbot_auto_extract_archive = true;
+   settings->network.http_max_transfers            = network_http_max_transfers;
 
    settings->input.overlay_enable                  = true;
    settings->input.overlay_enable_autopreferred    = true;
@@ -686,6 +696,7 @@ static void config_set_defaults(void)
    settings->input.overlay_opacity                 = 0.7f;
    settings->input.overlay_scale                   = 1.0f;
    settings->input.autodetect_enable               = input_autodetect_enable;
+   settings->input.thread_enable                   = input_thread_enable;
    *settings->input.keyboard_layout                = '\0';
 
    settings->osk.enable                            = true;
@@ -746,6 +757,7 @@ static void config_set_defaults(void)
    *settings->path.content_history   = '\0';
    *settings->path.cheat_settings    = '\0';
    *settings->path.shader            = '\0';
+   *settings->path.perfcnt_trace     = '\0';
 #ifndef IOS
    *settings->path.bundle_assets_src = '\0';
    *settings->path.bundle_assets_dst = '\0';
@@ -1325,6 +1337,12 @@ static bool config_load_file(const char *path, bool set_defaults)
          "menu_dynamic_wallpaper_enable");
    CONFIG_GET_INT_BASE(conf, settings, menu.thumbnails,
          "menu_thumbnails");
+   CONFIG_GET_INT_BASE(conf, settings, menu.thumbnail_cache_size,
+         "menu_thumbnail_cache_size");
+   CONFIG_GET_INT_BASE(conf, settings, menu.thumbnail_prefetch,
+         "menu_thumbnail_prefetch");
+   CONFIG_GET_BOOL_BASE(conf, settings, menu.thumbnail_disk_cache,
+         "menu_thumbnail_disk_cache");
    CONFIG_GET_BOOL_BASE(conf, settings, menu.navigation.wraparound.enable,
          "menu_navigation_wraparound_enable");
    CONFIG_GET_BOOL_BASE(conf, settings,
@@ -1354,6 +1372,7 @@ static bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_INT_BASE(conf, settings, video.frame_delay, "video_frame_delay");
    if (settings->video.frame_delay > 15)
       settings->video.frame_delay = 15;
+   CONFIG_GET_BOOL_BASE(conf, settings, video.frame_delay_auto, "video_frame_delay_auto");
 
    CONFIG_GET_BOOL_BASE(conf, settings, video.black_frame_insertion, "video_black_frame_insertion");
    CONFIG_GET_INT_BASE(conf, settings, video.swap_interval, "video_swap_interval");
@@ -1378,6 +1397,8 @@ static bool config_load_file(const char *path, bool set_defaults)
       strlcpy(settings->path.shader, tmp_str, sizeof(settings->path.shader));
 
    CONFIG_GET_BOOL_BASE(conf, settings, video.shader_enable, "video_shader_enable");
+   CONFIG_GET_BOOL_BASE(conf, settings, video.shader_binary_cache,
+         "video_shader_binary_cache");
 
    CONFIG_GET_BOOL_BASE(conf, settings, video.allow_rotate, "video_allow_rotate");
 
@@ -1454,6 +1475,7 @@ static bool config_load_file(const char *path, bool set_defaults)
    if (config_get_path(conf, "core_updater_buildbot_assets_url", tmp_str, sizeof(tmp_str)))
       strlcpy(settings->network.buildbot_assets_url, tmp_str, sizeof(settings->network.buildbot_assets_url));
    CONFIG_GET_BOOL_BASE(conf, settings, network.buildbot_auto_extract_archive, "core_updater_auto_extract_archive");
+   CONFIG_GET_INT_BASE(conf, settings, network.http_max_transfers, "network_http_max_transfers");
 
    for (i = 0; i < MAX_USERS; i++)
    {
@@ -1601,6 +1623,8 @@ static bool config_load_file(const char *path, bool set_defaults)
    }
 
    CONFIG_GET_BOOL_BASE(conf, settings, auto_screenshot_filename, "auto_screenshot_filename");
+   CONFIG_GET_INT_BASE(conf, settings, screenshot_compression, "screenshot_compression");
+   CONFIG_GET_INT_BASE(conf, settings, screenshot_threads, "screenshot_threads");
 
    if (config_get_path(conf, "screenshot_directory", tmp_str, sizeof(tmp_str)))
       strlcpy(settings->directory.screenshot, tmp_str, sizeof(settings->directory.screenshot));
@@ -1709,6 +1733,13 @@ static bool config_load_file(const char *path, bool set_defaults)
       }
    }
 
+   if (config_get_path(conf, "perfcnt_trace_path", tmp_str, sizeof(tmp_str)))
+      strlcpy(settings->path.perfcnt_trace, tmp_str, sizeof(settings->path.perfcnt_trace));
+
+   if (runloop_ctl(RUNLOOP_CTL_IS_PERFCNT_ENABLE, NULL)
+         && !string_is_empty(settings->path.perfcnt_trace))
+      performance_counters_trace_init();
+
 #if TARGET_OS_IPHONE
    CONFIG_GET_BOOL_BASE(conf, settings, input.small_keyboard_enable,   "small_keyboard_enable");
 #endif
@@ -1813,12 +1844,14 @@ static bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_BOOL_BASE(conf, settings, history_list_enable, "history_list_enable");
 
    CONFIG_GET_INT_BASE(conf, settings, content_history_size, "content_history_size");
+   CONFIG_GET_INT_BASE(conf, settings, extraction_cache_size, "extraction_cache_size");
 
    CONFIG_GET_INT_BASE(conf, settings, input.bind_timeout, "input_bind_timeout");
    CONFIG_GET_INT_BASE(conf, settings, input.turbo_period, "input_turbo_period");
    CONFIG_GET_INT_BASE(conf, settings, input.turbo_duty_cycle, "input_duty_cycle");
 
    CONFIG_GET_BOOL_BASE(conf, settings, input.autodetect_enable, "input_autodetect_enable");
+   CONFIG_GET_BOOL_BASE(conf, settings, input.thread_enable, "input_thread_enable");
    if (config_get_path(conf, "joypad_autoconfig_dir", tmp_str, sizeof(tmp_str)))
       strlcpy(settings->directory.autoconfig, tmp_str, sizeof(settings->directory.autoconfig));
 
@@ -2678,6 +2711,8 @@ bool config_save_file(const char *path)
    config_set_int(conf,   "rewind_granularity", settings->rewind_granularity);
    config_set_bool(conf,  "video_shader_enable",
          settings->video.shader_enable);
+   config_set_bool(conf,  "video_shader_binary_cache",
+         settings->video.shader_binary_cache);
    config_set_float(conf, "video_aspect_ratio", settings->video.aspect_ratio);
    config_set_bool(conf,  "video_aspect_ratio_auto", settings->video.aspect_ratio_auto);
    config_set_bool(conf,  "video_windowed_fullscreen",
@@ -2730,6 +2765,12 @@ bool config_save_file(const char *path)
    config_set_bool(conf,"menu_dynamic_wallpaper_enable",
          settings->menu.dynamic_wallpaper_enable);
    config_set_int(conf,"menu_thumbnails", settings->menu.thumbnails);
+   config_set_int(conf,"menu_thumbnail_cache_size",
+         settings->menu.thumbnail_cache_size);
+   config_set_int(conf,"menu_thumbnail_prefetch",
+         settings->menu.thumbnail_prefetch);
+   config_set_bool(conf,"menu_thumbnail_disk_cache",
+         settings->menu.thumbnail_disk_cache);
 #endif
 
 
@@ -2740,6 +2781,8 @@ bool config_save_file(const char *path)
    config_set_int(conf,   "video_hard_sync_frames",
          settings->video.hard_sync_frames);
    config_set_int(conf,   "video_frame_delay", settings->video.frame_delay);
+   config_set_bool(conf,  "video_frame_delay_auto",
+         settings->video.frame_delay_auto);
    config_set_bool(conf,  "video_black_frame_insertion",
          settings->video.black_frame_insertion);
    config_set_bool(conf,  "video_disable_composition",
@@ -2753,6 +2796,10 @@ bool config_save_file(const char *path)
          settings->directory.screenshot : "default");
    config_set_bool(conf, "auto_screenshot_filename",
          settings->auto_screenshot_filename);
+   config_set_int(conf, "screenshot_compression",
+         settings->screenshot_compression);
+   config_set_int(conf, "screenshot_threads",
+         settings->screenshot_threads);
    config_set_int(conf, "aspect_ratio_index", settings->video.aspect_ratio_idx);
    config_set_string(conf, "audio_device", settings->audio.device);
    config_set_string(conf, "core_updater_buildbot_url",
@@ -2761,6 +2808,8 @@ bool config_save_file(const char *path)
          settings->network.buildbot_assets_url);
    config_set_bool(conf, "core_updater_auto_extract_archive",
          settings->network.buildbot_auto_extract_archive);
+   config_set_int(conf, "network_http_max_transfers",
+         settings->network.http_max_transfers);
    config_set_string(conf, "camera_device", settings->camera.device);
    config_set_bool(conf, "camera_allow", settings->camera.allow);
 
@@ -2882,8 +2931,11 @@ bool config_save_file(const char *path)
 #endif
 
    config_set_int(conf, "content_history_size", settings->content_history_size);
+   config_set_int(conf, "extraction_cache_size", settings->extraction_cache_size);
    config_set_bool(conf, "input_autodetect_enable",
          settings->input.autodetect_enable);
+   config_set_bool(conf, "input_thread_enable",
+         settings->input.thread_enable);
 
 #ifdef HAVE_OVERLAY
    config_set_bool(conf, "input_overlay_enable", settings->input.overlay_enable);
@@ -3023,6 +3075,7 @@ bool config_save_file(const char *path)
 
    config_set_bool(conf, "log_verbosity", verbosity_is_enabled());
    config_set_bool(conf, "perfcnt_enable", runloop_ctl(RUNLOOP_CTL_IS_PERFCNT_ENABLE, NULL));
+   config_set_path(conf, "perfcnt_trace_path", settings->path.perfcnt_trace);
 
 #if TARGET_OS_IPHONE
    config_set_bool(conf, "small_keyboard_enable",   settings->input.small_keyboard_enable);
@@ -59,6 +59,7 @@ typedef struct settings
       unsigned swap_interval;
       unsigned hard_sync_frames;
       unsigned frame_delay;
+      bool frame_delay_auto;
 #ifdef GEKKO
       unsigned viwidth;
       bool vfilter;
@@ -73,6 +74,7 @@ typedef struct settings
       unsigned rotation;
 
       bool shader_enable;
+      bool shader_binary_cache;
 
       float refresh_rate;
       bool threaded;
@@ -119,6 +121,9 @@ typedef struct settings
       bool core_enable;
       bool dynamic_wallpaper_enable;
       unsigned thumbnails;
+      unsigned thumbnail_cache_size;
+      unsigned thumbnail_prefetch;
+      bool thumbnail_disk_cache;
       bool throttle;
 
       struct
@@ -238,6 +243,7 @@ typedef struct settings
       unsigned device[MAX_USERS];
       unsigned device_name_index[MAX_USERS];
       bool autodetect_enable;
+      bool thread_enable;
       bool netplay_client_swap_input;
 
       unsigned turbo_period;
@@ -281,6 +287,7 @@ typedef struct settings
       char buildbot_url[PATH_MAX_LENGTH];
       char buildbot_assets_url[PATH_MAX_LENGTH];
       bool buildbot_auto_extract_archive;
+      unsigned http_max_transfers;
    } network;
 
    bool set_supports_no_game_enable;
@@ -327,6 +334,7 @@ typedef struct settings
       char bundle_assets_dst_subdir[PATH_MAX_LENGTH];
       char shader[PATH_MAX_LENGTH];
       char font[PATH_MAX_LENGTH];
+      char perfcnt_trace[PATH_MAX_LENGTH];
    } path;
 
    struct
@@ -354,10 +362,13 @@ typedef struct settings
    } directory;
 
    unsigned content_history_size;
+   unsigned extraction_cache_size;
 
    unsigned libretro_log_level;
 
    bool auto_screenshot_filename;
+   unsigned screenshot_compression;
+   unsigned screenshot_threads;
 
    bool history_list_enable;
    bool rewind_enable;
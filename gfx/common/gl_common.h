@@ -40,6 +40,9 @@
 #ifdef GL_PIXEL_PACK_BUFFER
 #define HAVE_GL_ASYNC_READBACK
 #endif
+#ifdef GL_PIXEL_UNPACK_BUFFER
+#define HAVE_GL_PBO_UPLOAD
+#endif
 #endif
 
 #if defined(HAVE_PSGL)
@@ -271,6 +274,20 @@ typedef struct gl
 #endif
    void *readback_buffer_screenshot;
 
+#ifdef HAVE_GL_PBO_UPLOAD
+   /* Ring of PBOs used to stream core frames into the texture. */
+#define GL_PBO_UPLOAD_RING 3
+   GLuint pbo_upload[GL_PBO_UPLOAD_RING];
+   void *pbo_upload_map[GL_PBO_UPLOAD_RING];
+#ifdef HAVE_GL_SYNC
+   GLsync pbo_upload_fence[GL_PBO_UPLOAD_RING];
+#endif
+   bool pbo_upload_enable;
+   bool pbo_upload_persistent;
+   unsigned pbo_upload_index;
+   size_t pbo_upload_size;
+#endif
+
 #if defined(HAVE_MENU)
    GLuint menu_texture;
    bool menu_texture_enable;
@@ -115,6 +115,446 @@ uint32_t vulkan_find_memory_type_fallback(
          device_reqs, host_reqs_second, 0);
 }
 
+struct vk_memory_block
+{
+   struct vk_memory_block *next;
+   struct vk_memory_block **pool;
+   enum vk_alloc_strategy strategy;
+   VkDeviceMemory memory;
+   uint8_t *mapped;
+
+   /* Ranges still handed out. */
+   unsigned live;
+
+   /* VULKAN_ALLOC_LINEAR: the next free byte. */
+   VkDeviceSize head;
+
+   /* VULKAN_ALLOC_BUDDY: a binary tree over the block, the root
+    * at 1. Each node holds the largest free order below it plus
+    * one, 0 if nothing below is free. */
+   uint8_t tree[2 << VULKAN_ALLOCATOR_ORDERS];
+};
+
+struct vk_allocator
+{
+   VkDevice device;
+   VkPhysicalDeviceMemoryProperties memory_properties;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+#endif
+
+   /* Blocks by memory type, linear or optimal tiling, and strategy. */
+   struct vk_memory_block
+      *pools[VK_MAX_MEMORY_TYPES][2][VULKAN_ALLOC_STRATEGIES];
+
+   struct
+   {
+      unsigned device_allocations;
+      unsigned blocks;
+      unsigned blocks_peak;
+      unsigned dedicated;
+      unsigned allocations;
+      unsigned allocations_peak;
+      VkDeviceSize used;
+      VkDeviceSize used_peak;
+      VkDeviceSize reserved;
+      VkDeviceSize reserved_peak;
+   } stats;
+};
+
+static bool vulkan_allocator_device_alloc(struct vk_allocator *allocator,
+      VkDeviceSize size, uint32_t type,
+      VkDeviceMemory *memory, uint8_t **mapped)
+{
+   VkMemoryAllocateInfo alloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+   void *ptr                  = NULL;
+
+   alloc.allocationSize       = size;
+   alloc.memoryTypeIndex      = type;
+
+   if (vkAllocateMemory(allocator->device, &alloc, NULL, memory) != VK_SUCCESS)
+   {
+      RARCH_ERR("[Vulkan]: Failed to allocate %llu bytes of memory type %u.\n",
+            (unsigned long long)size, type);
+      return false;
+   }
+
+   /* Host visible memory is mapped once for its lifetime. */
+   if (allocator->memory_properties.memoryTypes[type].propertyFlags &
+         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+      vkMapMemory(allocator->device, *memory, 0, VK_WHOLE_SIZE, 0, &ptr);
+
+   *mapped = (uint8_t*)ptr;
+
+   allocator->stats.device_allocations++;
+   allocator->stats.reserved += size;
+   if (allocator->stats.reserved > allocator->stats.reserved_peak)
+      allocator->stats.reserved_peak = allocator->stats.reserved;
+   return true;
+}
+
+static void vulkan_allocator_device_free(struct vk_allocator *allocator,
+      VkDeviceSize size, VkDeviceMemory memory, uint8_t *mapped)
+{
+   if (mapped)
+      vkUnmapMemory(allocator->device, memory);
+   vkFreeMemory(allocator->device, memory, NULL);
+   allocator->stats.reserved -= size;
+}
+
+static struct vk_memory_block *vulkan_allocator_new_block(
+      struct vk_allocator *allocator, uint32_t type)
+{
+   unsigned depth;
+   struct vk_memory_block *block = (struct vk_memory_block*)
+      calloc(1, sizeof(*block));
+
+   if (!block)
+      return NULL;
+
+   if (!vulkan_allocator_device_alloc(allocator,
+            VULKAN_ALLOCATOR_BLOCK_SIZE, type,
+            &block->memory, &block->mapped))
+   {
+      free(block);
+      return NULL;
+   }
+
+   for (depth = 0; depth <= VULKAN_ALLOCATOR_ORDERS; depth++)
+      memset(block->tree + (1u << depth),
+            VULKAN_ALLOCATOR_ORDERS - depth + 1, 1u << depth);
+
+   allocator->stats.blocks++;
+   if (allocator->stats.blocks > allocator->stats.blocks_peak)
+      allocator->stats.blocks_peak = allocator->stats.blocks;
+   return block;
+}
+
+static void vulkan_buddy_update(uint8_t *tree,
+      unsigned node, unsigned order)
+{
+   while (node > 1)
+   {
+      unsigned left, right;
+
+      node >>= 1;
+      order++;
+
+      left  = tree[2 * node];
+      right = tree[2 * node + 1];
+
+      /* Two free buddies merge back into one free node. */
+      if (left == order && right == order)
+         tree[node] = order + 1;
+      else
+         tree[node] = MAX(left, right);
+   }
+}
+
+static bool vulkan_buddy_alloc(struct vk_memory_block *block,
+      unsigned order, VkDeviceSize *offset)
+{
+   unsigned node       = 1;
+   unsigned node_order = VULKAN_ALLOCATOR_ORDERS;
+
+   if (block->tree[1] < order + 1)
+      return false;
+
+   while (node_order > order)
+   {
+      node = 2 * node;
+      if (block->tree[node] < order + 1)
+         node++;
+      node_order--;
+   }
+
+   block->tree[node] = 0;
+   vulkan_buddy_update(block->tree, node, order);
+
+   *offset = (VkDeviceSize)(node - (1u << (VULKAN_ALLOCATOR_ORDERS - order)))
+      * ((VkDeviceSize)VULKAN_ALLOCATOR_MIN_SIZE << order);
+   return true;
+}
+
+static void vulkan_buddy_free(struct vk_memory_block *block,
+      unsigned order, VkDeviceSize offset)
+{
+   unsigned node = (1u << (VULKAN_ALLOCATOR_ORDERS - order)) +
+      (unsigned)(offset / ((VkDeviceSize)VULKAN_ALLOCATOR_MIN_SIZE << order));
+
+   block->tree[node] = order + 1;
+   vulkan_buddy_update(block->tree, node, order);
+}
+
+static bool vulkan_linear_alloc(struct vk_memory_block *block,
+      const VkMemoryRequirements *reqs, VkDeviceSize *offset)
+{
+   VkDeviceSize alignment = reqs->alignment ? reqs->alignment : 1;
+   VkDeviceSize start     = (block->head + alignment - 1) & ~(alignment - 1);
+
+   if (start + reqs->size > VULKAN_ALLOCATOR_BLOCK_SIZE)
+      return false;
+
+   block->head = start + reqs->size;
+   *offset     = start;
+   return true;
+}
+
+static unsigned vulkan_buddy_order(VkDeviceSize size)
+{
+   unsigned order = 0;
+   while (((VkDeviceSize)VULKAN_ALLOCATOR_MIN_SIZE << order) < size)
+      order++;
+   return order;
+}
+
+struct vk_allocator *vulkan_allocator_new(VkDevice device,
+      const VkPhysicalDeviceMemoryProperties *mem_props)
+{
+   struct vk_allocator *allocator = (struct vk_allocator*)
+      calloc(1, sizeof(*allocator));
+
+   if (!allocator)
+      return NULL;
+
+   allocator->device            = device;
+   allocator->memory_properties = *mem_props;
+
+#ifdef HAVE_THREADS
+   allocator->lock = slock_new();
+   if (!allocator->lock)
+   {
+      free(allocator);
+      return NULL;
+   }
+#endif
+
+   return allocator;
+}
+
+void vulkan_allocator_log_stats(const struct vk_allocator *allocator)
+{
+   RARCH_LOG("[Vulkan]: Memory: %u allocations (peak %u), %u dedicated, "
+         "%llu KiB used (peak %llu KiB).\n",
+         allocator->stats.allocations, allocator->stats.allocations_peak,
+         allocator->stats.dedicated,
+         (unsigned long long)(allocator->stats.used >> 10),
+         (unsigned long long)(allocator->stats.used_peak >> 10));
+   RARCH_LOG("[Vulkan]: Memory: %u blocks (peak %u), %llu KiB reserved "
+         "(peak %llu KiB), %u vkAllocateMemory calls.\n",
+         allocator->stats.blocks, allocator->stats.blocks_peak,
+         (unsigned long long)(allocator->stats.reserved >> 10),
+         (unsigned long long)(allocator->stats.reserved_peak >> 10),
+         allocator->stats.device_allocations);
+}
+
+void vulkan_allocator_free(struct vk_allocator *allocator)
+{
+   unsigned type, tiling, strategy;
+
+   if (!allocator)
+      return;
+
+   if (allocator->stats.allocations)
+      RARCH_WARN("[Vulkan]: %u allocations still live on allocator teardown.\n",
+            allocator->stats.allocations);
+
+   vulkan_allocator_log_stats(allocator);
+
+   for (type = 0; type < VK_MAX_MEMORY_TYPES; type++)
+      for (tiling = 0; tiling < 2; tiling++)
+         for (strategy = 0; strategy < VULKAN_ALLOC_STRATEGIES; strategy++)
+         {
+            struct vk_memory_block *block =
+               allocator->pools[type][tiling][strategy];
+
+            while (block)
+            {
+               struct vk_memory_block *next = block->next;
+               vulkan_allocator_device_free(allocator,
+                     VULKAN_ALLOCATOR_BLOCK_SIZE,
+                     block->memory, block->mapped);
+               free(block);
+               block = next;
+            }
+         }
+
+#ifdef HAVE_THREADS
+   slock_free(allocator->lock);
+#endif
+   free(allocator);
+}
+
+const VkPhysicalDeviceMemoryProperties *vulkan_allocator_memory_properties(
+      const struct vk_allocator *allocator)
+{
+   return &allocator->memory_properties;
+}
+
+bool vulkan_allocator_alloc(struct vk_allocator *allocator,
+      const VkMemoryRequirements *reqs, uint32_t type, bool optimal,
+      enum vk_alloc_strategy strategy, struct vk_allocation *allocation)
+{
+   VkDeviceSize size             = reqs->size;
+   VkDeviceSize offset           = 0;
+   unsigned order                = 0;
+   struct vk_memory_block *block = NULL;
+   struct vk_memory_block **pool = NULL;
+
+   memset(allocation, 0, sizeof(*allocation));
+
+   if (strategy == VULKAN_ALLOC_BUDDY)
+   {
+      /* Buddy ranges are aligned to their own size. */
+      order = vulkan_buddy_order(MAX(reqs->size, reqs->alignment));
+      size  = (VkDeviceSize)VULKAN_ALLOCATOR_MIN_SIZE << order;
+   }
+
+#ifdef HAVE_THREADS
+   slock_lock(allocator->lock);
+#endif
+
+   if (size > VULKAN_ALLOCATOR_BLOCK_SIZE / 2)
+   {
+      uint8_t *mapped = NULL;
+
+      size = reqs->size;
+      if (!vulkan_allocator_device_alloc(allocator,
+               size, type, &allocation->memory, &mapped))
+         goto error;
+
+      allocation->mapped = mapped;
+      allocator->stats.dedicated++;
+   }
+   else
+   {
+      pool = &allocator->pools[type][optimal][strategy];
+
+      for (block = *pool; block; block = block->next)
+      {
+         if (strategy == VULKAN_ALLOC_BUDDY)
+         {
+            if (vulkan_buddy_alloc(block, order, &offset))
+               break;
+         }
+         else if (vulkan_linear_alloc(block, reqs, &offset))
+         {
+            size = reqs->size;
+            break;
+         }
+      }
+
+      if (!block)
+      {
+         block = vulkan_allocator_new_block(allocator, type);
+         if (!block)
+            goto error;
+
+         block->next     = *pool;
+         block->pool     = pool;
+         block->strategy = strategy;
+         *pool           = block;
+
+         if (strategy == VULKAN_ALLOC_BUDDY)
+            vulkan_buddy_alloc(block, order, &offset);
+         else
+         {
+            vulkan_linear_alloc(block, reqs, &offset);
+            size = reqs->size;
+         }
+      }
+
+      block->live++;
+      allocation->block  = block;
+      allocation->memory = block->memory;
+      if (block->mapped)
+         allocation->mapped = block->mapped + offset;
+   }
+
+   allocation->allocator = allocator;
+   allocation->offset    = offset;
+   allocation->size      = size;
+   allocation->type      = type;
+
+   allocator->stats.allocations++;
+   if (allocator->stats.allocations > allocator->stats.allocations_peak)
+      allocator->stats.allocations_peak = allocator->stats.allocations;
+   allocator->stats.used += size;
+   if (allocator->stats.used > allocator->stats.used_peak)
+      allocator->stats.used_peak = allocator->stats.used;
+
+#ifdef HAVE_THREADS
+   slock_unlock(allocator->lock);
+#endif
+   return true;
+
+error:
+#ifdef HAVE_THREADS
+   slock_unlock(allocator->lock);
+#endif
+   return false;
+}
+
+void vulkan_allocator_release(struct vk_allocation *allocation)
+{
+   struct vk_allocator *allocator = allocation->allocator;
+   struct vk_memory_block *block  = allocation->block;
+
+   if (!allocator)
+      return;
+
+#ifdef HAVE_THREADS
+   slock_lock(allocator->lock);
+#endif
+
+   allocator->stats.allocations--;
+   allocator->stats.used -= allocation->size;
+
+   if (!block)
+   {
+      vulkan_allocator_device_free(allocator, allocation->size,
+            allocation->memory,
+            (uint8_t*)allocation->mapped);
+      allocator->stats.dedicated--;
+   }
+   else
+   {
+      if (block->strategy == VULKAN_ALLOC_BUDDY)
+         vulkan_buddy_free(block,
+               vulkan_buddy_order(allocation->size), allocation->offset);
+
+      if (--block->live == 0)
+      {
+         struct vk_memory_block **it = NULL;
+
+         block->head = 0;
+
+         /* One empty block per pool is kept around to absorb
+          * churn, further ones go back to the driver. */
+         for (it = block->pool; *it; it = &(*it)->next)
+            if (*it != block && (*it)->live == 0)
+               break;
+
+         if (*it)
+         {
+            for (it = block->pool; *it != block; it = &(*it)->next);
+            *it = block->next;
+
+            vulkan_allocator_device_free(allocator,
+                  VULKAN_ALLOCATOR_BLOCK_SIZE, block->memory, block->mapped);
+            free(block);
+            allocator->stats.blocks--;
+         }
+      }
+   }
+
+#ifdef HAVE_THREADS
+   slock_unlock(allocator->lock);
+#endif
+
+   memset(allocation, 0, sizeof(*allocation));
+}
+
 void vulkan_transfer_image_ownership(VkCommandBuffer cmd,
       VkImage image, VkImageLayout layout,
       VkPipelineStageFlags src_stages,
@@ -144,8 +584,10 @@ void vulkan_map_persistent_texture(
       VkDevice device,
       struct vk_texture *texture)
 {
-   vkMapMemory(device, texture->memory, texture->offset,
-         texture->size, 0, &texture->mapped);
+   (void)device;
+
+   /* The allocator keeps host visible memory mapped. */
+   texture->mapped = (uint8_t*)texture->allocation.mapped + texture->offset;
 }
 
 void vulkan_copy_staging_to_dynamic(vk_t *vk, VkCommandBuffer cmd,
@@ -254,7 +696,7 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
    VkDevice device                      = vk->context->device;
    VkImageCreateInfo info               = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
    VkImageViewCreateInfo view           = { VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
-   VkMemoryAllocateInfo alloc           = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+   uint32_t memory_type                 = 0;
    VkImageSubresource subresource       = { VK_IMAGE_ASPECT_COLOR_BIT };
    VkCommandBufferAllocateInfo cmd_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
    VkSubmitInfo submit_info             = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
@@ -327,20 +769,19 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
    vulkan_track_alloc(tex.image);
 #endif
    vkGetImageMemoryRequirements(device, tex.image, &mem_reqs);
-   alloc.allocationSize = mem_reqs.size;
 
    switch (type)
    {
       case VULKAN_TEXTURE_STATIC:
       case VULKAN_TEXTURE_DYNAMIC:
-         alloc.memoryTypeIndex = vulkan_find_memory_type_fallback(
+         memory_type = vulkan_find_memory_type_fallback(
                &vk->context->memory_properties,
                mem_reqs.memoryTypeBits,
                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
          break;
 
       default:
-         alloc.memoryTypeIndex = vulkan_find_memory_type_fallback(
+         memory_type = vulkan_find_memory_type_fallback(
                &vk->context->memory_properties,
                mem_reqs.memoryTypeBits,
                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
@@ -354,7 +795,7 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
    /* If the texture is STREAMED and it's not DEVICE_LOCAL, we expect to hit a slower path,
     * so fallback to copy path. */
    if (type == VULKAN_TEXTURE_STREAMED && 
-         (vk->context->memory_properties.memoryTypes[alloc.memoryTypeIndex].propertyFlags &
+         (vk->context->memory_properties.memoryTypes[memory_type].propertyFlags &
           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == 0)
    {
       /* Recreate texture but for STAGING this time ... */
@@ -367,8 +808,7 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
 
       vkGetImageMemoryRequirements(device, tex.image, &mem_reqs);
 
-      alloc.allocationSize  = mem_reqs.size;
-      alloc.memoryTypeIndex = vulkan_find_memory_type_fallback(&vk->context->memory_properties,
+      memory_type           = vulkan_find_memory_type_fallback(&vk->context->memory_properties,
             mem_reqs.memoryTypeBits,
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
@@ -388,35 +828,21 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
 #endif
    }
 
-   /* We can pilfer the old memory and move it over to the new texture. */
-   if (old &&
-         old->memory_size >= mem_reqs.size &&
-         old->memory_type == alloc.memoryTypeIndex)
-   {
-      tex.memory      = old->memory;
-      tex.memory_size = old->memory_size;
-      tex.memory_type = old->memory_type;
-
-      if (old->mapped)
-         vkUnmapMemory(device, old->memory);
-
-      old->memory     = VK_NULL_HANDLE;
-   }
-   else
-   {
-      vkAllocateMemory(device, &alloc, NULL, &tex.memory);
-      tex.memory_size = alloc.allocationSize;
-      tex.memory_type = alloc.memoryTypeIndex;
-   }
-
+   /* Giving the old range back first lets the new texture
+    * take its place when it fits. */
    if (old)
    {
-      if (old->memory != VK_NULL_HANDLE)
-         vkFreeMemory(device, old->memory, NULL);
+      vulkan_allocator_release(&old->allocation);
       memset(old, 0, sizeof(*old));
    }
 
-   vkBindImageMemory(device, tex.image, tex.memory, 0);
+   vulkan_allocator_alloc(vk->context->allocator, &mem_reqs, memory_type,
+         info.tiling == VK_IMAGE_TILING_OPTIMAL, VULKAN_ALLOC_BUDDY,
+         &tex.allocation);
+   tex.memory      = tex.allocation.memory;
+   tex.memory_type = memory_type;
+
+   vkBindImageMemory(device, tex.image, tex.memory, tex.allocation.offset);
 
    if (type != VULKAN_TEXTURE_STAGING && type != VULKAN_TEXTURE_READBACK)
    {
@@ -457,18 +883,13 @@ struct vk_texture vulkan_create_texture(vk_t *vk,
       unsigned y;
       uint8_t *dst       = NULL;
       const uint8_t *src = NULL;
-      void *ptr          = NULL;
       unsigned bpp       = vulkan_format_to_bpp(tex.format);
       unsigned stride    = tex.width * bpp;
 
-      vkMapMemory(device, tex.memory, tex.offset, tex.size, 0, &ptr);
-
-      dst                = (uint8_t*)ptr;
+      dst                = (uint8_t*)tex.allocation.mapped + tex.offset;
       src                = (const uint8_t*)initial;
       for (y = 0; y < tex.height; y++, dst += tex.stride, src += stride)
          memcpy(dst, src, width * bpp);
-
-      vkUnmapMemory(device, tex.memory);
    }
    else if (initial && type == VULKAN_TEXTURE_STATIC)
    {
@@ -549,9 +970,7 @@ void vulkan_destroy_texture(
       VkDevice device,
       struct vk_texture *tex)
 {
-   if (tex->mapped)
-      vkUnmapMemory(device, tex->memory);
-   vkFreeMemory(device, tex->memory, NULL);
+   vulkan_allocator_release(&tex->allocation);
    if (tex->view)
       vkDestroyImageView(device, tex->view, NULL);
    vkDestroyImage(device, tex->image, NULL);
@@ -834,7 +1253,7 @@ struct vk_buffer vulkan_create_buffer(
 {
    struct vk_buffer buffer;
    VkMemoryRequirements mem_reqs;
-   VkMemoryAllocateInfo alloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+   uint32_t type;
    VkBufferCreateInfo info    = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
 
    info.size                  = size;
@@ -844,19 +1263,19 @@ struct vk_buffer vulkan_create_buffer(
 
    vkGetBufferMemoryRequirements(context->device, buffer.buffer, &mem_reqs);
 
-   alloc.allocationSize       = mem_reqs.size;
-   alloc.memoryTypeIndex      = vulkan_find_memory_type(
+   type                       = vulkan_find_memory_type(
          &context->memory_properties,
          mem_reqs.memoryTypeBits,
          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | 
          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-   vkAllocateMemory(context->device, &alloc, NULL, &buffer.memory);
-   vkBindBufferMemory(context->device, buffer.buffer, buffer.memory, 0);
-
-   buffer.size                = alloc.allocationSize;
-
-   vkMapMemory(context->device,
-         buffer.memory, 0, buffer.size, 0, &buffer.mapped);
+   vulkan_allocator_alloc(context->allocator, &mem_reqs, type,
+         false, VULKAN_ALLOC_BUDDY, &buffer.allocation);
+   buffer.memory              = buffer.allocation.memory;
+   vkBindBufferMemory(context->device, buffer.buffer,
+         buffer.memory, buffer.allocation.offset);
+
+   buffer.size                = mem_reqs.size;
+   buffer.mapped              = buffer.allocation.mapped;
    return buffer;
 }
 
@@ -864,8 +1283,7 @@ void vulkan_destroy_buffer(
       VkDevice device,
       struct vk_buffer *buffer)
 {
-   vkUnmapMemory(device, buffer->memory);
-   vkFreeMemory(device, buffer->memory, NULL);
+   vulkan_allocator_release(&buffer->allocation);
 
    vkDestroyBuffer(device, buffer->buffer, NULL);
 
@@ -1425,6 +1843,14 @@ static bool vulkan_context_init_device(gfx_ctx_vulkan_data_t *vk)
    }
 #endif
 
+   vk->context.allocator = vulkan_allocator_new(vk->context.device,
+         &vk->context.memory_properties);
+   if (!vk->context.allocator)
+   {
+      RARCH_ERR("[Vulkan]: Failed to create memory allocator.\n");
+      return false;
+   }
+
    return true;
 }
 
@@ -1830,6 +2256,11 @@ void vulkan_context_destroy(gfx_ctx_vulkan_data_t *vk,
       vkDestroyDebugReportCallbackEXT(vk->context.instance, vk->context.debug_callback, NULL);
 #endif
 
+   /* Blocks go back to the driver even when the device is cached,
+    * the next context creates a new allocator. */
+   vulkan_allocator_free(vk->context.allocator);
+   vk->context.allocator = NULL;
+
    if (video_driver_is_video_cache_context())
    {
       cached_device         = vk->context.device;
@@ -26,6 +26,13 @@
 
 #define VULKAN_MAX_SWAPCHAIN_IMAGES             8
 
+/* Device memory is allocated in blocks of this size and
+ * handed out in ranges, allocations bigger than half a
+ * block get their own device memory. */
+#define VULKAN_ALLOCATOR_BLOCK_SIZE             (16 * 1024 * 1024)
+#define VULKAN_ALLOCATOR_MIN_SIZE               (4 * 1024)
+#define VULKAN_ALLOCATOR_ORDERS                 12
+
 #define VULKAN_DIRTY_DYNAMIC_BIT                0x0001
 
 #include "vksym.h"
@@ -53,6 +60,37 @@ RETRO_BEGIN_DECLS
 
 typedef struct vulkan_filter_chain vulkan_filter_chain_t;
 
+struct vk_allocator;
+struct vk_memory_block;
+
+enum vk_alloc_strategy
+{
+   /* Power of two ranges, freed in any order.
+    * Freed ranges merge with their buddy right away. */
+   VULKAN_ALLOC_BUDDY = 0,
+
+   /* Ranges handed out one after the other. The block is
+    * reused from the start once all its ranges are freed,
+    * for resources which are created and freed together. */
+   VULKAN_ALLOC_LINEAR,
+
+   VULKAN_ALLOC_STRATEGIES
+};
+
+struct vk_allocation
+{
+   struct vk_allocator *allocator;
+   /* NULL if the allocation has its own device memory. */
+   struct vk_memory_block *block;
+   VkDeviceMemory memory;
+   VkDeviceSize offset;
+   VkDeviceSize size;
+   uint32_t type;
+
+   /* Host visible memory stays mapped, this points at offset. */
+   void *mapped;
+};
+
 enum vk_texture_type
 {
    /* We will use the texture as a sampled linear texture. */
@@ -109,6 +147,8 @@ typedef struct vulkan_context
    slock_t *queue_lock;
    retro_vulkan_destroy_device_t destroy_device;
 
+   struct vk_allocator *allocator;
+
 #ifdef VULKAN_DEBUG
    VkDebugReportCallbackEXT debug_callback;
 #endif
@@ -149,6 +189,7 @@ struct vk_texture
    VkImage image;
    VkImageView view;
    VkDeviceMemory memory;
+   struct vk_allocation allocation;
 
    unsigned width, height;
    VkFormat format;
@@ -157,7 +198,6 @@ struct vk_texture
    size_t offset;
    size_t stride;
    size_t size;
-   VkDeviceSize memory_size;
    uint32_t memory_type;
 
    VkImageLayout layout;
@@ -169,6 +209,7 @@ struct vk_buffer
 {
    VkBuffer buffer;
    VkDeviceMemory memory;
+   struct vk_allocation allocation;
    VkDeviceSize size;
    void *mapped;
 };
@@ -391,6 +432,41 @@ uint32_t vulkan_find_memory_type_fallback(
       uint32_t device_reqs, uint32_t host_reqs_first,
       uint32_t host_reqs_second);
 
+struct vk_allocator *vulkan_allocator_new(VkDevice device,
+      const VkPhysicalDeviceMemoryProperties *mem_props);
+
+/* Frees the device memory blocks and logs the allocation stats.
+ * All allocations must have been released. */
+void vulkan_allocator_free(struct vk_allocator *allocator);
+
+const VkPhysicalDeviceMemoryProperties *vulkan_allocator_memory_properties(
+      const struct vk_allocator *allocator);
+
+/**
+ * vulkan_allocator_alloc:
+ * @allocator           : the device's allocator
+ * @reqs                : memory requirements of the resource
+ * @type                : memory type index
+ * @optimal             : true for optimally tiled images
+ * @strategy            : how the range is carved out of its block
+ * @allocation          : the allocated range
+ *
+ * Allocates a range of device memory for a buffer or an image.
+ * Linear and optimal resources are kept in separate blocks, so
+ * bufferImageGranularity never comes into play.
+ *
+ * Returns: true on success, false if the driver ran out of memory.
+ **/
+bool vulkan_allocator_alloc(struct vk_allocator *allocator,
+      const VkMemoryRequirements *reqs, uint32_t type, bool optimal,
+      enum vk_alloc_strategy strategy, struct vk_allocation *allocation);
+
+/* Gives the range back to its block. Does nothing for an
+ * empty allocation. */
+void vulkan_allocator_release(struct vk_allocation *allocation);
+
+void vulkan_allocator_log_stats(const struct vk_allocator *allocator);
+
 
 struct vk_texture vulkan_create_texture(vk_t *vk,
       struct vk_texture *old,
@@ -1464,6 +1464,238 @@ static void gl_init_textures(gl_t *gl, const video_info_t *video)
    glBindTexture(GL_TEXTURE_2D, gl->texture[gl->tex_index]);
 }
 
+#ifdef HAVE_GL_PBO_UPLOAD
+static void gl_deinit_pbo_upload(gl_t *gl)
+{
+   unsigned i;
+
+   if (!gl->pbo_upload[0])
+      return;
+
+   for (i = 0; i < GL_PBO_UPLOAD_RING; i++)
+   {
+#ifdef HAVE_GL_SYNC
+      if (gl->pbo_upload_fence[i])
+      {
+         glClientWaitSync(gl->pbo_upload_fence[i],
+               GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+         glDeleteSync(gl->pbo_upload_fence[i]);
+         gl->pbo_upload_fence[i] = 0;
+      }
+#endif
+
+      if (gl->pbo_upload_map[i])
+      {
+         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[i]);
+         glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+         gl->pbo_upload_map[i] = NULL;
+      }
+   }
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   glDeleteBuffers(GL_PBO_UPLOAD_RING, gl->pbo_upload);
+   memset(gl->pbo_upload, 0, sizeof(gl->pbo_upload));
+   gl->pbo_upload_enable     = false;
+   gl->pbo_upload_persistent = false;
+}
+
+static void gl_init_pbo_upload(gl_t *gl)
+{
+   unsigned i;
+#ifdef HAVE_OPENGLES
+   unsigned major = 0, minor = 0;
+   const char *version = (const char*)glGetString(GL_VERSION);
+#endif
+
+   gl->pbo_upload_enable     = false;
+   gl->pbo_upload_persistent = false;
+   gl->pbo_upload_index      = 0;
+   gl->pbo_upload_size       = gl->tex_w * gl->tex_h * sizeof(uint32_t);
+
+   /* Frames don't go through gl_copy_frame() then. */
+   if (gl->hw_render_use || gl->egl_images)
+      return;
+
+#ifdef HAVE_OPENGLES
+   if (!version || sscanf(version, "OpenGL ES %u.%u", &major, &minor) != 2
+         || major < 3)
+      return;
+#else
+   if (!glMapBufferRange || !glUnmapBuffer)
+      return;
+   if (gl->version_major < 3 && !gl_query_extension("ARB_map_buffer_range"))
+      return;
+
+#ifdef HAVE_GL_SYNC
+   /* Persistent mappings are only safe to write to
+    * if we can fence each slot of the ring. */
+   gl->pbo_upload_persistent = gl->have_sync && glBufferStorage &&
+      (gl->version_major > 4 ||
+       (gl->version_major == 4 && gl->version_minor >= 4) ||
+       gl_query_extension("ARB_buffer_storage"));
+#endif
+#endif
+
+   glGenBuffers(GL_PBO_UPLOAD_RING, gl->pbo_upload);
+
+   for (i = 0; i < GL_PBO_UPLOAD_RING; i++)
+   {
+      gl->pbo_upload_map[i]   = NULL;
+#ifdef HAVE_GL_SYNC
+      gl->pbo_upload_fence[i] = 0;
+#endif
+
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[i]);
+
+#ifndef HAVE_OPENGLES
+      if (gl->pbo_upload_persistent)
+      {
+         GLbitfield flags = GL_MAP_WRITE_BIT
+            | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+         glBufferStorage(GL_PIXEL_UNPACK_BUFFER,
+               gl->pbo_upload_size, NULL, flags);
+         gl->pbo_upload_map[i] = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+               0, gl->pbo_upload_size, flags);
+
+         if (!gl->pbo_upload_map[i])
+         {
+            RARCH_WARN("[GL]: Failed to map upload PBO persistently.\n");
+            gl_deinit_pbo_upload(gl);
+            return;
+         }
+         continue;
+      }
+#endif
+
+      glBufferData(GL_PIXEL_UNPACK_BUFFER,
+            gl->pbo_upload_size, NULL, GL_STREAM_DRAW);
+   }
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+   gl->pbo_upload_enable = true;
+   RARCH_LOG("[GL]: Streaming frames through %u %sPBOs.\n",
+         GL_PBO_UPLOAD_RING,
+         gl->pbo_upload_persistent ? "persistently mapped " : "");
+}
+
+/**
+ * gl_pbo_upload_frame:
+ * @gl                  : GL driver handle
+ * @frame               : core frame
+ * @width               : width of @frame
+ * @height              : height of @frame
+ * @pitch               : pitch of @frame in bytes
+ *
+ * Writes @frame into the next PBO of the ring, converting it
+ * on the way if the texture format requires it, and uploads
+ * the texture from the PBO. The slot is fenced so it isn't
+ * written to again before the GPU is done reading it.
+ *
+ * Returns: true if the frame was uploaded, false if the PBO
+ * couldn't be mapped, in which case PBO uploads are disabled.
+ **/
+static bool gl_pbo_upload_frame(gl_t *gl, const void *frame,
+      unsigned width, unsigned height, unsigned pitch)
+{
+   static struct retro_perf_counter pbo_upload      = {0};
+   static struct retro_perf_counter pbo_upload_wait = {0};
+   unsigned h;
+   uint8_t *dst          = NULL;
+   const uint8_t *src    = (const uint8_t*)frame;
+   unsigned slot         = gl->pbo_upload_index;
+   unsigned out_size     = gl->base_size;
+   bool to_abgr8888      = false;
+   bool to_rgb32         = false;
+   GLbitfield map_flags  = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+#ifdef HAVE_OPENGLES
+   to_abgr8888           = gl->base_size == 4 && video_driver_supports_rgba();
+#else
+   to_rgb32              = gl->base_size == 2 && !gl->have_es2_compat;
+#endif
+   if (to_rgb32)
+      out_size           = sizeof(uint32_t);
+
+   performance_counter_init(&pbo_upload, "pbo_upload");
+   performance_counter_start(&pbo_upload);
+
+   gl->pbo_upload_index  = (gl->pbo_upload_index + 1) % GL_PBO_UPLOAD_RING;
+
+#ifdef HAVE_GL_SYNC
+   if (gl->pbo_upload_fence[slot])
+   {
+      performance_counter_init(&pbo_upload_wait, "pbo_upload_wait");
+      performance_counter_start(&pbo_upload_wait);
+      glClientWaitSync(gl->pbo_upload_fence[slot],
+            GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      glDeleteSync(gl->pbo_upload_fence[slot]);
+      gl->pbo_upload_fence[slot] = 0;
+      performance_counter_stop(&pbo_upload_wait);
+
+      /* The GPU is done with this slot, no need
+       * for the driver to synchronize. */
+      map_flags |= GL_MAP_UNSYNCHRONIZED_BIT;
+   }
+#endif
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo_upload[slot]);
+
+   if (gl->pbo_upload_persistent)
+      dst = (uint8_t*)gl->pbo_upload_map[slot];
+   else
+      dst = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+            0, width * height * out_size, map_flags);
+
+   if (!dst)
+   {
+      RARCH_WARN("[GL]: Failed to map upload PBO, disabling PBO uploads.\n");
+      gl_deinit_pbo_upload(gl);
+      performance_counter_stop(&pbo_upload);
+      return false;
+   }
+
+   if (to_abgr8888)
+      video_frame_convert_argb8888_to_abgr8888(&gl->scaler,
+            dst, frame, width, height, pitch);
+   else if (to_rgb32)
+      video_frame_convert_rgb16_to_rgb32(&gl->scaler,
+            dst, frame, width, height, pitch);
+   else if (pitch == width * out_size)
+      memcpy(dst, src, pitch * height);
+   else
+   {
+      /* Packing the lines tightly spares us
+       * GL_UNPACK_ROW_LENGTH, which GLES2 lacks. */
+      const unsigned line_bytes = width * out_size;
+
+      for (h = 0; h < height; h++, src += pitch, dst += line_bytes)
+         memcpy(dst, src, line_bytes);
+   }
+
+   if (!gl->pbo_upload_persistent)
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+   glPixelStorei(GL_UNPACK_ALIGNMENT,
+         video_pixel_get_alignment(width * out_size));
+   glTexSubImage2D(GL_TEXTURE_2D,
+         0, 0, 0, width, height, gl->texture_type,
+         gl->texture_fmt, NULL);
+
+#ifdef HAVE_GL_SYNC
+   if (gl->have_sync)
+      gl->pbo_upload_fence[slot] = glFenceSync(
+            GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+   performance_counter_stop(&pbo_upload);
+   return true;
+}
+#endif
+
 static INLINE void gl_copy_frame(gl_t *gl, const void *frame,
       unsigned width, unsigned height, unsigned pitch)
 {
@@ -1472,6 +1704,15 @@ static INLINE void gl_copy_frame(gl_t *gl, const void *frame,
    performance_counter_init(&copy_frame, "copy_frame");
    performance_counter_start(&copy_frame);
 
+#ifdef HAVE_GL_PBO_UPLOAD
+   if (gl->pbo_upload_enable &&
+         gl_pbo_upload_frame(gl, frame, width, height, pitch))
+   {
+      performance_counter_stop(&copy_frame);
+      return;
+   }
+#endif
+
 #if defined(HAVE_OPENGLES2)
 #if defined(HAVE_EGL)
    if (gl->egl_images)
@@ -2137,6 +2378,10 @@ static void gl_free(void *data)
 
    scaler_ctx_gen_reset(&gl->scaler);
 
+#ifdef HAVE_GL_PBO_UPLOAD
+   gl_deinit_pbo_upload(gl);
+#endif
+
 #ifdef HAVE_GL_ASYNC_READBACK
    if (gl->pbo_readback_enable)
    {
@@ -2856,6 +3101,10 @@ static void *gl_init(const video_info_t *video, const input_driver_t **input, vo
    gl_init_textures(gl, video);
    gl_init_textures_data(gl);
 
+#ifdef HAVE_GL_PBO_UPLOAD
+   gl_init_pbo_upload(gl);
+#endif
+
 #ifdef HAVE_FBO
    gl_init_fbo(gl, gl->tex_w, gl->tex_h);
 
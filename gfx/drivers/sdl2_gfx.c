@@ -19,6 +19,7 @@
 
 #include <retro_inline.h>
 #include <gfx/scaler/scaler.h>
+#include <encodings/utf.h>
 
 #include "SDL.h"
 #include "SDL_syswm.h"
@@ -91,39 +92,17 @@ static INLINE void sdl_tex_zero(sdl2_tex_t *t)
    t->w = t->h = t->pitch = 0;
 }
 
-static void sdl2_init_font(sdl2_video_t *vid, const char *font_path,
-                          unsigned font_size)
+/* (Re)creates the font texture from the atlas of the font renderer. */
+static void sdl2_upload_font_atlas(sdl2_video_t *vid)
 {
-   int i, r, g, b;
+   int i;
    SDL_Color colors[256];
-   SDL_Surface *tmp = NULL;
-   SDL_Palette *pal = NULL;
-   const struct font_atlas *atlas = NULL;
-   settings_t *settings = config_get_ptr();
-
-   if (!settings->video.font_enable)
-      return;
-
-   if (!font_renderer_create_default((const void**)&vid->font_driver, &vid->font_data,
-                                    *font_path ? font_path : NULL, font_size))
-   {
-      RARCH_WARN("[SDL]: Could not initialize fonts.\n");
-      return;
-   }
-
-   r = settings->video.msg_color_r * 255;
-   g = settings->video.msg_color_g * 255;
-   b = settings->video.msg_color_b * 255;
+   SDL_Surface *tmp         = NULL;
+   SDL_Palette *pal         = NULL;
+   struct font_atlas *atlas = vid->font_driver->get_atlas(vid->font_data);
 
-   r = (r < 0) ? 0 : (r > 255 ? 255 : r);
-   g = (g < 0) ? 0 : (g > 255 ? 255 : g);
-   b = (b < 0) ? 0 : (b > 255 ? 255 : b);
-
-   vid->font_r = r;
-   vid->font_g = g;
-   vid->font_b = b;
-
-   atlas = vid->font_driver->get_atlas(vid->font_data);
+   sdl_tex_zero(&vid->font);
+   vid->font.active = false;
 
    tmp = SDL_CreateRGBSurfaceFrom(atlas->buffer, atlas->width,
          atlas->height, 8, atlas->width,
@@ -155,11 +134,45 @@ static void sdl2_init_font(sdl2_video_t *vid, const char *font_path,
 
    SDL_FreePalette(pal);
    SDL_FreeSurface(tmp);
+
+   atlas->dirty = false;
+}
+
+static void sdl2_init_font(sdl2_video_t *vid, const char *font_path,
+                          unsigned font_size)
+{
+   int r, g, b;
+   settings_t *settings = config_get_ptr();
+
+   if (!settings->video.font_enable)
+      return;
+
+   if (!font_renderer_create_default((const void**)&vid->font_driver, &vid->font_data,
+                                    *font_path ? font_path : NULL, font_size))
+   {
+      RARCH_WARN("[SDL]: Could not initialize fonts.\n");
+      return;
+   }
+
+   r = settings->video.msg_color_r * 255;
+   g = settings->video.msg_color_g * 255;
+   b = settings->video.msg_color_b * 255;
+
+   r = (r < 0) ? 0 : (r > 255 ? 255 : r);
+   g = (g < 0) ? 0 : (g > 255 ? 255 : g);
+   b = (b < 0) ? 0 : (b > 255 ? 255 : b);
+
+   vid->font_r = r;
+   vid->font_g = g;
+   vid->font_b = b;
+
+   sdl2_upload_font_atlas(vid);
 }
 
 static void sdl2_render_msg(sdl2_video_t *vid, const char *msg)
 {
    int x, y, delta_x, delta_y;
+   const char *walk;
    unsigned width  = vid->vp.width;
    unsigned height = vid->vp.height;
    settings_t *settings = config_get_ptr();
@@ -167,6 +180,17 @@ static void sdl2_render_msg(sdl2_video_t *vid, const char *msg)
    if (!vid->font_data)
       return;
 
+   /* Glyphs are rasterized on demand, have the atlas hold all
+    * of the message before the texture is used. */
+   for (walk = msg; *walk; )
+      vid->font_driver->get_glyph(vid->font_data, utf8_walk(&walk));
+
+   if (vid->font_driver->get_atlas(vid->font_data)->dirty)
+      sdl2_upload_font_atlas(vid);
+
+   if (!vid->font.tex)
+      return;
+
    x       = settings->video.msg_pos_x * width;
    y       = (1.0f - settings->video.msg_pos_y) * height;
    delta_x = 0;
@@ -174,12 +198,13 @@ static void sdl2_render_msg(sdl2_video_t *vid, const char *msg)
 
    SDL_SetTextureColorMod(vid->font.tex, vid->font_r, vid->font_g, vid->font_b);
 
-   for (; *msg; msg++)
+   while (*msg)
    {
       SDL_Rect src_rect, dst_rect;
       int off_x, off_y, tex_x, tex_y;
+      uint32_t code                = utf8_walk(&msg);
       const struct font_glyph *gly = 
-         vid->font_driver->get_glyph(vid->font_data, (uint8_t)*msg);
+         vid->font_driver->get_glyph(vid->font_data, code);
 
       if (!gly)
          gly = vid->font_driver->get_glyph(vid->font_data, '?');
@@ -649,7 +649,7 @@ static bool vulkan_init_default_filter_chain(vk_t *vk)
 
    info.device                = vk->context->device;
    info.gpu                   = vk->context->gpu;
-   info.memory_properties     = &vk->context->memory_properties;
+   info.allocator             = vk->context->allocator;
    info.pipeline_cache        = vk->pipelines.cache;
    info.max_input_size.width  = vk->tex_w;
    info.max_input_size.height = vk->tex_h;
@@ -681,7 +681,7 @@ static bool vulkan_init_filter_chain_preset(vk_t *vk, const char *shader_path)
 
    info.device                = vk->context->device;
    info.gpu                   = vk->context->gpu;
-   info.memory_properties     = &vk->context->memory_properties;
+   info.allocator             = vk->context->allocator;
    info.pipeline_cache        = vk->pipelines.cache;
    info.max_input_size.width  = vk->tex_w;
    info.max_input_size.height = vk->tex_h;
@@ -2006,9 +2006,7 @@ static void vulkan_set_texture_frame(void *data,
          NULL, rgb32 ? NULL : &br_swizzle,
          texture_optimal->memory ? VULKAN_TEXTURE_STAGING : VULKAN_TEXTURE_STREAMED);
 
-   vkMapMemory(vk->context->device, texture->memory,
-         texture->offset, texture->size, 0, (void**)&ptr);
-
+   ptr       = (uint8_t*)texture->allocation.mapped + texture->offset;
    dst       = ptr;
    src       = (const uint8_t*)frame;
    stride    = (rgb32 ? sizeof(uint32_t) : sizeof(uint16_t)) * width;
@@ -2016,8 +2014,6 @@ static void vulkan_set_texture_frame(void *data,
    for (y = 0; y < height; y++, dst += texture->stride, src += stride)
       memcpy(dst, src, stride);
 
-   vkUnmapMemory(vk->context->device, texture->memory);
-
    vk->menu.alpha      = alpha;
    vk->menu.last_index = index;
 
@@ -2161,15 +2157,12 @@ static bool vulkan_read_viewport(void *data, uint8_t *buffer)
       performance_counter_start(&stream_readback);
 
       buffer += 3 * (vk->vp.height - 1) * vk->vp.width;
-      vkMapMemory(vk->context->device, staging->memory,
-            staging->offset, staging->size, 0, (void**)&src);
+      src     = (const uint8_t*)staging->allocation.mapped + staging->offset;
 
       vk->readback.scaler.in_stride  = staging->stride;
       vk->readback.scaler.out_stride = -(int)vk->vp.width * 3;
       scaler_ctx_scale(&vk->readback.scaler, buffer, src);
 
-      vkUnmapMemory(vk->context->device, staging->memory);
-
       performance_counter_stop(&stream_readback);
    }
    else
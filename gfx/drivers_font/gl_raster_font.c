@@ -14,6 +14,8 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <encodings/utf.h>
+
 #include "../common/gl_common.h"
 #include "../font_driver.h"
 #include "../video_shader_driver.h"
@@ -43,31 +45,33 @@ typedef struct
 
    const font_renderer_driver_t *font_driver;
    void *font_data;
+   struct font_atlas *atlas;
+
+   GLint gl_internal;
+   GLenum gl_format;
+   size_t ncomponents;
 
    video_font_raster_block_t *block;
 } gl_raster_t;
 
 static void gl_raster_font_free_font(void *data);
 
-static bool gl_raster_font_upload_atlas(gl_raster_t *font,
-      const struct font_atlas *atlas,
-      unsigned width, unsigned height)
+static void gl_raster_font_select_format(gl_raster_t *font)
 {
-   unsigned i, j;
-   GLint  gl_internal                   = GL_LUMINANCE_ALPHA;
-   GLenum gl_format                     = GL_LUMINANCE_ALPHA;
-   size_t ncomponents                   = 2;
-   uint8_t       *tmp                   = NULL;
    bool ancient                         = false; /* add a check here if needed */
 #if defined(GL_VERSION_3_0)
    struct retro_hw_render_callback *hwr = video_driver_get_hw_context();
 #endif
 
+   font->gl_internal = GL_LUMINANCE_ALPHA;
+   font->gl_format   = GL_LUMINANCE_ALPHA;
+   font->ncomponents = 2;
+
    if (ancient)
    {
-      gl_internal = GL_RGBA;
-      gl_format   = GL_RGBA;
-      ncomponents = 4;
+      font->gl_internal = GL_RGBA;
+      font->gl_format   = GL_RGBA;
+      font->ncomponents = 4;
    }
     
 #if defined(GL_VERSION_3_0)
@@ -78,23 +82,26 @@ static bool gl_raster_font_upload_atlas(gl_raster_t *font,
       GLint swizzle[] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
       glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
 
-      gl_internal = GL_R8;
-      gl_format   = GL_RED;
-      ncomponents = 1;
+      font->gl_internal = GL_R8;
+      font->gl_format   = GL_RED;
+      font->ncomponents = 1;
    }
 #endif
+}
 
-   tmp = (uint8_t*)calloc(height, width * ncomponents);
-
-   if (!tmp)
-      return false;
+/* Converts atlas rows to the texture format, @pitch is in texels. */
+static void gl_raster_font_convert_rows(gl_raster_t *font, uint8_t *tmp,
+      unsigned pitch, unsigned y, unsigned rows)
+{
+   unsigned i, j;
+   const struct font_atlas *atlas = font->atlas;
 
-   for (i = 0; i < atlas->height; ++i)
+   for (i = 0; i < rows; ++i)
    {
-      const uint8_t *src = &atlas->buffer[i * atlas->width];
-      uint8_t       *dst = &tmp[i * width * ncomponents];
+      const uint8_t *src = &atlas->buffer[(y + i) * atlas->width];
+      uint8_t       *dst = &tmp[i * pitch * font->ncomponents];
 
-      switch (ncomponents)
+      switch (font->ncomponents)
       {
          case 1:
             memcpy(dst, src, atlas->width);
@@ -115,26 +122,76 @@ static bool gl_raster_font_upload_atlas(gl_raster_t *font,
                *dst++ = *src++;
             }
             break;
-         default:
-            RARCH_ERR("Unsupported number of components: %u\n",
-                  (unsigned)ncomponents);
-            free(tmp);
-            return false;
       }
    }
+}
 
-   glTexImage2D(GL_TEXTURE_2D, 0, gl_internal, width, height,
-         0, gl_format, GL_UNSIGNED_BYTE, tmp);
+/* Creates the texture for the whole atlas, the font texture
+ * has to be bound. */
+static bool gl_raster_font_upload_atlas(gl_raster_t *font)
+{
+   uint8_t *tmp = NULL;
+
+   font->tex_width  = next_pow2(font->atlas->width);
+   font->tex_height = next_pow2(font->atlas->height);
+
+   tmp = (uint8_t*)calloc(font->tex_height,
+         font->tex_width * font->ncomponents);
+
+   if (!tmp)
+      return false;
+
+   gl_raster_font_convert_rows(font, tmp, font->tex_width,
+         0, font->atlas->height);
+
+   glTexImage2D(GL_TEXTURE_2D, 0, font->gl_internal,
+         font->tex_width, font->tex_height,
+         0, font->gl_format, GL_UNSIGNED_BYTE, tmp);
 
    free(tmp);
 
+   font->atlas->dirty = false;
+
    return true;
 }
 
+/* Uploads the rows glyphs were added to since the last upload,
+ * or the whole atlas if it grew. */
+static void gl_raster_font_update_atlas(gl_raster_t *font)
+{
+   uint8_t *tmp             = NULL;
+   struct font_atlas *atlas = font->atlas;
+   unsigned y               = atlas->dirty_y;
+   unsigned rows            = MIN(atlas->dirty_height, atlas->height - y);
+
+   glBindTexture(GL_TEXTURE_2D, font->tex);
+
+   if (     next_pow2(atlas->width)  != font->tex_width
+         || next_pow2(atlas->height) != font->tex_height)
+   {
+      gl_raster_font_upload_atlas(font);
+      return;
+   }
+
+   tmp = (uint8_t*)malloc(rows * atlas->width * font->ncomponents);
+   if (!tmp)
+      return;
+
+   gl_raster_font_convert_rows(font, tmp, atlas->width, y, rows);
+
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, atlas->width, rows,
+         font->gl_format, GL_UNSIGNED_BYTE, tmp);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+   free(tmp);
+
+   atlas->dirty = false;
+}
+
 static void *gl_raster_font_init_font(void *data,
       const char *font_path, float font_size)
 {
-   const struct font_atlas *atlas = NULL;
    gl_raster_t   *font = (gl_raster_t*)calloc(1, sizeof(*font));
 
    if (!font)
@@ -157,12 +214,11 @@ static void *gl_raster_font_init_font(void *data,
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-   atlas            = font->font_driver->get_atlas(font->font_data);
-   font->tex_width  = next_pow2(atlas->width);;
-   font->tex_height = next_pow2(atlas->height);;
+   font->atlas = font->font_driver->get_atlas(font->font_data);
+
+   gl_raster_font_select_format(font);
 
-   if (!gl_raster_font_upload_atlas(font, atlas,
-            font->tex_width, font->tex_height))
+   if (!gl_raster_font_upload_atlas(font))
       goto error;
 
    glBindTexture(GL_TEXTURE_2D, font->gl->texture[font->gl->tex_index]);
@@ -190,11 +246,10 @@ static void gl_raster_font_free_font(void *data)
 }
 
 static int gl_get_message_width(void *data, const char *msg,
-      unsigned msg_len_full, float scale)
+      unsigned msg_len, float scale)
 {
-   unsigned i;
    int delta_x       = 0;
-   unsigned msg_len  = MIN(msg_len_full, MAX_MSG_LEN_CHUNK);
+   const char *end   = msg + msg_len;
    gl_raster_t *font = (gl_raster_t*)data;
 
    if (!font)
@@ -206,24 +261,18 @@ static int gl_get_message_width(void *data, const char *msg,
          || !font->font_data )
       return 0;
 
-   while (msg_len_full)
+   while (msg < end)
    {
-      for (i = 0; i < msg_len; i++)
-      {
-         const struct font_glyph *glyph = 
-            font->font_driver->get_glyph(font->font_data, (uint8_t)msg[i]);
-
-         if (!glyph) /* Do something smarter here ... */
-            glyph = font->font_driver->get_glyph(font->font_data, '?');
-         if (!glyph)
-            continue;
+      uint32_t code                  = utf8_walk(&msg);
+      const struct font_glyph *glyph =
+         font->font_driver->get_glyph(font->font_data, code);
 
-         delta_x += glyph->advance_x;
-      }
+      if (!glyph) /* Do something smarter here ... */
+         glyph = font->font_driver->get_glyph(font->font_data, '?');
+      if (!glyph)
+         continue;
 
-      msg_len_full -= msg_len;
-      msg          += msg_len;
-      msg_len       = MIN(msg_len_full, MAX_MSG_LEN_CHUNK);
+      delta_x += glyph->advance_x;
    }
 
    return delta_x * scale;
@@ -254,19 +303,18 @@ static void gl_raster_font_render_line(
 {
    int x, y, delta_x, delta_y;
    float inv_tex_size_x, inv_tex_size_y, inv_win_width, inv_win_height;
-   unsigned i, msg_len;
+   unsigned i;
    struct video_coords coords;
    GLfloat font_tex_coords[2 * 6 * MAX_MSG_LEN_CHUNK];
    GLfloat font_vertex[2 * 6 * MAX_MSG_LEN_CHUNK]; 
    GLfloat font_color[4 * 6 * MAX_MSG_LEN_CHUNK];
    GLfloat font_lut_tex_coord[2 * 6 * MAX_MSG_LEN_CHUNK];
    gl_t *gl       = font ? font->gl : NULL;
+   const char *end = msg + msg_len_full;
 
    if (!gl)
       return;
 
-   msg_len        = MIN(msg_len_full, MAX_MSG_LEN_CHUNK);
-
    x              = roundf(pos_x * gl->vp.width);
    y              = roundf(pos_y * gl->vp.height);
    delta_x        = 0;
@@ -287,13 +335,15 @@ static void gl_raster_font_render_line(
    inv_win_width  = 1.0f / font->gl->vp.width;
    inv_win_height = 1.0f / font->gl->vp.height;
 
-   while (msg_len_full)
+   while (msg < end)
    {
-      for (i = 0; i < msg_len; i++)
+      /* i counts the glyphs of this chunk, not bytes. */
+      for (i = 0; i < MAX_MSG_LEN_CHUNK && msg < end; )
       {
          int off_x, off_y, tex_x, tex_y, width, height;
+         uint32_t code                  = utf8_walk(&msg);
          const struct font_glyph *glyph =
-            font->font_driver->get_glyph(font->font_data, (uint8_t)msg[i]);
+            font->font_driver->get_glyph(font->font_data, code);
 
          if (!glyph) /* Do something smarter here ... */
             glyph = font->font_driver->get_glyph(font->font_data, '?');
@@ -317,22 +367,22 @@ static void gl_raster_font_render_line(
 
          delta_x += glyph->advance_x;
          delta_y -= glyph->advance_y;
+         i++;
       }
 
+      if (!i)
+         continue;
+
       coords.tex_coord     = font_tex_coords;
       coords.vertex        = font_vertex;
       coords.color         = font_color;
-      coords.vertices      = 6 * msg_len;
+      coords.vertices      = 6 * i;
       coords.lut_tex_coord = font_lut_tex_coord;
 
       if (font->block)
          video_coord_array_append(&font->block->carr, &coords, coords.vertices);
       else
          gl_raster_font_draw_vertices(gl, &coords);
-
-      msg_len_full -= msg_len;
-      msg          += msg_len;
-      msg_len       = MIN(msg_len_full, MAX_MSG_LEN_CHUNK);
    }
 }
 
@@ -482,6 +532,19 @@ static void gl_raster_font_render_msg(void *data, const char *msg,
       drop_alpha = 1.0f;
    }
 
+   if (font && font->atlas)
+   {
+      /* Rasterize the glyphs of the message that aren't in the atlas
+       * yet, so the texture is up to date before anything is drawn. */
+      gl_get_message_width(font, msg, strlen(msg), 1.0f);
+
+      if (font->atlas->dirty)
+      {
+         gl_raster_font_update_atlas(font);
+         glBindTexture(GL_TEXTURE_2D, gl->texture[gl->tex_index]);
+      }
+   }
+
    if (font && font->block)
       font->block->fullscreen = full_screen;
    else
@@ -514,7 +577,7 @@ static const struct font_glyph *gl_raster_font_get_glyph(
       return NULL;
    if (!font->font_driver->ident)
        return NULL;
-   return font->font_driver->get_glyph((void*)font->font_driver, code);
+   return font->font_driver->get_glyph(font->font_data, code);
 }
 
 static void gl_raster_font_flush_block(void *data)
@@ -13,6 +13,8 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <encodings/utf.h>
+
 #include "../common/vulkan_common.h"
 #include "../font_driver.h"
 
@@ -20,8 +22,13 @@ typedef struct
 {
    vk_t *vk;
    struct vk_texture texture;
+   /* Texture replaced in the frame retired_frame, draws recorded
+    * in that frame may still use it. */
+   struct vk_texture retired;
+   uint64_t retired_frame;
    const font_renderer_driver_t *font_driver;
    void *font_data;
+   struct font_atlas *atlas;
 
    struct vk_vertex *pv;
    struct vk_buffer_range range;
@@ -33,7 +40,6 @@ static void vulkan_raster_font_free_font(void *data);
 static void *vulkan_raster_font_init_font(void *data,
       const char *font_path, float font_size)
 {
-   const struct font_atlas *atlas = NULL;
    vulkan_raster_t *font = (vulkan_raster_t*)calloc(1, sizeof(*font));
 
 #if 0
@@ -58,14 +64,40 @@ static void *vulkan_raster_font_init_font(void *data,
       return NULL;
    }
 
-   atlas = font->font_driver->get_atlas(font->font_data);
+   font->atlas   = font->font_driver->get_atlas(font->font_data);
    font->texture = vulkan_create_texture(font->vk, NULL,
-         atlas->width, atlas->height, VK_FORMAT_R8_UNORM, atlas->buffer,
-         NULL /*&swizzle*/, VULKAN_TEXTURE_STATIC);
+         font->atlas->width, font->atlas->height, VK_FORMAT_R8_UNORM,
+         font->atlas->buffer, NULL /*&swizzle*/, VULKAN_TEXTURE_STATIC);
+   font->atlas->dirty = false;
 
    return font;
 }
 
+/* The font texture is static, glyphs added to the atlas need a new
+ * texture. The old one is kept until the next frame since draws of
+ * this frame may still sample it, so the atlas is updated at most
+ * once a frame. */
+static void vulkan_raster_font_update_atlas(vulkan_raster_t *font)
+{
+   uint64_t frame = *video_driver_get_frame_count_ptr();
+
+   if (font->retired.memory != VK_NULL_HANDLE)
+   {
+      if (font->retired_frame == frame)
+         return;
+
+      vkQueueWaitIdle(font->vk->context->queue);
+      vulkan_destroy_texture(font->vk->context->device, &font->retired);
+   }
+
+   font->retired       = font->texture;
+   font->retired_frame = frame;
+   font->texture       = vulkan_create_texture(font->vk, NULL,
+         font->atlas->width, font->atlas->height, VK_FORMAT_R8_UNORM,
+         font->atlas->buffer, NULL, VULKAN_TEXTURE_STATIC);
+   font->atlas->dirty  = false;
+}
+
 static void vulkan_raster_font_free_font(void *data)
 {
    vulkan_raster_t *font = (vulkan_raster_t*)data;
@@ -78,6 +110,9 @@ static void vulkan_raster_font_free_font(void *data)
    vkQueueWaitIdle(font->vk->context->queue);
    vulkan_destroy_texture( 
          font->vk->context->device, &font->texture);
+   if (font->retired.memory != VK_NULL_HANDLE)
+      vulkan_destroy_texture(
+            font->vk->context->device, &font->retired);
 
    free(font);
 }
@@ -87,16 +122,17 @@ static int vulkan_get_message_width(void *data, const char *msg,
 {
    vulkan_raster_t *font = (vulkan_raster_t*)data;
       
-   unsigned i;
-   int delta_x = 0;
+   int delta_x     = 0;
+   const char *end = msg + msg_len;
 
    if (!font)
       return 0;
 
-   for (i = 0; i < msg_len; i++)
+   while (msg < end)
    {
+      uint32_t code                  = utf8_walk(&msg);
       const struct font_glyph *glyph = 
-         font->font_driver->get_glyph(font->font_data, (uint8_t)msg[i]);
+         font->font_driver->get_glyph(font->font_data, code);
       if (!glyph) /* Do something smarter here ... */
          glyph = font->font_driver->get_glyph(font->font_data, '?');
       if (!glyph)
@@ -115,9 +151,9 @@ static void vulkan_raster_font_render_line(
 {
    int x, y, delta_x, delta_y;
    float inv_tex_size_x, inv_tex_size_y, inv_win_width, inv_win_height;
-   unsigned i;
    struct vk_color vk_color;
-   vk_t *vk = font ? font->vk : NULL;
+   vk_t *vk        = font ? font->vk : NULL;
+   const char *end = msg + msg_len;
 
    if (!vk)
       return;
@@ -147,11 +183,12 @@ static void vulkan_raster_font_render_line(
    inv_win_width  = 1.0f / font->vk->vp.width;
    inv_win_height = 1.0f / font->vk->vp.height;
 
-   for (i = 0; i < msg_len; i++)
+   while (msg < end)
    {
       int off_x, off_y, tex_x, tex_y, width, height;
+      uint32_t code                  = utf8_walk(&msg);
       const struct font_glyph *glyph =
-         font->font_driver->get_glyph(font->font_data, (uint8_t)msg[i]);
+         font->font_driver->get_glyph(font->font_data, code);
 
       if (!glyph) /* Do something smarter here ... */
          glyph = font->font_driver->get_glyph(font->font_data, '?');
@@ -310,8 +347,16 @@ static void vulkan_raster_font_render_msg(void *data, const char *msg,
       drop_alpha = 1.0f;
    }
 
+   /* Rasterize the glyphs of the message that aren't in the atlas
+    * yet before the texture is used. */
+   vulkan_get_message_width(font, msg, strlen(msg), 1.0f);
+
+   if (font->atlas->dirty)
+      vulkan_raster_font_update_atlas(font);
+
    vulkan_raster_font_setup_viewport(font, full_screen);
 
+   /* Bytes, at least as many as there are glyphs. */
    max_glyphs = strlen(msg);
    if (drop_x || drop_y)
       max_glyphs *= 2;
@@ -349,7 +394,7 @@ static const struct font_glyph *vulkan_raster_font_get_glyph(
       return NULL;
    if (!font->font_driver->ident)
        return NULL;
-   return font->font_driver->get_glyph((void*)font->font_driver, code);
+   return font->font_driver->get_glyph(font->font_data, code);
 }
 
 static void vulkan_raster_font_flush_block(void *data)
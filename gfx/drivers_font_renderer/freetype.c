@@ -25,27 +25,24 @@
 #include FT_FREETYPE_H
 
 #include "../font_driver.h"
+#include "../font_glyph_cache.h"
 #include "../../general.h"
-
-#define FT_ATLAS_ROWS 16
-#define FT_ATLAS_COLS 16
-#define FT_ATLAS_SIZE (FT_ATLAS_ROWS * FT_ATLAS_COLS)
+#include "../../verbosity.h"
 
 typedef struct freetype_renderer
 {
    FT_Library lib;
    FT_Face face;
 
-   struct font_atlas atlas;
-   struct font_glyph glyphs[FT_ATLAS_SIZE];
+   font_glyph_cache_t *cache;
 } ft_font_renderer_t;
 
-static const struct font_atlas *font_renderer_ft_get_atlas(void *data)
+static struct font_atlas *font_renderer_ft_get_atlas(void *data)
 {
    ft_font_renderer_t *handle = (ft_font_renderer_t*)data;
    if (!handle)
       return NULL;
-   return &handle->atlas;
+   return font_glyph_cache_get_atlas(handle->cache);
 }
 
 static const struct font_glyph *font_renderer_ft_get_glyph(
@@ -54,7 +51,7 @@ static const struct font_glyph *font_renderer_ft_get_glyph(
    ft_font_renderer_t *handle = (ft_font_renderer_t*)data;
    if (!handle)
       return NULL;
-   return code < FT_ATLAS_SIZE ? &handle->glyphs[code] : NULL;
+   return font_glyph_cache_get(handle->cache, code);
 }
 
 static void font_renderer_ft_free(void *data)
@@ -63,7 +60,7 @@ static void font_renderer_ft_free(void *data)
    if (!handle)
       return;
 
-   free(handle->atlas.buffer);
+   font_glyph_cache_free(handle->cache);
 
    if (handle->face)
       FT_Done_Face(handle->face);
@@ -72,99 +69,54 @@ static void font_renderer_ft_free(void *data)
    free(handle);
 }
 
-static bool font_renderer_create_atlas(ft_font_renderer_t *handle)
+static bool font_renderer_ft_has_glyph(void *data, uint32_t code)
 {
-   unsigned i;
-   bool ret = true;
+   ft_font_renderer_t *handle = (ft_font_renderer_t*)data;
+   return !code || FT_Get_Char_Index(handle->face, code);
+}
 
-   uint8_t *buffer[FT_ATLAS_SIZE] = {NULL};
-   unsigned pitches[FT_ATLAS_SIZE] = {0};
+static bool font_renderer_ft_rasterize(void *data, uint32_t code,
+      struct font_glyph *glyph, uint8_t *dst, unsigned dst_pitch,
+      unsigned max_width, unsigned max_height)
+{
+   unsigned r;
+   FT_GlyphSlot slot;
+   const uint8_t *src         = NULL;
+   ft_font_renderer_t *handle = (ft_font_renderer_t*)data;
+   FT_UInt index              = FT_Get_Char_Index(handle->face, code);
 
-   unsigned max_width = 0;
-   unsigned max_height = 0;
+   if (!index && code)
+      return false;
 
-   for (i = 0; i < FT_ATLAS_SIZE; i++)
-   {
-      FT_GlyphSlot slot;
-      struct font_glyph *glyph = &handle->glyphs[i];
-
-      if (!glyph)
-         continue;
-
-      if (FT_Load_Char(handle->face, i, FT_LOAD_RENDER))
-      {
-         ret = false;
-         goto end;
-      }
-
-      FT_Render_Glyph(handle->face->glyph, FT_RENDER_MODE_NORMAL);
-      slot = handle->face->glyph;
-
-      /* Some glyphs can be blank. */
-      buffer[i] = (uint8_t*)calloc(slot->bitmap.rows * slot->bitmap.pitch, 1);
-
-      glyph->width = slot->bitmap.width;
-      glyph->height = slot->bitmap.rows;
-      pitches[i] = slot->bitmap.pitch;
-
-      glyph->advance_x = slot->advance.x >> 6;
-      glyph->advance_y = slot->advance.y >> 6;
-      glyph->draw_offset_x = slot->bitmap_left;
-      glyph->draw_offset_y = -slot->bitmap_top;
-
-      if (buffer[i])
-         memcpy(buffer[i], slot->bitmap.buffer,
-               slot->bitmap.rows * pitches[i]);
-      max_width  = MAX(max_width, (unsigned)slot->bitmap.width);
-      max_height = MAX(max_height, (unsigned)slot->bitmap.rows);
-   }
+   if (FT_Load_Glyph(handle->face, index, FT_LOAD_RENDER))
+      return false;
 
-   handle->atlas.width = max_width * FT_ATLAS_COLS;
-   handle->atlas.height = max_height * FT_ATLAS_ROWS;
+   slot = handle->face->glyph;
 
-   handle->atlas.buffer = (uint8_t*)
-      calloc(handle->atlas.width * handle->atlas.height, 1);
+   glyph->width         = MIN((unsigned)slot->bitmap.width, max_width);
+   glyph->height        = MIN((unsigned)slot->bitmap.rows, max_height);
+   glyph->advance_x     = slot->advance.x >> 6;
+   glyph->advance_y     = slot->advance.y >> 6;
+   glyph->draw_offset_x = slot->bitmap_left;
+   glyph->draw_offset_y = -slot->bitmap_top;
 
-   if (!handle->atlas.buffer)
-   {
-      ret = false;
-      goto end;
-   }
+   src = slot->bitmap.buffer;
 
-   /* Blit our texture atlas. */
-   for (i = 0; i < FT_ATLAS_SIZE; i++)
-   {
-      uint8_t *dst      = NULL;
-      unsigned offset_x = (i % FT_ATLAS_COLS) * max_width;
-      unsigned offset_y = (i / FT_ATLAS_COLS) * max_height;
-
-      handle->glyphs[i].atlas_offset_x = offset_x;
-      handle->glyphs[i].atlas_offset_y = offset_y;
-
-      dst = (uint8_t*)handle->atlas.buffer;
-      dst += offset_x + offset_y * handle->atlas.width;
-
-      if (buffer[i])
-      {
-         unsigned r, c;
-         const uint8_t *src = (const uint8_t*)buffer[i];
-
-         for (r = 0; r < handle->glyphs[i].height;
-               r++, dst += handle->atlas.width, src += pitches[i])
-            for (c = 0; c < handle->glyphs[i].width; c++)
-               dst[c] = src[c];
-      }
-   }
+   /* Some glyphs can be blank. */
+   if (!src)
+      return true;
+
+   for (r = 0; r < glyph->height;
+         r++, dst += dst_pitch, src += slot->bitmap.pitch)
+      memcpy(dst, src, glyph->width);
 
-end:
-   for (i = 0; i < FT_ATLAS_SIZE; i++)
-      free(buffer[i]);
-   return ret;
+   return true;
 }
 
 static void *font_renderer_ft_init(const char *font_path, float font_size)
 {
    FT_Error err;
+   unsigned cell_size;
 
    ft_font_renderer_t *handle = (ft_font_renderer_t*)
       calloc(1, sizeof(*handle));
@@ -180,11 +132,23 @@ static void *font_renderer_ft_init(const char *font_path, float font_size)
    if (err)
       goto error;
 
+   err = FT_Select_Charmap(handle->face, FT_ENCODING_UNICODE);
+   if (err)
+      RARCH_WARN("[freetype]: %s has no Unicode charmap.\n", font_path);
+
    err = FT_Set_Pixel_Sizes(handle->face, 0, font_size);
    if (err)
       goto error;
 
-   if (!font_renderer_create_atlas(handle))
+   /* Glyphs are rasterized when they're first drawn, in cells a
+    * line high and as wide, which fits CJK glyphs. The odd glyph
+    * larger than that is cut. */
+   cell_size     = MAX(handle->face->size->metrics.height >> 6,
+         (unsigned)font_size) + 2;
+   handle->cache = font_glyph_cache_new(cell_size, cell_size,
+         font_renderer_ft_has_glyph, font_renderer_ft_rasterize, handle);
+
+   if (!handle->cache)
       goto error;
 
    return handle;
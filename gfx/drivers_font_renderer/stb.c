@@ -14,12 +14,11 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <ctype.h>
-
 #include <file/file_path.h>
 #include <streams/file_stream.h>
 
 #include "../font_driver.h"
+#include "../font_glyph_cache.h"
 #include "../../general.h"
 #include "../../verbosity.h"
 
@@ -34,110 +33,74 @@
 typedef struct
 {
    int     line_height;
-   struct font_atlas atlas;
-   struct font_glyph glyphs[256];
+   float   scale;
+   /* stbtt_fontinfo points into it. */
+   uint8_t *font_data;
+   stbtt_fontinfo info;
+   font_glyph_cache_t *cache;
 } stb_font_renderer_t;
 
-static const struct font_atlas *font_renderer_stb_get_atlas(void *data)
+static struct font_atlas *font_renderer_stb_get_atlas(void *data)
 {
    stb_font_renderer_t *self = (stb_font_renderer_t*)data;
-   return &self->atlas;
+   return font_glyph_cache_get_atlas(self->cache);
 }
 
 static const struct font_glyph *font_renderer_stb_get_glyph(
       void *data, uint32_t code)
 {
    stb_font_renderer_t *self = (stb_font_renderer_t*)data;
-   return code < 256 ? &self->glyphs[code] : NULL;
+   return font_glyph_cache_get(self->cache, code);
 }
 
 static void font_renderer_stb_free(void *data)
 {
    stb_font_renderer_t *self = (stb_font_renderer_t*)data;
 
-   free(self->atlas.buffer);
+   font_glyph_cache_free(self->cache);
+   free(self->font_data);
    free(self);
 }
 
-static bool font_renderer_stb_create_atlas(stb_font_renderer_t *self,
-      uint8_t *font_data, float font_size, unsigned width, unsigned height)
+static bool font_renderer_stb_has_glyph(void *data, uint32_t code)
 {
-   int i;
-   stbtt_pack_context pc = {NULL};
-   stbtt_packedchar   chardata[256];
+   stb_font_renderer_t *self = (stb_font_renderer_t*)data;
+   return !code || stbtt_FindGlyphIndex(&self->info, code);
+}
 
-   if (width > 2048 || height > 2048)
-   {
-      RARCH_WARN("[stb] Font atlas too big: %ux%u\n", width, height);
-      goto error;
-   }
+static bool font_renderer_stb_rasterize(void *data, uint32_t code,
+      struct font_glyph *glyph, uint8_t *dst, unsigned dst_pitch,
+      unsigned max_width, unsigned max_height)
+{
+   int index, advance, lsb, x0, y0, x1, y1;
+   stb_font_renderer_t *self = (stb_font_renderer_t*)data;
 
-   if (self->atlas.buffer)
-      free(self->atlas.buffer);
+   index = stbtt_FindGlyphIndex(&self->info, code);
+   if (!index && code)
+      return false;
 
-   self->atlas.buffer = (uint8_t*)calloc(height, width);
-   self->atlas.width  = width;
-   self->atlas.height = height;
+   stbtt_GetGlyphHMetrics(&self->info, index, &advance, &lsb);
+   stbtt_GetGlyphBitmapBox(&self->info, index,
+         self->scale, self->scale, &x0, &y0, &x1, &y1);
 
-   if (!self->atlas.buffer)
-      goto error;
+   glyph->width         = MIN((unsigned)(x1 - x0), max_width);
+   glyph->height        = MIN((unsigned)(y1 - y0), max_height);
+   glyph->advance_x     = (int)(advance * self->scale + 0.5f);
+   glyph->advance_y     = 0;
+   glyph->draw_offset_x = x0;
+   glyph->draw_offset_y = y0;
 
-   stbtt_PackBegin(&pc, self->atlas.buffer,
-         self->atlas.width, self->atlas.height,
-         self->atlas.width, 1, NULL);
-
-   stbtt_PackFontRange(&pc, font_data, 0, font_size, 0, 256, chardata);
-   stbtt_PackEnd(&pc);
-
-   for (i = 0; i < 256; ++i)
-   {
-      struct font_glyph *g = &self->glyphs[i];
-      stbtt_packedchar  *c = &chardata[i];
-
-      g->advance_x = c->xadvance;
-      g->atlas_offset_x = c->x0;
-      g->atlas_offset_y = c->y0;
-      g->draw_offset_x  = c->xoff;
-      g->draw_offset_y  = c->yoff;
-      g->width          = c->x1 - c->x0;
-      g->height         = c->y1 - c->y0;
-
-      /* Make sure important characters fit */
-      if (isalnum(i) && (!g->width || !g->height))
-      {
-         int new_width  = width  * 1.2;
-         int new_height = height * 1.2;
-
-         /* Limit growth to 2048x2048 unless we already reached that */
-         if (width < 2048 || height < 2048)
-         {
-            new_width  = MIN(new_width,  2048);
-            new_height = MIN(new_height, 2048);
-         }
-
-         return font_renderer_stb_create_atlas(self, font_data, font_size,
-               new_width, new_height);
-      }
-   }
+   if (glyph->width && glyph->height)
+      stbtt_MakeGlyphBitmap(&self->info, dst,
+            glyph->width, glyph->height, dst_pitch,
+            self->scale, self->scale, index);
 
    return true;
-
-error:
-   self->atlas.width = self->atlas.height = 0;
-
-   if (self->atlas.buffer)
-      free(self->atlas.buffer);
-
-   self->atlas.buffer = NULL;
-
-   return false;
 }
 
 static void *font_renderer_stb_init(const char *font_path, float font_size)
 {
    int ascent, descent, line_gap;
-   stbtt_fontinfo info;
-   uint8_t *font_data = NULL;
    stb_font_renderer_t *self = (stb_font_renderer_t*) calloc(1, sizeof(*self));
 
    /* See https://github.com/nothings/stb/blob/master/stb_truetype.h#L539 */
@@ -146,31 +109,36 @@ static void *font_renderer_stb_init(const char *font_path, float font_size)
    if (!self)
       goto error;
 
-   if (!filestream_read_file(font_path, (void**)&font_data, NULL))
-      goto error;
-
-   if (!font_renderer_stb_create_atlas(self, font_data, font_size, 512, 512))
+   if (!filestream_read_file(font_path, (void**)&self->font_data, NULL))
       goto error;
 
-   if (!stbtt_InitFont(&info, font_data, stbtt_GetFontOffsetForIndex(font_data, 0)))
+   if (!stbtt_InitFont(&self->info, self->font_data,
+            stbtt_GetFontOffsetForIndex(self->font_data, 0)))
       goto error;
 
-   stbtt_GetFontVMetrics(&info, &ascent, &descent, &line_gap);
+   stbtt_GetFontVMetrics(&self->info, &ascent, &descent, &line_gap);
    self->line_height  = ascent - descent;
 
    if (font_size < 0)
-      self->line_height *= stbtt_ScaleForMappingEmToPixels(&info, -font_size);
+      self->scale = stbtt_ScaleForMappingEmToPixels(&self->info, -font_size);
    else
-      self->line_height *= stbtt_ScaleForPixelHeight(&info, font_size);
+      self->scale = stbtt_ScaleForPixelHeight(&self->info, font_size);
+
+   self->line_height *= self->scale;
 
-   free(font_data);
+   /* Glyphs are rasterized when they're first drawn, in cells a
+    * line high and as wide, which fits CJK glyphs. The odd glyph
+    * larger than that is cut. */
+   self->cache = font_glyph_cache_new(
+         self->line_height + 2, self->line_height + 2,
+         font_renderer_stb_has_glyph, font_renderer_stb_rasterize, self);
+
+   if (!self->cache)
+      goto error;
 
    return self;
 
 error:
-   if (font_data)
-      free(font_data);
-
    if (self)
       font_renderer_stb_free(self);
    return NULL;
@@ -19,7 +19,11 @@
 #include <compat/strl.h>
 #include <compat/posix_string.h>
 #include <file/file_path.h>
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
 #include <retro_assert.h>
+#include <retro_stat.h>
+#include <rhash.h>
 #include <streams/file_stream.h>
 #include <string/stdstring.h>
 
@@ -29,6 +33,7 @@
 #include "../../dynamic.h"
 #include "../../managers/state_manager.h"
 #include "../../core.h"
+#include "../../configuration.h"
 
 #ifdef HAVE_CONFIG_H
 #include "../../config.h"
@@ -46,6 +51,27 @@
 
 #define PREV_TEXTURES (GFX_MAX_TEXTURES - 1)
 
+#if defined(GL_PROGRAM_BINARY_LENGTH) && (!defined(HAVE_OPENGLES2) || defined(HAVE_OPENGLES3))
+#define HAVE_GLSL_PROGRAM_BINARY
+#define GLSL_PROGRAM_BINARY_MAGIC 0x4e42534cU /* "LSBN" */
+
+/* Binaries of other drivers and shaders pile up, the least
+ * recently used ones go once the directory grows past this. */
+#if defined(_WIN32) && !defined(_XBOX)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#define HAVE_GLSL_BINARY_CACHE_LRU
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+#define HAVE_GLSL_BINARY_CACHE_LRU
+#endif
+#define GLSL_BINARY_CACHE_MAX_SIZE   (64 * 1024 * 1024)
+#define GLSL_BINARY_CACHE_PRUNE_SIZE (GLSL_BINARY_CACHE_MAX_SIZE / 4 * 3)
+#endif
+
 /* Cache the VBO. */
 struct cache_vbo
 {
@@ -105,6 +131,17 @@ struct shader_uniforms
    struct shader_uniforms_frame feedback;
    struct shader_uniforms_frame pass[GFX_MAX_SHADERS];
    struct shader_uniforms_frame prev[PREV_TEXTURES];
+
+   /* #pragma parameters and state tracker variables,
+    * with the value last uploaded to the program. */
+   int parameters[GFX_MAX_PARAMETERS];
+   float parameters_value[GFX_MAX_PARAMETERS];
+   int state[GFX_MAX_VARIABLES];
+   float state_value[GFX_MAX_VARIABLES];
+
+   /* Last uniform looked up by name through set_parameter. */
+   char lookup_ident[64];
+   int lookup;
 };
 
 
@@ -151,6 +188,14 @@ typedef struct glsl_shader_data
    struct shader_program_glsl_data prg[GFX_MAX_SHADERS];
    GLuint lut_textures[GFX_MAX_TEXTURES];
    state_tracker_t *state_tracker;
+
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+   bool binary_cache;
+   char binary_cache_dir[PATH_MAX_LENGTH];
+   char binary_cache_driver[512];
+   unsigned binary_cache_hits;
+   unsigned binary_cache_misses;
+#endif
 } glsl_shader_data_t;
 
 static bool glsl_core;
@@ -310,6 +355,230 @@ static bool gl_glsl_link_program(GLuint prog)
    return true;
 }
 
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+#ifdef HAVE_GLSL_BINARY_CACHE_LRU
+typedef struct glsl_binary_cache_file
+{
+   const char *path;
+   int64_t mtime;
+   int64_t size;
+} glsl_binary_cache_file_t;
+
+static int gl_glsl_binary_cache_file_cmp(const void *a, const void *b)
+{
+   const glsl_binary_cache_file_t *fa = (const glsl_binary_cache_file_t*)a;
+   const glsl_binary_cache_file_t *fb = (const glsl_binary_cache_file_t*)b;
+
+   if (fa->mtime != fb->mtime)
+      return fa->mtime < fb->mtime ? -1 : 1;
+   return 0;
+}
+
+/**
+ * gl_glsl_binary_cache_prune:
+ * @dir                 : directory of the binary cache
+ *
+ * Adds up the size of the cached binaries and, if they take
+ * more than GLSL_BINARY_CACHE_MAX_SIZE, deletes the least recently
+ * used ones until GLSL_BINARY_CACHE_PRUNE_SIZE is left.
+ **/
+static void gl_glsl_binary_cache_prune(const char *dir)
+{
+   size_t i;
+   size_t count                    = 0;
+   int64_t total                   = 0;
+   glsl_binary_cache_file_t *files = NULL;
+   struct string_list *list        = dir_list_new(dir, "bin", false, false);
+
+   if (!list)
+      return;
+
+   files = (glsl_binary_cache_file_t*)calloc(MAX(list->size, 1),
+         sizeof(*files));
+   if (!files)
+   {
+      string_list_free(list);
+      return;
+   }
+
+   for (i = 0; i < list->size; i++)
+   {
+      struct stat st;
+
+      if (stat(list->elems[i].data, &st) != 0)
+         continue;
+
+      files[count].path  = list->elems[i].data;
+      files[count].mtime = st.st_mtime;
+      files[count].size  = st.st_size;
+      total             += st.st_size;
+      count++;
+   }
+
+   if (total > GLSL_BINARY_CACHE_MAX_SIZE)
+   {
+      qsort(files, count, sizeof(*files), gl_glsl_binary_cache_file_cmp);
+
+      for (i = 0; i < count && total > GLSL_BINARY_CACHE_PRUNE_SIZE; i++)
+         if (remove(files[i].path) == 0)
+            total -= files[i].size;
+
+      RARCH_LOG("[GLSL]: Pruned program binary cache to %u KB.\n",
+            (unsigned)(total / 1024));
+   }
+
+   free(files);
+   string_list_free(list);
+}
+#endif
+
+static void gl_glsl_init_binary_cache(glsl_shader_data_t *glsl)
+{
+   GLint formats         = 0;
+   settings_t *settings  = config_get_ptr();
+   const char *vendor    = (const char*)glGetString(GL_VENDOR);
+   const char *renderer  = (const char*)glGetString(GL_RENDERER);
+   const char *version   = (const char*)glGetString(GL_VERSION);
+
+   glsl->binary_cache    = false;
+
+   if (!settings->video.shader_binary_cache
+         || string_is_empty(settings->directory.cache))
+      return;
+
+#ifndef HAVE_OPENGLES
+   if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+      return;
+#endif
+
+   glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+   if (formats <= 0)
+      return;
+
+   fill_pathname_join(glsl->binary_cache_dir, settings->directory.cache,
+         "shaders", sizeof(glsl->binary_cache_dir));
+   if (!path_is_directory(glsl->binary_cache_dir)
+         && !path_mkdir(glsl->binary_cache_dir))
+      return;
+
+   /* Binaries are only good for the driver that made them. */
+   snprintf(glsl->binary_cache_driver, sizeof(glsl->binary_cache_driver),
+         "%s\n%s\n%s\n%u.%u%s",
+         vendor   ? vendor   : "",
+         renderer ? renderer : "",
+         version  ? version  : "",
+         glsl_major, glsl_minor, glsl_core ? " core" : "");
+
+#ifdef HAVE_GLSL_BINARY_CACHE_LRU
+   gl_glsl_binary_cache_prune(glsl->binary_cache_dir);
+#endif
+
+   glsl->binary_cache = true;
+}
+
+/**
+ * gl_glsl_binary_cache_path:
+ * @glsl                : GLSL shader handle
+ * @program_info        : sources of the program
+ * @path                : the path of the cached binary
+ * @size                : size of @path
+ *
+ * The cached binary is named after the MD5 of everything
+ * that goes into compiling the program: the driver string,
+ * the alias defines and the vertex and fragment sources.
+ **/
+static void gl_glsl_binary_cache_path(glsl_shader_data_t *glsl,
+      const struct shader_program_info *program_info,
+      char *path, size_t size)
+{
+   unsigned i;
+   MD5_CTX ctx;
+   unsigned char digest[16];
+   char name[sizeof(digest) * 2 + 5];
+   const char *vertex   = program_info->vertex   ? program_info->vertex   : "";
+   const char *fragment = program_info->fragment ? program_info->fragment : "";
+
+   MD5_Init(&ctx);
+   MD5_Update(&ctx, glsl->binary_cache_driver,
+         strlen(glsl->binary_cache_driver) + 1);
+   MD5_Update(&ctx, glsl->alias_define, strlen(glsl->alias_define) + 1);
+   MD5_Update(&ctx, vertex,   strlen(vertex) + 1);
+   MD5_Update(&ctx, fragment, strlen(fragment) + 1);
+   MD5_Final(digest, &ctx);
+
+   for (i = 0; i < sizeof(digest); i++)
+      snprintf(name + i * 2, 3, "%02x", digest[i]);
+   strlcat(name, ".bin", sizeof(name));
+
+   fill_pathname_join(path, glsl->binary_cache_dir, name, size);
+}
+
+static bool gl_glsl_load_program_binary(GLuint prog, const char *path)
+{
+   GLint status      = GL_FALSE;
+   void *buf         = NULL;
+   ssize_t len       = 0;
+   const uint32_t *header;
+
+   if (!path_file_exists(path))
+      return false;
+
+   if (!filestream_read_file(path, &buf, &len))
+      return false;
+
+   header = (const uint32_t*)buf;
+
+   if (len > (ssize_t)(3 * sizeof(uint32_t))
+         && header[0] == GLSL_PROGRAM_BINARY_MAGIC
+         && header[2] == (uint32_t)(len - 3 * sizeof(uint32_t)))
+   {
+      glProgramBinary(prog, (GLenum)header[1], header + 3, header[2]);
+      glGetProgramiv(prog, GL_LINK_STATUS, &status);
+   }
+
+   free(buf);
+
+#ifdef HAVE_GLSL_BINARY_CACHE_LRU
+   /* Used now, pruned last. */
+   if (status == GL_TRUE)
+      utime(path, NULL);
+#endif
+
+   /* Stale or corrupt binaries are rewritten
+    * once the program is compiled again. */
+   return status == GL_TRUE;
+}
+
+static void gl_glsl_save_program_binary(GLuint prog, const char *path)
+{
+   GLint len         = 0;
+   GLsizei written   = 0;
+   GLenum format     = 0;
+   uint32_t *buf     = NULL;
+
+   glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+   if (len <= 0)
+      return;
+
+   buf = (uint32_t*)malloc(3 * sizeof(uint32_t) + len);
+   if (!buf)
+      return;
+
+   glGetProgramBinary(prog, len, &written, &format, buf + 3);
+
+   if (written > 0)
+   {
+      buf[0] = GLSL_PROGRAM_BINARY_MAGIC;
+      buf[1] = format;
+      buf[2] = written;
+
+      if (!filestream_write_file(path, buf, 3 * sizeof(uint32_t) + written))
+         RARCH_WARN("[GLSL]: Failed to write program binary to %s.\n", path);
+   }
+
+   free(buf);
+}
+#endif
 
 static bool gl_glsl_compile_program(
       void *data,
@@ -320,6 +589,11 @@ static bool gl_glsl_compile_program(
    glsl_shader_data_t *glsl = (glsl_shader_data_t*)data;
    struct shader_program_glsl_data *program = (struct shader_program_glsl_data*)program_data;
    GLuint prog = glCreateProgram();
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+   char binary_path[PATH_MAX_LENGTH];
+
+   *binary_path = '\0';
+#endif
 
    if (!program)
       program = &glsl->prg[idx];
@@ -327,6 +601,29 @@ static bool gl_glsl_compile_program(
    if (!prog)
       goto error;
 
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+   if (glsl->binary_cache && (program_info->vertex || program_info->fragment))
+   {
+      gl_glsl_binary_cache_path(glsl, program_info,
+            binary_path, sizeof(binary_path));
+
+      if (gl_glsl_load_program_binary(prog, binary_path))
+      {
+         glsl->binary_cache_hits++;
+         goto linked;
+      }
+
+      /* Start over with a fresh program, the failed
+       * glProgramBinary() left this one unusable. */
+      glsl->binary_cache_misses++;
+      glDeleteProgram(prog);
+      prog = glCreateProgram();
+      if (!prog)
+         goto error;
+      glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+   }
+#endif
+
    if (program_info->vertex)
    {
       RARCH_LOG("Found GLSL vertex shader.\n");
@@ -374,6 +671,12 @@ static bool gl_glsl_compile_program(
       program->vprg = 0;
       program->fprg = 0;
 
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+      if (*binary_path)
+         gl_glsl_save_program_binary(prog, binary_path);
+
+linked:
+#endif
       glUseProgram(prog);
       glUniform1i(gl_glsl_get_uniform(glsl, prog, "Texture"), 0);
       glUseProgram(0);
@@ -584,6 +887,30 @@ static void gl_glsl_find_uniforms(glsl_shader_data_t *glsl,
    for (i = 0; i < glsl->shader->luts; i++)
       uni->lut_texture[i] = glGetUniformLocation(prog, glsl->shader->lut[i].id);
 
+   /* Parameters and state variables are set every frame, resolve
+    * them once here and keep their values in sync with the program,
+    * so only the ones that changed are uploaded again. */
+   for (i = 0; i < glsl->shader->num_parameters; i++)
+   {
+      uni->parameters[i]       = glGetUniformLocation(prog,
+            glsl->shader->parameters[i].id);
+      uni->parameters_value[i] = glsl->shader->parameters[i].current;
+      if (uni->parameters[i] >= 0)
+         glUniform1f(uni->parameters[i], uni->parameters_value[i]);
+   }
+
+   for (i = 0; i < glsl->shader->variables; i++)
+   {
+      uni->state[i]       = glGetUniformLocation(prog,
+            glsl->shader->variable[i].id);
+      uni->state_value[i] = 0.0f;
+      if (uni->state[i] >= 0)
+         glUniform1f(uni->state[i], 0.0f);
+   }
+
+   *uni->lookup_ident = '\0';
+   uni->lookup        = -1;
+
    gl_glsl_clear_uniforms_frame(&uni->orig);
    gl_glsl_find_uniforms_frame(glsl, prog, &uni->orig, "Orig");
    gl_glsl_clear_uniforms_frame(&uni->feedback);
@@ -734,6 +1061,10 @@ static void *gl_glsl_init(void *data, const char *path)
    if (!glsl->shader)
       goto error;
 
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+   gl_glsl_init_binary_cache(glsl);
+#endif
+
    if (!string_is_empty(path))
    {
       bool ret             = false;
@@ -942,6 +1273,13 @@ static void *gl_glsl_init(void *data, const char *path)
       glGenBuffers(1, &glsl->vbo[i].vbo_secondary);
    }
 
+#ifdef HAVE_GLSL_PROGRAM_BINARY
+   if (glsl->binary_cache)
+      RARCH_LOG("[GLSL]: %u of %u programs loaded from the binary cache.\n",
+            glsl->binary_cache_hits,
+            glsl->binary_cache_hits + glsl->binary_cache_misses);
+#endif
+
    return glsl;
 
 error:
@@ -967,7 +1305,19 @@ static void gl_glsl_set_uniform_parameter(
       return;
 
    if (param->lookup.enable)
-      location = glGetUniformLocation(glsl->prg[param->lookup.idx].id, param->lookup.ident);
+   {
+      struct shader_uniforms *uni = &glsl->uniforms[param->lookup.idx];
+
+      if (!string_is_equal(uni->lookup_ident, param->lookup.ident))
+      {
+         strlcpy(uni->lookup_ident, param->lookup.ident,
+               sizeof(uni->lookup_ident));
+         uni->lookup = glGetUniformLocation(
+               glsl->prg[param->lookup.idx].id, param->lookup.ident);
+      }
+
+      location = uni->lookup;
+   }
    else
       location = param->location;
 
@@ -1022,7 +1372,7 @@ static void gl_glsl_set_params(void *data, void *shader_data,
    struct glsl_attrib attribs[32];
    float input_size[2], output_size[2], texture_size[2];
    unsigned texunit = 1;
-   const struct shader_uniforms *uni = NULL;
+   struct shader_uniforms *uni = NULL;
    size_t size = 0, attribs_size = 0;
    const struct video_tex_info *info = (const struct video_tex_info*)_info;
    const struct video_tex_info *prev_info = (const struct video_tex_info*)_prev_info;
@@ -1034,7 +1384,7 @@ static void gl_glsl_set_params(void *data, void *shader_data,
    if (!glsl)
       return;
 
-   uni = (const struct shader_uniforms*)&glsl->uniforms[glsl->active_idx];
+   uni = &glsl->uniforms[glsl->active_idx];
 
    if (glsl->prg[glsl->active_idx].id == 0)
       return;
@@ -1215,11 +1565,13 @@ static void gl_glsl_set_params(void *data, void *shader_data,
    /* #pragma parameters. */
    for (i = 0; i < glsl->shader->num_parameters; i++)
    {
-      
-      int location = glGetUniformLocation(
-            glsl->prg[glsl->active_idx].id,
-            glsl->shader->parameters[i].id);
-      glUniform1f(location, glsl->shader->parameters[i].current);
+      float current = glsl->shader->parameters[i].current;
+
+      if (uni->parameters[i] < 0 || uni->parameters_value[i] == current)
+         continue;
+
+      glUniform1f(uni->parameters[i], current);
+      uni->parameters_value[i] = current;
    }
 
    /* Set state parameters. */
@@ -1234,10 +1586,11 @@ static void gl_glsl_set_params(void *data, void *shader_data,
 
       for (i = 0; i < cnt; i++)
       {
-         int location = glGetUniformLocation(
-               glsl->prg[glsl->active_idx].id,
-               state_info[i].id);
-         glUniform1f(location, state_info[i].value);
+         if (uni->state[i] < 0 || uni->state_value[i] == state_info[i].value)
+            continue;
+
+         glUniform1f(uni->state[i], state_info[i].value);
+         uni->state_value[i] = state_info[i].value;
       }
    }
 }
@@ -153,8 +153,7 @@ class DeferredDisposer
 class Buffer
 {
    public:
-      Buffer(VkDevice device,
-            const VkPhysicalDeviceMemoryProperties &mem_props,
+      Buffer(VkDevice device, vk_allocator *allocator,
             size_t size, VkBufferUsageFlags usage);
       ~Buffer();
 
@@ -167,15 +166,14 @@ class Buffer
    private:
       VkDevice device;
       VkBuffer buffer;
-      VkDeviceMemory memory;
+      vk_allocation allocation;
       size_t size;
 };
 
 class Framebuffer
 {
    public:
-      Framebuffer(VkDevice device,
-            const VkPhysicalDeviceMemoryProperties &mem_props,
+      Framebuffer(VkDevice device, vk_allocator *allocator,
             const Size2D &max_size, VkFormat format);
 
       ~Framebuffer();
@@ -195,7 +193,7 @@ class Framebuffer
 
    private:
       VkDevice device = VK_NULL_HANDLE;
-      const VkPhysicalDeviceMemoryProperties &memory_properties;
+      vk_allocator *allocator;
       VkImage image = VK_NULL_HANDLE;
       VkImageView view = VK_NULL_HANDLE;
       Size2D size;
@@ -204,12 +202,7 @@ class Framebuffer
       VkFramebuffer framebuffer = VK_NULL_HANDLE;
       VkRenderPass render_pass = VK_NULL_HANDLE;
 
-      struct
-      {
-         size_t size = 0;
-         uint32_t type = 0;
-         VkDeviceMemory memory = VK_NULL_HANDLE;
-      } memory;
+      vk_allocation memory = {};
 
       void init(DeferredDisposer *disposer);
       void init_framebuffer();
@@ -218,8 +211,7 @@ class Framebuffer
 
 struct CommonResources
 {
-   CommonResources(VkDevice device,
-         const VkPhysicalDeviceMemoryProperties &memory_properties);
+   CommonResources(VkDevice device, vk_allocator *allocator);
    ~CommonResources();
 
    unique_ptr<Buffer> vbo;
@@ -244,11 +236,10 @@ struct CommonResources
 class Pass
 {
    public:
-      Pass(VkDevice device,
-            const VkPhysicalDeviceMemoryProperties &memory_properties,
+      Pass(VkDevice device, vk_allocator *allocator,
             VkPipelineCache cache, unsigned num_sync_indices, bool final_pass) :
          device(device),
-         memory_properties(memory_properties),
+         allocator(allocator),
          cache(cache),
          num_sync_indices(num_sync_indices),
          final_pass(final_pass)
@@ -340,7 +331,7 @@ class Pass
 
    private:
       VkDevice device;
-      const VkPhysicalDeviceMemoryProperties &memory_properties;
+      vk_allocator *allocator;
       VkPipelineCache cache;
       unsigned num_sync_indices;
       unsigned sync_index;
@@ -449,7 +440,7 @@ struct vulkan_filter_chain
    private:
       VkDevice device;
       VkPhysicalDevice gpu;
-      const VkPhysicalDeviceMemoryProperties &memory_properties;
+      vk_allocator *allocator;
       VkPipelineCache cache;
       vector<unique_ptr<Pass>> passes;
       vector<vulkan_filter_chain_pass_info> pass_info;
@@ -488,9 +479,9 @@ vulkan_filter_chain::vulkan_filter_chain(
       const vulkan_filter_chain_create_info &info)
    : device(info.device),
      gpu(info.gpu),
-     memory_properties(*info.memory_properties),
+     allocator(info.allocator),
      cache(info.pipeline_cache),
-     common(info.device, *info.memory_properties),
+     common(info.device, info.allocator),
      original_format(info.original_format)
 {
    max_input_size = { info.max_input_size.width, info.max_input_size.height };
@@ -535,7 +526,7 @@ void vulkan_filter_chain::set_num_passes(unsigned num_passes)
    passes.reserve(num_passes);
    for (unsigned i = 0; i < num_passes; i++)
    {
-      passes.emplace_back(new Pass(device, memory_properties,
+      passes.emplace_back(new Pass(device, allocator,
                cache, deferred_calls.size(), i + 1 == num_passes));
       passes.back()->set_common_resources(&common);
       passes.back()->set_pass_number(i);
@@ -666,7 +657,7 @@ bool vulkan_filter_chain::init_history()
 
    for (unsigned i = 0; i < required_images; i++)
    {
-      original_history.emplace_back(new Framebuffer(device, memory_properties,
+      original_history.emplace_back(new Framebuffer(device, allocator,
                max_input_size, original_format));
    }
 
@@ -790,7 +781,7 @@ bool vulkan_filter_chain::init_ubo()
    if (common.ubo_offset != 0)
    {
       common.ubo = unique_ptr<Buffer>(new Buffer(device,
-               memory_properties, common.ubo_offset * deferred_calls.size(),
+               allocator, common.ubo_offset * deferred_calls.size(),
                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT));
    }
 
@@ -970,8 +961,7 @@ void vulkan_filter_chain::build_viewport_pass(
       pass->end_frame();
 }
 
-Buffer::Buffer(VkDevice device,
-      const VkPhysicalDeviceMemoryProperties &mem_props,
+Buffer::Buffer(VkDevice device, vk_allocator *allocator,
       size_t size, VkBufferUsageFlags usage) :
    device(device), size(size)
 {
@@ -984,35 +974,31 @@ Buffer::Buffer(VkDevice device,
 
    vkGetBufferMemoryRequirements(device, buffer, &mem_reqs);
 
-   VkMemoryAllocateInfo alloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-   alloc.allocationSize       = mem_reqs.size;
-
-   alloc.memoryTypeIndex      = find_memory_type(
-         mem_props, mem_reqs.memoryTypeBits,
+   uint32_t type = find_memory_type(
+         *vulkan_allocator_memory_properties(allocator),
+         mem_reqs.memoryTypeBits,
          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
          | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-   vkAllocateMemory(device, &alloc, NULL, &memory);
-   vkBindBufferMemory(device, buffer, memory, 0);
+   // The VBO and UBO live and die with the chain.
+   vulkan_allocator_alloc(allocator, &mem_reqs, type,
+         false, VULKAN_ALLOC_LINEAR, &allocation);
+   vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
 }
 
 void *Buffer::map()
 {
-   void *ptr = nullptr;
-   if (vkMapMemory(device, memory, 0, size, 0, &ptr) == VK_SUCCESS)
-      return ptr;
-   return nullptr;
+   // Host visible memory is kept mapped by the allocator.
+   return allocation.mapped;
 }
 
 void Buffer::unmap()
 {
-   vkUnmapMemory(device, memory);
 }
 
 Buffer::~Buffer()
 {
-   if (memory != VK_NULL_HANDLE)
-      vkFreeMemory(device, memory, nullptr);
+   vulkan_allocator_release(&allocation);
    if (buffer != VK_NULL_HANDLE)
       vkDestroyBuffer(device, buffer, nullptr);
 }
@@ -1340,7 +1326,7 @@ bool Pass::init_pipeline()
 }
 
 CommonResources::CommonResources(VkDevice device,
-      const VkPhysicalDeviceMemoryProperties &memory_properties)
+      vk_allocator *allocator)
    : device(device)
 {
    // The final pass uses an MVP designed for [0, 1] range VBO.
@@ -1360,7 +1346,7 @@ CommonResources::CommonResources(VkDevice device,
    };
 
    vbo = unique_ptr<Buffer>(new Buffer(device,
-            memory_properties, sizeof(vbo_data), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+            allocator, sizeof(vbo_data), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
 
    void *ptr = vbo->map();
    memcpy(ptr, vbo_data, sizeof(vbo_data));
@@ -1424,7 +1410,7 @@ bool Pass::init_feedback()
       return false;
 
    framebuffer_feedback = unique_ptr<Framebuffer>(
-         new Framebuffer(device, memory_properties,
+         new Framebuffer(device, allocator,
             current_framebuffer_size,
             pass_info.rt_format));
    return true;
@@ -1438,7 +1424,7 @@ bool Pass::build()
    if (!final_pass)
    {
       framebuffer = unique_ptr<Framebuffer>(
-            new Framebuffer(device, memory_properties,
+            new Framebuffer(device, allocator,
                current_framebuffer_size,
                pass_info.rt_format));
    }
@@ -1758,10 +1744,10 @@ void Pass::build_commands(
 
 Framebuffer::Framebuffer(
       VkDevice device,
-      const VkPhysicalDeviceMemoryProperties &mem_props,
+      vk_allocator *allocator,
       const Size2D &max_size, VkFormat format) :
    device(device),
-   memory_properties(mem_props),
+   allocator(allocator),
    size(max_size),
    format(format)
 {
@@ -1851,31 +1837,29 @@ void Framebuffer::init(DeferredDisposer *disposer)
 
    vkGetImageMemoryRequirements(device, image, &mem_reqs);
 
-   VkMemoryAllocateInfo alloc = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-   alloc.allocationSize   = mem_reqs.size;
-   alloc.memoryTypeIndex  = find_memory_type_fallback(
-         memory_properties, mem_reqs.memoryTypeBits,
+   uint32_t type = find_memory_type_fallback(
+         *vulkan_allocator_memory_properties(allocator),
+         mem_reqs.memoryTypeBits,
          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
    // Can reuse already allocated memory.
-   if (memory.size < mem_reqs.size || memory.type != alloc.memoryTypeIndex)
+   if (memory.size < mem_reqs.size || memory.type != type)
    {
       // Memory might still be in use since we don't want to totally stall
       // the world for framebuffer recreation.
       if (memory.memory != VK_NULL_HANDLE && disposer)
       {
-         auto d = device;
-         auto m = memory.memory;
-         disposer->defer([=] { vkFreeMemory(d, m, nullptr); });
+         auto m = memory;
+         disposer->defer([=]() mutable { vulkan_allocator_release(&m); });
       }
+      else
+         vulkan_allocator_release(&memory);
 
-      memory.type = alloc.memoryTypeIndex;
-      memory.size = mem_reqs.size;
-
-      vkAllocateMemory(device, &alloc, nullptr, &memory.memory);
+      vulkan_allocator_alloc(allocator, &mem_reqs, type,
+            true, VULKAN_ALLOC_BUDDY, &memory);
    }
 
-   vkBindImageMemory(device, image, memory.memory, 0);
+   vkBindImageMemory(device, image, memory.memory, memory.offset);
 
    VkImageViewCreateInfo view_info           = { 
       VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
@@ -1987,8 +1971,7 @@ Framebuffer::~Framebuffer()
       vkDestroyImageView(device, view, nullptr);
    if (image != VK_NULL_HANDLE)
       vkDestroyImage(device, image, nullptr);
-   if (memory.memory != VK_NULL_HANDLE)
-      vkFreeMemory(device, memory.memory, nullptr);
+   vulkan_allocator_release(&memory);
 }
 
 // C glue
@@ -79,7 +79,7 @@ struct vulkan_filter_chain_create_info
 {
    VkDevice device;
    VkPhysicalDevice gpu;
-   const VkPhysicalDeviceMemoryProperties *memory_properties;
+   struct vk_allocator *allocator;
    VkPipelineCache pipeline_cache;
    unsigned num_passes;
 
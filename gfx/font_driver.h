@@ -72,6 +72,13 @@ struct font_atlas
    uint8_t *buffer; /* Alpha channel. */
    unsigned width;
    unsigned height;
+
+   /* Glyphs were added since the driver uploaded the atlas, in
+    * the rows from dirty_y to dirty_y + dirty_height. Renderers
+    * set it, drivers clear it once they uploaded the rows. */
+   bool dirty;
+   unsigned dirty_y;
+   unsigned dirty_height;
 };
 
 struct font_params
@@ -111,7 +118,7 @@ typedef struct font_renderer_driver
 {
    void *(*init)(const char *font_path, float font_size);
 
-   const struct font_atlas *(*get_atlas)(void *data);
+   struct font_atlas *(*get_atlas)(void *data);
 
    /* Returns NULL if no glyph for this code is found. */
    const struct font_glyph *(*get_glyph)(void *data, uint32_t code);
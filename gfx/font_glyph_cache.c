@@ -0,0 +1,389 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <retro_miscellaneous.h>
+
+#include "font_glyph_cache.h"
+#include "video_driver.h"
+
+/* Largest atlas dimensions, anything GLES2 and up handles. */
+#define FONT_GLYPH_CACHE_MAX_WIDTH   2048
+#define FONT_GLYPH_CACHE_MAX_HEIGHT  2048
+
+/* Cells the atlas starts with, at least. */
+#define FONT_GLYPH_CACHE_MIN_CELLS   128
+
+/* A glyph bleeds into its neighbours with linear filtering
+ * without an empty texel in between. */
+#define FONT_GLYPH_CACHE_PADDING     1
+
+/* Code points remembered as missing from the font, by hash.
+ * No code point is 0xffffffff, it marks a free slot. */
+#define FONT_GLYPH_CACHE_MISSES      256
+#define FONT_GLYPH_CACHE_NO_CODE     0xffffffff
+
+typedef struct font_glyph_cache_entry
+{
+   struct font_glyph glyph;
+   uint32_t code;
+   /* Video frame the glyph was last asked for in. */
+   uint64_t frame;
+   /* Next entry in the hash bucket. */
+   int hash_next;
+   /* Most recently used first. */
+   int lru_prev;
+   int lru_next;
+} font_glyph_cache_entry_t;
+
+struct font_glyph_cache
+{
+   struct font_atlas atlas;
+
+   font_glyph_cache_has_glyph_t has_glyph;
+   font_glyph_cache_rasterize_t rasterize;
+   void *userdata;
+
+   uint32_t misses[FONT_GLYPH_CACHE_MISSES];
+
+   unsigned cell_width;
+   unsigned cell_height;
+   unsigned columns;
+
+   /* Entry i owns cell i of the atlas. */
+   font_glyph_cache_entry_t *entries;
+   unsigned max_cells;
+   /* Cells that fit in the atlas as it is now. */
+   unsigned cells;
+   /* Cells handed out so far, from the start of the atlas. */
+   unsigned used;
+
+   /* Cells given back by glyphs the font turned out not to have. */
+   int *free_cells;
+   unsigned free_count;
+
+   int *buckets;
+   unsigned bucket_mask;
+
+   int lru_head;
+   int lru_tail;
+};
+
+static void font_glyph_cache_lru_unlink(font_glyph_cache_t *cache, int i)
+{
+   font_glyph_cache_entry_t *entry = &cache->entries[i];
+
+   if (entry->lru_prev >= 0)
+      cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+   else
+      cache->lru_head = entry->lru_next;
+
+   if (entry->lru_next >= 0)
+      cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+   else
+      cache->lru_tail = entry->lru_prev;
+
+   entry->lru_prev = -1;
+   entry->lru_next = -1;
+}
+
+static void font_glyph_cache_lru_push(font_glyph_cache_t *cache, int i)
+{
+   font_glyph_cache_entry_t *entry = &cache->entries[i];
+
+   entry->lru_prev = -1;
+   entry->lru_next = cache->lru_head;
+
+   if (cache->lru_head >= 0)
+      cache->entries[cache->lru_head].lru_prev = i;
+   else
+      cache->lru_tail = i;
+
+   cache->lru_head = i;
+}
+
+static void font_glyph_cache_hash_remove(font_glyph_cache_t *cache, int i)
+{
+   int *link = &cache->buckets[cache->entries[i].code & cache->bucket_mask];
+
+   while (*link >= 0)
+   {
+      if (*link == i)
+      {
+         *link = cache->entries[i].hash_next;
+         break;
+      }
+      link = &cache->entries[*link].hash_next;
+   }
+
+   cache->entries[i].hash_next = -1;
+}
+
+static void font_glyph_cache_mark_dirty(font_glyph_cache_t *cache,
+      unsigned y, unsigned height)
+{
+   struct font_atlas *atlas = &cache->atlas;
+
+   if (atlas->dirty)
+   {
+      unsigned bottom = MAX(atlas->dirty_y + atlas->dirty_height, y + height);
+
+      atlas->dirty_y      = MIN(atlas->dirty_y, y);
+      atlas->dirty_height = bottom - atlas->dirty_y;
+   }
+   else
+   {
+      atlas->dirty        = true;
+      atlas->dirty_y      = y;
+      atlas->dirty_height = height;
+   }
+}
+
+/* Doubles the height of the atlas, the cells already there
+ * stay where they are. */
+static bool font_glyph_cache_grow(font_glyph_cache_t *cache)
+{
+   struct font_atlas *atlas = &cache->atlas;
+   unsigned height          = atlas->height * 2;
+   uint8_t *buffer          = NULL;
+
+   if (height > FONT_GLYPH_CACHE_MAX_HEIGHT)
+      return false;
+
+   buffer = (uint8_t*)realloc(atlas->buffer, atlas->width * height);
+   if (!buffer)
+      return false;
+
+   memset(buffer + atlas->width * atlas->height, 0,
+         atlas->width * (height - atlas->height));
+
+   atlas->buffer = buffer;
+   atlas->height = height;
+   cache->cells  = MIN(cache->columns * (height / cache->cell_height),
+         cache->max_cells);
+
+   /* The whole texture has to be created again. */
+   font_glyph_cache_mark_dirty(cache, 0, height);
+
+   return true;
+}
+
+static uint64_t font_glyph_cache_frame(void)
+{
+   return *video_driver_get_frame_count_ptr();
+}
+
+static int font_glyph_cache_alloc_cell(font_glyph_cache_t *cache,
+      uint64_t frame)
+{
+   int i;
+
+   if (cache->free_count)
+      return cache->free_cells[--cache->free_count];
+
+   if (cache->used < cache->cells
+         || font_glyph_cache_grow(cache))
+      return cache->used++;
+
+   /* Full, the least recently used glyph goes. If that one was
+    * drawn in this frame, so were all the others. */
+   i = cache->lru_tail;
+   if (i < 0 || cache->entries[i].frame == frame)
+      return -1;
+
+   font_glyph_cache_lru_unlink(cache, i);
+   font_glyph_cache_hash_remove(cache, i);
+   return i;
+}
+
+font_glyph_cache_t *font_glyph_cache_new(
+      unsigned cell_width, unsigned cell_height,
+      font_glyph_cache_has_glyph_t has_glyph,
+      font_glyph_cache_rasterize_t rasterize, void *userdata)
+{
+   unsigned i, rows, buckets;
+   font_glyph_cache_t *cache = NULL;
+
+   cell_width  += FONT_GLYPH_CACHE_PADDING;
+   cell_height += FONT_GLYPH_CACHE_PADDING;
+
+   if (!rasterize || cell_width < 2 || cell_height < 2
+         || cell_width > FONT_GLYPH_CACHE_MAX_WIDTH
+         || cell_height > FONT_GLYPH_CACHE_MAX_HEIGHT)
+      return NULL;
+
+   cache = (font_glyph_cache_t*)calloc(1, sizeof(*cache));
+   if (!cache)
+      return NULL;
+
+   cache->has_glyph    = has_glyph;
+   cache->rasterize    = rasterize;
+   cache->userdata     = userdata;
+   cache->cell_width   = cell_width;
+   cache->cell_height  = cell_height;
+   cache->lru_head     = -1;
+   cache->lru_tail     = -1;
+
+   cache->atlas.width  = MIN(next_pow2(cell_width * 16),
+         FONT_GLYPH_CACHE_MAX_WIDTH);
+   cache->columns      = cache->atlas.width / cell_width;
+
+   rows                = (FONT_GLYPH_CACHE_MIN_CELLS + cache->columns - 1)
+      / cache->columns;
+   cache->atlas.height = MIN(next_pow2(rows * cell_height),
+         FONT_GLYPH_CACHE_MAX_HEIGHT);
+
+   cache->max_cells    = cache->columns
+      * (FONT_GLYPH_CACHE_MAX_HEIGHT / cell_height);
+   cache->cells        = cache->columns
+      * (cache->atlas.height / cell_height);
+
+   buckets             = next_pow2(cache->max_cells);
+   cache->bucket_mask  = buckets - 1;
+
+   cache->atlas.buffer = (uint8_t*)calloc(cache->atlas.height,
+         cache->atlas.width);
+   cache->entries      = (font_glyph_cache_entry_t*)
+      calloc(cache->max_cells, sizeof(*cache->entries));
+   cache->free_cells   = (int*)calloc(cache->max_cells, sizeof(int));
+   cache->buckets      = (int*)malloc(buckets * sizeof(int));
+
+   if (!cache->atlas.buffer || !cache->entries
+         || !cache->free_cells || !cache->buckets)
+   {
+      font_glyph_cache_free(cache);
+      return NULL;
+   }
+
+   for (i = 0; i < buckets; i++)
+      cache->buckets[i] = -1;
+
+   for (i = 0; i < FONT_GLYPH_CACHE_MISSES; i++)
+      cache->misses[i] = FONT_GLYPH_CACHE_NO_CODE;
+
+   for (i = 0; i < cache->max_cells; i++)
+   {
+      cache->entries[i].hash_next = -1;
+      cache->entries[i].lru_prev  = -1;
+      cache->entries[i].lru_next  = -1;
+   }
+
+   font_glyph_cache_mark_dirty(cache, 0, cache->atlas.height);
+
+   return cache;
+}
+
+void font_glyph_cache_free(font_glyph_cache_t *cache)
+{
+   if (!cache)
+      return;
+
+   free(cache->atlas.buffer);
+   free(cache->entries);
+   free(cache->free_cells);
+   free(cache->buckets);
+   free(cache);
+}
+
+struct font_atlas *font_glyph_cache_get_atlas(font_glyph_cache_t *cache)
+{
+   if (!cache)
+      return NULL;
+   return &cache->atlas;
+}
+
+const struct font_glyph *font_glyph_cache_get(
+      font_glyph_cache_t *cache, uint32_t code)
+{
+   int i;
+   unsigned r, x, y;
+   uint64_t frame;
+   uint8_t *dst                    = NULL;
+   uint32_t *miss                  = NULL;
+   font_glyph_cache_entry_t *entry = NULL;
+
+   if (!cache)
+      return NULL;
+
+   frame = font_glyph_cache_frame();
+
+   for (i = cache->buckets[code & cache->bucket_mask];
+         i >= 0; i = cache->entries[i].hash_next)
+   {
+      if (cache->entries[i].code != code)
+         continue;
+
+      cache->entries[i].frame = frame;
+
+      if (cache->lru_head != i)
+      {
+         font_glyph_cache_lru_unlink(cache, i);
+         font_glyph_cache_lru_push(cache, i);
+      }
+      return &cache->entries[i].glyph;
+   }
+
+   /* Missing code points mustn't cost a cell, they'd evict
+    * a glyph in use every frame they're drawn. */
+   miss = &cache->misses[(code * 2654435761u) >> 24
+      & (FONT_GLYPH_CACHE_MISSES - 1)];
+   if (*miss == code)
+      return NULL;
+
+   if (cache->has_glyph && !cache->has_glyph(cache->userdata, code))
+   {
+      *miss = code;
+      return NULL;
+   }
+
+   i = font_glyph_cache_alloc_cell(cache, frame);
+   if (i < 0)
+      return NULL;
+
+   entry = &cache->entries[i];
+   x     = (i % cache->columns) * cache->cell_width;
+   y     = (i / cache->columns) * cache->cell_height;
+   dst   = cache->atlas.buffer + y * cache->atlas.width + x;
+
+   /* The cell may still hold an evicted glyph. */
+   for (r = 0; r < cache->cell_height; r++)
+      memset(dst + r * cache->atlas.width, 0, cache->cell_width);
+
+   memset(&entry->glyph, 0, sizeof(entry->glyph));
+
+   if (!cache->rasterize(cache->userdata, code, &entry->glyph,
+            dst, cache->atlas.width,
+            cache->cell_width  - FONT_GLYPH_CACHE_PADDING,
+            cache->cell_height - FONT_GLYPH_CACHE_PADDING))
+   {
+      cache->free_cells[cache->free_count++] = i;
+      *miss = code;
+      return NULL;
+   }
+
+   entry->glyph.atlas_offset_x = x;
+   entry->glyph.atlas_offset_y = y;
+   entry->code                 = code;
+   entry->frame                = frame;
+   entry->hash_next            = cache->buckets[code & cache->bucket_mask];
+   cache->buckets[code & cache->bucket_mask] = i;
+
+   font_glyph_cache_lru_push(cache, i);
+   font_glyph_cache_mark_dirty(cache, y, cache->cell_height);
+
+   return &entry->glyph;
+}
@@ -0,0 +1,90 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FONT_GLYPH_CACHE_H__
+#define __FONT_GLYPH_CACHE_H__
+
+#include <stdint.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+#include "font_driver.h"
+
+RETRO_BEGIN_DECLS
+
+/* Glyph atlas for the font renderers that can rasterize single
+ * glyphs (freetype, stb).
+ *
+ * Glyphs are rasterized the first time they're asked for, each one
+ * in a cell of the atlas. The atlas starts small and doubles its
+ * height when it runs out of cells; once it can't grow anymore, the
+ * least recently used glyph gives its cell up, unless it was drawn in
+ * the current frame. Added glyphs mark their rows of the atlas dirty
+ * for the font driver to upload. Code points the font doesn't have
+ * are looked up before a cell is taken and remembered.
+ *
+ * A glyph returned by font_glyph_cache_get() stays valid for the rest
+ * of the frame. */
+
+/* Returns false if the font has no glyph for @code. */
+typedef bool (*font_glyph_cache_has_glyph_t)(void *userdata,
+      uint32_t code);
+
+/* Rasterizes @code into @dst and fills in the metrics of @glyph,
+ * except for its atlas offsets. The bitmap must be clipped to
+ * @max_width x @max_height. Returns false if the font has no
+ * glyph for @code. */
+typedef bool (*font_glyph_cache_rasterize_t)(void *userdata,
+      uint32_t code, struct font_glyph *glyph,
+      uint8_t *dst, unsigned dst_pitch,
+      unsigned max_width, unsigned max_height);
+
+typedef struct font_glyph_cache font_glyph_cache_t;
+
+/**
+ * font_glyph_cache_new:
+ * @cell_width           : widest glyph to expect
+ * @cell_height          : tallest glyph to expect
+ * @has_glyph            : checks for a glyph cheaply, can be NULL
+ * @rasterize            : renders a glyph
+ * @userdata             : passed to @has_glyph and @rasterize
+ *
+ * Returns: new glyph cache with an empty atlas, NULL on error.
+ **/
+font_glyph_cache_t *font_glyph_cache_new(
+      unsigned cell_width, unsigned cell_height,
+      font_glyph_cache_has_glyph_t has_glyph,
+      font_glyph_cache_rasterize_t rasterize, void *userdata);
+
+void font_glyph_cache_free(font_glyph_cache_t *cache);
+
+struct font_atlas *font_glyph_cache_get_atlas(font_glyph_cache_t *cache);
+
+/**
+ * font_glyph_cache_get:
+ * @cache                : glyph cache
+ * @code                 : Unicode code point
+ *
+ * Returns: glyph for @code, rasterized if needed, NULL if the
+ * font doesn't have it or every cell holds a glyph drawn in
+ * the current frame.
+ **/
+const struct font_glyph *font_glyph_cache_get(
+      font_glyph_cache_t *cache, uint32_t code);
+
+RETRO_END_DECLS
+
+#endif
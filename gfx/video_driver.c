@@ -42,6 +42,7 @@
 #include "../system.h"
 #include "../command.h"
 #include "../msg_hash.h"
+#include "../input/input_driver.h"
 
 #ifdef HAVE_MENU
 #include "../menu/menu_setting.h"
@@ -55,6 +56,16 @@
 
 #define FPS_UPDATE_INTERVAL 256
 
+/* Automatic frame delay keeps a histogram of the time the core
+ * took over the last frames, in bins this many usec wide. */
+#define FRAME_DELAY_AUTO_BIN_USEC     250
+#define FRAME_DELAY_AUTO_BINS         128
+#define FRAME_DELAY_AUTO_WINDOW       512
+/* Left for the video driver to submit the frame. A fixed guess,
+ * its frame call also waits for VSync so it can't be measured. */
+#define FRAME_DELAY_AUTO_HEADROOM     2000
+#define FRAME_DELAY_AUTO_MAX          15
+
 typedef struct video_driver_state
 {
    struct
@@ -88,6 +99,29 @@ typedef struct video_driver_state
    } filter;
 } video_driver_state_t;
 
+typedef struct video_frame_delay_auto
+{
+   unsigned histogram[FRAME_DELAY_AUTO_BINS];
+   /* Bin of each frame in the window, oldest gets replaced. */
+   uint8_t window[FRAME_DELAY_AUTO_WINDOW];
+   unsigned count;
+
+   unsigned delay;
+   unsigned misses;
+   /* Frames left before the delay may grow again. */
+   unsigned hold;
+   /* Below the delay VSync was last missed at, it's raised
+    * again after a window of frames without a miss. */
+   unsigned ceiling;
+   unsigned calm;
+
+   /* Time spent in the driver's frame call during the core run,
+    * which is where it waits for VSync. */
+   retro_time_t driver_time;
+   retro_time_t last_present;
+   bool core_ran;
+} video_frame_delay_auto_t;
+
 typedef struct video_pixel_scaler
 {
    struct scaler_ctx *scaler;
@@ -113,6 +147,8 @@ static const video_poke_interface_t *video_driver_poke = NULL;
 
 static video_driver_state_t video_driver_state;
 
+static video_frame_delay_auto_t video_driver_frame_delay;
+
 /* Used for 16-bit -> 16-bit conversions that take place before
  * being passed to video driver. */
 static video_pixel_scaler_t *video_driver_scaler_ptr = NULL;
@@ -685,6 +721,8 @@ static bool init_video(void)
    /* Reset video frame count */
    video_driver_frame_count = 0;
 
+   memset(&video_driver_frame_delay, 0, sizeof(video_driver_frame_delay));
+
    tmp = input_get_ptr();
    /* Need to grab the "real" video driver interface on a reinit. */
    video_driver_find_driver();
@@ -1022,11 +1060,24 @@ bool video_monitor_get_fps(char *buf, size_t size,
       }
 
       if (buf_fps && settings->fps_show)
+      {
          snprintf(buf_fps, size_fps, "FPS: %6.1f || %s: " STRING_REP_UINT64,
                last_fps,
                msg_hash_to_str(MSG_FRAMES),
                (unsigned long long)video_driver_frame_count);
 
+         if (settings->video.frame_delay_auto)
+         {
+            char delay_text[64];
+            unsigned misses = 0;
+            unsigned delay  = video_driver_frame_delay_auto_get(&misses);
+
+            snprintf(delay_text, sizeof(delay_text),
+                  " || Delay: %u ms, %u missed", delay, misses);
+            strlcat(buf_fps, delay_text, size_fps);
+         }
+      }
+
       return ret;
    }
 
@@ -2102,6 +2153,155 @@ static bool video_pixel_frame_scale(const void *data,
    return true;
 }
 
+/* Time between two frames of the core, a swap interval above 1
+ * and black frame insertion show each frame for several refreshes. */
+static retro_time_t video_driver_frame_delay_auto_budget(void)
+{
+   settings_t *settings = config_get_ptr();
+   unsigned refreshes   = MAX(settings->video.swap_interval, 1);
+
+   if (settings->video.refresh_rate <= 0.0f)
+      return 0;
+   if (settings->video.black_frame_insertion)
+      refreshes *= 2;
+   return (retro_time_t)(1000000.0f * refreshes
+         / settings->video.refresh_rate);
+}
+
+static void video_driver_frame_delay_auto_back_off(void)
+{
+   video_frame_delay_auto_t *fd = &video_driver_frame_delay;
+
+   fd->delay /= 2;
+   /* Give it a couple of seconds before trying again. */
+   fd->hold   = FRAME_DELAY_AUTO_WINDOW / 4;
+}
+
+/* Called once the video driver returns from a frame which
+ * it started on at @start. */
+static void video_driver_frame_delay_auto_present(retro_time_t start)
+{
+   settings_t *settings         = config_get_ptr();
+   video_frame_delay_auto_t *fd = &video_driver_frame_delay;
+   retro_time_t budget          = video_driver_frame_delay_auto_budget();
+   retro_time_t now             = cpu_features_get_time_usec();
+
+   fd->driver_time += now - start;
+
+   /* Only frames following a core run tell of a missed VSync,
+    * the menu or a pause make for gaps of their own. */
+   if (fd->core_ran && fd->last_present && budget && settings->video.vsync
+         && now - fd->last_present > budget * 3 / 2)
+   {
+      fd->misses++;
+      fd->ceiling = fd->delay ? fd->delay - 1 : 0;
+      fd->calm    = 0;
+      video_driver_frame_delay_auto_back_off();
+   }
+
+   fd->core_ran     = false;
+   fd->last_present = now;
+}
+
+/**
+ * video_driver_frame_delay_auto_update:
+ * @core_time            : time core_run() took
+ *
+ * Adds a frame to the histogram automatic frame delay is based
+ * on. The delay becomes the largest which leaves the 99th
+ * percentile of the frames, plus some headroom for the video
+ * driver, within the refresh period. It drops right away, but
+ * only grows a millisecond at a time.
+ *
+ * Returns: the frame delay to use for the next frame, in ms.
+ **/
+unsigned video_driver_frame_delay_auto_update(retro_time_t core_time)
+{
+   unsigned bin, slot, i, seen, target;
+   video_frame_delay_auto_t *fd = &video_driver_frame_delay;
+   retro_time_t budget          = video_driver_frame_delay_auto_budget();
+   /* Waiting on VSync isn't work. */
+   retro_time_t work            = core_time - fd->driver_time;
+
+   fd->driver_time = 0;
+   fd->core_ran    = true;
+
+   if (!budget)
+      return 0;
+
+   if (!fd->count)
+      fd->ceiling = FRAME_DELAY_AUTO_MAX;
+   else if (++fd->calm >= FRAME_DELAY_AUTO_WINDOW)
+   {
+      if (fd->ceiling < FRAME_DELAY_AUTO_MAX)
+         fd->ceiling++;
+      fd->calm = 0;
+   }
+
+   if (work < 0)
+      work = 0;
+
+   bin  = (unsigned)(work / FRAME_DELAY_AUTO_BIN_USEC);
+   if (bin >= FRAME_DELAY_AUTO_BINS)
+      bin = FRAME_DELAY_AUTO_BINS - 1;
+   slot = fd->count++ % FRAME_DELAY_AUTO_WINDOW;
+
+   if (fd->count > FRAME_DELAY_AUTO_WINDOW)
+      fd->histogram[fd->window[slot]]--;
+   fd->window[slot] = bin;
+   fd->histogram[bin]++;
+
+   /* Overran the budget, VSync may just have been made. */
+   if (fd->delay && work + fd->delay * 1000
+         + FRAME_DELAY_AUTO_HEADROOM > budget)
+      video_driver_frame_delay_auto_back_off();
+
+   if (fd->hold)
+      fd->hold--;
+
+   /* Wait for enough frames for a 99th percentile. */
+   if (fd->count < FRAME_DELAY_AUTO_WINDOW / 4)
+      return fd->delay;
+
+   seen = 0;
+   i    = FRAME_DELAY_AUTO_BINS;
+   while (i > 0)
+   {
+      seen += fd->histogram[--i];
+      if (seen * 100 > MIN(fd->count, FRAME_DELAY_AUTO_WINDOW))
+         break;
+   }
+
+   work = (i + 1) * FRAME_DELAY_AUTO_BIN_USEC + FRAME_DELAY_AUTO_HEADROOM;
+   target = work < budget ? (unsigned)((budget - work) / 1000) : 0;
+   if (target > fd->ceiling)
+      target = fd->ceiling;
+
+   if (target < fd->delay)
+      fd->delay = target;
+   else if (target > fd->delay && !fd->hold)
+   {
+      fd->delay++;
+      /* Let the new delay show in a few frames first. */
+      fd->hold = 8;
+   }
+
+   return fd->delay;
+}
+
+/**
+ * video_driver_frame_delay_auto_get:
+ * @misses               : receives the frames which missed VSync
+ *
+ * Returns: the frame delay picked automatically, in ms.
+ **/
+unsigned video_driver_frame_delay_auto_get(unsigned *misses)
+{
+   if (misses)
+      *misses = video_driver_frame_delay.misses;
+   return video_driver_frame_delay.delay;
+}
+
 /**
  * video_driver_frame:
  * @data                 : pointer to data of the video frame.
@@ -2118,6 +2318,7 @@ void video_driver_frame(const void *data, unsigned width,
    unsigned output_width  = 0;
    unsigned output_height = 0;
    unsigned  output_pitch = 0;
+   retro_time_t driver_time;
    const char *msg        = NULL;
    settings_t *settings   = config_get_ptr();
 
@@ -2162,6 +2363,8 @@ void video_driver_frame(const void *data, unsigned width,
    if (msg)
       strlcpy(video_driver_msg, msg, sizeof(video_driver_msg));
 
+   driver_time = cpu_features_get_time_usec();
+
    if (!current_video || !current_video->frame(
             video_driver_data, data, width, height,
             video_driver_frame_count,
@@ -2170,6 +2373,11 @@ void video_driver_frame(const void *data, unsigned width,
       video_driver_unset_active();
    }
 
+   if (settings->video.frame_delay_auto)
+      video_driver_frame_delay_auto_present(driver_time);
+
+   input_driver_frame_presented();
+
    video_driver_frame_count++;
 }
 
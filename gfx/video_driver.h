@@ -504,6 +504,25 @@ unsigned video_pixel_get_alignment(unsigned pitch);
 
 const video_poke_interface_t *video_driver_get_poke(void);
 
+/**
+ * video_driver_frame_delay_auto_update:
+ * @core_time            : time core_run() took
+ *
+ * Adds a frame to the histogram automatic frame delay is based
+ * on, and picks the delay for the next one.
+ *
+ * Returns: the frame delay to use for the next frame, in ms.
+ **/
+unsigned video_driver_frame_delay_auto_update(retro_time_t core_time);
+
+/**
+ * video_driver_frame_delay_auto_get:
+ * @misses               : receives the frames which missed VSync
+ *
+ * Returns: the frame delay picked automatically, in ms.
+ **/
+unsigned video_driver_frame_delay_auto_get(unsigned *misses);
+
 /**
  * video_driver_frame:
  * @data                 : pointer to data of the video frame.
@@ -321,6 +321,7 @@ FONTS
 
 #include "../gfx/drivers_font_renderer/bitmapfont.c"
 #include "../gfx/font_driver.c"
+#include "../gfx/font_glyph_cache.c"
 
 #if defined(HAVE_STB_FONT)
 #include "../gfx/drivers_font_renderer/stb.c"
@@ -807,8 +808,10 @@ NETPLAY
 #ifdef HAVE_NETPLAY
 #include "../network/netplay/netplay_net.c"
 #include "../network/netplay/netplay_spectate.c"
+#include "../network/netplay/netplay_spectate_server.c"
 #include "../network/netplay/netplay_common.c"
 #include "../network/netplay/netplay.c"
+#include "../network/net_memwatch.c"
 #include "../libretro-common/net/net_compat.c"
 #include "../libretro-common/net/net_socket.c"
 #include "../libretro-common/net/net_http.c"
@@ -825,6 +828,7 @@ DATA RUNLOOP
 #include "../tasks/task_save_ram.c"
 #include "../tasks/task_save_state.c"
 #include "../tasks/task_image.c"
+#include "../tasks/task_autodetect.c"
 #include "../tasks/task_file_transfer.c"
 #ifdef HAVE_ZLIB
 #include "../tasks/task_decompress.c"
@@ -873,6 +877,7 @@ MENU
 #include "../menu/menu_shader.c"
 #include "../menu/menu_navigation.c"
 #include "../menu/menu_display.c"
+#include "../menu/menu_thumbnail_cache.c"
 #include "../menu/menu_displaylist.c"
 #include "../menu/menu_animation.c"
 
@@ -990,7 +995,6 @@ XML
  LIBRETRODB
 ============================================================ */
 #ifdef HAVE_LIBRETRODB
-#include "../libretro-db/bintree.c"
 #include "../libretro-db/libretrodb.c"
 #include "../libretro-db/rmsgpack.c"
 #include "../libretro-db/rmsgpack_dom.c"
@@ -34,20 +34,32 @@
 
 #include <file/file_path.h>
 #include <string/stdstring.h>
+#include <features/features_cpu.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "../drivers_keyboard/keyboard_event_udev.h"
 #include "../common/linux_common.h"
 
 #include "../input_config.h"
+#include "../input_driver.h"
 #include "../input_joypad_driver.h"
 #include "../input_keymaps.h"
 #include "../../general.h"
+#include "../../performance_counters.h"
 #include "../../verbosity.h"
 
 #ifdef HAVE_CONFIG_H
 #include "../../config.h"
 #endif
 
+/* Events the input thread queues up between two polls. Once
+ * it's full the thread waits, the rest stay with the kernel. */
+#define UDEV_EVENT_QUEUE_SIZE 1024
+#define UDEV_EVENT_QUEUE_MASK (UDEV_EVENT_QUEUE_SIZE - 1)
+
 typedef struct udev_input udev_input_t;
 
 typedef void (*device_handle_cb)(void *data,
@@ -58,6 +70,8 @@ struct udev_input_device
    int fd;
    dev_t dev;
    device_handle_cb handle_cb;
+   /* Event timestamps are on the monotonic clock. */
+   bool monotonic;
    char devnode[PATH_MAX_LENGTH];
 
    union
@@ -77,6 +91,15 @@ struct udev_input_device
    } state;
 };
 
+#ifdef HAVE_THREADS
+typedef struct udev_input_event
+{
+   struct input_event event;
+   /* NULL once the device was removed. */
+   udev_input_device_t *device;
+} udev_input_event_t;
+#endif
+
 struct udev_input
 {
    bool blocked;
@@ -93,6 +116,21 @@ struct udev_input
    int16_t mouse_x;
    int16_t mouse_y;
    bool mouse_l, mouse_r, mouse_m, mouse_wu, mouse_wd, mouse_whu, mouse_whd;
+
+#ifdef HAVE_THREADS
+   /* Blocks on the epoll set and queues the events read,
+    * they get handled on the next poll. The lock guards the
+    * queue and the device list. */
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   int wakeup_fds[2];
+   bool thread_quit;
+
+   udev_input_event_t *queue;
+   unsigned queue_head;
+   unsigned queue_tail;
+#endif
 };
 
 #ifdef HAVE_XKBCOMMON
@@ -261,6 +299,15 @@ static bool add_device(udev_input_t *udev,
    device->dev       = st.st_dev;
    device->handle_cb = cb;
 
+#ifdef EVIOCSCLOCKID
+   {
+      /* Same clock as cpu_features_get_time_usec(),
+       * so the age of events can be told. */
+      int clock_id      = CLOCK_MONOTONIC;
+      device->monotonic = ioctl(fd, EVIOCSCLOCKID, &clock_id) == 0;
+   }
+#endif
+
    strlcpy(device->devnode, devnode, sizeof(device->devnode));
 
    /* Touchpads report in absolute coords. */
@@ -305,6 +352,17 @@ static void udev_input_remove_device(udev_input_t *udev, const char *devnode)
       if (!string_is_equal(devnode, udev->devices[i]->devnode))
          continue;
 
+#ifdef HAVE_THREADS
+      if (udev->queue)
+      {
+         unsigned j;
+
+         for (j = udev->queue_tail; j != udev->queue_head; j++)
+            if (udev->queue[j & UDEV_EVENT_QUEUE_MASK].device == udev->devices[i])
+               udev->queue[j & UDEV_EVENT_QUEUE_MASK].device = NULL;
+      }
+#endif
+
       close(udev->devices[i]->fd);
       free(udev->devices[i]);
       memmove(udev->devices + i, udev->devices + i + 1,
@@ -367,6 +425,213 @@ end:
    udev_device_unref(dev);
 }
 
+static void udev_input_handle_event(udev_input_t *udev,
+      const struct input_event *event, udev_input_device_t *device)
+{
+   static struct retro_perf_counter input_age_poll = {0};
+
+   /* One report per SYN_REPORT, the age of which is how
+    * long it waited to be polled. */
+   if (device->monotonic && event->type == EV_SYN
+         && event->code == SYN_REPORT)
+   {
+      retro_time_t time = event->time.tv_sec * INT64_C(1000000)
+         + event->time.tv_usec;
+
+      performance_counter_init(&input_age_poll, "input_age_poll_usec");
+      performance_counter_add_span(&input_age_poll, time);
+      input_driver_set_event_time(time);
+   }
+
+   device->handle_cb(udev, event, device);
+}
+
+#ifdef HAVE_THREADS
+static bool udev_input_has_device(udev_input_t *udev,
+      const udev_input_device_t *device)
+{
+   unsigned i;
+
+   for (i = 0; i < udev->num_devices; i++)
+      if (udev->devices[i] == device)
+         return true;
+
+   return false;
+}
+
+/* Queues what @device has to read, called with the lock held. */
+static void udev_input_thread_read(udev_input_t *udev,
+      udev_input_device_t *device)
+{
+   for (;;)
+   {
+      int j, len;
+      unsigned space;
+      struct input_event input_events[32];
+
+      while (!udev->thread_quit && udev->queue_head - udev->queue_tail
+            == UDEV_EVENT_QUEUE_SIZE)
+         scond_wait(udev->cond, udev->lock);
+
+      /* The device might have been removed while waiting. */
+      if (udev->thread_quit || !udev_input_has_device(udev, device))
+         return;
+
+      space = UDEV_EVENT_QUEUE_SIZE - (udev->queue_head - udev->queue_tail);
+      if (space > ARRAY_SIZE(input_events))
+         space = ARRAY_SIZE(input_events);
+
+      len = read(device->fd, input_events, space * sizeof(*input_events));
+      if (len <= 0)
+         return;
+
+      len /= sizeof(*input_events);
+      for (j = 0; j < len; j++)
+      {
+         udev_input_event_t *entry = &udev->queue[
+            udev->queue_head++ & UDEV_EVENT_QUEUE_MASK];
+
+         entry->event  = input_events[j];
+         entry->device = device;
+      }
+   }
+}
+
+static void udev_input_thread(void *data)
+{
+   udev_input_t *udev = (udev_input_t*)data;
+
+   for (;;)
+   {
+      int i, ret;
+      struct epoll_event events[32];
+
+      ret = epoll_wait(udev->epfd, events, ARRAY_SIZE(events), -1);
+      if (ret < 0 && errno != EINTR)
+      {
+         RARCH_ERR("[udev]: Input thread failed to wait for events (%s).\n",
+               strerror(errno));
+         break;
+      }
+
+      slock_lock(udev->lock);
+
+      if (udev->thread_quit)
+      {
+         slock_unlock(udev->lock);
+         break;
+      }
+
+      /* The wakeup pipe has no device, it only breaks the wait. */
+      for (i = 0; i < ret; i++)
+         if ((events[i].events & EPOLLIN) && events[i].data.ptr
+               && udev_input_has_device(udev,
+                  (udev_input_device_t*)events[i].data.ptr))
+            udev_input_thread_read(udev,
+                  (udev_input_device_t*)events[i].data.ptr);
+
+      slock_unlock(udev->lock);
+   }
+}
+
+static void udev_input_thread_free(udev_input_t *udev)
+{
+   if (udev->thread)
+   {
+      char c = 0;
+
+      slock_lock(udev->lock);
+      udev->thread_quit = true;
+      scond_signal(udev->cond);
+      slock_unlock(udev->lock);
+
+      if (write(udev->wakeup_fds[1], &c, 1) != 1)
+         RARCH_WARN("[udev]: Failed to wake up input thread.\n");
+
+      sthread_join(udev->thread);
+   }
+
+   if (udev->wakeup_fds[0] >= 0)
+      close(udev->wakeup_fds[0]);
+   if (udev->wakeup_fds[1] >= 0)
+      close(udev->wakeup_fds[1]);
+   if (udev->cond)
+      scond_free(udev->cond);
+   if (udev->lock)
+      slock_free(udev->lock);
+   free(udev->queue);
+
+   udev->thread = NULL;
+   udev->cond   = NULL;
+   udev->lock   = NULL;
+   udev->queue  = NULL;
+}
+
+/**
+ * udev_input_thread_init:
+ * @udev                : udev input handle
+ *
+ * Starts reading keyboard, mouse and touchpad events on a
+ * thread of its own. They are read as soon as they arrive,
+ * instead of sitting in the kernel until the next poll.
+ *
+ * Returns: true (1) if the thread is running, otherwise false (0).
+ **/
+static bool udev_input_thread_init(udev_input_t *udev)
+{
+   struct epoll_event event = {0};
+
+   udev->wakeup_fds[0] = udev->wakeup_fds[1] = -1;
+
+   if (pipe(udev->wakeup_fds) < 0)
+      return false;
+
+   event.events   = EPOLLIN;
+   event.data.ptr = NULL;
+
+   if (epoll_ctl(udev->epfd, EPOLL_CTL_ADD, udev->wakeup_fds[0], &event) < 0)
+      goto error;
+
+   udev->queue = (udev_input_event_t*)
+      calloc(UDEV_EVENT_QUEUE_SIZE, sizeof(*udev->queue));
+   udev->lock  = slock_new();
+   udev->cond  = scond_new();
+
+   if (!udev->queue || !udev->lock || !udev->cond)
+      goto error;
+
+   udev->thread = sthread_create(udev_input_thread, udev);
+   if (!udev->thread)
+      goto error;
+
+   return true;
+
+error:
+   udev_input_thread_free(udev);
+   return false;
+}
+
+static void udev_input_thread_poll(udev_input_t *udev)
+{
+   slock_lock(udev->lock);
+
+   while (udev_input_hotplug_available(udev))
+      udev_input_handle_hotplug(udev);
+
+   while (udev->queue_tail != udev->queue_head)
+   {
+      udev_input_event_t *entry = &udev->queue[
+         udev->queue_tail++ & UDEV_EVENT_QUEUE_MASK];
+
+      if (entry->device)
+         udev_input_handle_event(udev, &entry->event, entry->device);
+   }
+
+   scond_signal(udev->cond);
+   slock_unlock(udev->lock);
+}
+#endif
+
 static void udev_input_poll(void *data)
 {
    int i, ret;
@@ -377,6 +642,17 @@ static void udev_input_poll(void *data)
    udev->mouse_wu  = udev->mouse_wd  = 0;
    udev->mouse_whu = udev->mouse_whd = 0;
 
+#ifdef HAVE_THREADS
+   if (udev->thread)
+   {
+      udev_input_thread_poll(udev);
+
+      if (udev->joypad)
+         udev->joypad->poll();
+      return;
+   }
+#endif
+
    while (udev_input_hotplug_available(udev))
       udev_input_handle_hotplug(udev);
 
@@ -394,7 +670,7 @@ static void udev_input_poll(void *data)
          {
             len /= sizeof(*input_events);
             for (j = 0; j < len; j++)
-               device->handle_cb(udev, &input_events[j], device);
+               udev_input_handle_event(udev, &input_events[j], device);
          }
       }
    }
@@ -572,6 +848,10 @@ static void udev_input_free(void *data)
    if (udev->joypad)
       udev->joypad->destroy();
 
+#ifdef HAVE_THREADS
+   udev_input_thread_free(udev);
+#endif
+
    if (udev->epfd >= 0)
       close(udev->epfd);
 
@@ -639,6 +919,11 @@ static void *udev_input_init(void)
    if (!udev)
       return NULL;
 
+   udev->epfd = -1;
+#ifdef HAVE_THREADS
+   udev->wakeup_fds[0] = udev->wakeup_fds[1] = -1;
+#endif
+
    udev->udev = udev_new();
    if (!udev->udev)
    {
@@ -688,6 +973,16 @@ static void *udev_input_init(void)
    if (!udev->num_devices)
       RARCH_WARN("[udev]: Couldn't open any keyboard, mouse or touchpad. Are permissions set correctly for /dev/input/event*?\n");
 
+#ifdef HAVE_THREADS
+   if (settings->input.thread_enable)
+   {
+      if (udev_input_thread_init(udev))
+         RARCH_LOG("[udev]: Reading input on a separate thread.\n");
+      else
+         RARCH_WARN("[udev]: Failed to start input thread, polling instead.\n");
+   }
+#endif
+
    udev->joypad = input_joypad_init_driver(settings->input.joypad_driver, udev);
    input_keymaps_init_keyboard_lut(rarch_key_map_linux);
 
@@ -21,6 +21,7 @@
 
 #include "../connect/joypad_connection.h"
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../input_hid_driver.h"
 #include "../../configuration.h"
 #include "../../verbosity.h"
@@ -307,7 +308,7 @@ static void iohidmanager_hid_device_add_autodetect(unsigned idx,
    strlcpy(params.name, device_name, sizeof(params.name));
    strlcpy(params.driver, driver_name, sizeof(params.driver));
 
-   input_config_autoconfigure_joypad(&params);
+   task_push_joypad_autoconfigure(&params);
    RARCH_LOG("Port %d: %s.\n", idx, device_name);
 }
 
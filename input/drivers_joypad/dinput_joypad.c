@@ -26,6 +26,7 @@
 #include "../../general.h"
 #include "../../verbosity.h"
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../input_config.h"
 #include "../input_joypad_driver.h"
 #include "../input_keymaps.h"
@@ -270,7 +271,7 @@ static BOOL CALLBACK enum_joypad_cb(const DIDEVICEINSTANCE *inst, void *p)
       strlcpy(params.driver, dinput_joypad.ident, sizeof(params.driver));
       params.vid = dinput_joypad_vid(g_joypad_cnt);
       params.pid = dinput_joypad_pid(g_joypad_cnt);
-      input_config_autoconfigure_joypad(&params);
+      task_push_joypad_autoconfigure(&params);
       settings->input.pid[g_joypad_cnt] = params.pid;
       settings->input.vid[g_joypad_cnt] = params.vid;
    }
@@ -25,6 +25,7 @@
 
 #include "../common/epoll_common.h"
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../../general.h"
 #include "../../verbosity.h"
 
@@ -159,7 +160,7 @@ static void handle_plugged_pad(void)
 
                /* TODO - implement VID/PID? */
                params.idx = idx;
-               input_config_autoconfigure_joypad(&params);
+               task_push_joypad_autoconfigure(&params);
             }
          }
          /* Sometimes, device will be created before access to it is established. */
@@ -177,7 +178,7 @@ static void handle_plugged_pad(void)
                strlcpy(params.name,   linuxraw_pads[idx].ident, sizeof(params.name));
                strlcpy(params.driver, linuxraw_joypad.ident, sizeof(params.driver));
                /* TODO - implement VID/PID? */
-               input_config_autoconfigure_joypad(&params);
+               task_push_joypad_autoconfigure(&params);
             }
          }
       }
@@ -233,11 +234,11 @@ static bool linuxraw_joypad_init(void *data)
          strlcpy(params.driver, "linuxraw", sizeof(params.driver));
 
          /* TODO - implement VID/PID? */
-         input_config_autoconfigure_joypad(&params);
+         task_push_joypad_autoconfigure(&params);
          linuxraw_poll_pad(pad);
       }
       else
-         input_config_autoconfigure_joypad(&params);
+         task_push_joypad_autoconfigure(&params);
    }
 
    g_inotify = inotify_init();
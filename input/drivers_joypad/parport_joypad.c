@@ -24,6 +24,7 @@
 #include <fcntl.h>
 
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../../general.h"
 #include "../../verbosity.h"
 
@@ -302,7 +303,7 @@ static bool parport_joypad_init(void *data)
             parport_free_pad(pad);
          }
       }
-      input_config_autoconfigure_joypad(&params);
+      task_push_joypad_autoconfigure(&params);
    }
 
    return true;
@@ -15,6 +15,7 @@
  */
 
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "SDL.h"
 #include "../../general.h"
 #include "../../verbosity.h"
@@ -144,7 +145,7 @@ static void sdl_pad_connect(unsigned id)
    params.pid = product;
    strlcpy(params.driver, sdl_joypad.ident, sizeof(params.driver));
 
-   input_config_autoconfigure_joypad(&params);
+   task_push_joypad_autoconfigure(&params);
 
    RARCH_LOG("[SDL]: Device #%u (%04x:%04x) connected: %s.\n", id, vendor,
              product, sdl_pad_name(id));
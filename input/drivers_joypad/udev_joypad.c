@@ -32,6 +32,7 @@
 #include <string/stdstring.h>
 
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../../general.h"
 #include "../../verbosity.h"
 
@@ -298,7 +299,7 @@ static int udev_add_pad(struct udev_device *dev, unsigned p, int fd, const char
       settings->input.vid[p] = params.vid;
       strlcpy(settings->input.device_names[p], params.name, sizeof(settings->input.device_names[p]));
       strlcpy(params.driver, udev_joypad.ident, sizeof(params.driver));
-      input_config_autoconfigure_joypad(&params);
+      task_push_joypad_autoconfigure(&params);
 
       ret = 1;
    }
@@ -31,6 +31,7 @@
 #include <boolean.h>
 
 #include "../input_autodetect.h"
+#include "../../tasks/tasks_internal.h"
 #include "../input_config.h"
 
 #include "../../general.h"
@@ -262,7 +263,7 @@ static bool xinput_joypad_init(void *data)
          params.idx = autoconf_pad;
          strlcpy(params.name, xinput_joypad_name(autoconf_pad), sizeof(params.name));
          strlcpy(params.driver, xinput_joypad.ident, sizeof(params.driver));
-         input_config_autoconfigure_joypad(&params);
+         task_push_joypad_autoconfigure(&params);
       }
    }
 
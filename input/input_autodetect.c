@@ -14,13 +14,25 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <ctype.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include <lists/dir_list.h>
 #include <file/file_path.h>
+#include <streams/file_stream.h>
 #include <string/stdstring.h>
+#include <compat/strl.h>
+#include <retro_miscellaneous.h>
+#include <retro_stat.h>
+#include <rhash.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "input_config.h"
 #include "input_autodetect.h"
@@ -70,6 +82,7 @@ static void input_autoconfigure_joypad_conf(config_file_t *conf,
    }
 }
 
+#if defined(HAVE_BUILTIN_AUTOCONFIG)
 static int input_try_autoconfigure_joypad_from_conf(config_file_t *conf,
       autoconfig_params_t *params)
 {
@@ -131,6 +144,7 @@ static int input_try_autoconfigure_joypad_from_conf(config_file_t *conf,
 #endif
    return score;
 }
+#endif
 
 static void input_autoconfigure_joypad_add(config_file_t *conf,
       autoconfig_params_t *params)
@@ -204,72 +218,708 @@ static int input_autoconfigure_joypad_from_conf(
 }
 #endif
 
-static bool input_autoconfigure_joypad_from_conf_dir(
-      autoconfig_params_t *params)
+/* Index of the profiles in an autoconfig directory.
+ *
+ * Matching a pad used to parse every profile in the directory.
+ * The index keeps what the matching looks at (driver, VID/PID and
+ * device name) in one string blob, hashed by VID/PID and by name.
+ * It is saved to the cache directory and revalidated against the
+ * mtime and size of each profile, so only profiles that changed
+ * are parsed again. Like dir_list's cache, profiles changed within
+ * a couple of seconds of being indexed are not trusted. */
+
+#define AUTOCONF_INDEX_MAGIC      0x58444941 /* "AIDX" */
+#define AUTOCONF_INDEX_VERSION    1
+#define AUTOCONF_INDEX_BUCKETS    256
+#define AUTOCONF_INDEX_RACY_SECS  2
+#define AUTOCONF_INDEX_DIRS       4
+
+typedef struct autoconf_index_entry
 {
-   size_t i;
-   char path[PATH_MAX_LENGTH] = {0};
-   int ret                    = 0;
-   int index                  = -1;
-   int current_best           = 0;
-   config_file_t *conf        = NULL;
-   struct string_list *list   = NULL;
-
-   fill_pathname_application_special(path, sizeof(path),
-         APPLICATION_SPECIAL_DIRECTORY_AUTOCONFIG);
+   int64_t mtime;
+   int64_t size;
+   int32_t vid;
+   int32_t pid;
+   /* Offsets into the string blob. */
+   uint32_t name;
+   uint32_t ident;
+   uint32_t driver;
+   /* Next entry in the same bucket plus one, 0 ends the chain. */
+   uint32_t vid_pid_next;
+   uint32_t ident_next;
+} autoconf_index_entry_t;
+
+typedef struct autoconf_index_header
+{
+   uint32_t magic;
+   uint32_t version;
+   int64_t  dir_mtime;
+   int64_t  indexed_at;
+   uint32_t dir_len;
+   uint32_t count;
+   uint32_t strings_size;
+} autoconf_index_header_t;
+
+typedef struct autoconf_index
+{
+   char dir[PATH_MAX_LENGTH];
+   int64_t dir_mtime;
+   int64_t indexed_at;
+   /* Loaded from disk, the profiles haven't been looked at yet. */
+   bool unverified;
+
+   autoconf_index_entry_t *entries;
+   uint32_t count;
+
+   char *strings;
+   uint32_t strings_size;
+   uint32_t strings_cap;
+
+   uint32_t vid_pid_buckets[AUTOCONF_INDEX_BUCKETS];
+   uint32_t ident_buckets[AUTOCONF_INDEX_BUCKETS];
+} autoconf_index_t;
 
-   list = dir_list_new_special(path, DIR_LIST_AUTOCONFIG, "cfg");
+static autoconf_index_t *autoconf_indexes[AUTOCONF_INDEX_DIRS];
+#ifdef HAVE_THREADS
+static slock_t *autoconf_index_lock = NULL;
+#endif
+
+static void autoconf_index_free(autoconf_index_t *index)
+{
+   if (!index)
+      return;
+
+   free(index->entries);
+   free(index->strings);
+   free(index);
+}
+
+static uint32_t autoconf_index_hash_vid_pid(int32_t vid, int32_t pid)
+{
+   return ((uint32_t)vid * 31u + (uint32_t)pid) % AUTOCONF_INDEX_BUCKETS;
+}
+
+static uint32_t autoconf_index_hash_ident(const char *ident)
+{
+   return djb2_calculate(ident) % AUTOCONF_INDEX_BUCKETS;
+}
 
-   if (!list || !list->size)
+static void autoconf_index_link(autoconf_index_t *index)
+{
+   uint32_t i;
+
+   memset(index->vid_pid_buckets, 0, sizeof(index->vid_pid_buckets));
+   memset(index->ident_buckets, 0, sizeof(index->ident_buckets));
+
+   for (i = 0; i < index->count; i++)
    {
-      settings_t *settings = config_get_ptr();
-      if (list)
-         string_list_free(list);
-      list = dir_list_new_special(settings->directory.autoconfig,
-            DIR_LIST_AUTOCONFIG, "cfg");
+      autoconf_index_entry_t *entry = &index->entries[i];
+      uint32_t *vid_pid = &index->vid_pid_buckets[
+         autoconf_index_hash_vid_pid(entry->vid, entry->pid)];
+      uint32_t *ident   = &index->ident_buckets[
+         autoconf_index_hash_ident(index->strings + entry->ident)];
+
+      entry->vid_pid_next = *vid_pid;
+      *vid_pid            = i + 1;
+      entry->ident_next   = *ident;
+      *ident              = i + 1;
    }
+}
 
-   if(!list)
-      return false;
+static uint32_t autoconf_index_add_string(autoconf_index_t *index,
+      const char *s)
+{
+   uint32_t offset = index->strings_size;
+   uint32_t len    = (uint32_t)strlen(s) + 1;
+
+   if (index->strings_size + len > index->strings_cap)
+   {
+      uint32_t cap  = MAX(index->strings_cap * 2,
+            index->strings_size + len + 4096);
+      char *strings = (char*)realloc(index->strings, cap);
 
-   RARCH_LOG("Autodetect: %d profiles found\n", list->size);
+      if (!strings)
+         return 0;
 
-   for (i = 0; i < list->size; i++)
+      index->strings     = strings;
+      index->strings_cap = cap;
+   }
+
+   memcpy(index->strings + offset, s, len);
+   index->strings_size += len;
+   return offset;
+}
+
+static void autoconf_index_cache_path(const char *dir,
+      char *path, size_t size)
+{
+   char name[64];
+   settings_t *settings = config_get_ptr();
+
+   path[0] = '\0';
+
+   if (string_is_empty(settings->directory.cache))
+      return;
+
+   snprintf(name, sizeof(name), "%08x.idx", djb2_calculate(dir));
+   fill_pathname_join(path, settings->directory.cache,
+         "autoconfig", size);
+   fill_pathname_slash(path, size);
+   strlcat(path, name, size);
+}
+
+static autoconf_index_t *autoconf_index_read(const char *dir)
+{
+   uint32_t i;
+   autoconf_index_header_t header;
+   char path[PATH_MAX_LENGTH];
+   char cached_dir[PATH_MAX_LENGTH];
+   size_t entries_size;
+   RFILE *file              = NULL;
+   autoconf_index_t *index  = NULL;
+
+   autoconf_index_cache_path(dir, path, sizeof(path));
+   if (string_is_empty(path))
+      return NULL;
+
+   file = filestream_open(path, RFILE_MODE_READ, -1);
+   if (!file)
+      return NULL;
+
+   if (filestream_read(file, &header, sizeof(header)) != sizeof(header)
+         || header.magic   != AUTOCONF_INDEX_MAGIC
+         || header.version != AUTOCONF_INDEX_VERSION
+         || header.dir_len >= sizeof(cached_dir)
+         || header.count   > 65536
+         || header.strings_size > 16 * 1024 * 1024)
+      goto error;
+
+   /* Two directories hashing to the same name evict each other. */
+   if (filestream_read(file, cached_dir, header.dir_len) != header.dir_len)
+      goto error;
+   cached_dir[header.dir_len] = '\0';
+   if (strcmp(cached_dir, dir))
+      goto error;
+
+   index = (autoconf_index_t*)calloc(1, sizeof(*index));
+   if (!index)
+      goto error;
+
+   entries_size     = header.count * sizeof(*index->entries);
+   index->entries   = (autoconf_index_entry_t*)malloc(
+         MAX(entries_size, 1));
+   index->strings   = (char*)malloc(MAX(header.strings_size, 1));
+   if (!index->entries || !index->strings)
+      goto error;
+
+   if (filestream_read(file, index->entries, entries_size)
+            != (ssize_t)entries_size
+         || filestream_read(file, index->strings, header.strings_size)
+            != (ssize_t)header.strings_size)
+      goto error;
+
+   /* Offsets are trusted from here on, a corrupt file must not
+    * point them past the blob or leave a string unterminated. */
+   if (!header.strings_size
+         || index->strings[header.strings_size - 1] != '\0')
+      goto error;
+
+   for (i = 0; i < header.count; i++)
    {
-      conf = config_file_new(list->elems[i].data);
-      ret = input_try_autoconfigure_joypad_from_conf(conf, params);
-      if(ret >= current_best)
+      const autoconf_index_entry_t *entry = &index->entries[i];
+
+      if (     entry->name   >= header.strings_size
+            || entry->ident  >= header.strings_size
+            || entry->driver >= header.strings_size)
+         goto error;
+   }
+
+   index->count        = header.count;
+   index->strings_size = header.strings_size;
+   index->strings_cap  = header.strings_size;
+   index->dir_mtime    = header.dir_mtime;
+   index->indexed_at   = header.indexed_at;
+   index->unverified   = true;
+   strlcpy(index->dir, dir, sizeof(index->dir));
+
+   filestream_close(file);
+   return index;
+
+error:
+   autoconf_index_free(index);
+   filestream_close(file);
+   return NULL;
+}
+
+static void autoconf_index_write(const autoconf_index_t *index)
+{
+   autoconf_index_header_t header;
+   char path[PATH_MAX_LENGTH];
+   char tmp[PATH_MAX_LENGTH];
+   char dir[PATH_MAX_LENGTH];
+   size_t entries_size = index->count * sizeof(*index->entries);
+   RFILE *file         = NULL;
+   bool ok             = false;
+
+   autoconf_index_cache_path(index->dir, path, sizeof(path));
+   if (string_is_empty(path))
+      return;
+
+   fill_pathname_basedir(dir, path, sizeof(dir));
+   if (!path_is_directory(dir) && !path_mkdir(dir))
+      return;
+
+   /* Written under another name and renamed, so that a reader
+    * never sees half a file. */
+   snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+   file = filestream_open(tmp, RFILE_MODE_WRITE, -1);
+   if (!file)
+      return;
+
+   header.magic        = AUTOCONF_INDEX_MAGIC;
+   header.version      = AUTOCONF_INDEX_VERSION;
+   header.dir_mtime    = index->dir_mtime;
+   header.indexed_at   = index->indexed_at;
+   header.dir_len      = (uint32_t)strlen(index->dir);
+   header.count        = index->count;
+   header.strings_size = index->strings_size;
+
+   ok = filestream_write(file, &header, sizeof(header)) == sizeof(header)
+      && filestream_write(file, index->dir, header.dir_len)
+         == header.dir_len
+      && filestream_write(file, index->entries, entries_size)
+         == (ssize_t)entries_size
+      && filestream_write(file, index->strings, index->strings_size)
+         == (ssize_t)index->strings_size;
+
+   filestream_close(file);
+
+   if (!ok || rename(tmp, path) != 0)
+      remove(tmp);
+}
+
+/**
+ * autoconf_index_build:
+ * @dir                 : autoconfig directory
+ * @old                 : previous index of @dir, can be NULL
+ * @dir_mtime           : modification time of @dir
+ * @parsed              : number of profiles that had to be parsed
+ *
+ * Indexes the profiles in @dir, taking the entries of profiles
+ * that didn't change from @old.
+ *
+ * Returns: the new index, NULL if @dir couldn't be listed.
+ **/
+static autoconf_index_t *autoconf_index_build(const char *dir,
+      const autoconf_index_t *old, int64_t dir_mtime, unsigned *parsed)
+{
+   size_t i;
+   uint32_t old_buckets[AUTOCONF_INDEX_BUCKETS];
+   uint32_t *old_next       = NULL;
+   autoconf_index_t *index  = NULL;
+   struct string_list *list = dir_list_new_special(dir,
+         DIR_LIST_AUTOCONFIG, "cfg");
+
+   *parsed = 0;
+
+   if (!list)
+      return NULL;
+
+   index = (autoconf_index_t*)calloc(1, sizeof(*index));
+   if (!index)
+      goto error;
+
+   index->entries = (autoconf_index_entry_t*)calloc(
+         MAX(list->size, 1), sizeof(*index->entries));
+   if (!index->entries)
+      goto error;
+
+   strlcpy(index->dir, dir, sizeof(index->dir));
+   index->dir_mtime  = dir_mtime;
+   index->indexed_at = (int64_t)time(NULL);
+
+   /* Offset 0 is the empty string. */
+   autoconf_index_add_string(index, "");
+
+   /* Old entries by file name. */
+   if (old && old->count)
+   {
+      old_next = (uint32_t*)calloc(old->count, sizeof(*old_next));
+      if (!old_next)
+         goto error;
+
+      memset(old_buckets, 0, sizeof(old_buckets));
+      for (i = 0; i < old->count; i++)
       {
-         index = i;
-         current_best = ret;
+         uint32_t hash = djb2_calculate(old->strings + old->entries[i].name)
+            % AUTOCONF_INDEX_BUCKETS;
+         old_next[i]       = old_buckets[hash];
+         old_buckets[hash] = (uint32_t)i + 1;
       }
-      config_file_free(conf);
    }
 
-   if(index >= 0 && current_best > 0)
+   for (i = 0; i < list->size; i++)
    {
-      conf = config_file_new(list->elems[index].data);
+      struct stat st;
+      const char *path                    = list->elems[i].data;
+      const char *name                    = path_basename(path);
+      const autoconf_index_entry_t *found = NULL;
+      autoconf_index_entry_t *entry       = &index->entries[index->count];
 
-      if (conf)
+      if (stat(path, &st) != 0)
+         continue;
+
+      if (old_next)
       {
-         char conf_path[PATH_MAX_LENGTH];
+         uint32_t it = old_buckets[djb2_calculate(name)
+            % AUTOCONF_INDEX_BUCKETS];
+
+         for (; it; it = old_next[it - 1])
+         {
+            const autoconf_index_entry_t *old_entry = &old->entries[it - 1];
 
-         config_get_config_path(conf, conf_path, sizeof(conf_path));
+            if (strcmp(old->strings + old_entry->name, name))
+               continue;
+
+            if (old_entry->mtime == (int64_t)st.st_mtime
+                  && old_entry->size == (int64_t)st.st_size
+                  && old_entry->mtime + AUTOCONF_INDEX_RACY_SECS
+                     < old->indexed_at)
+               found = old_entry;
+            break;
+         }
+      }
+
+      if (found)
+      {
+         entry->vid    = found->vid;
+         entry->pid    = found->pid;
+         entry->ident  = autoconf_index_add_string(index,
+               old->strings + found->ident);
+         entry->driver = autoconf_index_add_string(index,
+               old->strings + found->driver);
+      }
+      else
+      {
+         int tmp_int                        = 0;
+         char ident[PATH_MAX_LENGTH]        = {0};
+         char input_driver[PATH_MAX_LENGTH] = {0};
+         config_file_t *conf                = config_file_new(path);
+
+         if (!conf)
+            continue;
+
+         config_get_array(conf, "input_device", ident, sizeof(ident));
+         config_get_array(conf, "input_driver",
+               input_driver, sizeof(input_driver));
+
+         if (config_get_int(conf, "input_vendor_id", &tmp_int))
+            entry->vid = tmp_int;
+         if (config_get_int(conf, "input_product_id", &tmp_int))
+            entry->pid = tmp_int;
+
+         entry->ident  = autoconf_index_add_string(index, ident);
+         entry->driver = autoconf_index_add_string(index, input_driver);
 
-         RARCH_LOG("Autodetect: selected configuration: %s\n", conf_path);
-         input_autoconfigure_joypad_add(conf, params);
          config_file_free(conf);
-         ret = 1;
+         (*parsed)++;
       }
+
+      entry->mtime = st.st_mtime;
+      entry->size  = st.st_size;
+      entry->name  = autoconf_index_add_string(index, name);
+      index->count++;
    }
-   else
-      ret = 0;
 
+   autoconf_index_link(index);
+
+   free(old_next);
    string_list_free(list);
+   return index;
 
-   if (ret == 0)
-      return false;
-   return true;
+error:
+   autoconf_index_free(index);
+   string_list_free(list);
+   return NULL;
+}
+
+/* Profiles can be edited in place, which leaves the mtime
+ * of the directory alone, so each one is looked at again. */
+static bool autoconf_index_profiles_changed(const autoconf_index_t *index)
+{
+   uint32_t i;
+   char path[PATH_MAX_LENGTH];
+
+   for (i = 0; i < index->count; i++)
+   {
+      struct stat st;
+      const autoconf_index_entry_t *entry = &index->entries[i];
+
+      fill_pathname_join(path, index->dir,
+            index->strings + entry->name, sizeof(path));
+
+      if (stat(path, &st) != 0
+            || entry->mtime != (int64_t)st.st_mtime
+            || entry->size  != (int64_t)st.st_size
+            || entry->mtime + AUTOCONF_INDEX_RACY_SECS >= index->indexed_at)
+         return true;
+   }
+
+   return false;
+}
+
+/**
+ * autoconf_index_get:
+ * @dir                 : autoconfig directory
+ *
+ * Looks for the index of @dir in memory, then on disk, and
+ * brings it up to date. Once verified, an index only costs a
+ * stat() of the directory and of each profile until one changes.
+ * Must be called with the index lock held.
+ *
+ * Returns: the index of @dir, NULL if @dir can't be listed.
+ **/
+static autoconf_index_t *autoconf_index_get(const char *dir)
+{
+   struct stat st;
+   unsigned i;
+   unsigned parsed           = 0;
+   unsigned slot             = AUTOCONF_INDEX_DIRS - 1;
+   autoconf_index_t *index   = NULL;
+   autoconf_index_t *rebuilt = NULL;
+
+   if (string_is_empty(dir) || stat(dir, &st) != 0)
+      return NULL;
+
+   for (i = 0; i < AUTOCONF_INDEX_DIRS; i++)
+   {
+      if (autoconf_indexes[i] && !strcmp(autoconf_indexes[i]->dir, dir))
+      {
+         index = autoconf_indexes[i];
+         slot  = i;
+         break;
+      }
+   }
+
+   if (!index)
+   {
+      /* Take the slot of the least recently used index. */
+      autoconf_index_free(autoconf_indexes[slot]);
+      autoconf_indexes[slot] = NULL;
+      index = autoconf_index_read(dir);
+   }
+
+   /* Move to the front. */
+   memmove(&autoconf_indexes[1], &autoconf_indexes[0],
+         slot * sizeof(*autoconf_indexes));
+   autoconf_indexes[0] = index;
+
+   if (index && !index->unverified
+         && index->dir_mtime == (int64_t)st.st_mtime
+         && index->dir_mtime + AUTOCONF_INDEX_RACY_SECS < index->indexed_at
+         && !autoconf_index_profiles_changed(index))
+      return index;
+
+   rebuilt = autoconf_index_build(dir, index, st.st_mtime, &parsed);
+   if (!rebuilt)
+      return index;
+
+   RARCH_LOG("Autodetect: indexed %u profiles in %s (%u parsed).\n",
+         rebuilt->count, dir, parsed);
+
+   autoconf_index_write(rebuilt);
+   autoconf_index_free(index);
+   autoconf_indexes[0] = rebuilt;
+   return rebuilt;
+}
+
+static int autoconf_index_score(const autoconf_index_t *index,
+      const autoconf_index_entry_t *entry,
+      const autoconfig_params_t *params)
+{
+   int score         = 0;
+   const char *ident = index->strings + entry->ident;
+
+   /* Check for VID/PID */
+   if (     (params->vid == entry->vid)
+         && (params->pid == entry->pid)
+         && params->vid != 0
+         && params->pid != 0)
+      score += 3;
+
+   /* Check for name match */
+   if (string_is_equal(ident, params->name))
+      score += 2;
+   else if (!string_is_empty(ident)
+         && !strncmp(params->name, ident, strlen(ident)))
+      score += 1;
+
+   return score;
+}
+
+static bool autoconf_index_is_better(const autoconf_index_t *index,
+      const autoconf_index_entry_t *entry, int score,
+      const autoconf_index_entry_t *best, int best_score,
+      const autoconfig_params_t *params)
+{
+   bool driver, best_driver;
+
+   if (score != best_score)
+      return score > best_score;
+   if (!best)
+      return true;
+
+   /* Ties go to profiles made for the pad's driver first,
+    * then to the last one listed, as before the index. */
+   driver      = string_is_equal(index->strings + entry->driver,
+         params->driver);
+   best_driver = string_is_equal(index->strings + best->driver,
+         params->driver);
+   if (driver != best_driver)
+      return driver;
+
+   return entry > best;
+}
+
+/**
+ * autoconf_index_find:
+ * @index               : index of an autoconfig directory
+ * @params              : the connected pad
+ *
+ * Scores the profiles like input_try_autoconfigure_joypad_from_conf().
+ * Profiles matching the VID/PID or the exact name are in the
+ * buckets of @params, only partial name matches need a scan.
+ *
+ * Returns: the best matching entry, NULL if none matched.
+ **/
+static const autoconf_index_entry_t *autoconf_index_find(
+      const autoconf_index_t *index, const autoconfig_params_t *params)
+{
+   uint32_t it;
+   int best_score                     = 0;
+   const autoconf_index_entry_t *best = NULL;
+
+   if (params->vid != 0 && params->pid != 0)
+   {
+      for (it = index->vid_pid_buckets[autoconf_index_hash_vid_pid(
+                  params->vid, params->pid)];
+            it; it = index->entries[it - 1].vid_pid_next)
+      {
+         const autoconf_index_entry_t *entry = &index->entries[it - 1];
+         int score = autoconf_index_score(index, entry, params);
+
+         if (score && autoconf_index_is_better(index, entry, score,
+                  best, best_score, params))
+         {
+            best       = entry;
+            best_score = score;
+         }
+      }
+   }
+
+   for (it = index->ident_buckets[autoconf_index_hash_ident(params->name)];
+         it; it = index->entries[it - 1].ident_next)
+   {
+      const autoconf_index_entry_t *entry = &index->entries[it - 1];
+      int score = autoconf_index_score(index, entry, params);
+
+      if (score && autoconf_index_is_better(index, entry, score,
+               best, best_score, params))
+      {
+         best       = entry;
+         best_score = score;
+      }
+   }
+
+   if (!best)
+   {
+      for (it = 0; it < index->count; it++)
+      {
+         const autoconf_index_entry_t *entry = &index->entries[it];
+         int score = autoconf_index_score(index, entry, params);
+
+         if (score && autoconf_index_is_better(index, entry, score,
+                  best, best_score, params))
+         {
+            best       = entry;
+            best_score = score;
+         }
+      }
+   }
+
+   return best;
+}
+
+/**
+ * input_autoconfigure_index_init:
+ *
+ * Creates the lock of the profile indexes. Has to be called
+ * before pads are looked up from more than one thread.
+ **/
+void input_autoconfigure_index_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!autoconf_index_lock)
+      autoconf_index_lock = slock_new();
+#endif
+}
+
+/**
+ * input_autoconfigure_find_profile:
+ * @params              : the connected pad
+ *
+ * Looks the pad up in the index of the joypad driver's autoconfig
+ * directory, or of the autoconfig directory itself if the former
+ * has no profiles. Doesn't touch the settings beyond reading the
+ * directories, so it can run on a task thread.
+ *
+ * Returns: the best matching profile, NULL if none matched.
+ **/
+config_file_t *input_autoconfigure_find_profile(
+      const autoconfig_params_t *params)
+{
+   char dir[PATH_MAX_LENGTH]          = {0};
+   char path[PATH_MAX_LENGTH]         = {0};
+   config_file_t *conf                = NULL;
+   autoconf_index_t *index            = NULL;
+   const autoconf_index_entry_t *best = NULL;
+   settings_t *settings               = config_get_ptr();
+
+   fill_pathname_application_special(dir, sizeof(dir),
+         APPLICATION_SPECIAL_DIRECTORY_AUTOCONFIG);
+
+#ifdef HAVE_THREADS
+   if (autoconf_index_lock)
+      slock_lock(autoconf_index_lock);
+#endif
+
+   index = autoconf_index_get(dir);
+   if (!index || !index->count)
+      index = autoconf_index_get(settings->directory.autoconfig);
+
+   if (index)
+   {
+      RARCH_LOG("Autodetect: %u profiles found\n", index->count);
+
+      best = autoconf_index_find(index, params);
+      if (best)
+         fill_pathname_join(path, index->dir,
+               index->strings + best->name, sizeof(path));
+   }
+
+#ifdef HAVE_THREADS
+   if (autoconf_index_lock)
+      slock_unlock(autoconf_index_lock);
+#endif
+
+   if (string_is_empty(path))
+      return NULL;
+
+   conf = config_file_new(path);
+   if (conf)
+      RARCH_LOG("Autodetect: selected configuration: %s\n", path);
+   return conf;
 }
 
 #if defined(HAVE_BUILTIN_AUTOCONFIG)
@@ -296,7 +946,7 @@ static bool input_autoconfigure_joypad_from_conf_internal(
 }
 #endif
 
-static bool input_config_autoconfigure_joypad_init(autoconfig_params_t *params)
+bool input_config_autoconfigure_joypad_init(autoconfig_params_t *params)
 {
    size_t i;
    settings_t *settings = config_get_ptr();
@@ -316,18 +966,29 @@ static bool input_config_autoconfigure_joypad_init(autoconfig_params_t *params)
    return true;
 }
 
-bool input_config_autoconfigure_joypad(autoconfig_params_t *params)
+/**
+ * input_config_autoconfigure_joypad_apply:
+ * @conf                : profile found by input_autoconfigure_find_profile(),
+ *                        can be NULL; freed here
+ * @params              : the connected pad
+ *
+ * Binds the profile, or falls back to the built-in profiles.
+ * Must be called on the main thread.
+ *
+ * Returns: true if the pad is configured.
+ **/
+bool input_config_autoconfigure_joypad_apply(config_file_t *conf,
+      autoconfig_params_t *params)
 {
    char msg[PATH_MAX_LENGTH];
 
-   if (!input_config_autoconfigure_joypad_init(params))
-      goto error;
-
-   if (!*params->name)
-      goto error;
-
-   if (input_autoconfigure_joypad_from_conf_dir(params))
+   if (conf)
+   {
+      input_autoconfigure_joypad_add(conf, params);
+      config_file_free(conf);
       return true;
+   }
+
 #if defined(HAVE_BUILTIN_AUTOCONFIG)
    if (input_autoconfigure_joypad_from_conf_internal(params))
       return true;
@@ -339,10 +1000,21 @@ bool input_config_autoconfigure_joypad(autoconfig_params_t *params)
          params->name, (long)params->vid, (long)params->pid);
    runloop_msg_queue_push(msg, 0, 60, false);
 
-error:
    return false;
 }
 
+bool input_config_autoconfigure_joypad(autoconfig_params_t *params)
+{
+   if (!input_config_autoconfigure_joypad_init(params))
+      return false;
+
+   if (!*params->name)
+      return false;
+
+   return input_config_autoconfigure_joypad_apply(
+         input_autoconfigure_find_profile(params), params);
+}
+
 const struct retro_keybind *input_get_auto_bind(unsigned port, unsigned id)
 {
    settings_t *settings = config_get_ptr();
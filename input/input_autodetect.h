@@ -21,6 +21,7 @@
 
 #include <boolean.h>
 #include <retro_miscellaneous.h>
+#include <file/config_file.h>
 
 typedef struct autoconfig_params
 {
@@ -37,6 +38,18 @@ const struct retro_keybind *input_get_auto_bind(unsigned port,
 
 bool input_config_autoconfigure_joypad(autoconfig_params_t *params);
 
+/* Clears the autoconfigured binds of the pad's port.
+ * Returns false if autodetection is disabled. */
+bool input_config_autoconfigure_joypad_init(autoconfig_params_t *params);
+
+void input_autoconfigure_index_init(void);
+
+config_file_t *input_autoconfigure_find_profile(
+      const autoconfig_params_t *params);
+
+bool input_config_autoconfigure_joypad_apply(config_file_t *conf,
+      autoconfig_params_t *params);
+
 void input_config_autoconfigure_disconnect(unsigned i, const char *ident);
 
 extern const char* const input_builtin_autoconfs[];
@@ -26,6 +26,7 @@
 #include "../list_special.h"
 #include "../verbosity.h"
 #include "../command.h"
+#include "../performance_counters.h"
 
 #ifdef HAVE_NETWORKGAMEPAD
 #include "input_remote.h"
@@ -106,6 +107,7 @@ static bool input_driver_osk_enabled              = false;
 static bool input_driver_nonblock_state           = false;
 static bool input_driver_flushing_input           = false;
 static bool input_driver_data_own                 = false;
+static retro_time_t input_driver_event_time       = 0;
 
 /**
  * input_driver_find_handle:
@@ -655,6 +657,40 @@ void input_driver_poll(void)
    current_input->poll(current_input_data);
 }
 
+/**
+ * input_driver_set_event_time:
+ * @time                : timestamp of the newest event polled,
+ *                        on the cpu_features_get_time_usec() clock
+ *
+ * Lets input drivers which know when their events happened
+ * report it, see input_driver_frame_presented().
+ **/
+void input_driver_set_event_time(retro_time_t time)
+{
+   if (time > input_driver_event_time)
+      input_driver_event_time = time;
+}
+
+/**
+ * input_driver_frame_presented:
+ *
+ * Called once a frame was handed to the video driver. The first
+ * frame after an event was polled counts its age, which is the
+ * input latency as far as RetroArch can see it.
+ **/
+void input_driver_frame_presented(void)
+{
+   static struct retro_perf_counter input_age_present = {0};
+
+   if (!input_driver_event_time)
+      return;
+
+   performance_counter_init(&input_age_present, "input_age_present_usec");
+   performance_counter_add_span(&input_age_present, input_driver_event_time);
+
+   input_driver_event_time = 0;
+}
+
 bool input_driver_init(void)
 {
    if (current_input)
@@ -685,6 +721,7 @@ void input_driver_destroy(void)
    input_driver_nonblock_state           = false;
    input_driver_flushing_input           = false;
    input_driver_data_own                 = false;
+   input_driver_event_time               = 0;
    memset(&input_driver_turbo_btns, 0, sizeof(turbo_buttons_t));
    current_input                         = NULL;
 }
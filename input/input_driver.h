@@ -239,6 +239,10 @@ bool input_driver_has_capabilities(void);
 
 void input_driver_poll(void);
 
+void input_driver_set_event_time(retro_time_t time);
+
+void input_driver_frame_presented(void);
+
 bool input_driver_init(void);
 
 void input_driver_deinit(void);
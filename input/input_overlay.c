@@ -68,6 +68,9 @@ struct input_overlay
 
    unsigned next_index;
    enum overlay_status state;
+
+   /* Tells the images of an earlier load apart from ours. */
+   unsigned generation;
 };
 
 static input_overlay_t *overlay_ptr = NULL;
@@ -165,6 +168,9 @@ void input_overlay_free_overlay(struct overlay *overlay)
    for (i = 0; i < overlay->size; i++)
       image_texture_free(&overlay->descs[i].image);
 
+   string_list_free(overlay->pending_images);
+   overlay->pending_images = NULL;
+
    if (overlay->load_images)
       free(overlay->load_images);
    overlay->load_images = NULL;
@@ -536,6 +542,7 @@ void input_overlay_loaded(void *task_data, void *user_data, const char *err)
    ol->active     = data->active;
    ol->iface      = iface;
    ol->iface_data = video_driver_get_ptr(true);
+   ol->generation = data->generation;
 
    input_overlay_load_active(ol, settings->input.overlay_opacity);
 
@@ -561,6 +568,71 @@ abort_load:
    free(data);
 }
 
+/* task_data = overlay_images_task_data_t* */
+void input_overlay_images_loaded(void *task_data,
+      void *user_data, const char *err)
+{
+   unsigned i;
+   overlay_images_task_data_t *data = (overlay_images_task_data_t*)task_data;
+   input_overlay_t              *ol = overlay_ptr;
+   struct overlay          *overlay = NULL;
+   settings_t             *settings = config_get_ptr();
+
+   if (!data)
+      return;
+
+   /* The overlay was unloaded, or replaced, in the meantime. */
+   if (err || !ol || ol->generation != data->generation
+         || data->index >= ol->size)
+   {
+      for (i = 0; i < data->count; i++)
+         image_texture_free(&data->images[i]);
+      goto end;
+   }
+
+   overlay = &ol->overlays[data->index];
+
+   for (i = 0; i < data->count; i++)
+   {
+      int desc = data->descs[i];
+
+      if (!data->images[i].pixels)
+         continue;
+
+      if (desc < 0)
+         overlay->image = data->images[i];
+      else if ((size_t)desc < overlay->size)
+         overlay->descs[desc].image = data->images[i];
+      else
+         image_texture_free(&data->images[i]);
+   }
+
+   /* Base image first, as input_overlay_set_vertex_geom() expects. */
+   overlay->load_images_size = 0;
+
+   if (overlay->image.pixels)
+      overlay->load_images[overlay->load_images_size++] = overlay->image;
+
+   for (i = 0; i < overlay->size; i++)
+   {
+      struct overlay_desc *desc = &overlay->descs[i];
+
+      if (!desc->image.pixels)
+         continue;
+
+      overlay->load_images[overlay->load_images_size++] = desc->image;
+      desc->image_index = overlay->load_images_size - 1;
+   }
+
+   if (ol->active == overlay)
+      input_overlay_load_active(ol, settings->input.overlay_opacity);
+
+end:
+   free(data->images);
+   free(data->descs);
+   free(data);
+}
+
 /**
  * input_overlay_set_alpha_mod:
  * @ol                    : Overlay handle.
@@ -23,6 +23,7 @@
 #include <retro_common_api.h>
 #include <retro_miscellaneous.h>
 #include <formats/image.h>
+#include <lists/string_list.h>
 
 RETRO_BEGIN_DECLS
 
@@ -143,6 +144,10 @@ struct overlay
 
    struct texture_image *load_images;
    unsigned load_images_size;
+
+   /* Images decoded in the background once the overlay is shown,
+    * attr.i is the desc they belong to, -1 for the base image. */
+   struct string_list *pending_images;
 };
 
 struct overlay_desc
@@ -182,8 +187,21 @@ typedef struct
     struct overlay *overlays;
     struct overlay *active;
     size_t size;
+    unsigned generation;
 } overlay_task_data_t;
 
+/* Images of one overlay decoded in the background. */
+typedef struct
+{
+    struct texture_image *images;
+    /* Desc each image belongs to, -1 for the base image. */
+    int *descs;
+    unsigned count;
+    size_t index;
+    /* Generation of the overlay load the images belong to. */
+    unsigned generation;
+} overlay_images_task_data_t;
+
 /**
  * input_overlay_free:
  *
@@ -242,6 +260,11 @@ bool input_overlay_is_alive(input_overlay_t *ol);
 
 void input_overlay_loaded(void *task_data, void *user_data, const char *err);
 
+/* task_data = overlay_images_task_data_t*, swaps the images in if
+ * the overlay they belong to is still loaded. */
+void input_overlay_images_loaded(void *task_data,
+      void *user_data, const char *err);
+
 RETRO_END_DECLS
 
 #endif
@@ -1674,6 +1674,8 @@ static const char *menu_hash_to_str_us_label_enum(enum msg_hash_enums msg)
          return "video_monitor_index";
       case MENU_ENUM_LABEL_VIDEO_FRAME_DELAY:
          return "video_frame_delay";
+      case MENU_ENUM_LABEL_VIDEO_FRAME_DELAY_AUTO:
+         return "video_frame_delay_auto";
       case MENU_ENUM_LABEL_INPUT_DUTY_CYCLE:
          return "input_duty_cycle";
       case MENU_ENUM_LABEL_INPUT_TURBO_PERIOD:
@@ -2166,6 +2168,8 @@ const char *msg_hash_to_str_us(enum msg_hash_enums msg)
          return "Taking screenshot.";
       case MSG_FAILED_TO_TAKE_SCREENSHOT:
          return "Failed to take screenshot.";
+      case MSG_SCREENSHOT_SAVED:
+         return "Screenshot saved";
       case MSG_FAILED_TO_START_RECORDING:
          return "Failed to start recording.";
       case MSG_RECORDING_TERMINATED_DUE_TO_RESIZE:
@@ -2808,6 +2812,8 @@ const char *msg_hash_to_str_us(enum msg_hash_enums msg)
          return "Monitor Index";
       case MENU_ENUM_LABEL_VALUE_VIDEO_FRAME_DELAY:
          return "Frame Delay";
+      case MENU_ENUM_LABEL_VALUE_VIDEO_FRAME_DELAY_AUTO:
+         return "Automatic Frame Delay";
       case MENU_ENUM_LABEL_VALUE_INPUT_DUTY_CYCLE:
          return "Duty Cycle";
       case MENU_ENUM_LABEL_VALUE_INPUT_TURBO_PERIOD:
@@ -208,3 +208,42 @@ size_t utf8len(const char *string)
    return strlen(string);
 #endif
 }
+
+/* Invalid sequences give their first byte back as a Latin-1
+ * code point, so strings that aren't UTF-8 still look right. */
+uint32_t utf8_walk(const char **string)
+{
+   const uint8_t *str = (const uint8_t*)*string;
+   uint32_t ret       = *str++;
+   unsigned count     = 0;
+
+   if (ret >= 0xF0 && ret < 0xF8)
+   {
+      ret  &= 0x07;
+      count = 3;
+   }
+   else if (ret >= 0xE0 && ret < 0xF0)
+   {
+      ret  &= 0x0F;
+      count = 2;
+   }
+   else if (ret >= 0xC0 && ret < 0xE0)
+   {
+      ret  &= 0x1F;
+      count = 1;
+   }
+
+   for (; count; count--, str++)
+   {
+      if ((*str & 0xC0) != 0x80)
+      {
+         ret = *(const uint8_t*)*string;
+         str = (const uint8_t*)*string + 1;
+         break;
+      }
+      ret = (ret << 6) | (*str & 0x3F);
+   }
+
+   *string = (const char*)str;
+   return ret;
+}
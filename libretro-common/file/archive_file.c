@@ -38,6 +38,15 @@
 #include <sys/stat.h>
 #endif
 
+#if !defined(VITA) && !defined(PSP) && !defined(__CELLOS_LV2__)
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include <compat/strl.h>
 #include <file/archive_file.h>
 #include <file/file_path.h>
@@ -54,6 +63,16 @@
 #define END_OF_CENTRAL_DIR_SIGNATURE 0x06054b50
 #endif
 
+struct zip_crc_userdata
+{
+   const char *needle;
+   char *name;
+   size_t name_size;
+   uint32_t crc;
+   uint32_t size;
+   bool found;
+};
+
 struct zip_extract_userdata
 {
    char *zip_path;
@@ -512,6 +531,366 @@ void file_archive_parse_file_iterate_stop(file_archive_transfer_t *state)
    file_archive_parse_file_iterate(state, NULL, NULL, NULL, NULL, NULL);
 }
 
+/* Central directory index.
+ *
+ * The central directory of a zip archive is parsed once into a flat
+ * table of members and kept in a small MRU cache keyed by the archive
+ * path, size and modification time. File listings and CRC queries are
+ * then served without touching the archive again; extraction only has
+ * to map the file to reach the compressed data. */
+
+#define FILE_ARCHIVE_INDEX_CACHE_SIZE 8
+
+typedef struct file_archive_index_entry
+{
+   const char *name;
+   uint32_t offset;
+   uint32_t csize;
+   uint32_t size;
+   uint32_t crc32;
+   unsigned cmode;
+} file_archive_index_entry_t;
+
+typedef struct file_archive_index
+{
+   char *path;
+   char *names;
+   int64_t file_size;
+   int64_t mtime;
+   size_t count;
+   unsigned refcount;
+   file_archive_index_entry_t *entries;
+} file_archive_index_t;
+
+static file_archive_index_t
+   *file_archive_index_cache[FILE_ARCHIVE_INDEX_CACHE_SIZE];
+#ifdef HAVE_THREADS
+static slock_t *file_archive_index_lock = NULL;
+#endif
+
+/**
+ * file_archive_init:
+ *
+ * Creates the lock of the archive index cache. Has to be called
+ * before archives are read from more than one thread.
+ **/
+void file_archive_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!file_archive_index_lock)
+      file_archive_index_lock = slock_new();
+#endif
+}
+
+static void file_archive_index_lock_acquire(void)
+{
+#ifdef HAVE_THREADS
+   if (file_archive_index_lock)
+      slock_lock(file_archive_index_lock);
+#endif
+}
+
+static void file_archive_index_lock_release(void)
+{
+#ifdef HAVE_THREADS
+   if (file_archive_index_lock)
+      slock_unlock(file_archive_index_lock);
+#endif
+}
+
+static bool file_archive_get_stamp(const char *path,
+      int64_t *file_size, int64_t *mtime)
+{
+#if defined(VITA) || defined(PSP) || defined(__CELLOS_LV2__)
+   *file_size = path_get_size(path);
+   *mtime     = 0;
+   return *file_size > 0;
+#else
+   struct stat st;
+
+   if (stat(path, &st) != 0)
+      return false;
+
+   *file_size = st.st_size;
+   *mtime     = st.st_mtime;
+   return true;
+#endif
+}
+
+/* Must be called with the index lock held. */
+static void file_archive_index_unref(file_archive_index_t *index)
+{
+   if (!index || --index->refcount)
+      return;
+
+   free(index->entries);
+   free(index->names);
+   free(index->path);
+   free(index);
+}
+
+static file_archive_index_t *file_archive_index_build(const char *path,
+      int64_t file_size, int64_t mtime)
+{
+   size_t i;
+   size_t names_len              = 0;
+   size_t names_pos              = 0;
+   const uint8_t *directory      = NULL;
+   file_archive_transfer_t state = {0};
+   file_archive_index_t *index   = NULL;
+
+   if (file_archive_parse_file_init(&state, path) != 0)
+      goto error;
+
+   index = (file_archive_index_t*)calloc(1, sizeof(*index));
+   if (!index)
+      goto error;
+
+   /* First pass sizes the tables, second pass fills them. */
+   for (directory = state.directory;
+         directory + 46 <= state.data + state.zip_size
+         && read_le(directory, 4) == CENTRAL_FILE_HEADER_SIGNATURE; )
+   {
+      uint32_t namelength    = read_le(directory + 28, 2);
+      uint32_t extralength   = read_le(directory + 30, 2);
+      uint32_t commentlength = read_le(directory + 32, 2);
+      size_t record_size     = 46 + namelength + extralength + commentlength;
+
+      if (namelength >= PATH_MAX_LENGTH)
+         goto error;
+
+      /* Truncated or corrupt, the name would be read past the end. */
+      if (record_size > (size_t)(state.data + state.zip_size - directory))
+         goto error;
+
+      names_len += namelength + 1;
+      index->count++;
+      directory += record_size;
+   }
+
+   index->entries = (file_archive_index_entry_t*)
+      calloc(index->count + 1, sizeof(*index->entries));
+   index->names   = (char*)malloc(names_len + 1);
+
+   if (!index->entries || !index->names)
+      goto error;
+
+   directory = state.directory;
+
+   for (i = 0; i < index->count; i++)
+   {
+      file_archive_index_entry_t *entry = &index->entries[i];
+      uint32_t namelength               = read_le(directory + 28, 2);
+      uint32_t extralength              = read_le(directory + 30, 2);
+      uint32_t commentlength            = read_le(directory + 32, 2);
+
+      entry->cmode  = read_le(directory + 10, 2);
+      entry->crc32  = read_le(directory + 16, 4);
+      entry->csize  = read_le(directory + 20, 4);
+      entry->size   = read_le(directory + 24, 4);
+      entry->offset = read_le(directory + 42, 4);
+      entry->name   = index->names + names_pos;
+
+      memcpy(index->names + names_pos, directory + 46, namelength);
+      names_pos += namelength;
+      index->names[names_pos++] = '\0';
+
+      directory += 46 + namelength + extralength + commentlength;
+   }
+
+   index->path      = strdup(path);
+   index->file_size = file_size;
+   index->mtime     = mtime;
+   index->refcount  = 1;
+
+   file_archive_free(state.handle);
+   return index;
+
+error:
+   if (state.handle)
+      file_archive_free(state.handle);
+   if (index)
+   {
+      free(index->entries);
+      free(index->names);
+      free(index);
+   }
+   return NULL;
+}
+
+/**
+ * file_archive_index_acquire:
+ * @path                        : filename path of archive.
+ *
+ * Returns the central directory index of an archive, building it
+ * if it isn't cached or the archive changed on disk. Has to be
+ * handed back with file_archive_index_release().
+ *
+ * Returns: index on success, otherwise NULL.
+ **/
+static file_archive_index_t *file_archive_index_acquire(const char *path)
+{
+   unsigned i;
+   int64_t file_size            = 0;
+   int64_t mtime                = 0;
+   file_archive_index_t *index  = NULL;
+
+   if (!path || !file_archive_get_stamp(path, &file_size, &mtime))
+      return NULL;
+
+   file_archive_index_lock_acquire();
+
+   for (i = 0; i < FILE_ARCHIVE_INDEX_CACHE_SIZE; i++)
+   {
+      file_archive_index_t *cached = file_archive_index_cache[i];
+
+      if (!cached || strcmp(cached->path, path))
+         continue;
+
+      /* Stale, drop it and rebuild below. */
+      if (cached->file_size != file_size || cached->mtime != mtime)
+      {
+         file_archive_index_cache[i] = NULL;
+         file_archive_index_unref(cached);
+         break;
+      }
+
+      /* Move to the front. */
+      memmove(&file_archive_index_cache[1], &file_archive_index_cache[0],
+            i * sizeof(*file_archive_index_cache));
+      file_archive_index_cache[0] = cached;
+      cached->refcount++;
+
+      file_archive_index_lock_release();
+      return cached;
+   }
+
+   file_archive_index_lock_release();
+
+   /* Built outside the lock, an occasional duplicate
+    * build is cheaper than serializing every lookup. */
+   index = file_archive_index_build(path, file_size, mtime);
+   if (!index)
+      return NULL;
+
+   file_archive_index_lock_acquire();
+
+   /* Drop any NULL hole left by a stale entry,
+    * then evict the least recently used entry. */
+   for (i = 0; i < FILE_ARCHIVE_INDEX_CACHE_SIZE - 1; i++)
+      if (!file_archive_index_cache[i])
+         break;
+   if (i == FILE_ARCHIVE_INDEX_CACHE_SIZE - 1)
+      file_archive_index_unref(file_archive_index_cache[i]);
+
+   memmove(&file_archive_index_cache[1], &file_archive_index_cache[0],
+         i * sizeof(*file_archive_index_cache));
+   file_archive_index_cache[0] = index;
+   index->refcount++;
+
+   file_archive_index_lock_release();
+
+   return index;
+}
+
+static void file_archive_index_release(file_archive_index_t *index)
+{
+   file_archive_index_lock_acquire();
+   file_archive_index_unref(index);
+   file_archive_index_lock_release();
+}
+
+/* Returns the start of the compressed data of an index entry
+ * within the mapped archive, or NULL if it is out of bounds. */
+static const uint8_t *file_archive_index_entry_data(
+      const file_archive_index_entry_t *entry,
+      const uint8_t *data, size_t size)
+{
+   uint32_t offsetNL, offsetEL;
+
+   if ((size_t)entry->offset + 30 > size)
+      return NULL;
+
+   offsetNL = read_le(data + entry->offset + 26, 2);
+   offsetEL = read_le(data + entry->offset + 28, 2);
+
+   if ((size_t)entry->offset + 30 + offsetNL + offsetEL
+         + entry->csize > size)
+      return NULL;
+
+   return data + entry->offset + 30 + offsetNL + offsetEL;
+}
+
+/**
+ * file_archive_walk_index:
+ * @file                        : filename path of archive
+ * @valid_exts                  : Valid extensions of archive to be parsed. 
+ *                                If NULL, allow all.
+ * @file_cb                     : file_cb function pointer
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ * @need_data                   : map the archive and pass the compressed
+ *                                data to @file_cb. If false, @file_cb
+ *                                gets NULL instead.
+ *
+ * Enumerates over all files of the archive index and calls 
+ * file_cb with userdata.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool file_archive_walk_index(const char *file,
+      const char *valid_exts, file_archive_file_cb file_cb,
+      void *userdata, bool need_data)
+{
+   size_t i;
+   bool ret                     = true;
+   void *handle                 = NULL;
+   const uint8_t *data          = NULL;
+   size_t size                  = 0;
+   file_archive_index_t *index  = file_archive_index_acquire(file);
+
+   if (!index)
+      return false;
+
+   if (need_data)
+   {
+      handle = file_archive_open(file);
+      if (!handle)
+      {
+         file_archive_index_release(index);
+         return false;
+      }
+
+      data = file_archive_data(handle);
+      size = file_archive_size(handle);
+   }
+
+   for (i = 0; i < index->count; i++)
+   {
+      const file_archive_index_entry_t *entry = &index->entries[i];
+      const uint8_t *cdata                    = NULL;
+
+      if (need_data)
+      {
+         cdata = file_archive_index_entry_data(entry, data, size);
+         if (!cdata)
+         {
+            ret = false;
+            break;
+         }
+      }
+
+      if (!file_cb(entry->name, valid_exts, cdata, entry->cmode,
+               entry->csize, entry->size, entry->crc32, userdata))
+         break;
+   }
+
+   if (handle)
+      file_archive_free(handle);
+   file_archive_index_release(index);
+
+   return ret;
+}
+
 /**
  * file_archive_parse_file:
  * @file                        : filename path of archive
@@ -528,20 +907,244 @@ void file_archive_parse_file_iterate_stop(file_archive_transfer_t *state)
 static bool file_archive_parse_file(const char *file, const char *valid_exts,
       file_archive_file_cb file_cb, void *userdata)
 {
-   file_archive_transfer_t state = {0};
-   bool returnerr        = true;
+   return file_archive_walk_index(file, valid_exts,
+         file_cb, userdata, true);
+}
 
-   state.type = ZLIB_TRANSFER_INIT;
+#ifdef HAVE_THREADS
+struct file_archive_parallel
+{
+   file_archive_index_t *index;
+   void *handle;
+   const uint8_t *data;
+   size_t size;
+   char *valid_exts;
+   file_archive_file_cb file_cb;
+   void *userdata;
+
+   slock_t *lock;
+   scond_t *cond;
+   sthread_t **threads;
+   unsigned num_threads;
+   unsigned running;
+
+   size_t next;
+   size_t done;
+   bool failed;
+   bool cancelled;
+};
+
+static void file_archive_parallel_thread(void *data)
+{
+   file_archive_parallel_t *par = (file_archive_parallel_t*)data;
 
    for (;;)
    {
-      if (file_archive_parse_file_iterate(&state, &returnerr, file,
-            valid_exts, file_cb, userdata) != 0)
+      size_t i;
+      bool ok                                 = true;
+      const uint8_t *cdata                    = NULL;
+      const file_archive_index_entry_t *entry = NULL;
+
+      slock_lock(par->lock);
+      if (par->failed || par->cancelled || par->next >= par->index->count)
+      {
+         slock_unlock(par->lock);
          break;
+      }
+      i = par->next++;
+      slock_unlock(par->lock);
+
+      entry = &par->index->entries[i];
+      cdata = file_archive_index_entry_data(entry, par->data, par->size);
+
+      if (!cdata || !par->file_cb(entry->name, par->valid_exts, cdata,
+               entry->cmode, entry->csize, entry->size, entry->crc32,
+               par->userdata))
+         ok = false;
+
+      slock_lock(par->lock);
+      par->done++;
+      if (!ok)
+         par->failed = true;
+      scond_signal(par->cond);
+      slock_unlock(par->lock);
+   }
+
+   slock_lock(par->lock);
+   par->running--;
+   scond_signal(par->cond);
+   slock_unlock(par->lock);
+}
+
+/**
+ * file_archive_parallel_new:
+ * @file                        : filename path of archive
+ * @valid_exts                  : Valid extensions of archive to be parsed. 
+ *                                If NULL, allow all.
+ * @file_cb                     : file_cb function pointer
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ * @threads                     : number of worker threads.
+ *
+ * Calls file_cb for every file of the archive from a pool of worker
+ * threads, so independent files are inflated in parallel. file_cb
+ * has to be safe to call concurrently. Unlike with
+ * file_archive_parse_file_iterate(), returning 0 from file_cb
+ * signals an error and stops the remaining files.
+ *
+ * Returns: handle on success, otherwise NULL.
+ **/
+file_archive_parallel_t *file_archive_parallel_new(const char *file,
+      const char *valid_exts, file_archive_file_cb file_cb,
+      void *userdata, unsigned threads)
+{
+   unsigned i;
+   file_archive_parallel_t *par = (file_archive_parallel_t*)
+      calloc(1, sizeof(*par));
+
+   if (!par)
+      return NULL;
+
+   par->index = file_archive_index_acquire(file);
+   if (!par->index)
+      goto error;
+
+   par->handle = file_archive_open(file);
+   if (!par->handle)
+      goto error;
+
+   par->data       = file_archive_data(par->handle);
+   par->size       = file_archive_size(par->handle);
+   par->valid_exts = valid_exts ? strdup(valid_exts) : NULL;
+   par->file_cb    = file_cb;
+   par->userdata   = userdata;
+   par->lock       = slock_new();
+   par->cond       = scond_new();
+
+   if (!par->lock || !par->cond)
+      goto error;
+
+   if (threads < 1)
+      threads = 1;
+   if (threads > par->index->count)
+      threads = par->index->count ? par->index->count : 1;
+
+   par->threads = (sthread_t**)calloc(threads, sizeof(*par->threads));
+   if (!par->threads)
+      goto error;
+
+   for (i = 0; i < threads; i++)
+   {
+      slock_lock(par->lock);
+      par->running++;
+      slock_unlock(par->lock);
+
+      par->threads[i] = sthread_create(file_archive_parallel_thread, par);
+
+      if (!par->threads[i])
+      {
+         slock_lock(par->lock);
+         par->running--;
+         slock_unlock(par->lock);
+         break;
+      }
+      par->num_threads++;
+   }
+
+   if (!par->num_threads)
+      goto error;
+
+   return par;
+
+error:
+   file_archive_parallel_free(par);
+   return NULL;
+}
+
+/**
+ * file_archive_parallel_iterate:
+ * @par                         : handle from file_archive_parallel_new().
+ * @timeout_us                  : how long to wait for a file to finish.
+ *
+ * Returns: true once all worker threads are done.
+ **/
+bool file_archive_parallel_iterate(file_archive_parallel_t *par,
+      int64_t timeout_us)
+{
+   bool finished;
+
+   if (!par)
+      return true;
+
+   slock_lock(par->lock);
+   if (par->running && timeout_us > 0)
+      scond_wait_timeout(par->cond, par->lock, timeout_us);
+   finished = !par->running;
+   slock_unlock(par->lock);
+
+   return finished;
+}
+
+int file_archive_parallel_progress(file_archive_parallel_t *par)
+{
+   int progress = 100;
+
+   if (!par)
+      return progress;
+
+   slock_lock(par->lock);
+   if (par->index->count)
+      progress = (int)(par->done * 100 / par->index->count);
+   slock_unlock(par->lock);
+
+   return progress;
+}
+
+/**
+ * file_archive_parallel_free:
+ * @par                         : handle from file_archive_parallel_new().
+ *
+ * Stops the remaining files, waits for the worker threads and frees
+ * the handle.
+ *
+ * Returns: true (1) if every file was processed successfully,
+ * otherwise false (0).
+ **/
+bool file_archive_parallel_free(file_archive_parallel_t *par)
+{
+   unsigned i;
+   bool ret = false;
+
+   if (!par)
+      return false;
+
+   if (par->lock)
+   {
+      slock_lock(par->lock);
+      par->cancelled = true;
+      slock_unlock(par->lock);
    }
 
-   return returnerr;
+   for (i = 0; i < par->num_threads; i++)
+      sthread_join(par->threads[i]);
+
+   if (par->index)
+      ret = !par->failed && par->done == par->index->count;
+
+   free(par->threads);
+   if (par->cond)
+      scond_free(par->cond);
+   if (par->lock)
+      slock_free(par->lock);
+   free(par->valid_exts);
+   if (par->handle)
+      file_archive_free(par->handle);
+   if (par->index)
+      file_archive_index_release(par->index);
+   free(par);
+
+   return ret;
 }
+#endif
 
 int file_archive_parse_file_progress(file_archive_transfer_t *state)
 {
@@ -617,6 +1220,106 @@ end:
    return ret;
 }
 
+static int file_archive_get_file_crc_cb(
+      const char *path,
+      const char *valid_exts,
+      const uint8_t *cdata,
+      unsigned cmode,
+      uint32_t csize,
+      uint32_t size,
+      uint32_t checksum,
+      void *userdata)
+{
+   struct zip_crc_userdata *data = (struct zip_crc_userdata*)userdata;
+
+   (void)valid_exts;
+   (void)cdata;
+   (void)cmode;
+   (void)csize;
+
+   if (data->needle ? strcmp(path, data->needle) != 0 : !checksum)
+      return 1;
+
+   if (data->name)
+      strlcpy(data->name, path, data->name_size);
+
+   data->crc   = checksum;
+   data->size  = size;
+   data->found = true;
+
+   return 0;
+}
+
+/**
+ * file_archive_get_file_crc:
+ * @path                        : filename path of archive.
+ * @needle                      : name of the file inside the archive.
+ * @crc                         : CRC32 of the file as recorded by the archive.
+ * @size                        : uncompressed size of the file. Can be NULL.
+ *
+ * Looks up a file in the central directory of an archive
+ * without decompressing it.
+ *
+ * Returns: true (1) if the file was found, otherwise false (0).
+ **/
+bool file_archive_get_file_crc(const char *path, const char *needle,
+      uint32_t *crc, uint32_t *size)
+{
+   struct zip_crc_userdata userdata = {0};
+
+   if (!needle || !crc)
+      return false;
+
+   userdata.needle = needle;
+
+   if (!file_archive_walk_index(path, NULL,
+            file_archive_get_file_crc_cb, &userdata, false))
+      return false;
+
+   if (!userdata.found)
+      return false;
+
+   *crc = userdata.crc;
+   if (size)
+      *size = userdata.size;
+
+   return true;
+}
+
+/**
+ * file_archive_get_first_file_crc:
+ * @path                        : filename path of archive.
+ * @name                        : receives the name of the file.
+ * @len                         : size of @name.
+ * @crc                         : CRC32 of the file as recorded by the archive.
+ *
+ * Looks up the first file of an archive with a CRC, which skips
+ * directories and empty files, without decompressing it.
+ *
+ * Returns: true (1) if a file was found, otherwise false (0).
+ **/
+bool file_archive_get_first_file_crc(const char *path,
+      char *name, size_t len, uint32_t *crc)
+{
+   struct zip_crc_userdata userdata = {0};
+
+   if (!name || !len || !crc)
+      return false;
+
+   userdata.name      = name;
+   userdata.name_size = len;
+
+   if (!file_archive_walk_index(path, NULL,
+            file_archive_get_file_crc_cb, &userdata, false))
+      return false;
+
+   if (!userdata.found)
+      return false;
+
+   *crc = userdata.crc;
+   return true;
+}
+
 /**
  * file_archive_get_file_list:
  * @path                        : filename path of archive
@@ -631,8 +1334,8 @@ struct string_list *file_archive_get_file_list(const char *path,
    if (!list)
       goto error;
 
-   if (!file_archive_parse_file(path, valid_exts,
-            file_archive_get_file_list_cb, list))
+   if (!file_archive_walk_index(path, valid_exts,
+            file_archive_get_file_list_cb, list, false))
       goto error;
 
    return list;
@@ -774,8 +774,9 @@ void config_set_string(config_file_t *conf, const char *key, const char *val)
    if (!entry)
       return;
 
-   entry->key   = strdup(key);
-   entry->value = strdup(val);
+   entry->key      = strdup(key);
+   entry->value    = strdup(val);
+   entry->key_hash = djb2_calculate(key);
 
    if (last)
       last->next = entry;
@@ -886,14 +887,23 @@ bool config_file_write(config_file_t *conf, const char *path)
    return true;
 }
 
-void config_file_dump(config_file_t *conf, FILE *file)
+/* Writes the includes, then every entry that isn't read only,
+ * to @file, or else to @buf if it isn't NULL.
+ * Returns the length of what was or would be written. */
+static size_t config_file_dump_internal(config_file_t *conf,
+      FILE *file, char *buf)
 {
+   size_t len                           = 0;
    struct config_entry_list       *list = NULL;
    struct config_include_list *includes = conf->includes;
 
    while (includes)
    {
-      fprintf(file, "#include \"%s\"\n", includes->path);
+      if (file)
+         fprintf(file, "#include \"%s\"\n", includes->path);
+      else if (buf)
+         sprintf(buf + len, "#include \"%s\"\n", includes->path);
+      len     += strlen(includes->path) + 12;
       includes = includes->next;
    }
 
@@ -902,9 +912,35 @@ void config_file_dump(config_file_t *conf, FILE *file)
    while (list)
    {
       if (!list->readonly && list->key)
-         fprintf(file, "%s = \"%s\"\n", list->key, list->value);
+      {
+         if (file)
+            fprintf(file, "%s = \"%s\"\n", list->key, list->value);
+         else if (buf)
+            sprintf(buf + len, "%s = \"%s\"\n", list->key, list->value);
+         len += strlen(list->key) + strlen(list->value) + 6;
+      }
       list = list->next;
    }
+
+   return len;
+}
+
+void config_file_dump(config_file_t *conf, FILE *file)
+{
+   config_file_dump_internal(conf, file, NULL);
+}
+
+char *config_file_dump_to_buffer(config_file_t *conf)
+{
+   size_t len = config_file_dump_internal(conf, NULL, NULL);
+   char *buf  = (char*)malloc(len + 1);
+
+   if (!buf)
+      return NULL;
+
+   buf[0] = '\0';
+   config_file_dump_internal(conf, NULL, buf);
+   return buf;
 }
 
 bool config_entry_exists(config_file_t *conf, const char *entry)
@@ -29,6 +29,10 @@
 #include <formats/image.h>
 #include <file/nbio.h>
 
+#ifdef HAVE_RPNG
+#include <formats/rpng.h>
+#endif
+
 enum video_image_format
 {
    IMAGE_FORMAT_NONE = 0,
@@ -167,7 +171,21 @@ static bool image_texture_load_internal(
 {
    int ret;
    bool success = false;
-   void *img    = image_transfer_new(type);
+   void *img    = NULL;
+
+#ifdef HAVE_RPNG
+   /* The whole file is here already, no need to go step by step. */
+   if (type == IMAGE_TYPE_PNG)
+   {
+      if (!rpng_load_image_argb_from_memory((const uint8_t*)ptr, len,
+               &out_img->pixels, &out_img->width, &out_img->height))
+         return false;
+
+      goto convert;
+   }
+#endif
+
+   img = image_transfer_new(type);
 
    if (!img)
       goto end;
@@ -192,6 +210,9 @@ static bool image_texture_load_internal(
    if (ret == IMAGE_PROCESS_ERROR || ret == IMAGE_PROCESS_ERROR_END)
       goto end;
 
+#ifdef HAVE_RPNG
+convert:
+#endif
    image_texture_color_convert(r_shift, g_shift, b_shift,
          a_shift, out_img);
 
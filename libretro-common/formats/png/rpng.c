@@ -29,6 +29,22 @@
 #include <malloc.h>
 #endif
 
+#ifdef RPNG_NO_SIMD
+#undef __SSE2__
+#undef __SSSE3__
+#undef __ARM_NEON__
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include <boolean.h>
 #include <formats/image.h>
 #include <formats/rpng.h>
@@ -230,11 +246,40 @@ end:
 static void png_reverse_filter_copy_line_rgb(uint32_t *data,
       const uint8_t *decoded, unsigned width, unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
 
    bpp /= 8;
 
-   for (i = 0; i < width; i++)
+   if (bpp == 1)
+   {
+#if defined(__SSSE3__)
+      const __m128i shuffle = _mm_setr_epi8(
+            2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+      const __m128i alpha   = _mm_set1_epi32(0xff000000);
+
+      /* Reads 16 bytes for 4 pixels, stays 4 bytes short of the end. */
+      for (; i + 6 <= width; i += 4, decoded += 12)
+      {
+         __m128i in = _mm_loadu_si128((const __m128i*)decoded);
+         _mm_storeu_si128((__m128i*)(data + i),
+               _mm_or_si128(_mm_shuffle_epi8(in, shuffle), alpha));
+      }
+#elif defined(__ARM_NEON__)
+      for (; i + 8 <= width; i += 8, decoded += 24)
+      {
+         uint8x8x3_t in = vld3_u8(decoded);
+         uint8x8x4_t out;
+
+         out.val[0] = in.val[2];
+         out.val[1] = in.val[1];
+         out.val[2] = in.val[0];
+         out.val[3] = vdup_n_u8(0xff);
+         vst4_u8((uint8_t*)(data + i), out);
+      }
+#endif
+   }
+
+   for (; i < width; i++)
    {
       uint32_t r, g, b;
 
@@ -251,11 +296,49 @@ static void png_reverse_filter_copy_line_rgb(uint32_t *data,
 static void png_reverse_filter_copy_line_rgba(uint32_t *data,
       const uint8_t *decoded, unsigned width, unsigned bpp)
 {
-   unsigned i;
+   unsigned i = 0;
 
    bpp /= 8;
 
-   for (i = 0; i < width; i++)
+   /* RGBA bytes to ARGB words is a swap of R and B. */
+   if (bpp == 1)
+   {
+#if defined(__SSSE3__)
+      const __m128i shuffle = _mm_setr_epi8(
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+      for (; i + 4 <= width; i += 4, decoded += 16)
+      {
+         __m128i in = _mm_loadu_si128((const __m128i*)decoded);
+         _mm_storeu_si128((__m128i*)(data + i),
+               _mm_shuffle_epi8(in, shuffle));
+      }
+#elif defined(__SSE2__)
+      const __m128i mask_ag = _mm_set1_epi32(0xff00ff00);
+
+      for (; i + 4 <= width; i += 4, decoded += 16)
+      {
+         __m128i in = _mm_loadu_si128((const __m128i*)decoded);
+         __m128i rb = _mm_andnot_si128(mask_ag, in);
+
+         rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+         _mm_storeu_si128((__m128i*)(data + i),
+               _mm_or_si128(_mm_and_si128(in, mask_ag), rb));
+      }
+#elif defined(__ARM_NEON__)
+      for (; i + 8 <= width; i += 8, decoded += 32)
+      {
+         uint8x8x4_t in = vld4_u8(decoded);
+         uint8x8_t r    = in.val[0];
+
+         in.val[0]      = in.val[2];
+         in.val[2]      = r;
+         vst4_u8((uint8_t*)(data + i), in);
+      }
+#endif
+   }
+
+   for (; i < width; i++)
    {
       uint32_t r, g, b, a;
       r        = *decoded;
@@ -424,6 +507,320 @@ static void png_reverse_filter_copy_line_plt(uint32_t *data,
    }
 }
 
+/* Reverse filters. @dst may be @src, every byte of @src is
+ * read before the same byte of @dst is written. @prev is the
+ * previous reconstructed scanline, zeroes for the first one. */
+
+static void png_unfilter_up(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned pitch)
+{
+   unsigned i = 0;
+
+#if defined(__SSE2__)
+   for (; i + 16 <= pitch; i += 16)
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(
+               _mm_loadu_si128((const __m128i*)(src + i)),
+               _mm_loadu_si128((const __m128i*)(prev + i))));
+#elif defined(__ARM_NEON__)
+   for (; i + 16 <= pitch; i += 16)
+      vst1q_u8(dst + i, vaddq_u8(vld1q_u8(src + i), vld1q_u8(prev + i)));
+#endif
+
+   for (; i < pitch; i++)
+      dst[i] = src[i] + prev[i];
+}
+
+#if defined(__SSE2__)
+/* One 3 or 4 byte pixel in the low lanes of a vector. The sub,
+ * average and paeth filters depend on the pixel to the left, so
+ * they go a pixel at a time, all channels at once. */
+static INLINE __m128i png_load_pixel(const uint8_t *p, unsigned bpp)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, bpp);
+   return _mm_cvtsi32_si128((int)v);
+}
+
+static INLINE void png_store_pixel(uint8_t *p, __m128i v, unsigned bpp)
+{
+   uint32_t out = (uint32_t)_mm_cvtsi128_si32(v);
+   memcpy(p, &out, bpp);
+}
+
+static void png_unfilter_sub_sse2(uint8_t *dst, const uint8_t *src,
+      unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   __m128i a = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = _mm_add_epi8(a, png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+   }
+}
+
+static void png_unfilter_avg_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a         = _mm_setzero_si128();
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      __m128i b   = png_load_pixel(prev + i, bpp);
+      /* avg_epu8 rounds up, PNG rounds down. */
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b),
+            _mm_and_si128(_mm_xor_si128(a, b), one));
+
+      a = _mm_add_epi8(avg, png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+   }
+}
+
+static INLINE __m128i png_abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static INLINE __m128i png_select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void png_unfilter_paeth_sse2(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   const __m128i zero = _mm_setzero_si128();
+   /* Left and upper left neighbours, widened to 16 bits. */
+   __m128i a          = zero;
+   __m128i c          = zero;
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      __m128i b  = _mm_unpacklo_epi8(png_load_pixel(prev + i, bpp), zero);
+      /* p = a + b - c, pa = |p - a|, pb = |p - b|, pc = |p - c| */
+      __m128i pa = _mm_sub_epi16(b, c);
+      __m128i pb = _mm_sub_epi16(a, c);
+      __m128i pc = png_abs_epi16(_mm_add_epi16(pa, pb));
+      __m128i smallest, nearest;
+
+      pa       = png_abs_epi16(pa);
+      pb       = png_abs_epi16(pb);
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+      /* Ties go to a, then b, like paeth(). */
+      nearest  = png_select(_mm_cmpeq_epi16(pa, smallest), a,
+            png_select(_mm_cmpeq_epi16(pb, smallest), b, c));
+
+      a = _mm_add_epi8(_mm_packus_epi16(nearest, nearest),
+            png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+
+      a = _mm_unpacklo_epi8(a, zero);
+      c = b;
+   }
+}
+#elif defined(__ARM_NEON__)
+static INLINE uint8x8_t png_load_pixel(const uint8_t *p, unsigned bpp)
+{
+   uint32_t v = 0;
+   memcpy(&v, p, bpp);
+   return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static INLINE void png_store_pixel(uint8_t *p, uint8x8_t v, unsigned bpp)
+{
+   uint32_t out = vget_lane_u32(vreinterpret_u32_u8(v), 0);
+   memcpy(p, &out, bpp);
+}
+
+static void png_unfilter_sub_neon(uint8_t *dst, const uint8_t *src,
+      unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      a = vadd_u8(a, png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+   }
+}
+
+static void png_unfilter_avg_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      /* vhadd rounds down, like PNG. */
+      a = vadd_u8(vhadd_u8(a, png_load_pixel(prev + i, bpp)),
+            png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+   }
+}
+
+static void png_unfilter_paeth_neon(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+   uint8x8_t a = vdup_n_u8(0);
+   uint8x8_t c = vdup_n_u8(0);
+
+   for (i = 0; i < pitch; i += bpp)
+   {
+      uint8x8_t b    = png_load_pixel(prev + i, bpp);
+      /* pa = |b - c|, pb = |a - c|, pc = |a + b - 2c| */
+      uint16x8_t pa  = vmovl_u8(vabd_u8(b, c));
+      uint16x8_t pb  = vmovl_u8(vabd_u8(a, c));
+      uint16x8_t pc  = vabdq_u16(vaddl_u8(a, b), vshll_n_u8(c, 1));
+      /* Ties go to a, then b, like paeth(). */
+      uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb),
+               vcleq_u16(pa, pc)));
+      uint8x8_t use_b = vmovn_u16(vcleq_u16(pb, pc));
+      uint8x8_t nearest = vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+
+      a = vadd_u8(nearest, png_load_pixel(src + i, bpp));
+      png_store_pixel(dst + i, a, bpp);
+      c = b;
+   }
+}
+#endif
+
+static void png_unfilter_sub(uint8_t *dst, const uint8_t *src,
+      unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+
+#if defined(__SSE2__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_sub_sse2(dst, src, bpp, pitch);
+      return;
+   }
+#elif defined(__ARM_NEON__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_sub_neon(dst, src, bpp, pitch);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = dst[i - bpp] + src[i];
+}
+
+static void png_unfilter_avg(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+
+#if defined(__SSE2__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_avg_sse2(dst, src, prev, bpp, pitch);
+      return;
+   }
+#elif defined(__ARM_NEON__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_avg_neon(dst, src, prev, bpp, pitch);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = (prev[i] >> 1) + src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = ((dst[i - bpp] + prev[i]) >> 1) + src[i];
+}
+
+static void png_unfilter_paeth(uint8_t *dst, const uint8_t *src,
+      const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   unsigned i;
+
+#if defined(__SSE2__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_paeth_sse2(dst, src, prev, bpp, pitch);
+      return;
+   }
+#elif defined(__ARM_NEON__)
+   if (bpp == 3 || bpp == 4)
+   {
+      png_unfilter_paeth_neon(dst, src, prev, bpp, pitch);
+      return;
+   }
+#endif
+
+   for (i = 0; i < bpp; i++)
+      dst[i] = paeth(0, prev[i], 0) + src[i];
+   for (i = bpp; i < pitch; i++)
+      dst[i] = paeth(dst[i - bpp], prev[i], prev[i - bpp]) + src[i];
+}
+
+static bool png_unfilter_line(unsigned filter, uint8_t *dst,
+      const uint8_t *src, const uint8_t *prev, unsigned bpp, unsigned pitch)
+{
+   switch (filter)
+   {
+      case PNG_FILTER_NONE:
+         if (dst != src)
+            memcpy(dst, src, pitch);
+         break;
+      case PNG_FILTER_SUB:
+         png_unfilter_sub(dst, src, bpp, pitch);
+         break;
+      case PNG_FILTER_UP:
+         png_unfilter_up(dst, src, prev, pitch);
+         break;
+      case PNG_FILTER_AVERAGE:
+         png_unfilter_avg(dst, src, prev, bpp, pitch);
+         break;
+      case PNG_FILTER_PAETH:
+         png_unfilter_paeth(dst, src, prev, bpp, pitch);
+         break;
+      default:
+         return false;
+   }
+
+   return true;
+}
+
+static void png_reverse_filter_expand_line(uint32_t *data,
+      const struct png_ihdr *ihdr, const uint8_t *decoded,
+      const uint32_t *palette)
+{
+   switch (ihdr->color_type)
+   {
+      case PNG_IHDR_COLOR_GRAY:
+         png_reverse_filter_copy_line_bw(data, decoded, ihdr->width, ihdr->depth);
+         break;
+      case PNG_IHDR_COLOR_RGB:
+         png_reverse_filter_copy_line_rgb(data, decoded, ihdr->width, ihdr->depth);
+         break;
+      case PNG_IHDR_COLOR_PLT:
+         png_reverse_filter_copy_line_plt(data, decoded, ihdr->width,
+               ihdr->depth, palette);
+         break;
+      case PNG_IHDR_COLOR_GRAY_ALPHA:
+         png_reverse_filter_copy_line_gray_alpha(data, decoded, ihdr->width,
+               ihdr->depth);
+         break;
+      case PNG_IHDR_COLOR_RGBA:
+         png_reverse_filter_copy_line_rgba(data, decoded, ihdr->width, ihdr->depth);
+         break;
+   }
+}
+
 static void png_pass_geom(const struct png_ihdr *ihdr,
       unsigned width, unsigned height,
       unsigned *bpp_out, unsigned *pitch_out, size_t *pass_size)
@@ -578,69 +975,19 @@ error:
 static int png_reverse_filter_copy_line(uint32_t *data, const struct png_ihdr *ihdr,
       struct rpng_process *pngp, unsigned filter)
 {
-   unsigned i;
+   uint8_t *tmp = NULL;
 
-   switch (filter)
-   {
-      case PNG_FILTER_NONE:
-         memcpy(pngp->decoded_scanline, pngp->inflate_buf, pngp->pitch);
-         break;
-      case PNG_FILTER_SUB:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->decoded_scanline[i - pngp->bpp] + pngp->inflate_buf[i];
-         break;
-      case PNG_FILTER_UP:
-         for (i = 0; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = pngp->prev_scanline[i] + pngp->inflate_buf[i];
-         break;
-      case PNG_FILTER_AVERAGE:
-         for (i = 0; i < pngp->bpp; i++)
-         {
-            uint8_t avg = pngp->prev_scanline[i] >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-         {
-            uint8_t avg = (pngp->decoded_scanline[i - pngp->bpp] + pngp->prev_scanline[i]) >> 1;
-            pngp->decoded_scanline[i] = avg + pngp->inflate_buf[i];
-         }
-         break;
-      case PNG_FILTER_PAETH:
-         for (i = 0; i < pngp->bpp; i++)
-            pngp->decoded_scanline[i] = paeth(0, pngp->prev_scanline[i], 0) + pngp->inflate_buf[i];
-         for (i = pngp->bpp; i < pngp->pitch; i++)
-            pngp->decoded_scanline[i] = paeth(pngp->decoded_scanline[i - pngp->bpp],
-                  pngp->prev_scanline[i], pngp->prev_scanline[i - pngp->bpp]) + pngp->inflate_buf[i];
-         break;
+   if (!png_unfilter_line(filter, pngp->decoded_scanline,
+            pngp->inflate_buf, pngp->prev_scanline, pngp->bpp, pngp->pitch))
+      return IMAGE_PROCESS_ERROR_END;
 
-      default:
-         return IMAGE_PROCESS_ERROR_END;
-   }
+   png_reverse_filter_expand_line(data, ihdr,
+         pngp->decoded_scanline, pngp->palette);
 
-   switch (ihdr->color_type)
-   {
-      case PNG_IHDR_COLOR_GRAY:
-         png_reverse_filter_copy_line_bw(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
-         break;
-      case PNG_IHDR_COLOR_RGB:
-         png_reverse_filter_copy_line_rgb(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
-         break;
-      case PNG_IHDR_COLOR_PLT:
-         png_reverse_filter_copy_line_plt(data, pngp->decoded_scanline, ihdr->width,
-               ihdr->depth, pngp->palette);
-         break;
-      case PNG_IHDR_COLOR_GRAY_ALPHA:
-         png_reverse_filter_copy_line_gray_alpha(data, pngp->decoded_scanline, ihdr->width,
-               ihdr->depth);
-         break;
-      case PNG_IHDR_COLOR_RGBA:
-         png_reverse_filter_copy_line_rgba(data, pngp->decoded_scanline, ihdr->width, ihdr->depth);
-         break;
-   }
-
-   memcpy(pngp->prev_scanline, pngp->decoded_scanline, pngp->pitch);
+   /* This scanline is the previous one of the next. */
+   tmp                    = pngp->prev_scanline;
+   pngp->prev_scanline    = pngp->decoded_scanline;
+   pngp->decoded_scanline = tmp;
 
    return IMAGE_PROCESS_NEXT;
 }
@@ -845,7 +1192,7 @@ static bool png_read_trns(uint8_t *buf, uint32_t *palette, unsigned entries)
 
    for (i = 0; i < entries; i++, buf++, palette++)
    {
-      *palette = (*palette & 0x00ffffff) | *buf << 24;
+      *palette = (*palette & 0x00ffffff) | (unsigned)*buf << 24;
    }
 
    return true;
@@ -952,22 +1299,12 @@ static bool png_parse_ihdr(uint8_t *buf,
 
 bool rpng_iterate_image(rpng_t *rpng)
 {
-   unsigned i;
    struct png_chunk chunk = {0};
    uint8_t *buf           = (uint8_t*)rpng->buff_data;
 
    if (!read_chunk_header(buf, &chunk))
       return false;
 
-   *buf += 8;
-
-#if 0
-   for (i = 0; i < 4; i++)
-   {
-      fprintf(stderr, "chunktype: %c\n", chunk.type[i]);
-   }
-#endif
-
    switch (png_chunk_type(&chunk))
    {
       case PNG_CHUNK_NOOP:
@@ -1044,8 +1381,7 @@ bool rpng_iterate_image(rpng_t *rpng)
 
          buf += 8;
 
-         for (i = 0; i < chunk.size; i++)
-            rpng->idat_buf.data[i + rpng->idat_buf.size] = buf[i];
+         memcpy(rpng->idat_buf.data + rpng->idat_buf.size, buf, chunk.size);
 
          rpng->idat_buf.size += chunk.size;
 
@@ -1109,6 +1445,336 @@ error:
    return IMAGE_PROCESS_ERROR;
 }
 
+/* Unfilters a whole (pass of an) image in place, every
+ * scanline right after the previous one. */
+static bool png_reverse_filter_image(const struct png_ihdr *ihdr,
+      uint8_t *inflated, uint32_t *data, const uint32_t *palette)
+{
+   unsigned y, bpp, pitch;
+   uint8_t *zero        = NULL;
+   const uint8_t *prev  = NULL;
+
+   png_pass_geom(ihdr, ihdr->width, ihdr->height, &bpp, &pitch, NULL);
+
+   zero = (uint8_t*)calloc(1, pitch);
+   if (!zero)
+      return false;
+
+   prev = zero;
+
+   for (y = 0; y < ihdr->height; y++)
+   {
+      uint8_t *line = inflated + 1;
+
+      if (!png_unfilter_line(*inflated, line, line, prev, bpp, pitch))
+      {
+         free(zero);
+         return false;
+      }
+
+      png_reverse_filter_expand_line(data, ihdr, line, palette);
+
+      prev      = line;
+      inflated += pitch + 1;
+      data     += ihdr->width;
+   }
+
+   free(zero);
+   return true;
+}
+
+static bool png_reverse_filter_adam7_image(const struct png_ihdr *ihdr,
+      uint8_t *inflated, uint32_t *data, const uint32_t *palette)
+{
+   unsigned pos;
+
+   for (pos = 0; pos < ARRAY_SIZE(passes); pos++)
+   {
+      size_t pass_size;
+      struct png_ihdr pass_ihdr;
+      uint32_t *pass_data = NULL;
+      const struct adam7_pass *pass = &passes[pos];
+
+      if (ihdr->width <= pass->x || ihdr->height <= pass->y)
+         continue;
+
+      pass_ihdr        = *ihdr;
+      pass_ihdr.width  = (ihdr->width - pass->x
+            + pass->stride_x - 1) / pass->stride_x;
+      pass_ihdr.height = (ihdr->height - pass->y
+            + pass->stride_y - 1) / pass->stride_y;
+
+      png_pass_geom(&pass_ihdr, pass_ihdr.width, pass_ihdr.height,
+            NULL, NULL, &pass_size);
+
+      pass_data = (uint32_t*)malloc(
+            pass_ihdr.width * pass_ihdr.height * sizeof(uint32_t));
+      if (!pass_data)
+         return false;
+
+      if (!png_reverse_filter_image(&pass_ihdr, inflated,
+               pass_data, palette))
+      {
+         free(pass_data);
+         return false;
+      }
+
+      png_reverse_filter_adam7_deinterlace_pass(data, ihdr, pass_data,
+            pass_ihdr.width, pass_ihdr.height, pass);
+
+      free(pass_data);
+      inflated += pass_size;
+   }
+
+   return true;
+}
+
+/* Size of the inflated image data, every pass of it. */
+static size_t png_inflated_size(const struct png_ihdr *ihdr)
+{
+   unsigned pos;
+   size_t total = 0;
+
+   if (!ihdr->interlace)
+   {
+      png_pass_geom(ihdr, ihdr->width, ihdr->height, NULL, NULL, &total);
+      return total;
+   }
+
+   for (pos = 0; pos < ARRAY_SIZE(passes); pos++)
+   {
+      size_t pass_size;
+      struct png_ihdr pass_ihdr;
+      const struct adam7_pass *pass = &passes[pos];
+
+      if (ihdr->width <= pass->x || ihdr->height <= pass->y)
+         continue;
+
+      pass_ihdr        = *ihdr;
+      pass_ihdr.width  = (ihdr->width - pass->x
+            + pass->stride_x - 1) / pass->stride_x;
+      pass_ihdr.height = (ihdr->height - pass->y
+            + pass->stride_y - 1) / pass->stride_y;
+
+      png_pass_geom(&pass_ihdr, pass_ihdr.width, pass_ihdr.height,
+            NULL, NULL, &pass_size);
+      total += pass_size;
+   }
+
+   return total;
+}
+
+static bool png_inflate(const uint8_t *in, size_t in_size,
+      uint8_t *out, size_t out_size)
+{
+   bool ret = false;
+   const struct file_archive_file_backend *backend =
+      file_archive_get_default_file_backend();
+   void *stream = backend->stream_new();
+
+   if (!stream)
+      return false;
+
+   if (!backend->stream_decompress_init(stream))
+   {
+      free(stream);
+      return false;
+   }
+
+   /* All of the input and all of the output at once,
+    * zlib gets through it in a single call. */
+   backend->stream_set(stream, (uint32_t)in_size, (uint32_t)out_size,
+         in, out);
+
+   while (backend->stream_get_avail_in(stream) > 0
+         && backend->stream_get_avail_out(stream) > 0)
+   {
+      int zstatus = backend->stream_decompress_data_to_file_iterate(stream);
+
+      if (zstatus == -1)
+         goto end;
+      if (zstatus == 1)
+         break;
+   }
+
+   ret = backend->stream_get_total_out(stream) == out_size;
+
+end:
+   backend->stream_free(stream);
+   free(stream);
+   return ret;
+}
+
+/**
+ * rpng_load_image_argb_from_memory:
+ * @buf                  : PNG file
+ * @size                 : size of @buf
+ * @data                 : ARGB8888 pixels, to be freed by the caller
+ * @width                : width of the image
+ * @height               : height of the image
+ *
+ * Decodes a PNG file that is already in memory in one go, for
+ * callers that don't need to spread the work over several frames.
+ * The IDAT chunks are inflated in a single call, straight from
+ * @buf when there's only one, and the scanlines are unfiltered in
+ * place. Unlike the incremental interface, every chunk is checked
+ * against @size.
+ *
+ * Returns: true if successful, otherwise false.
+ **/
+bool rpng_load_image_argb_from_memory(const uint8_t *buf, size_t size,
+      uint32_t **data, unsigned *width, unsigned *height)
+{
+   size_t pos;
+   struct png_ihdr ihdr   = {0};
+   uint32_t palette[256];
+   const uint8_t *idat    = NULL;
+   uint8_t *idat_copy     = NULL;
+   uint8_t *inflated      = NULL;
+   uint32_t *out          = NULL;
+   size_t idat_size       = 0;
+   size_t inflated_size   = 0;
+   unsigned idat_chunks   = 0;
+   bool has_ihdr          = false;
+   bool has_plte          = false;
+   bool has_iend          = false;
+
+   if (!buf || !data || size < sizeof(png_magic)
+         || memcmp(buf, png_magic, sizeof(png_magic)))
+      return false;
+
+   memset(palette, 0, sizeof(palette));
+
+   for (pos = sizeof(png_magic); pos + 12 <= size && !has_iend; )
+   {
+      struct png_chunk chunk;
+      uint8_t *chunk_data = (uint8_t*)buf + pos + 8;
+
+      read_chunk_header((uint8_t*)buf + pos, &chunk);
+
+      if (chunk.size > size - pos - 12)
+         return false;
+
+      switch (png_chunk_type(&chunk))
+      {
+         case PNG_CHUNK_IHDR:
+            if (has_ihdr || idat_chunks || chunk.size != 13)
+               return false;
+            if (!png_parse_ihdr((uint8_t*)buf + pos, &ihdr)
+                  || !png_process_ihdr(&ihdr))
+               return false;
+            has_ihdr = true;
+            break;
+         case PNG_CHUNK_PLTE:
+            if (!has_ihdr || has_plte || idat_chunks
+                  || chunk.size % 3 || chunk.size / 3 > 256)
+               return false;
+            png_read_plte(chunk_data, palette, chunk.size / 3);
+            has_plte = true;
+            break;
+         case PNG_CHUNK_tRNS:
+            if (idat_chunks)
+               return false;
+            if (ihdr.color_type == PNG_IHDR_COLOR_PLT)
+            {
+               if (chunk.size > 256)
+                  return false;
+               png_read_trns(chunk_data, palette, chunk.size);
+            }
+            break;
+         case PNG_CHUNK_IDAT:
+            if (!has_ihdr || (ihdr.color_type == PNG_IHDR_COLOR_PLT
+                     && !has_plte))
+               return false;
+            if (!idat_chunks++)
+               idat   = chunk_data;
+            idat_size += chunk.size;
+            break;
+         case PNG_CHUNK_IEND:
+            has_iend = true;
+            break;
+         default:
+            break;
+      }
+
+      pos += chunk.size + 12;
+   }
+
+   if (!has_ihdr || !idat_chunks)
+      return false;
+
+   if ((uint64_t)ihdr.width * ihdr.height > 0x4000000)
+      return false;
+
+   /* Split IDATs have to be joined for a single inflate call. */
+   if (idat_chunks > 1)
+   {
+      size_t copied = 0;
+
+      idat_copy = (uint8_t*)malloc(idat_size);
+      if (!idat_copy)
+         return false;
+
+      for (pos = sizeof(png_magic); pos + 12 <= size; )
+      {
+         struct png_chunk chunk;
+
+         read_chunk_header((uint8_t*)buf + pos, &chunk);
+
+         if (png_chunk_type(&chunk) == PNG_CHUNK_IDAT)
+         {
+            memcpy(idat_copy + copied, buf + pos + 8, chunk.size);
+            copied += chunk.size;
+         }
+         else if (png_chunk_type(&chunk) == PNG_CHUNK_IEND)
+            break;
+
+         pos += chunk.size + 12;
+      }
+
+      idat = idat_copy;
+   }
+
+   inflated_size = png_inflated_size(&ihdr);
+   inflated      = (uint8_t*)malloc(inflated_size);
+#ifdef GEKKO
+   /* we often use these in textures, make sure they're 32-byte aligned */
+   out           = (uint32_t*)memalign(32, ihdr.width *
+         ihdr.height * sizeof(uint32_t));
+#else
+   out           = (uint32_t*)malloc(ihdr.width *
+         ihdr.height * sizeof(uint32_t));
+#endif
+
+   if (!inflated || !out)
+      goto error;
+
+   if (!png_inflate(idat, idat_size, inflated, inflated_size))
+      goto error;
+
+   if (ihdr.interlace)
+   {
+      if (!png_reverse_filter_adam7_image(&ihdr, inflated, out, palette))
+         goto error;
+   }
+   else if (!png_reverse_filter_image(&ihdr, inflated, out, palette))
+      goto error;
+
+   free(inflated);
+   free(idat_copy);
+
+   *data   = out;
+   *width  = ihdr.width;
+   *height = ihdr.height;
+   return true;
+
+error:
+   free(out);
+   free(inflated);
+   free(idat_copy);
+   return false;
+}
+
 void rpng_free(rpng_t *rpng)
 {
    if (!rpng)
@@ -24,8 +24,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <retro_miscellaneous.h>
 #include <streams/file_stream.h>
 #include <file/archive_file.h>
+#ifdef HAVE_ZLIB_DEFLATE
+#include <compat/zlib.h>
+#endif
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "rpng_internal.h"
 
@@ -208,67 +215,70 @@ static unsigned filter_paeth(uint8_t *target,
    return count_sad(target, width);
 }
 
-static bool rpng_save_image(const char *path,
-      const uint8_t *data,
-      unsigned width, unsigned height, unsigned pitch, unsigned bpp)
+/* A band of rows filtered, and with several threads deflated,
+ * on its own. */
+struct png_encode_band
 {
-   unsigned h;
-   bool ret = true;
-   struct png_ihdr ihdr = {0};
-
-   const struct file_archive_file_backend *stream_backend = NULL;
-   size_t encode_buf_size  = 0;
-   uint8_t *encode_buf     = NULL;
-   uint8_t *deflate_buf    = NULL;
-   uint8_t *rgba_line      = NULL;
-   uint8_t *up_filtered    = NULL;
-   uint8_t *sub_filtered   = NULL;
-   uint8_t *avg_filtered   = NULL;
-   uint8_t *paeth_filtered = NULL;
-   uint8_t *prev_encoded   = NULL;
-   uint8_t *encode_target  = NULL;
-   void *stream            = NULL;
-   RFILE *file             = filestream_open(path, RFILE_MODE_WRITE, -1);
-   if (!file)
-      GOTO_END_ERROR();
-
-   stream_backend = file_archive_get_default_file_backend();
-
-   if (filestream_write(file, png_magic, sizeof(png_magic)) != sizeof(png_magic))
-      GOTO_END_ERROR();
-
-   ihdr.width = width;
-   ihdr.height = height;
-   ihdr.depth = 8;
-   ihdr.color_type = bpp == sizeof(uint32_t) ? 6 : 2; /* RGBA or RGB */
-   if (!png_write_ihdr(file, &ihdr))
-      GOTO_END_ERROR();
-
-   encode_buf_size = (width * bpp + 1) * height;
-   encode_buf = (uint8_t*)malloc(encode_buf_size);
-   if (!encode_buf)
-      GOTO_END_ERROR();
-
-   prev_encoded = (uint8_t*)calloc(1, width * bpp);
-   if (!prev_encoded)
-      GOTO_END_ERROR();
-
-   rgba_line      = (uint8_t*)malloc(width * bpp);
-   up_filtered    = (uint8_t*)malloc(width * bpp);
-   sub_filtered   = (uint8_t*)malloc(width * bpp);
-   avg_filtered   = (uint8_t*)malloc(width * bpp);
-   paeth_filtered = (uint8_t*)malloc(width * bpp);
-   if (!rgba_line || !up_filtered || !sub_filtered || !avg_filtered || !paeth_filtered)
-      GOTO_END_ERROR();
+   const uint8_t *data;
+   const uint8_t *prev_data;
+   unsigned width;
+   unsigned rows;
+   unsigned pitch;
+   unsigned bpp;
+   int level;
+   bool last;
+
+   /* Filtered rows, each one prefixed with its filter type. */
+   uint8_t *encoded;
+   size_t encoded_size;
+   /* Filtered bytes right before the band that are used
+    * as the deflate dictionary. */
+   size_t dict_size;
+
+   uint8_t *deflated;
+   size_t deflated_size;
+   uint32_t adler;
+   bool ok;
+};
+
+static void png_copy_line(uint8_t *dst, const uint8_t *src,
+      unsigned width, unsigned bpp)
+{
+   if (bpp == sizeof(uint32_t))
+      copy_argb_line(dst, (const uint32_t*)src, width);
+   else
+      copy_bgr24_line(dst, src, width);
+}
 
-   encode_target = encode_buf;
-   for (h = 0; h < height;
-         h++, encode_target += width * bpp, data += pitch)
+static void png_filter_band(void *data)
+{
+   unsigned h;
+   struct png_encode_band *band = (struct png_encode_band*)data;
+   unsigned line_size           = band->width * band->bpp;
+   const uint8_t *src           = band->data;
+   uint8_t *encode_target       = band->encoded;
+   uint8_t *rgba_line           = (uint8_t*)malloc(line_size);
+   uint8_t *prev_encoded        = (uint8_t*)calloc(1, line_size);
+   uint8_t *up_filtered         = (uint8_t*)malloc(line_size);
+   uint8_t *sub_filtered        = (uint8_t*)malloc(line_size);
+   uint8_t *avg_filtered        = (uint8_t*)malloc(line_size);
+   uint8_t *paeth_filtered      = (uint8_t*)malloc(line_size);
+
+   band->ok = false;
+
+   if (!rgba_line || !prev_encoded || !up_filtered || !sub_filtered
+         || !avg_filtered || !paeth_filtered)
+      goto end;
+
+   /* The first row of a band is filtered against the last row
+    * of the band above. */
+   if (band->prev_data)
+      png_copy_line(prev_encoded, band->prev_data, band->width, band->bpp);
+
+   for (h = 0; h < band->rows;
+         h++, encode_target += line_size, src += band->pitch)
    {
-      if (bpp == sizeof(uint32_t))
-         copy_argb_line(rgba_line, (const uint32_t*)data, width);
-      else
-         copy_bgr24_line(rgba_line, data, width);
+      png_copy_line(rgba_line, src, band->width, band->bpp);
 
       /* Try every filtering method, and choose the method
        * which has most entries as zero.
@@ -277,11 +287,11 @@ static bool rpng_save_image(const char *path,
        * simple to implement.
        */
       {
-         unsigned none_score  = count_sad(rgba_line, width * bpp);
-         unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned sub_score   = filter_sub(sub_filtered, rgba_line, width, bpp);
-         unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, width, bpp);
-         unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, width, bpp);
+         unsigned none_score  = count_sad(rgba_line, line_size);
+         unsigned up_score    = filter_up(up_filtered, rgba_line, prev_encoded, band->width, band->bpp);
+         unsigned sub_score   = filter_sub(sub_filtered, rgba_line, band->width, band->bpp);
+         unsigned avg_score   = filter_avg(avg_filtered, rgba_line, prev_encoded, band->width, band->bpp);
+         unsigned paeth_score = filter_paeth(paeth_filtered, rgba_line, prev_encoded, band->width, band->bpp);
 
          uint8_t filter       = 0;
          unsigned min_sad     = none_score;
@@ -316,10 +326,246 @@ static bool rpng_save_image(const char *path,
          }
 
          *encode_target++ = filter;
-         memcpy(encode_target, chosen_filtered, width * bpp);
+         memcpy(encode_target, chosen_filtered, line_size);
+
+         memcpy(prev_encoded, rgba_line, line_size);
+      }
+   }
+
+   band->ok = true;
+
+end:
+   free(rgba_line);
+   free(prev_encoded);
+   free(up_filtered);
+   free(sub_filtered);
+   free(avg_filtered);
+   free(paeth_filtered);
+}
+
+/* Deflates a band as raw deflate blocks, primed with the 32 KB
+ * before it. Every band but the last ends on a byte aligned empty
+ * stored block (Z_SYNC_FLUSH) without the final bit set, so the
+ * bands can be concatenated into a single stream. */
+static void png_deflate_band(void *data)
+{
+   z_stream stream;
+   size_t bound;
+   int zret;
+   struct png_encode_band *band = (struct png_encode_band*)data;
+
+   band->ok = false;
 
-         memcpy(prev_encoded, rgba_line, width * bpp);
+   memset(&stream, 0, sizeof(stream));
+   if (deflateInit2(&stream, band->level, Z_DEFLATED,
+            -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return;
+
+   if (band->dict_size && deflateSetDictionary(&stream,
+            band->encoded - band->dict_size, (uInt)band->dict_size) != Z_OK)
+      goto end;
+
+   /* Room for Z_FINISH, plus the empty stored block of
+    * Z_SYNC_FLUSH. */
+   bound          = deflateBound(&stream, band->encoded_size) + 16;
+   band->deflated = (uint8_t*)malloc(bound);
+   if (!band->deflated)
+      goto end;
+
+   stream.next_in   = band->encoded;
+   stream.avail_in  = (uInt)band->encoded_size;
+   stream.next_out  = band->deflated;
+   stream.avail_out = (uInt)bound;
+
+   zret = deflate(&stream, band->last ? Z_FINISH : Z_SYNC_FLUSH);
+
+   if (band->last ? zret != Z_STREAM_END
+         : (zret != Z_OK || stream.avail_in || !stream.avail_out))
+      goto end;
+
+   band->deflated_size = bound - stream.avail_out;
+   band->adler         = (uint32_t)adler32(adler32(0L, Z_NULL, 0),
+         band->encoded, (uInt)band->encoded_size);
+   band->ok            = true;
+
+end:
+   deflateEnd(&stream);
+}
+
+static void png_run_bands(struct png_encode_band *bands, unsigned count,
+      void (*func)(void*))
+{
+   unsigned i;
+#ifdef HAVE_THREADS
+   sthread_t *threads[RPNG_ENCODE_MAX_THREADS] = {NULL};
+
+   for (i = 1; i < count; i++)
+      threads[i] = sthread_create(func, &bands[i]);
+#endif
+
+   func(&bands[0]);
+
+   for (i = 1; i < count; i++)
+   {
+#ifdef HAVE_THREADS
+      if (threads[i])
+      {
+         sthread_join(threads[i]);
+         continue;
       }
+#endif
+      func(&bands[i]);
+   }
+}
+
+static bool png_bands_ok(const struct png_encode_band *bands,
+      unsigned count)
+{
+   unsigned i;
+   for (i = 0; i < count; i++)
+      if (!bands[i].ok)
+         return false;
+   return true;
+}
+
+/* Writes the bands deflated on their own as a single zlib stream. */
+static bool png_write_idat_bands(RFILE *file,
+      const struct png_encode_band *bands, unsigned count, int level)
+{
+   unsigned i;
+   bool ret         = false;
+   size_t size      = 8 + 2 + 4;
+   uint32_t adler   = bands[0].adler;
+   uint8_t *idat    = NULL;
+   uint8_t *target  = NULL;
+
+   for (i = 0; i < count; i++)
+      size += bands[i].deflated_size;
+
+   idat = (uint8_t*)malloc(size);
+   if (!idat)
+      return false;
+
+   dword_write_be(idat + 0, (uint32_t)(size - 8));
+   memcpy(idat + 4, "IDAT", 4);
+
+   /* CMF and FLG of the zlib header, FLEVEL follows the level
+    * the way zlib sets it. */
+   idat[8]  = 0x78;
+   if (level >= 0 && level < 2)
+      idat[9] = 0x01;
+   else if (level >= 2 && level < 6)
+      idat[9] = 0x5e;
+   else if (level == 6 || level < 0)
+      idat[9] = 0x9c;
+   else
+      idat[9] = 0xda;
+
+   target = idat + 10;
+   for (i = 0; i < count; i++)
+   {
+      memcpy(target, bands[i].deflated, bands[i].deflated_size);
+      target += bands[i].deflated_size;
+
+      if (i > 0)
+         adler = (uint32_t)adler32_combine(adler, bands[i].adler,
+               (z_off_t)bands[i].encoded_size);
+   }
+   dword_write_be(target, adler);
+
+   ret = png_write_idat(file, idat, size);
+   free(idat);
+   return ret;
+}
+
+static bool rpng_save_image(const char *path,
+      const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch, unsigned bpp,
+      int level, unsigned threads)
+{
+   unsigned i;
+   unsigned rows_per_band;
+   bool ret = true;
+   struct png_ihdr ihdr = {0};
+   struct png_encode_band bands[RPNG_ENCODE_MAX_THREADS];
+   unsigned band_count     = 0;
+   const struct file_archive_file_backend *stream_backend = NULL;
+   size_t line_size        = width * bpp + 1;
+   size_t encode_buf_size  = 0;
+   uint8_t *encode_buf     = NULL;
+   uint8_t *deflate_buf    = NULL;
+   void *stream            = NULL;
+   RFILE *file             = filestream_open(path, RFILE_MODE_WRITE, -1);
+
+   memset(bands, 0, sizeof(bands));
+
+   if (!file)
+      GOTO_END_ERROR();
+
+   stream_backend = file_archive_get_default_file_backend();
+
+   if (filestream_write(file, png_magic, sizeof(png_magic)) != sizeof(png_magic))
+      GOTO_END_ERROR();
+
+   ihdr.width = width;
+   ihdr.height = height;
+   ihdr.depth = 8;
+   ihdr.color_type = bpp == sizeof(uint32_t) ? 6 : 2; /* RGBA or RGB */
+   if (!png_write_ihdr(file, &ihdr))
+      GOTO_END_ERROR();
+
+   encode_buf_size = line_size * height;
+   encode_buf = (uint8_t*)malloc(encode_buf_size);
+   if (!encode_buf)
+      GOTO_END_ERROR();
+
+   /* Bands shorter than this aren't worth a thread. */
+   if (threads > RPNG_ENCODE_MAX_THREADS)
+      threads = RPNG_ENCODE_MAX_THREADS;
+   if (threads > height / 16)
+      threads = height / 16;
+   if (threads < 1)
+      threads = 1;
+
+   rows_per_band = (height + threads - 1) / threads;
+
+   for (i = 0; i * rows_per_band < height; i++, band_count++)
+   {
+      struct png_encode_band *band = &bands[i];
+      unsigned y                   = i * rows_per_band;
+
+      band->data          = data + (size_t)y * pitch;
+      band->prev_data     = y ? data + (size_t)(y - 1) * pitch : NULL;
+      band->width         = width;
+      band->rows          = MIN(rows_per_band, height - y);
+      band->pitch         = pitch;
+      band->bpp           = bpp;
+      band->level         = level;
+      band->last          = (y + band->rows) == height;
+      band->encoded       = encode_buf + (size_t)y * line_size;
+      band->encoded_size  = band->rows * line_size;
+      band->dict_size     = MIN((size_t)y * line_size, 32768);
+   }
+
+   png_run_bands(bands, band_count, png_filter_band);
+
+   if (!png_bands_ok(bands, band_count))
+      GOTO_END_ERROR();
+
+   if (band_count > 1)
+   {
+      png_run_bands(bands, band_count, png_deflate_band);
+
+      if (!png_bands_ok(bands, band_count))
+         GOTO_END_ERROR();
+
+      if (!png_write_idat_bands(file, bands, band_count, level))
+         GOTO_END_ERROR();
+
+      if (!png_write_iend(file))
+         GOTO_END_ERROR();
+
+      goto end;
    }
 
    deflate_buf = (uint8_t*)malloc(encode_buf_size * 2); /* Just to be sure. */
@@ -338,7 +584,7 @@ static bool rpng_save_image(const char *path,
          encode_buf,
          deflate_buf + 8);
 
-   stream_backend->stream_compress_init(stream, 9);
+   stream_backend->stream_compress_init(stream, level);
 
    if (stream_backend->stream_compress_data_to_file(stream) != 1)
    {
@@ -360,12 +606,8 @@ end:
    filestream_close(file);
    free(encode_buf);
    free(deflate_buf);
-   free(rgba_line);
-   free(prev_encoded);
-   free(up_filtered);
-   free(sub_filtered);
-   free(avg_filtered);
-   free(paeth_filtered);
+   for (i = 0; i < band_count; i++)
+      free(bands[i].deflated);
 
    if (stream_backend)
       stream_backend->stream_free(stream);
@@ -376,14 +618,22 @@ bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
    return rpng_save_image(path, (const uint8_t*)data,
-         width, height, pitch, sizeof(uint32_t));
+         width, height, pitch, sizeof(uint32_t), 9, 1);
 }
 
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch)
 {
    return rpng_save_image(path, (const uint8_t*)data,
-         width, height, pitch, 3);
+         width, height, pitch, 3, 9, 1);
+}
+
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      int level, unsigned threads)
+{
+   return rpng_save_image(path, (const uint8_t*)data,
+         width, height, pitch, 3, level, threads);
 }
 
 #endif
@@ -0,0 +1,202 @@
+/* Copyright  (C) 2010-2016 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (rpng_bench.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Decodes every PNG given on the command line through the incremental
+ * decoder and through rpng_load_image_argb_from_memory, checks both
+ * give the same pixels and times the latter.
+ *
+ * Build the scalar and SSSE3 variants (make rpng_bench_scalar,
+ * make rpng_bench_ssse3) to compare the unfilter kernels. The pixel
+ * checksums printed must match between the variants. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <formats/rpng.h>
+#include <formats/image.h>
+
+#define BENCH_ITERATIONS 20
+
+static double bench_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1000000000.0;
+}
+
+static uint8_t *bench_read_file(const char *path, size_t *len)
+{
+   long size;
+   uint8_t *buf = NULL;
+   FILE *file   = fopen(path, "rb");
+
+   if (!file)
+      return NULL;
+
+   fseek(file, 0, SEEK_END);
+   size = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   if (size > 0)
+      buf = (uint8_t*)malloc(size);
+
+   if (buf && fread(buf, 1, size, file) != (size_t)size)
+   {
+      free(buf);
+      buf = NULL;
+   }
+
+   fclose(file);
+   *len = size;
+   return buf;
+}
+
+static bool bench_decode_incremental(uint8_t *buf, size_t len,
+      uint32_t **data, unsigned *width, unsigned *height)
+{
+   int retval;
+   bool ret     = false;
+   rpng_t *rpng = rpng_alloc();
+
+   *data = NULL;
+
+   if (!rpng)
+      return false;
+
+   if (!rpng_set_buf_ptr(rpng, buf) || !rpng_start(rpng))
+      goto end;
+
+   while (rpng_iterate_image(rpng));
+
+   if (!rpng_is_valid(rpng))
+      goto end;
+
+   do
+   {
+      retval = rpng_process_image(rpng,
+            (void**)data, len, width, height);
+   } while (retval == IMAGE_PROCESS_NEXT);
+
+   ret = retval == IMAGE_PROCESS_END;
+
+end:
+   rpng_free(rpng);
+   if (!ret)
+   {
+      free(*data);
+      *data = NULL;
+   }
+   return ret;
+}
+
+static uint32_t bench_checksum(const uint32_t *data, size_t count)
+{
+   size_t i;
+   uint32_t hash = 5381;
+
+   for (i = 0; i < count; i++)
+      hash = (hash << 5) + hash + data[i];
+
+   return hash;
+}
+
+int main(int argc, char *argv[])
+{
+   int i;
+   double total_time   = 0.0;
+   double total_pixels = 0.0;
+   int failed          = 0;
+
+   if (argc < 2)
+   {
+      fprintf(stderr, "Usage: %s <png file> [...]\n", argv[0]);
+      return 1;
+   }
+
+   for (i = 1; i < argc; i++)
+   {
+      unsigned j;
+      size_t len;
+      double start, elapsed;
+      unsigned width       = 0;
+      unsigned height      = 0;
+      unsigned ref_width   = 0;
+      unsigned ref_height  = 0;
+      uint32_t *data       = NULL;
+      uint32_t *ref        = NULL;
+      uint8_t *buf         = bench_read_file(argv[i], &len);
+
+      if (!buf)
+      {
+         fprintf(stderr, "%s: can't read.\n", argv[i]);
+         failed++;
+         continue;
+      }
+
+      if (!bench_decode_incremental(buf, len, &ref, &ref_width, &ref_height)
+            || !rpng_load_image_argb_from_memory(buf, len,
+               &data, &width, &height))
+      {
+         fprintf(stderr, "%s: decoding failed.\n", argv[i]);
+         free(ref);
+         free(buf);
+         failed++;
+         continue;
+      }
+
+      if (width != ref_width || height != ref_height ||
+            memcmp(data, ref, width * height * sizeof(uint32_t)))
+      {
+         fprintf(stderr, "%s: decoders disagree.\n", argv[i]);
+         failed++;
+      }
+
+      free(ref);
+
+      start = bench_time();
+      for (j = 0; j < BENCH_ITERATIONS; j++)
+      {
+         free(data);
+         data = NULL;
+         rpng_load_image_argb_from_memory(buf, len, &data, &width, &height);
+      }
+      elapsed = (bench_time() - start) / BENCH_ITERATIONS;
+
+      printf("%s: %ux%u, %08x, %.3f ms, %.1f Mpixels/s\n", argv[i],
+            width, height, bench_checksum(data, width * height),
+            elapsed * 1000.0, width * height / elapsed / 1000000.0);
+
+      total_time   += elapsed;
+      total_pixels += (double)width * height;
+
+      free(data);
+      free(buf);
+   }
+
+   printf("Total: %.3f ms, %.1f Mpixels/s\n", total_time * 1000.0,
+         total_time > 0.0 ? total_pixels / total_time / 1000000.0 : 0.0);
+
+   return failed ? 1 : 0;
+}
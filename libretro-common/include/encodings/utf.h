@@ -40,4 +40,7 @@ size_t utf8cpy(char *d, size_t d_len, const char *s, size_t chars);
 
 const char *utf8skip(const char *str, size_t chars);
 
+/* Returns the code point at *@string and moves it to the next one. */
+uint32_t utf8_walk(const char **string);
+
 #endif
@@ -83,6 +83,8 @@ typedef int (*file_archive_file_cb)(const char *name, const char *valid_exts,
       const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
       uint32_t crc32, void *userdata);
 
+typedef struct file_archive_parallel file_archive_parallel_t;
+
 int file_archive_parse_file_iterate(
       file_archive_transfer_t *state,
       bool *returnerr,
@@ -95,6 +97,14 @@ void file_archive_parse_file_iterate_stop(file_archive_transfer_t *state);
 
 int file_archive_parse_file_progress(file_archive_transfer_t *state);
 
+/**
+ * file_archive_init:
+ *
+ * Creates the lock of the archive index cache. Has to be called
+ * before archives are read from more than one thread.
+ **/
+void file_archive_init(void);
+
 /**
  * file_archive_extract_first_content_file:
  * @zip_path                    : filename path to ZIP archive.
@@ -121,6 +131,83 @@ bool file_archive_extract_first_content_file(char *zip_path, size_t zip_path_siz
  **/
 struct string_list *file_archive_get_file_list(const char *path, const char *valid_exts);
 
+/**
+ * file_archive_get_file_crc:
+ * @path                        : filename path of archive.
+ * @needle                      : name of the file inside the archive.
+ * @crc                         : CRC32 of the file as recorded by the archive.
+ * @size                        : uncompressed size of the file. Can be NULL.
+ *
+ * Looks up a file in the central directory of an archive
+ * without decompressing it.
+ *
+ * Returns: true (1) if the file was found, otherwise false (0).
+ **/
+bool file_archive_get_file_crc(const char *path, const char *needle,
+      uint32_t *crc, uint32_t *size);
+
+/**
+ * file_archive_get_first_file_crc:
+ * @path                        : filename path of archive.
+ * @name                        : receives the name of the file.
+ * @len                         : size of @name.
+ * @crc                         : CRC32 of the file as recorded by the archive.
+ *
+ * Looks up the first file of an archive with a CRC, which skips
+ * directories and empty files, without decompressing it.
+ *
+ * Returns: true (1) if a file was found, otherwise false (0).
+ **/
+bool file_archive_get_first_file_crc(const char *path,
+      char *name, size_t len, uint32_t *crc);
+
+#ifdef HAVE_THREADS
+/**
+ * file_archive_parallel_new:
+ * @file                        : filename path of archive
+ * @valid_exts                  : Valid extensions of archive to be parsed. 
+ *                                If NULL, allow all.
+ * @file_cb                     : file_cb function pointer
+ * @userdata                    : userdata to pass to file_cb function pointer.
+ * @threads                     : number of worker threads.
+ *
+ * Calls file_cb for every file of the archive from a pool of worker
+ * threads, so independent files are inflated in parallel. file_cb
+ * has to be safe to call concurrently. Unlike with
+ * file_archive_parse_file_iterate(), returning 0 from file_cb
+ * signals an error and stops the remaining files.
+ *
+ * Returns: handle on success, otherwise NULL.
+ **/
+file_archive_parallel_t *file_archive_parallel_new(const char *file,
+      const char *valid_exts, file_archive_file_cb file_cb,
+      void *userdata, unsigned threads);
+
+/**
+ * file_archive_parallel_iterate:
+ * @par                         : handle from file_archive_parallel_new().
+ * @timeout_us                  : how long to wait for a file to finish.
+ *
+ * Returns: true once all worker threads are done.
+ **/
+bool file_archive_parallel_iterate(file_archive_parallel_t *par,
+      int64_t timeout_us);
+
+int file_archive_parallel_progress(file_archive_parallel_t *par);
+
+/**
+ * file_archive_parallel_free:
+ * @par                         : handle from file_archive_parallel_new().
+ *
+ * Stops the remaining files, waits for the worker threads and frees
+ * the handle.
+ *
+ * Returns: true (1) if every file was processed successfully,
+ * otherwise false (0).
+ **/
+bool file_archive_parallel_free(file_archive_parallel_t *par);
+#endif
+
 bool file_archive_perform_mode(const char *name, const char *valid_exts,
       const uint8_t *cdata, unsigned cmode, uint32_t csize, uint32_t size,
       uint32_t crc32, void *userdata);
@@ -158,6 +158,10 @@ bool config_file_write(config_file_t *conf, const char *path);
  * Does not close the file. */
 void config_file_dump(config_file_t *conf, FILE *file);
 
+/* Dump the current config to a string, as config_file_write()
+ * would write it. Has to be freed by the caller. */
+char *config_file_dump_to_buffer(config_file_t *conf);
+
 RETRO_END_DECLS
 
 #endif
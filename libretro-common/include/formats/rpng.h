@@ -51,11 +51,37 @@ int rpng_process_image(rpng_t *rpng,
 
 bool rpng_start(rpng_t *rpng);
 
+bool rpng_load_image_argb_from_memory(const uint8_t *buf, size_t size,
+      uint32_t **data, unsigned *width, unsigned *height);
+
 #ifdef HAVE_ZLIB_DEFLATE
 bool rpng_save_image_argb(const char *path, const uint32_t *data,
       unsigned width, unsigned height, unsigned pitch);
 bool rpng_save_image_bgr24(const char *path, const uint8_t *data,
       unsigned width, unsigned height, unsigned pitch);
+
+#define RPNG_ENCODE_MAX_THREADS 16
+
+/**
+ * rpng_save_image_bgr24_ex:
+ * @path                 : file to write
+ * @data                 : BGR24 pixels, top row first
+ * @width                : width in pixels
+ * @height               : height in pixels
+ * @pitch                : bytes between rows of @data
+ * @level                : zlib compression level, 0 to 9
+ * @threads              : number of threads to encode with
+ *
+ * With more than one thread the image is cut in bands of rows
+ * which are filtered and deflated on their own threads, and
+ * written as one zlib stream. The result is slightly larger
+ * than with a single thread.
+ *
+ * Returns: true if the image was written.
+ **/
+bool rpng_save_image_bgr24_ex(const char *path, const uint8_t *data,
+      unsigned width, unsigned height, unsigned pitch,
+      int level, unsigned threads);
 #endif
 
 RETRO_END_DECLS
@@ -36,7 +36,8 @@ RETRO_BEGIN_DECLS
  * @include_dirs       : include directories as part of the finished directory listing?
  * @include_compressed : include compressed files, even when not part of ext.
  *
- * Create a directory listing.
+ * Create a directory listing. Recent listings are served from a
+ * cache as long as the directory didn't change.
  *
  * Returns: pointer to a directory listing of type 'struct string_list *' on success,
  * NULL in case of error. Has to be freed manually.
@@ -44,6 +45,45 @@ RETRO_BEGIN_DECLS
 struct string_list *dir_list_new(const char *dir, const char *ext,
       bool include_dirs, bool include_compressed);
 
+/**
+ * dir_list_prefetch:
+ * @dirs               : directories to list.
+ * @ext                : allowed extensions of file directory entries to include.
+ * @include_dirs       : include directories as part of the finished directory listing?
+ * @include_compressed : include compressed files, even when not part of ext.
+ *
+ * Lists directories on a background thread, so a later
+ * dir_list_new() with the same arguments is served from the
+ * listing cache. Does nothing if a prefetch is already running,
+ * or without thread support.
+ **/
+void dir_list_prefetch(const struct string_list *dirs,
+      const char *ext, bool include_dirs, bool include_compressed);
+
+/**
+ * dir_list_cache_clear:
+ *
+ * Drops all cached directory listings.
+ **/
+void dir_list_cache_clear(void);
+
+/**
+ * dir_list_cache_init:
+ *
+ * Sets the listing cache up for use from several threads.
+ * Has to be called before any other thread lists directories.
+ **/
+void dir_list_cache_init(void);
+
+/**
+ * dir_list_cache_deinit:
+ *
+ * Waits for a running prefetch, then drops all cached listings
+ * and stops watching their directories. No other thread may
+ * list directories anymore.
+ **/
+void dir_list_cache_deinit(void);
+
 /**
  * dir_list_sort:
  * @list      : pointer to the directory listing.
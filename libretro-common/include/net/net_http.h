@@ -44,8 +44,18 @@ void net_http_connection_free(struct http_connection_t *conn);
 
 const char *net_http_connection_url(struct http_connection_t *conn);
 
+/* Sends a GET request for the connection's URL.
+ *
+ * Requests to the same host share keep-alive connections; once a few
+ * connections to the host are busy, requests get pipelined on them. */
 struct http_t *net_http_new(struct http_connection_t *conn);
 
+/* Like net_http_new, but the body is written to the file at 'path'
+ * as it arrives instead of being kept in memory.
+ * net_http_data returns NULL for such requests. */
+struct http_t *net_http_new_file(struct http_connection_t *conn,
+      const char *path);
+
 /* You can use this to call net_http_update 
  * only when something will happen; select() it for reading. */
 int net_http_fd(struct http_t *state);
@@ -68,6 +78,13 @@ uint8_t* net_http_data(struct http_t *state, size_t* len, bool accept_error);
 /* Cleans up all memory. */
 void net_http_delete(struct http_t *state);
 
+/* Sets up the pool of keep-alive connections. Has to be called
+ * before requests are made from more than one thread. */
+void net_http_pool_init(void);
+
+/* Closes the idle keep-alive connections. */
+void net_http_pool_clear(void);
+
 RETRO_END_DECLS
 
 #endif
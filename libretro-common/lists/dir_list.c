@@ -20,13 +20,35 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#if !defined(VITA) && !defined(PSP) && !defined(__CELLOS_LV2__)
+#define HAVE_DIR_LIST_CACHE
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(HAVE_DIR_LIST_CACHE) && defined(__linux__)
+#define HAVE_DIR_LIST_INOTIFY
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include <lists/dir_list.h>
 #include <lists/string_list.h>
 #include <file/file_path.h>
 
 #include <compat/strl.h>
+#include <compat/posix_string.h>
 #include <retro_dirent.h>
 
 #include <retro_miscellaneous.h>
@@ -80,6 +102,83 @@ void dir_list_free(struct string_list *list)
    string_list_free(list);
 }
 
+/* Extension filter, hashed so matching an entry doesn't
+ * depend on the number of extensions a core supports. */
+typedef struct dir_list_ext_set
+{
+   const char **slots;
+   size_t mask;
+} dir_list_ext_set_t;
+
+static uint32_t dir_list_ext_hash(const char *ext)
+{
+   uint32_t hash = 5381;
+
+   while (*ext)
+      hash = (hash << 5) + hash + (uint8_t)tolower((unsigned char)*ext++);
+
+   return hash;
+}
+
+static bool dir_list_ext_set_init(dir_list_ext_set_t *set,
+      const struct string_list *ext_list)
+{
+   size_t i;
+   size_t size = 8;
+
+   set->slots = NULL;
+   set->mask  = 0;
+
+   if (!ext_list)
+      return true;
+
+   while (size < ext_list->size * 2)
+      size <<= 1;
+
+   set->slots = (const char**)calloc(size, sizeof(*set->slots));
+   if (!set->slots)
+      return false;
+
+   set->mask = size - 1;
+
+   for (i = 0; i < ext_list->size; i++)
+   {
+      size_t slot;
+      const char *ext = ext_list->elems[i].data;
+
+      /* Extensions may be listed with or without a leading dot. */
+      if (*ext == '.')
+         ext++;
+
+      slot = dir_list_ext_hash(ext) & set->mask;
+      while (set->slots[slot] && strcasecmp(set->slots[slot], ext))
+         slot = (slot + 1) & set->mask;
+      set->slots[slot] = ext;
+   }
+
+   return true;
+}
+
+static bool dir_list_ext_set_find(const dir_list_ext_set_t *set,
+      const char *ext)
+{
+   size_t slot;
+
+   if (!set->slots || !ext)
+      return false;
+
+   slot = dir_list_ext_hash(ext) & set->mask;
+
+   while (set->slots[slot])
+   {
+      if (!strcasecmp(set->slots[slot], ext))
+         return true;
+      slot = (slot + 1) & set->mask;
+   }
+
+   return false;
+}
+
 /**
  * parse_dir_entry:
  * @name               : name of the directory listing entry.
@@ -88,7 +187,7 @@ void dir_list_free(struct string_list *list)
  * @include_dirs       : include directories as part of the finished directory listing?
  * @include_compressed : Include compressed files, even if not part of ext_list.
  * @list               : pointer to directory listing.
- * @ext_list           : pointer to allowed file extensions listing.
+ * @ext_set            : allowed file extensions, NULL to allow all.
  * @file_ext           : file extension of the directory listing entry.
  *
  * Parses a directory listing.
@@ -98,7 +197,7 @@ void dir_list_free(struct string_list *list)
  **/
 static int parse_dir_entry(const char *name, char *file_path,
       bool is_dir, bool include_dirs, bool include_compressed,
-      struct string_list *list, struct string_list *ext_list,
+      struct string_list *list, const dir_list_ext_set_t *ext_set,
       const char *file_ext)
 {
    union string_list_elem_attr attr;
@@ -110,7 +209,7 @@ static int parse_dir_entry(const char *name, char *file_path,
    if (!is_dir)
    {
       is_compressed_file = path_is_compressed_file(file_path);
-      if (string_list_find_elem_prefix(ext_list, ".", file_ext))
+      if (ext_set && dir_list_ext_set_find(ext_set, file_ext))
          supported_by_core = true;
    }
 
@@ -120,7 +219,7 @@ static int parse_dir_entry(const char *name, char *file_path,
    if (!strcmp(name, ".") || !strcmp(name, ".."))
       return 1;
 
-   if (!is_dir && ext_list &&
+   if (!is_dir && ext_set &&
            ((!is_compressed_file && !supported_by_core) ||
             (!supported_by_core && !include_compressed)))
       return 1;
@@ -146,31 +245,25 @@ static int parse_dir_entry(const char *name, char *file_path,
    return 0;
 }
 
-/**
- * dir_list_new:
- * @dir                : directory path.
- * @ext                : allowed extensions of file directory entries to include.
- * @include_dirs       : include directories as part of the finished directory listing?
- * @include_compressed : Only include files which match ext. Do not try to match compressed files, etc.
- *
- * Create a directory listing.
- *
- * Returns: pointer to a directory listing of type 'struct string_list *' on success,
- * NULL in case of error. Has to be freed manually.
- **/
-struct string_list *dir_list_new(const char *dir,
+static struct string_list *dir_list_read(const char *dir,
       const char *ext, bool include_dirs, bool include_compressed)
 {
+   dir_list_ext_set_t ext_set;
    struct RDIR *entry             = NULL;
    struct string_list *ext_list   = NULL;
    struct string_list *list       = NULL;
 
+   ext_set.slots                  = NULL;
+
    if (!(list = string_list_new()))
       return NULL;
 
    if (ext)
       ext_list = string_split(ext, "|");
 
+   if (!dir_list_ext_set_init(&ext_set, ext_list))
+      goto error;
+
    entry = retro_opendir(dir);
 
    if (!entry)
@@ -191,7 +284,8 @@ struct string_list *dir_list_new(const char *dir,
       is_dir = retro_dirent_is_dir(entry, file_path);
 
       ret    = parse_dir_entry(name, file_path, is_dir,
-            include_dirs, include_compressed, list, ext_list, file_ext);
+            include_dirs, include_compressed, list,
+            ext_list ? &ext_set : NULL, file_ext);
 
       if (ret == -1)
          goto error;
@@ -202,13 +296,533 @@ struct string_list *dir_list_new(const char *dir,
 
    retro_closedir(entry);
 
+   free(ext_set.slots);
    string_list_free(ext_list);
    return list;
 
 error:
    retro_closedir(entry);
 
+   free(ext_set.slots);
    string_list_free(list);
    string_list_free(ext_list);
    return NULL;
 }
+
+#ifdef HAVE_DIR_LIST_CACHE
+/* Cache of recent directory listings.
+ *
+ * A listing is keyed by directory, extension filter and flags. It is
+ * always revalidated against the directory's modification time, since
+ * inotify misses changes made by other hosts on network and FUSE
+ * mounts; where available, inotify also invalidates it right away.
+ * Listings taken while the directory's mtime was too recent to tell
+ * later changes apart (the "racy" window of coarse filesystem
+ * timestamps) are not trusted. */
+
+#define DIR_LIST_CACHE_SIZE       16
+#define DIR_LIST_CACHE_RACY_SECS  2
+
+typedef struct dir_list_cache_entry
+{
+   char *dir;
+   char *ext;
+   struct string_list *list;
+   int64_t mtime;
+   int64_t listed_at;
+   int watch;
+   bool include_dirs;
+   bool include_compressed;
+   bool stale;
+} dir_list_cache_entry_t;
+
+static dir_list_cache_entry_t *dir_list_cache[DIR_LIST_CACHE_SIZE];
+#ifdef HAVE_DIR_LIST_INOTIFY
+static int dir_list_inotify_fd   = -2;
+#endif
+#ifdef HAVE_THREADS
+/* Created by dir_list_cache_init(), listings are only
+ * taken on other threads while it exists. */
+static slock_t *dir_list_cache_lock        = NULL;
+static sthread_t *dir_list_prefetch_handle = NULL;
+static bool dir_list_prefetching           = false;
+#endif
+
+static void dir_list_cache_lock_acquire(void)
+{
+#ifdef HAVE_THREADS
+   if (dir_list_cache_lock)
+      slock_lock(dir_list_cache_lock);
+#endif
+}
+
+static void dir_list_cache_lock_release(void)
+{
+#ifdef HAVE_THREADS
+   if (dir_list_cache_lock)
+      slock_unlock(dir_list_cache_lock);
+#endif
+}
+
+static bool dir_list_get_mtime(const char *dir, int64_t *mtime)
+{
+   struct stat st;
+
+   if (stat(dir, &st) != 0)
+      return false;
+
+   *mtime = st.st_mtime;
+   return true;
+}
+
+static struct string_list *dir_list_copy(const struct string_list *src)
+{
+   size_t i;
+   struct string_list *list = string_list_new();
+
+   if (!list)
+      return NULL;
+
+   for (i = 0; i < src->size; i++)
+   {
+      if (!string_list_append(list, src->elems[i].data, src->elems[i].attr))
+      {
+         string_list_free(list);
+         return NULL;
+      }
+   }
+
+   return list;
+}
+
+/* Must be called with the cache locked. */
+static void dir_list_cache_entry_free(dir_list_cache_entry_t *entry)
+{
+   if (!entry)
+      return;
+
+#ifdef HAVE_DIR_LIST_INOTIFY
+   if (entry->watch >= 0)
+   {
+      unsigned i;
+      bool shared = false;
+
+      /* Listings of the same directory share one watch. */
+      for (i = 0; i < DIR_LIST_CACHE_SIZE; i++)
+         if (dir_list_cache[i] && dir_list_cache[i] != entry
+               && dir_list_cache[i]->watch == entry->watch)
+            shared = true;
+
+      if (!shared)
+         inotify_rm_watch(dir_list_inotify_fd, entry->watch);
+   }
+#endif
+
+   string_list_free(entry->list);
+   free(entry->dir);
+   free(entry->ext);
+   free(entry);
+}
+
+#ifdef HAVE_DIR_LIST_INOTIFY
+/* Marks listings of directories that changed as stale.
+ * Must be called with the cache locked. */
+static void dir_list_cache_poll_inotify(void)
+{
+   char buf[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+   if (dir_list_inotify_fd < 0)
+      return;
+
+   for (;;)
+   {
+      char *ptr;
+      ssize_t len = read(dir_list_inotify_fd, buf, sizeof(buf));
+
+      if (len <= 0)
+         break;
+
+      for (ptr = buf; ptr < buf + len; )
+      {
+         unsigned i;
+         const struct inotify_event *event =
+            (const struct inotify_event*)ptr;
+
+         for (i = 0; i < DIR_LIST_CACHE_SIZE; i++)
+         {
+            if (!dir_list_cache[i])
+               continue;
+            if (event->mask & IN_Q_OVERFLOW
+                  || dir_list_cache[i]->watch == event->wd)
+               dir_list_cache[i]->stale = true;
+         }
+
+         ptr += sizeof(struct inotify_event) + event->len;
+      }
+   }
+}
+#endif
+
+/* Must be called with the cache locked. */
+static bool dir_list_cache_entry_is_valid(dir_list_cache_entry_t *entry)
+{
+   int64_t mtime = 0;
+
+   if (entry->stale)
+      return false;
+
+   if (entry->mtime + DIR_LIST_CACHE_RACY_SECS >= entry->listed_at)
+      return false;
+
+   if (!dir_list_get_mtime(entry->dir, &mtime))
+      return false;
+
+   return mtime == entry->mtime;
+}
+
+static bool dir_list_cache_entry_matches(const dir_list_cache_entry_t *entry,
+      const char *dir, const char *ext,
+      bool include_dirs, bool include_compressed)
+{
+   if (entry->include_dirs != include_dirs
+         || entry->include_compressed != include_compressed)
+      return false;
+   if (strcmp(entry->dir, dir))
+      return false;
+   if (!entry->ext || !ext)
+      return entry->ext == ext;
+   return !strcmp(entry->ext, ext);
+}
+
+/**
+ * dir_list_cache_get:
+ *
+ * Returns: a copy of the cached listing if it is still valid,
+ * otherwise NULL.
+ **/
+static struct string_list *dir_list_cache_get(const char *dir,
+      const char *ext, bool include_dirs, bool include_compressed)
+{
+   unsigned i;
+   struct string_list *list = NULL;
+
+   dir_list_cache_lock_acquire();
+
+#ifdef HAVE_DIR_LIST_INOTIFY
+   dir_list_cache_poll_inotify();
+#endif
+
+   for (i = 0; i < DIR_LIST_CACHE_SIZE; i++)
+   {
+      dir_list_cache_entry_t *entry = dir_list_cache[i];
+
+      if (!entry || !dir_list_cache_entry_matches(entry, dir, ext,
+               include_dirs, include_compressed))
+         continue;
+
+      if (!dir_list_cache_entry_is_valid(entry))
+         break;
+
+      /* Move to the front. */
+      memmove(&dir_list_cache[1], &dir_list_cache[0],
+            i * sizeof(*dir_list_cache));
+      dir_list_cache[0] = entry;
+
+      list = dir_list_copy(entry->list);
+      break;
+   }
+
+   dir_list_cache_lock_release();
+
+   return list;
+}
+
+static void dir_list_cache_put(const char *dir, const char *ext,
+      bool include_dirs, bool include_compressed,
+      const struct string_list *list, int64_t mtime)
+{
+   unsigned i;
+   dir_list_cache_entry_t *old   = NULL;
+   dir_list_cache_entry_t *entry = (dir_list_cache_entry_t*)
+      calloc(1, sizeof(*entry));
+
+   if (!entry)
+      return;
+
+   entry->dir                = strdup(dir);
+   entry->ext                = ext ? strdup(ext) : NULL;
+   entry->list               = dir_list_copy(list);
+   entry->mtime              = mtime;
+   entry->listed_at          = (int64_t)time(NULL);
+   entry->watch              = -1;
+   entry->include_dirs       = include_dirs;
+   entry->include_compressed = include_compressed;
+
+   if (!entry->dir || (ext && !entry->ext) || !entry->list)
+   {
+      string_list_free(entry->list);
+      free(entry->dir);
+      free(entry->ext);
+      free(entry);
+      return;
+   }
+
+   dir_list_cache_lock_acquire();
+
+#ifdef HAVE_DIR_LIST_INOTIFY
+   if (dir_list_inotify_fd == -2)
+      dir_list_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (dir_list_inotify_fd >= 0)
+      entry->watch = inotify_add_watch(dir_list_inotify_fd, dir,
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+            | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+
+   /* Replace an older listing with the same key. */
+   for (i = 0; i < DIR_LIST_CACHE_SIZE; i++)
+   {
+      if (dir_list_cache[i] && dir_list_cache_entry_matches(
+               dir_list_cache[i], dir, ext,
+               include_dirs, include_compressed))
+         break;
+   }
+
+   if (i == DIR_LIST_CACHE_SIZE)
+      i = DIR_LIST_CACHE_SIZE - 1;
+
+   old = dir_list_cache[i];
+
+   memmove(&dir_list_cache[1], &dir_list_cache[0],
+         i * sizeof(*dir_list_cache));
+   dir_list_cache[0] = entry;
+
+   /* Freed after the new listing is in, which keeps
+    * the watch they share on the same directory. */
+   dir_list_cache_entry_free(old);
+
+   dir_list_cache_lock_release();
+}
+
+/**
+ * dir_list_cache_clear:
+ *
+ * Drops all cached directory listings.
+ **/
+void dir_list_cache_clear(void)
+{
+   unsigned i;
+
+   dir_list_cache_lock_acquire();
+
+   for (i = 0; i < DIR_LIST_CACHE_SIZE; i++)
+   {
+      dir_list_cache_entry_t *entry = dir_list_cache[i];
+      dir_list_cache[i]             = NULL;
+      dir_list_cache_entry_free(entry);
+   }
+
+   dir_list_cache_lock_release();
+}
+
+/**
+ * dir_list_cache_init:
+ *
+ * Sets the listing cache up for use from several threads.
+ * Has to be called before any other thread lists directories.
+ **/
+void dir_list_cache_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!dir_list_cache_lock)
+      dir_list_cache_lock = slock_new();
+#endif
+}
+
+/**
+ * dir_list_cache_deinit:
+ *
+ * Waits for a running prefetch, then drops all cached listings
+ * and stops watching their directories. No other thread may
+ * list directories anymore.
+ **/
+void dir_list_cache_deinit(void)
+{
+#ifdef HAVE_THREADS
+   if (dir_list_prefetch_handle)
+      sthread_join(dir_list_prefetch_handle);
+   dir_list_prefetch_handle = NULL;
+   dir_list_prefetching     = false;
+#endif
+
+   /* Removes the inotify watches as well. */
+   dir_list_cache_clear();
+
+#ifdef HAVE_DIR_LIST_INOTIFY
+   if (dir_list_inotify_fd >= 0)
+      close(dir_list_inotify_fd);
+   dir_list_inotify_fd = -2;
+#endif
+
+#ifdef HAVE_THREADS
+   if (dir_list_cache_lock)
+      slock_free(dir_list_cache_lock);
+   dir_list_cache_lock = NULL;
+#endif
+}
+#else
+void dir_list_cache_clear(void)
+{
+}
+
+void dir_list_cache_init(void)
+{
+}
+
+void dir_list_cache_deinit(void)
+{
+}
+#endif
+
+/**
+ * dir_list_new:
+ * @dir                : directory path.
+ * @ext                : allowed extensions of file directory entries to include.
+ * @include_dirs       : include directories as part of the finished directory listing?
+ * @include_compressed : Only include files which match ext. Do not try to match compressed files, etc.
+ *
+ * Create a directory listing. Recent listings are served from a
+ * cache as long as the directory didn't change.
+ *
+ * Returns: pointer to a directory listing of type 'struct string_list *' on success,
+ * NULL in case of error. Has to be freed manually.
+ **/
+struct string_list *dir_list_new(const char *dir,
+      const char *ext, bool include_dirs, bool include_compressed)
+{
+#ifdef HAVE_DIR_LIST_CACHE
+   int64_t mtime            = 0;
+   struct string_list *list = NULL;
+
+   if (!dir)
+      return NULL;
+
+   list = dir_list_cache_get(dir, ext, include_dirs, include_compressed);
+   if (list)
+      return list;
+
+   /* Sample the mtime before reading, a change made while
+    * reading then invalidates the cached listing. */
+   if (!dir_list_get_mtime(dir, &mtime))
+      return dir_list_read(dir, ext, include_dirs, include_compressed);
+
+   list = dir_list_read(dir, ext, include_dirs, include_compressed);
+   if (list)
+      dir_list_cache_put(dir, ext, include_dirs, include_compressed,
+            list, mtime);
+
+   return list;
+#else
+   return dir_list_read(dir, ext, include_dirs, include_compressed);
+#endif
+}
+
+#if defined(HAVE_DIR_LIST_CACHE) && defined(HAVE_THREADS)
+typedef struct dir_list_prefetch_state
+{
+   struct string_list *dirs;
+   char *ext;
+   bool include_dirs;
+   bool include_compressed;
+} dir_list_prefetch_state_t;
+
+static void dir_list_prefetch_thread(void *data)
+{
+   size_t i;
+   dir_list_prefetch_state_t *state = (dir_list_prefetch_state_t*)data;
+
+   for (i = 0; i < state->dirs->size; i++)
+      string_list_free(dir_list_new(state->dirs->elems[i].data,
+               state->ext, state->include_dirs, state->include_compressed));
+
+   string_list_free(state->dirs);
+   free(state->ext);
+   free(state);
+
+   dir_list_cache_lock_acquire();
+   dir_list_prefetching = false;
+   dir_list_cache_lock_release();
+}
+#endif
+
+/**
+ * dir_list_prefetch:
+ * @dirs               : directories to list.
+ * @ext                : allowed extensions of file directory entries to include.
+ * @include_dirs       : include directories as part of the finished directory listing?
+ * @include_compressed : Only include files which match ext.
+ *
+ * Lists directories on a background thread, so a later
+ * dir_list_new() with the same arguments is served from the
+ * listing cache. Does nothing if a prefetch is already running,
+ * or without thread support.
+ **/
+void dir_list_prefetch(const struct string_list *dirs,
+      const char *ext, bool include_dirs, bool include_compressed)
+{
+#if defined(HAVE_DIR_LIST_CACHE) && defined(HAVE_THREADS)
+   dir_list_prefetch_state_t *state = NULL;
+
+   if (!dirs || !dirs->size || !dir_list_cache_lock)
+      return;
+
+   dir_list_cache_lock_acquire();
+   if (dir_list_prefetching)
+   {
+      dir_list_cache_lock_release();
+      return;
+   }
+   dir_list_prefetching = true;
+   dir_list_cache_lock_release();
+
+   /* The previous prefetch is done, reap its thread. */
+   if (dir_list_prefetch_handle)
+      sthread_join(dir_list_prefetch_handle);
+   dir_list_prefetch_handle = NULL;
+
+   state = (dir_list_prefetch_state_t*)calloc(1, sizeof(*state));
+   if (!state)
+      goto error;
+
+   state->dirs               = dir_list_copy(dirs);
+   state->ext                = ext ? strdup(ext) : NULL;
+   state->include_dirs       = include_dirs;
+   state->include_compressed = include_compressed;
+
+   if (!state->dirs)
+      goto error;
+
+   dir_list_prefetch_handle = sthread_create(dir_list_prefetch_thread, state);
+   if (!dir_list_prefetch_handle)
+      goto error;
+
+   return;
+
+error:
+   if (state)
+   {
+      string_list_free(state->dirs);
+      free(state->ext);
+      free(state);
+   }
+
+   dir_list_cache_lock_acquire();
+   dir_list_prefetching = false;
+   dir_list_cache_lock_release();
+#else
+   (void)dirs;
+   (void)ext;
+   (void)include_dirs;
+   (void)include_compressed;
+#endif
+}
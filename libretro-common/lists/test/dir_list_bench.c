@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <time.h>
+
+#include <lists/dir_list.h>
+#include <lists/string_list.h>
+#include <file/file_path.h>
+#include <retro_stat.h>
+#include <retro_miscellaneous.h>
+
+#define EXTS "bin|cue|iso|chd|zip|7z|sfc|smc|nes|gb|gbc|gba|md|gen|sms|pce|a26|n64|z64|v64"
+
+/* Listings of directories modified this recently aren't trusted by
+ * the cache, see DIR_LIST_CACHE_RACY_SECS. */
+#define AGE_SECS 60
+
+#define SUBDIRS 8
+
+static double now_ms(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void touch(const char *path)
+{
+   FILE *file = fopen(path, "wb");
+   if (file)
+      fclose(file);
+}
+
+/* Sets the mtime of @dir back, past the window in which
+ * the cache doesn't trust a listing. */
+static void age(const char *dir)
+{
+   struct utimbuf times;
+
+   times.actime  = time(NULL) - AGE_SECS;
+   times.modtime = times.actime;
+   utime(dir, &times);
+}
+
+/* Lists @dir and every directory below it, setting their mtime
+ * back if @aging is set. Returns the number of entries listed. */
+static size_t walk(const char *dir, unsigned *dirs, bool aging)
+{
+   size_t i;
+   size_t size              = 0;
+   struct string_list *list = dir_list_new(dir, EXTS, true, true);
+
+   (*dirs)++;
+
+   if (!list)
+      return 0;
+
+   size = list->size;
+
+   for (i = 0; i < list->size; i++)
+      if (list->elems[i].attr.i == RARCH_DIRECTORY)
+         size += walk(list->elems[i].data, dirs, aging);
+
+   dir_list_free(list);
+
+   if (aging)
+      age(dir);
+
+   return size;
+}
+
+static size_t walk_timed(const char *dir, unsigned *dirs, double *ms)
+{
+   size_t size;
+   double start = now_ms();
+
+   *dirs = 0;
+   size  = walk(dir, dirs, false);
+   *ms   = now_ms() - start;
+
+   return size;
+}
+
+static void generate(const char *dir, unsigned entries)
+{
+   unsigned i;
+   char sub[PATH_MAX_LENGTH];
+   char path[PATH_MAX_LENGTH + 32];
+   static const char *exts[] = { "bin", "txt", "sfc", "jpg", "zip" };
+
+   printf("Creating %u entries in %u directories below %s ...\n",
+         entries, SUBDIRS, dir);
+   path_mkdir(dir);
+
+   for (i = 0; i < entries; i++)
+   {
+      snprintf(sub, sizeof(sub), "%s/dir%u", dir, i % SUBDIRS);
+      if (i < SUBDIRS)
+         path_mkdir(sub);
+      snprintf(path, sizeof(path), "%s/file%06u.%s",
+            sub, i, exts[i % 5]);
+      touch(path);
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   double ms;
+   size_t size;
+   unsigned dirs;
+   bool generated   = false;
+   char path[PATH_MAX_LENGTH];
+   const char *dir  = argc > 1 ? argv[1] : "dir_list_bench.tmp";
+   unsigned entries = argc > 2 ? (unsigned)atoi(argv[2]) : 50000;
+
+   dir_list_cache_init();
+
+   if (!path_is_directory(dir))
+   {
+      generate(dir, entries);
+      generated = true;
+   }
+
+   /* A listing taken while a directory is recent is never served
+    * from the cache, age the tree created above before timing. */
+   dirs = 0;
+   walk(dir, &dirs, generated);
+   dir_list_cache_clear();
+
+   size = walk_timed(dir, &dirs, &ms);
+   printf("cold:        %6u entries, %4u dirs in %8.3f ms\n",
+         (unsigned)size, dirs, ms);
+
+   size = walk_timed(dir, &dirs, &ms);
+   printf("warm:        %6u entries, %4u dirs in %8.3f ms\n",
+         (unsigned)size, dirs, ms);
+
+   snprintf(path, sizeof(path), "%s/added.bin", dir);
+   touch(path);
+
+   size = walk_timed(dir, &dirs, &ms);
+   printf("invalidated: %6u entries, %4u dirs in %8.3f ms\n",
+         (unsigned)size, dirs, ms);
+
+   remove(path);
+   if (generated)
+      age(dir);
+
+   size = walk_timed(dir, &dirs, &ms);
+   printf("removed:     %6u entries, %4u dirs in %8.3f ms\n",
+         (unsigned)size, dirs, ms);
+
+   dir_list_cache_deinit();
+   return 0;
+}
@@ -27,14 +27,32 @@
 #include <net/net_http.h>
 #include <net/net_compat.h>
 #include <net/net_socket.h>
+#include <streams/file_stream.h>
 #include <compat/strl.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+/* Size of the receive buffer of a request. */
+#define HTTP_BUFFER_SIZE          (64 * 1024)
+/* Reads done by a single net_http_update() call at most. */
+#define HTTP_READS_PER_UPDATE     8
+/* Idle keep-alive connections kept around. */
+#define HTTP_POOL_IDLE_MAX        8
+/* Connections opened to the same host before requests get pipelined. */
+#define HTTP_HOST_CONNECTIONS_MAX 2
+/* Requests queued on a connection before another one gets opened. */
+#define HTTP_PIPELINE_MAX         4
+
 enum
 {
    P_HEADER_TOP = 0,
    P_HEADER,
    P_BODY,
    P_BODY_CHUNKLEN,
+   P_BODY_CHUNKEND,
+   P_TRAILER,
    P_DONE,
    P_ERROR
 };
@@ -46,19 +64,64 @@ enum
    T_CHUNK
 };
 
-struct http_t
+/* A keep-alive connection, shared by the requests pipelined on it.
+ * Requests get a sequence number when they are sent and read their
+ * response once all the responses before theirs have been read. */
+struct http_socket_t
 {
    int fd;
+   int port;
+   char *domain;
+
+   unsigned sent;
+   unsigned served;
+   unsigned refs;
+
+   /* The server closes the connection after the current responses. */
+   bool closing;
+   /* A response was abandoned midway, the stream is unusable. */
+   bool broken;
+   /* A request is being sent without the pool locked, nothing
+    * else may be pipelined until it's out. */
+   bool sending;
+
+   /* Bytes read past the end of the previous response. */
+   char *leftover;
+   size_t leftover_len;
+
+   struct http_socket_t *next;
+};
+
+struct http_t
+{
+   struct http_socket_t *sock;
+   unsigned seq;
+   bool turn;
+   bool started;
+   bool retried;
+   bool keepalive;
+
+   char *domain;
+   int port;
+   char *request;
+
    int status;
-   
+
    char part;
    char bodytype;
    bool error;
-   
+
    size_t pos;
    size_t len;
+   size_t total;
+
+   char *in;
+   size_t in_pos;
+   size_t in_len;
+
    size_t buflen;
    char * data;
+   RFILE *file;
 };
 
 struct http_connection_t
@@ -70,6 +133,34 @@ struct http_connection_t
    int port;
 };
 
+static struct http_socket_t *http_pool = NULL;
+#ifdef HAVE_THREADS
+static slock_t *http_pool_lock         = NULL;
+#endif
+
+void net_http_pool_init(void)
+{
+#ifdef HAVE_THREADS
+   if (!http_pool_lock)
+      http_pool_lock = slock_new();
+#endif
+}
+
+static void net_http_pool_lock(void)
+{
+#ifdef HAVE_THREADS
+   if (http_pool_lock)
+      slock_lock(http_pool_lock);
+#endif
+}
+
+static void net_http_pool_unlock(void)
+{
+#ifdef HAVE_THREADS
+   if (http_pool_lock)
+      slock_unlock(http_pool_lock);
+#endif
+}
 
 static int net_http_new_socket(const char *domain, int port)
 {
@@ -96,13 +187,235 @@ error:
    return -1;
 }
 
-static void net_http_send_str(int fd, bool *error, const char *text)
+/* An idle connection has nothing to say; if it's readable,
+ * the server closed it or sent something we didn't ask for. */
+static bool net_http_socket_idle_alive(struct http_socket_t *sock)
 {
-   if (*error)
+   fd_set fds;
+   struct timeval tv = {0};
+
+   if (sock->leftover_len)
+      return false;
+
+   FD_ZERO(&fds);
+   FD_SET(sock->fd, &fds);
+
+   return socket_select(sock->fd + 1, &fds, NULL, NULL, &tv) == 0;
+}
+
+static void net_http_socket_free(struct http_socket_t *sock)
+{
+   socket_close(sock->fd);
+   free(sock->leftover);
+   free(sock->domain);
+   free(sock);
+}
+
+/* Must be called with the pool locked. */
+static void net_http_socket_unlink(struct http_socket_t *sock)
+{
+   struct http_socket_t **link = &http_pool;
+
+   while (*link && *link != sock)
+      link = &(*link)->next;
+
+   if (*link)
+      *link = sock->next;
+}
+
+static void net_http_socket_release(struct http_socket_t *sock,
+      bool reusable)
+{
+   unsigned idle               = 0;
+   struct http_socket_t *iter  = NULL;
+
+   net_http_pool_lock();
+
+   if (!reusable)
+      sock->broken = true;
+
+   if (--sock->refs)
+   {
+      net_http_pool_unlock();
       return;
+   }
+
+   for (iter = http_pool; iter; iter = iter->next)
+      if (!iter->refs && iter != sock)
+         idle++;
+
+   if (sock->broken || sock->closing || sock->sent != sock->served
+         || idle >= HTTP_POOL_IDLE_MAX)
+   {
+      net_http_socket_unlink(sock);
+      net_http_socket_free(sock);
+   }
+
+   net_http_pool_unlock();
+}
+
+/* Takes the next position on the connection for a request.
+ * Must be called with the pool locked. */
+static void net_http_socket_reserve(struct http_socket_t *sock,
+      unsigned *seq)
+{
+   sock->refs++;
+   sock->sending = true;
+   *seq          = sock->sent++;
+}
+
+/* Sends the request a position was reserved for. Must be called
+ * with the pool unlocked, sending can block. Drops the connection
+ * if it fails. */
+static bool net_http_socket_send(struct http_socket_t *sock,
+      const char *request)
+{
+   bool ret = socket_send_all_blocking(sock->fd,
+         request, strlen(request), true);
+
+   net_http_pool_lock();
+   sock->sending = false;
+   net_http_pool_unlock();
+
+   if (!ret)
+      net_http_socket_release(sock, false);
+
+   return ret;
+}
+
+/**
+ * net_http_socket_acquire:
+ * @domain               : host name
+ * @port                 : port
+ * @request              : request text
+ * @fresh                : don't reuse a pooled connection
+ * @seq                  : position of the request on the connection
+ *
+ * Sends @request on an idle connection to the host, a new one, or,
+ * once there are HTTP_HOST_CONNECTIONS_MAX of them, pipelined on the
+ * least busy one.
+ *
+ * Returns: connection the request was sent on, NULL on error.
+ **/
+static struct http_socket_t *net_http_socket_acquire(const char *domain,
+      int port, const char *request, bool fresh, unsigned *seq)
+{
+   unsigned conns               = 0;
+   struct http_socket_t *idle   = NULL;
+   struct http_socket_t *busy   = NULL;
+   struct http_socket_t *sock   = NULL;
+   struct http_socket_t **link  = NULL;
+
+   net_http_pool_lock();
+
+   link = &http_pool;
+   while (*link)
+   {
+      sock = *link;
+
+      if (sock->port != port || strcmp(sock->domain, domain)
+            || ((sock->closing || sock->broken) && sock->refs))
+      {
+         link = &sock->next;
+         continue;
+      }
+
+      if (!sock->refs)
+      {
+         if (sock->closing || sock->broken
+               || !net_http_socket_idle_alive(sock))
+         {
+            *link = sock->next;
+            net_http_socket_free(sock);
+            continue;
+         }
+
+         if (!idle)
+            idle = sock;
+      }
+      else if (!sock->sending && (!busy
+               || sock->sent - sock->served < busy->sent - busy->served))
+         busy = sock;
+
+      conns++;
+      link = &sock->next;
+   }
+
+   sock = NULL;
+
+   if (!fresh)
+   {
+      if (idle)
+         sock = idle;
+      else if (busy && conns >= HTTP_HOST_CONNECTIONS_MAX
+            && busy->sent - busy->served < HTTP_PIPELINE_MAX)
+         sock = busy;
+
+      if (sock)
+         net_http_socket_reserve(sock, seq);
+   }
+
+   net_http_pool_unlock();
+
+   if (sock && net_http_socket_send(sock, request))
+      return sock;
+
+   /* Connecting can block for a while, don't hold the lock for it. */
+   sock = (struct http_socket_t*)calloc(1, sizeof(*sock));
+   if (!sock)
+      return NULL;
+
+   sock->fd     = net_http_new_socket(domain, port);
+   sock->port   = port;
+   sock->domain = strdup(domain);
+
+   if (sock->fd < 0 || !sock->domain)
+   {
+      if (sock->fd >= 0)
+         socket_close(sock->fd);
+      free(sock->domain);
+      free(sock);
+      return NULL;
+   }
+
+   net_http_pool_lock();
+
+   sock->next = http_pool;
+   http_pool  = sock;
+   net_http_socket_reserve(sock, seq);
+
+   net_http_pool_unlock();
+
+   if (!net_http_socket_send(sock, request))
+      return NULL;
+
+   return sock;
+}
+
+void net_http_pool_clear(void)
+{
+   struct http_socket_t **link = NULL;
+
+   net_http_pool_lock();
+
+   link = &http_pool;
+   while (*link)
+   {
+      struct http_socket_t *sock = *link;
+
+      if (sock->refs)
+      {
+         /* Still in use, goes away when released. */
+         sock->closing = true;
+         link          = &sock->next;
+         continue;
+      }
+
+      *link = sock->next;
+      net_http_socket_free(sock);
+   }
 
-   if (!socket_send_all_blocking(fd, text, strlen(text), true))
-      *error = true;
+   net_http_pool_unlock();
 }
 
 static char* urlencode(const char* url)
@@ -183,6 +496,7 @@ bool net_http_connection_iterate(struct http_connection_t *conn)
 
 bool net_http_connection_done(struct http_connection_t *conn)
 {
+   char separator;
    char **location = NULL;
 
    if (!conn)
@@ -193,10 +507,11 @@ bool net_http_connection_done(struct http_connection_t *conn)
    if (*conn->scan == '\0')
       return false;
 
+   separator    = *conn->scan;
    *conn->scan  = '\0';
    conn->port   = 80;
 
-   if (*conn->scan == ':')
+   if (separator == ':')
    {
       if (!isdigit((int)conn->scan[1]))
          return false;
@@ -228,269 +543,494 @@ const char *net_http_connection_url(struct http_connection_t *conn)
    return conn->urlcopy;
 }
 
-struct http_t *net_http_new(struct http_connection_t *conn)
+static char *net_http_build_request(struct http_connection_t *conn)
+{
+   char portstr[16] = {0};
+   size_t len       = 0;
+   char *request    = NULL;
+
+   if (conn->port != 80)
+      snprintf(portstr, sizeof(portstr), ":%i", conn->port);
+
+   len = strlen(conn->location) + strlen(conn->domain) + strlen(portstr)
+      + 64;
+
+   request = (char*)malloc(len);
+   if (!request)
+      return NULL;
+
+   snprintf(request, len,
+         "GET /%s HTTP/1.1\r\n"
+         "Host: %s%s\r\n"
+         "Connection: keep-alive\r\n"
+         "\r\n",
+         conn->location, conn->domain, portstr);
+
+   return request;
+}
+
+static struct http_t *net_http_new_internal(struct http_connection_t *conn,
+      RFILE *file)
 {
-   bool error            = false;
-   int fd                = -1;
    struct http_t *state  = NULL;
 
    if (!conn)
       goto error;
 
-   fd = net_http_new_socket(conn->domain, conn->port);
-   if (fd < 0)
+   state = (struct http_t*)calloc(1, sizeof(struct http_t));
+   if (!state)
       goto error;
 
-   error = false;
-
-   /* This is a bit lazy, but it works. */
-   net_http_send_str(fd, &error, "GET /");
-   net_http_send_str(fd, &error, conn->location);
-   net_http_send_str(fd, &error, " HTTP/1.1\r\n");
+   state->status   = -1;
+   state->part     = P_HEADER_TOP;
+   state->bodytype = T_FULL;
+   state->port     = conn->port;
+   state->domain   = strdup(conn->domain);
+   state->request  = net_http_build_request(conn);
+   state->in       = (char*)malloc(HTTP_BUFFER_SIZE);
+   state->file     = file;
 
-   net_http_send_str(fd, &error, "Host: ");
-   net_http_send_str(fd, &error, conn->domain);
+   if (!state->domain || !state->request || !state->in)
+      goto error;
 
-   if (conn->port != 80)
+   if (!file)
    {
-      char portstr[16] = {0};
+      state->buflen = 512;
+      state->data   = (char*)malloc(state->buflen);
 
-      snprintf(portstr, sizeof(portstr), ":%i", conn->port);
-      net_http_send_str(fd, &error, portstr);
+      if (!state->data)
+         goto error;
    }
 
-   net_http_send_str(fd, &error, "\r\n");
-   net_http_send_str(fd, &error, "Connection: close\r\n");
-   net_http_send_str(fd, &error, "\r\n");
-
-   if (error)
-      goto error;
+   state->sock = net_http_socket_acquire(state->domain, state->port,
+         state->request, false, &state->seq);
 
-   state          = (struct http_t*)malloc(sizeof(struct http_t));
-   state->fd      = fd;
-   state->status  = -1;
-   state->data    = NULL;
-   state->part    = P_HEADER_TOP;
-   state->bodytype= T_FULL;
-   state->error   = false;
-   state->pos     = 0;
-   state->len     = 0;
-   state->buflen  = 512;
-   state->data    = (char*)malloc(state->buflen);
-
-   if (!state->data)
+   if (!state->sock)
       goto error;
 
    return state;
 
 error:
-   if (fd >= 0)
-      socket_close(fd);
    if (state)
+   {
+      free(state->domain);
+      free(state->request);
+      free(state->in);
+      free(state->data);
       free(state);
+   }
+   if (file)
+      filestream_close(file);
    return NULL;
 }
 
+struct http_t *net_http_new(struct http_connection_t *conn)
+{
+   return net_http_new_internal(conn, NULL);
+}
+
+struct http_t *net_http_new_file(struct http_connection_t *conn,
+      const char *path)
+{
+   RFILE *file = NULL;
+
+   if (!conn || !path)
+      return NULL;
+
+   file = filestream_open(path, RFILE_MODE_WRITE, -1);
+   if (!file)
+      return NULL;
+
+   return net_http_new_internal(conn, file);
+}
+
 int net_http_fd(struct http_t *state)
 {
-   if (!state)
+   if (!state || !state->sock)
       return -1;
-   return state->fd;
+   return state->sock->fd;
 }
 
-bool net_http_update(struct http_t *state, size_t* progress, size_t* total)
+/* Returns the value of header @line if it's named @name. */
+static const char *net_http_header_value(const char *line, const char *name)
 {
-   ssize_t newlen = 0;
+   for (; *name; line++, name++)
+      if (tolower((unsigned char)*line) != tolower((unsigned char)*name))
+         return NULL;
 
-   if (!state || state->error)
-      goto fail;
+   if (*line++ != ':')
+      return NULL;
 
-   if (state->part < P_BODY)
-   {
-      if (state->error)
-         newlen = -1;
-      else
-         newlen = socket_receive_all_nonblocking(state->fd, &state->error,
-               (uint8_t*)state->data + state->pos, state->buflen - state->pos);
+   while (*line == ' ' || *line == '\t')
+      line++;
 
-      if (newlen < 0)
-         goto fail;
+   return line;
+}
+
+static void net_http_parse_header(struct http_t *state, const char *line)
+{
+   const char *value = NULL;
+
+   if ((value = net_http_header_value(line, "Content-Length")))
+   {
+      state->bodytype = T_LEN;
+      state->len      = strtoul(value, NULL, 10);
+   }
+   else if ((value = net_http_header_value(line, "Transfer-Encoding")))
+   {
+      if (strstr(value, "chunked"))
+         state->bodytype = T_CHUNK;
+   }
+   else if ((value = net_http_header_value(line, "Connection")))
+   {
+      if (!strncmp(value, "close", strlen("close")))
+         state->keepalive = false;
+      else if (!strncmp(value, "keep-alive", strlen("keep-alive")))
+         state->keepalive = true;
+   }
+}
 
-      if (state->pos + newlen >= state->buflen - 64)
+static bool net_http_write_body(struct http_t *state,
+      const char *data, size_t len)
+{
+   if (state->file)
+   {
+      if (filestream_write(state->file, data, len) != (ssize_t)len)
+         return false;
+   }
+   else
+   {
+      if (state->pos + len > state->buflen)
       {
-         state->buflen *= 2;
-         state->data = (char*)realloc(state->data, state->buflen);
+         size_t buflen = state->buflen;
+         char *newdata = NULL;
+
+         while (state->pos + len > buflen)
+            buflen *= 2;
+
+         newdata = (char*)realloc(state->data, buflen);
+         if (!newdata)
+            return false;
+
+         state->data   = newdata;
+         state->buflen = buflen;
       }
-      state->pos += newlen;
 
-      while (state->part < P_BODY)
+      memcpy(state->data + state->pos, data, len);
+   }
+
+   state->pos += len;
+   return true;
+}
+
+/* Consumes as much of the receive buffer as possible.
+ * Returns false on a malformed response. */
+static bool net_http_parse(struct http_t *state)
+{
+   while (state->part != P_DONE)
+   {
+      char *start  = state->in + state->in_pos;
+      size_t avail = state->in_len - state->in_pos;
+      char *lineend;
+
+      if (state->part == P_BODY)
       {
-         char *dataend = state->data + state->pos;
-         char *lineend = (char*)memchr(state->data, '\n', state->pos);
+         size_t len = avail;
+
+         if (!len)
+            return true;
+
+         if (state->bodytype != T_FULL && len > state->len)
+            len = state->len;
+
+         if (!net_http_write_body(state, start, len))
+            return false;
 
-         if (!lineend)
+         state->in_pos += len;
+
+         if (state->bodytype == T_FULL)
+            continue;
+
+         state->len -= len;
+
+         if (!state->len)
+            state->part = (state->bodytype == T_CHUNK)
+               ? P_BODY_CHUNKEND : P_DONE;
+         continue;
+      }
+
+      /* Everything but the body is line based. */
+      lineend = (char*)memchr(start, '\n', avail);
+      if (!lineend)
+         return true;
+
+      *lineend = '\0';
+      if (lineend != start && lineend[-1] == '\r')
+         lineend[-1] = '\0';
+
+      state->in_pos += lineend + 1 - start;
+
+      switch (state->part)
+      {
+         case P_HEADER_TOP:
+            if (strncmp(start, "HTTP/1.", strlen("HTTP/1.")) != 0)
+               return false;
+            state->keepalive = start[strlen("HTTP/1.")] != '0';
+            state->status    = strtoul(start + strlen("HTTP/1.1 "), NULL, 10);
+            state->bodytype  = T_FULL;
+            state->part      = P_HEADER;
             break;
-         *lineend='\0';
-         if (lineend != state->data && lineend[-1]=='\r')
-            lineend[-1]='\0';
+         case P_HEADER:
+            if (*start)
+            {
+               /* TODO: save headers somewhere */
+               net_http_parse_header(state, start);
+               break;
+            }
 
-         if (state->part == P_HEADER_TOP)
-         {
-            if (strncmp(state->data, "HTTP/1.", strlen("HTTP/1."))!=0)
-               goto fail;
-            state->status = strtoul(state->data + strlen("HTTP/1.1 "), NULL, 10);
-            state->part   = P_HEADER;
-         }
-         else
-         {
-            if (!strncmp(state->data, "Content-Length: ",
-                     strlen("Content-Length: ")))
+            if (state->status >= 100 && state->status < 200)
+            {
+               /* Interim response, the real one follows. */
+               state->part = P_HEADER_TOP;
+               break;
+            }
+
+            if (state->status == 204 || state->status == 304)
             {
                state->bodytype = T_LEN;
-               state->len = strtol(state->data + 
-                     strlen("Content-Length: "), NULL, 10);
+               state->len      = 0;
             }
-            if (!strcmp(state->data, "Transfer-Encoding: chunked"))
-               state->bodytype = T_CHUNK;
 
-            /* TODO: save headers somewhere */
-            if (state->data[0]=='\0')
+            switch (state->bodytype)
             {
-               state->part = P_BODY;
-               if (state->bodytype == T_CHUNK)
-                  state->part = P_BODY_CHUNKLEN;
+               case T_LEN:
+                  state->total = state->len;
+                  state->part  = state->len ? P_BODY : P_DONE;
+                  break;
+               case T_CHUNK:
+                  state->part  = P_BODY_CHUNKLEN;
+                  break;
+               default:
+                  /* The body ends when the server closes the connection. */
+                  state->keepalive = false;
+                  state->part      = P_BODY;
+                  break;
             }
-         }
+            break;
+         case P_BODY_CHUNKLEN:
+            if (!isxdigit((unsigned char)*start))
+               return false;
+            state->len  = strtoul(start, NULL, 16);
+            state->part = state->len ? P_BODY : P_TRAILER;
+            break;
+         case P_BODY_CHUNKEND:
+            if (*start)
+               return false;
+            state->part = P_BODY_CHUNKLEN;
+            break;
+         case P_TRAILER:
+            if (!*start)
+               state->part = P_DONE;
+            break;
+      }
+   }
+
+   return true;
+}
+
+/* Returns 1 once the responses ahead of this one have been read,
+ * 0 while waiting for them and -1 if the connection broke. */
+static int net_http_wait_turn(struct http_t *state)
+{
+   int ret                    = 0;
+   struct http_socket_t *sock = state->sock;
+
+   net_http_pool_lock();
+
+   if (sock->broken)
+      ret = -1;
+   else if (sock->served == state->seq)
+   {
+      ret = 1;
 
-         memmove(state->data, lineend + 1, dataend-(lineend+1));
-         state->pos = (dataend-(lineend + 1));
+      if (sock->leftover_len)
+      {
+         memcpy(state->in, sock->leftover, sock->leftover_len);
+         state->in_len      = sock->leftover_len;
+         state->started     = true;
+         free(sock->leftover);
+         sock->leftover     = NULL;
+         sock->leftover_len = 0;
       }
-      if (state->part >= P_BODY)
+   }
+
+   net_http_pool_unlock();
+
+   return ret;
+}
+
+/* The connection went away before the response started; the server
+ * may have closed an idle connection or refused a pipelined request,
+ * so send the request once more on a new connection. */
+static bool net_http_retry(struct http_t *state)
+{
+   if (state->retried)
+      return false;
+
+   state->retried = true;
+
+   net_http_socket_release(state->sock, false);
+   state->sock    = net_http_socket_acquire(state->domain, state->port,
+         state->request, true, &state->seq);
+
+   state->turn    = false;
+   state->in_pos  = 0;
+   state->in_len  = 0;
+
+   return state->sock != NULL;
+}
+
+static void net_http_finish(struct http_t *state)
+{
+   struct http_socket_t *sock = state->sock;
+   size_t leftover_len        = state->in_len - state->in_pos;
+
+   state->part = P_DONE;
+   state->len  = state->pos;
+   state->sock = NULL;
+
+   if (state->file)
+   {
+      filestream_close(state->file);
+      state->file = NULL;
+   }
+   else if (state->pos)
+   {
+      char *data = (char*)realloc(state->data, state->pos);
+      if (data)
+         state->data = data;
+   }
+
+   /* Hand over what was read of the next response. */
+   net_http_pool_lock();
+
+   sock->served++;
+   if (!state->keepalive)
+      sock->closing = true;
+
+   if (leftover_len)
+   {
+      sock->leftover = (char*)malloc(leftover_len);
+
+      if (sock->leftover)
       {
-         newlen = state->pos;
-         state->pos = 0;
+         memcpy(sock->leftover, state->in + state->in_pos, leftover_len);
+         sock->leftover_len = leftover_len;
       }
+      else
+         sock->broken = true;
    }
 
-   if (state->part >= P_BODY && state->part < P_DONE)
+   net_http_pool_unlock();
+
+   net_http_socket_release(sock, true);
+}
+
+bool net_http_update(struct http_t *state, size_t* progress, size_t* total)
+{
+   unsigned reads = 0;
+
+   if (!state || state->error)
+      goto fail;
+
+   if (state->part == P_DONE)
+      goto done;
+
+   if (!state->turn)
    {
-      if (!newlen)
+      int turn = net_http_wait_turn(state);
+
+      if (turn < 0)
       {
-         if (state->error)
-            newlen = -1;
-         else
-            newlen = socket_receive_all_nonblocking(
-                  state->fd,
-                  &state->error,
-                  (uint8_t*)state->data + state->pos,
-                  state->buflen - state->pos);
-
-         if (newlen < 0)
-         {
-            if (state->bodytype == T_FULL)
-            {
-               state->part = P_DONE;
-               state->data = (char*)realloc(state->data, state->len);
-            }
-            else
-               goto fail;
-            newlen=0;
-         }
+         if (!net_http_retry(state))
+            goto fail;
+         goto progress;
+      }
 
-         if (state->pos + newlen >= state->buflen - 64)
-         {
-            state->buflen *= 2;
-            state->data = (char*)realloc(state->data, state->buflen);
-         }
+      if (!turn)
+         goto progress;
+
+      state->turn = true;
+   }
+
+   for (;;)
+   {
+      ssize_t newlen;
+
+      if (!net_http_parse(state))
+         goto fail;
+
+      if (state->part == P_DONE)
+      {
+         net_http_finish(state);
+         break;
       }
 
-parse_again:
-      if (state->bodytype == T_CHUNK)
+      if (reads++ == HTTP_READS_PER_UPDATE)
+         break;
+
+      if (state->in_pos)
       {
-         if (state->part == P_BODY_CHUNKLEN)
-         {
-            state->pos += newlen;
-            if (state->pos - state->len >= 2)
-            {
-               /*
-                * len=start of chunk including \r\n
-                * pos=end of data
-                */
-
-               char *fullend = state->data + state->pos;
-               char *end     = (char*)memchr(state->data + state->len + 2, '\n',
-                                             state->pos - state->len - 2);
-
-               if (end)
-               {
-                  size_t chunklen = strtoul(state->data+state->len, NULL, 16);
-                  state->pos      = state->len;
-                  end++;
-
-                  memmove(state->data+state->len, end, fullend-end);
-
-                  state->len      = chunklen;
-                  newlen          = (fullend - end);
-
-                  /*
-                     len=num bytes
-                     newlen=unparsed bytes after \n
-                     pos=start of chunk including \r\n
-                     */
-
-                  state->part = P_BODY;
-                  if (state->len == 0)
-                  {
-                     state->part = P_DONE;
-                     state->len  = state->pos;
-                     state->data = (char*)realloc(state->data, state->len);
-                  }
-                  goto parse_again;
-               }
-            }
-         }
-         else if (state->part == P_BODY)
-         {
-            if ((size_t)newlen >= state->len)
-            {
-               state->pos += state->len;
-               newlen     -= state->len;
-               state->len  = state->pos;
-               state->part = P_BODY_CHUNKLEN;
-               goto parse_again;
-            }
-            else
-            {
-               state->pos += newlen;
-               state->len -= newlen;
-            }
-         }
+         memmove(state->in, state->in + state->in_pos,
+               state->in_len - state->in_pos);
+         state->in_len -= state->in_pos;
+         state->in_pos  = 0;
       }
-      else
+
+      /* A header line doesn't fit into the buffer. */
+      if (state->in_len == HTTP_BUFFER_SIZE)
+         goto fail;
+
+      newlen = socket_receive_all_nonblocking(state->sock->fd, &state->error,
+            (uint8_t*)state->in + state->in_len,
+            HTTP_BUFFER_SIZE - state->in_len);
+
+      if (newlen < 0)
       {
-         state->pos += newlen;
+         state->error = false;
 
-         if (state->pos == state->len)
+         if (state->part == P_BODY && state->bodytype == T_FULL)
          {
-            state->part = P_DONE;
-            state->data = (char*)realloc(state->data, state->len);
+            net_http_finish(state);
+            break;
          }
-         if (state->pos > state->len)
-            goto fail;
+
+         if (!state->started && net_http_retry(state))
+            goto progress;
+
+         goto fail;
       }
+
+      if (!newlen)
+         break;
+
+      state->in_len += newlen;
+      state->started = true;
    }
 
+progress:
    if (progress)
       *progress = state->pos;
 
    if (total)
    {
       if (state->bodytype == T_LEN)
-         *total=state->len;
+         *total = state->total;
       else
-         *total=0;
+         *total = 0;
    }
 
+done:
    return (state->part == P_DONE);
 
 fail:
@@ -499,6 +1039,12 @@ fail:
       state->error  = true;
       state->part   = P_ERROR;
       state->status = -1;
+
+      if (state->sock)
+      {
+         net_http_socket_release(state->sock, false);
+         state->sock = NULL;
+      }
    }
 
    return true;
@@ -534,8 +1080,15 @@ void net_http_delete(struct http_t *state)
    if (!state)
       return;
 
-   if (state->fd >= 0)
-      socket_close(state->fd);
+   /* An unfinished response would be read by the next request. */
+   if (state->sock)
+      net_http_socket_release(state->sock, false);
+   if (state->file)
+      filestream_close(state->file);
+
+   free(state->domain);
+   free(state->request);
+   free(state->in);
    free(state);
 }
 
@@ -164,8 +164,19 @@ int socket_send_all_blocking(int fd, const void *data_, size_t size,
             no_signal ? MSG_NOSIGNAL : 0);
       if (ret <= 0)
       {
-         if (!isagain(ret))
+         if (isagain(ret))
+         {
+#ifndef VITA
+            /* Non-blocking socket, wait until it takes
+             * more rather than spinning. */
+            fd_set fds;
+
+            FD_ZERO(&fds);
+            FD_SET(fd, &fds);
+            socket_select(fd + 1, NULL, &fds, NULL, NULL);
+#endif
             continue;
+         }
 
          return false;
       }
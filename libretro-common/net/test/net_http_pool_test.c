@@ -0,0 +1,285 @@
+/* Copyright  (C) 2010-2016 The RetroArch team
+ *
+ * ---------------------------------------------------------------------------------------
+ * The following license statement only applies to this file (net_http_pool_test.c).
+ * ---------------------------------------------------------------------------------------
+ *
+ * Permission is hereby granted, free of charge,
+ * to any person obtaining a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Downloads a batch of files concurrently, to memory and to disk, from a
+ * local HTTP/1.1 server and checks what arrived. Serve the directory the
+ * test writes its files to with a keep-alive capable server, e.g.:
+ *
+ *   mkdir -p /tmp/http_pool && cd /tmp/http_pool && python3 -c \
+ *     "import http.server as h; \
+ *      h.test(HandlerClass=h.SimpleHTTPRequestHandler, port=8000, \
+ *             protocol='HTTP/1.1')"
+ *
+ *   ./net_http_pool_test http://127.0.0.1:8000 /tmp/http_pool
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <net/net_http.h>
+#include <net/net_compat.h>
+#include <streams/file_stream.h>
+
+#define FILES     32
+#define ROUNDS    3
+
+static size_t file_size(unsigned idx)
+{
+   /* From a few bytes to a couple of megabytes. */
+   return (size_t)1 << (4 + (idx % 18));
+}
+
+static unsigned char file_byte(unsigned idx, size_t pos)
+{
+   return (unsigned char)(idx * 31 + pos * 7 + (pos >> 11));
+}
+
+static bool check_data(unsigned idx, const unsigned char *data, size_t len)
+{
+   size_t i;
+
+   if (len != file_size(idx))
+      return false;
+
+   for (i = 0; i < len; i++)
+      if (data[i] != file_byte(idx, i))
+         return false;
+
+   return true;
+}
+
+static double now(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool write_files(const char *dir)
+{
+   unsigned i;
+   char path[1024];
+
+   for (i = 0; i < FILES; i++)
+   {
+      size_t j, len       = file_size(i);
+      unsigned char *data = (unsigned char*)malloc(len);
+
+      for (j = 0; j < len; j++)
+         data[j] = file_byte(i, j);
+
+      snprintf(path, sizeof(path), "%s/file%u.bin", dir, i);
+      if (!filestream_write_file(path, data, len))
+         return false;
+
+      free(data);
+   }
+
+   return true;
+}
+
+static struct http_t *start(const char *base, const char *dir,
+      unsigned idx, bool to_file)
+{
+   char url[1024];
+   char path[1024];
+   struct http_t *http            = NULL;
+   struct http_connection_t *conn = NULL;
+
+   snprintf(url, sizeof(url), "%s/file%u.bin", base, idx);
+   conn = net_http_connection_new(url);
+
+   while (!net_http_connection_iterate(conn)) {}
+   if (!net_http_connection_done(conn))
+   {
+      net_http_connection_free(conn);
+      return NULL;
+   }
+
+   if (to_file)
+   {
+      snprintf(path, sizeof(path), "%s/download%u.bin", dir, idx);
+      http = net_http_new_file(conn, path);
+   }
+   else
+      http = net_http_new(conn);
+
+   net_http_connection_free(conn);
+   return http;
+}
+
+static bool finish(struct http_t *http, const char *dir,
+      unsigned idx, bool to_file)
+{
+   bool ok             = false;
+   size_t len          = 0;
+   unsigned char *data = net_http_data(http, &len, true);
+
+   if (net_http_error(http))
+   {
+      printf("file%u: failed, status %d\n", idx, net_http_status(http));
+      free(data);
+      return false;
+   }
+
+   if (to_file)
+   {
+      char path[1024];
+      ssize_t file_len = 0;
+      void *buf        = NULL;
+
+      snprintf(path, sizeof(path), "%s/download%u.bin", dir, idx);
+      if (filestream_read_file(path, &buf, &file_len))
+         ok = check_data(idx, (unsigned char*)buf, (size_t)file_len);
+      free(buf);
+      remove(path);
+   }
+   else
+      ok = check_data(idx, data, len);
+
+   if (!ok)
+      printf("file%u: corrupt download\n", idx);
+
+   free(data);
+   return ok;
+}
+
+/* Starts every download at once and drives them together,
+ * the way the task queue would. Returns the number of
+ * distinct connections used, 0 on failure. */
+static unsigned run_concurrent(const char *base, const char *dir)
+{
+   unsigned i, fds = 0, remaining = FILES;
+   int seen[FILES];
+   struct http_t *http[FILES];
+   bool ok = true;
+
+   for (i = 0; i < FILES; i++)
+   {
+      unsigned j;
+      int fd;
+
+      http[i] = start(base, dir, i, i & 1);
+      if (!http[i])
+      {
+         printf("file%u: could not connect\n", i);
+         return 0;
+      }
+
+      fd = net_http_fd(http[i]);
+      for (j = 0; j < fds; j++)
+         if (seen[j] == fd)
+            break;
+      if (j == fds)
+         seen[fds++] = fd;
+   }
+
+   while (remaining)
+   {
+      for (i = 0; i < FILES; i++)
+      {
+         if (!http[i] || !net_http_update(http[i], NULL, NULL))
+            continue;
+
+         ok &= finish(http[i], dir, i, i & 1);
+         net_http_delete(http[i]);
+         http[i] = NULL;
+         remaining--;
+      }
+   }
+
+   return ok ? fds : 0;
+}
+
+/* Downloads the files one after the other.
+ * Returns the number of distinct connections used, 0 on failure. */
+static unsigned run_sequential(const char *base, const char *dir)
+{
+   unsigned i, fds = 0;
+   int last = -1;
+   bool ok  = true;
+
+   for (i = 0; i < FILES; i++)
+   {
+      struct http_t *http = start(base, dir, i, i & 1);
+
+      if (!http)
+      {
+         printf("file%u: could not connect\n", i);
+         return 0;
+      }
+
+      if (net_http_fd(http) != last)
+         fds++;
+      last = net_http_fd(http);
+
+      while (!net_http_update(http, NULL, NULL)) {}
+
+      ok &= finish(http, dir, i, i & 1);
+      net_http_delete(http);
+   }
+
+   return ok ? fds : 0;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned round;
+   const char *base = argc > 1 ? argv[1] : "http://127.0.0.1:8000";
+   const char *dir  = argc > 2 ? argv[2] : ".";
+   bool ok          = true;
+
+   if (!network_init())
+      return 1;
+
+   net_http_pool_init();
+
+   if (!write_files(dir))
+   {
+      printf("Could not write the test files to %s\n", dir);
+      return 1;
+   }
+
+   for (round = 0; round < ROUNDS; round++)
+   {
+      unsigned conns;
+      double t = now();
+
+      conns = run_concurrent(base, dir);
+      printf("concurrent: %u files over %u connection(s) in %.1f ms\n",
+            FILES, conns, (now() - t) * 1000.0);
+      ok   &= conns > 0;
+
+      t     = now();
+      conns = run_sequential(base, dir);
+      printf("sequential: %u files over %u connection(s) in %.1f ms\n",
+            FILES, conns, (now() - t) * 1000.0);
+      ok   &= conns == 1;
+   }
+
+   net_http_pool_clear();
+
+   puts(ok ? "OK" : "FAILED");
+   return ok ? 0 : 1;
+}
@@ -384,8 +384,12 @@ ssize_t filestream_tell(RFILE *stream)
    if (!stream)
       goto error;
 #if defined(VITA) || defined(PSP)
-  if (sceIoLseek(stream->fd, 0, SEEK_CUR) < 0)
-     goto error;
+   {
+      SceOff pos = sceIoLseek(stream->fd, 0, SEEK_CUR);
+      if (pos < 0)
+         goto error;
+      return pos;
+   }
 #else
 #if defined(HAVE_BUFFERED_IO)
    if ((stream->hints & RFILE_HINT_UNBUFFERED) == 0)
@@ -397,12 +401,14 @@ ssize_t filestream_tell(RFILE *stream)
    if (stream->mapped && stream->hints & RFILE_HINT_MMAP)
       return stream->mappos;
 #endif
-   if (lseek(stream->fd, 0, SEEK_CUR) < 0)
-      goto error;
+   {
+      off_t pos = lseek(stream->fd, 0, SEEK_CUR);
+      if (pos < 0)
+         goto error;
+      return pos;
+   }
 #endif
 
-   return 0;
-
 error:
    return -1;
 }
@@ -20,647 +20,812 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
-#include <stdlib.h>
 #include <assert.h>
-#include <rhash.h>
+
+#include <boolean.h>
+#include <rthreads/rthreads.h>
 
 #include "libretrodb.h"
 
+/* Deepest table a field is looked up in, game ( rom ( crc ) ) is 2. */
+#define DAT_CONVERTER_MAX_DEPTH 8
+
+#define DAT_CONVERTER_MAX_THREADS 16
+
 static void dat_converter_exit(int rc)
 {
    fflush(stdout);
    exit(rc);
 }
 
-typedef enum
-{
-   DAT_CONVERTER_STRING_MAP,
-   DAT_CONVERTER_LIST_MAP,
-} dat_converter_map_enum;
-
-typedef enum
+/* Path of a field, "rom.crc" is the crc of the rom table. */
+typedef struct
 {
-   DAT_CONVERTER_TOKEN_LIST,
-   DAT_CONVERTER_STRING_LIST,
-   DAT_CONVERTER_MAP_LIST,
-   DAT_CONVERTER_LIST_LIST,
-} dat_converter_list_enum;
+   char* value;
+   int count;
+   const char* parts[DAT_CONVERTER_MAX_DEPTH];
+   size_t lens[DAT_CONVERTER_MAX_DEPTH];
+   uint32_t hashes[DAT_CONVERTER_MAX_DEPTH];
+} dat_converter_match_key_t;
 
+/* Tokens point into the DAT file and aren't terminated. */
 typedef struct
 {
    const char* label;
+   size_t len;
    int line_no;
    int column;
-   const char* fname;
 } dat_converter_token_t;
 
+typedef struct
+{
+   const char* src;
+   const char* end;
+   const char* fname;
+   int line_no;
+   int column;
+   bool quoted;
+} dat_converter_lexer_t;
+
+typedef struct
+{
+   int mapping;
+   uint32_t len;
+   const char* value;
+} dat_converter_field_t;
 
-typedef struct dat_converter_map_t dat_converter_map_t;
-typedef struct dat_converter_list_t dat_converter_list_t;
-typedef union dat_converter_list_item_t dat_converter_list_item_t;
-typedef struct dat_converter_search_tree_t dat_converter_search_tree_t;
-typedef struct dat_converter_bt_node_t dat_converter_bt_node_t;
+typedef struct dat_converter_record_t dat_converter_record_t;
+typedef struct dat_converter_file_t dat_converter_file_t;
 
-struct dat_converter_map_t
+struct dat_converter_record_t
 {
+   const dat_converter_file_t* file;
    const char* key;
-   uint32_t hash;
-   dat_converter_map_enum type;
-   union
-   {
-      const char* string;
-      dat_converter_list_t* list;
-   } value;
+   size_t key_len;
+   uint32_t key_hash;
+   size_t first_field;
+   size_t field_count;
+   /* Same game from a later DAT file. */
+   dat_converter_record_t* next;
 };
 
-struct dat_converter_list_t
+struct dat_converter_file_t
 {
-   dat_converter_list_enum type;
-   dat_converter_list_item_t* values;
-   dat_converter_bt_node_t* bt_root;
-   int count;
-   int capacity;
+   const char* path;
+   char* data;
+   size_t size;
+   bool mapped;
+
+   dat_converter_record_t* records;
+   size_t record_count;
+   size_t record_capacity;
+
+   dat_converter_field_t* fields;
+   size_t field_count;
+   size_t field_capacity;
 };
 
-union dat_converter_list_item_t
+typedef struct
 {
-   const char* string;
-   dat_converter_map_t map;
-   dat_converter_token_t token;
-   dat_converter_list_t* list;
-};
+   dat_converter_lexer_t lexer;
+   dat_converter_file_t* file;
+   const dat_converter_match_key_t* match_key;
+   dat_converter_record_t* record;
 
+   /* Keys of the tables the parser is in. */
+   int depth;
+   dat_converter_token_t keys[DAT_CONVERTER_MAX_DEPTH];
+   uint32_t hashes[DAT_CONVERTER_MAX_DEPTH];
+} dat_converter_parser_t;
 
-struct dat_converter_bt_node_t
+typedef struct
 {
-   int index;
-   uint32_t hash;
-   dat_converter_bt_node_t* right;
-   dat_converter_bt_node_t* left;
-};
+   dat_converter_record_t* first;
+   dat_converter_record_t* last;
+} dat_converter_entry_t;
+
+typedef struct
+{
+   dat_converter_file_t* files;
+   unsigned count;
+   unsigned next;
+   slock_t* lock;
+   const dat_converter_match_key_t* match_key;
+} dat_converter_jobs_t;
+
+typedef struct
+{
+   dat_converter_entry_t* entries;
+   size_t count;
+} dat_converter_provider_t;
 
-static dat_converter_list_t* dat_converter_list_create(
-      dat_converter_list_enum type)
+static uint32_t dat_converter_hash(const char* str, size_t len)
 {
-   dat_converter_list_t* list = malloc(sizeof(*list));
+   const unsigned char* aux = (const unsigned char*)str;
+   uint32_t hash            = 5381;
 
-   list->type                 = type;
-   list->count                = 0;
-   list->capacity             = (1 << 2);
-   list->bt_root              = NULL;
-   list->values               = (dat_converter_list_item_t*)malloc(
-         sizeof(*list->values) * list->capacity);
+   while (len--)
+      hash = (hash << 5) + hash + *aux++;
 
-   return list;
+   return hash;
 }
 
-static void dat_converter_bt_node_free(dat_converter_bt_node_t* node)
+static bool dat_converter_token_is(const dat_converter_token_t* token,
+      const char* str)
 {
-   if (!node)
-      return;
-
-   dat_converter_bt_node_free(node->left);
-   dat_converter_bt_node_free(node->right);
-   free(node);
+   return token->len == strlen(str) && !memcmp(token->label, str, token->len);
 }
 
-static void dat_converter_list_free(dat_converter_list_t* list)
+static void* dat_converter_grow(void* values, size_t* capacity,
+      size_t count, size_t size)
 {
-   if (!list)
-      return;
-   switch (list->type)
+   if (count < *capacity)
+      return values;
+
+   *capacity = *capacity ? *capacity * 2 : 256;
+   values    = realloc(values, *capacity * size);
+
+   if (!values)
    {
-   case DAT_CONVERTER_LIST_LIST:
-      while (list->count--)
-         dat_converter_list_free(list->values[list->count].list);
-      break;
-   case DAT_CONVERTER_MAP_LIST:
-      while (list->count--)
-      {
-         if (list->values[list->count].map.type == DAT_CONVERTER_LIST_MAP)
-            dat_converter_list_free(list->values[list->count].map.value.list);
-      }
-      dat_converter_bt_node_free(list->bt_root);
-      break;
-   default:
-      break;
+      printf("out of memory\n");
+      dat_converter_exit(1);
    }
 
-   free(list->values);
-   free(list);
+   return values;
 }
-static void dat_converter_list_append(dat_converter_list_t* dst, void* item);
 
-static dat_converter_bt_node_t* dat_converter_bt_node_insert(
-      dat_converter_list_t* list,
-      dat_converter_bt_node_t** node,
-      dat_converter_map_t* map)
+static dat_converter_match_key_t* dat_converter_match_key_create(
+      const char* format)
 {
-   assert(map->key);
-   assert(list->type == DAT_CONVERTER_MAP_LIST);
+   int i;
+   char* dot;
+   dat_converter_match_key_t* match_key = calloc(1, sizeof(*match_key));
+
+   match_key->value    = strdup(format);
+   match_key->parts[0] = match_key->value;
+   match_key->count    = 1;
 
-   if (!*node)
+   for (dot = match_key->value; *dot; dot++)
    {
-      *node = calloc(1, sizeof(dat_converter_bt_node_t));
-      return *node;
+      if (*dot != '.' || match_key->count == DAT_CONVERTER_MAX_DEPTH)
+         continue;
+
+      *dot = '\0';
+      match_key->parts[match_key->count++] = dot + 1;
+   }
+
+   for (i = 0; i < match_key->count; i++)
+   {
+      match_key->lens[i]   = strlen(match_key->parts[i]);
+      match_key->hashes[i] = dat_converter_hash(match_key->parts[i],
+            match_key->lens[i]);
    }
 
-   int diff = (*node)->hash - map->hash;
+   return match_key;
+}
+
+static void dat_converter_match_key_free(dat_converter_match_key_t* match_key)
+{
+   if (!match_key)
+      return;
 
-   if (!diff)
-      diff = strcmp(list->values[(*node)->index].map.key, map->key);
+   free(match_key->value);
+   free(match_key);
+}
 
-   if (diff < 0)
-      return dat_converter_bt_node_insert(list, &(*node)->left, map);
-   else if (diff > 0)
-      return dat_converter_bt_node_insert(list, &(*node)->right, map);
+static bool dat_converter_match_key_is(
+      const dat_converter_match_key_t* match_key,
+      const dat_converter_parser_t* parser,
+      const dat_converter_token_t* key, uint32_t hash)
+{
+   int i;
 
-   /* found match */
+   if (match_key->count != parser->depth + 1
+         || match_key->hashes[parser->depth] != hash
+         || match_key->lens[parser->depth] != key->len
+         || memcmp(match_key->parts[parser->depth], key->label, key->len))
+      return false;
 
-   if (list->values[(*node)->index].map.type == DAT_CONVERTER_LIST_MAP)
+   for (i = 0; i < parser->depth; i++)
    {
-      if (map->type == DAT_CONVERTER_LIST_MAP)
-      {
-         int i;
-         assert(list->values[(*node)->index].map.value.list->type 
-               == map->value.list->type);
-
-         for (i = 0; i < map->value.list->count; i++)
-            dat_converter_list_append(
-                  list->values[(*node)->index].map.value.list,
-                  &map->value.list->values[i]);
-
-         /* set count to 0 to prevent freeing the child nodes */
-         map->value.list->count = 0;
-         dat_converter_list_free(map->value.list);
-      }
+      if (match_key->hashes[i] != parser->hashes[i]
+            || match_key->lens[i] != parser->keys[i].len
+            || memcmp(match_key->parts[i], parser->keys[i].label,
+               parser->keys[i].len))
+         return false;
    }
-   else
-      list->values[(*node)->index].map = *map;
 
-   return NULL;
+   return true;
 }
 
+typedef enum
+{
+   DAT_CONVERTER_RDB_TYPE_STRING,
+   DAT_CONVERTER_RDB_TYPE_UINT,
+   DAT_CONVERTER_RDB_TYPE_BINARY,
+   DAT_CONVERTER_RDB_TYPE_HEX
+} dat_converter_rdb_format_enum;
 
-static void dat_converter_list_append(dat_converter_list_t* dst, void* item)
+typedef struct
 {
-   if (dst->count == dst->capacity)
-   {
-      dst->capacity <<= 1;
-      dst->values = realloc(dst->values, sizeof(*dst->values) * dst->capacity);
-   }
-   switch (dst->type)
-   {
-   case DAT_CONVERTER_TOKEN_LIST:
-   {
-      dat_converter_token_t* token = (dat_converter_token_t*) item;
-      dst->values[dst->count].token = *token;
-      break;
-   }
-   case DAT_CONVERTER_STRING_LIST:
-   {
-      char* str = (char*) item;
-      dst->values[dst->count].string = str;
-      break;
-   }
-   case DAT_CONVERTER_MAP_LIST:
-   {
-      dat_converter_map_t* map = (dat_converter_map_t*) item;
-      if (!map->key)
-         dst->values[dst->count].map = *map;
-      else
-      {
-         map->hash = djb2_calculate(map->key);
-         dat_converter_bt_node_t* new_node = 
-            dat_converter_bt_node_insert(dst, &dst->bt_root, map);
+   const char* dat_key;
+   const char* rdb_key;
+   dat_converter_rdb_format_enum format;
+} dat_converter_rdb_mappings_t;
 
-         if (!new_node)
-            return;
+dat_converter_rdb_mappings_t rdb_mappings[] =
+{
+   {"name",           "name",           DAT_CONVERTER_RDB_TYPE_STRING},
+   {"description",    "description",    DAT_CONVERTER_RDB_TYPE_STRING},
+   {"genre",          "genre",          DAT_CONVERTER_RDB_TYPE_STRING},
+   {"rom.name",       "rom_name",       DAT_CONVERTER_RDB_TYPE_STRING},
+   {"rom.size",       "size",           DAT_CONVERTER_RDB_TYPE_UINT},
+   {"users",          "users",          DAT_CONVERTER_RDB_TYPE_UINT},
+   {"releasemonth",   "releasemonth",   DAT_CONVERTER_RDB_TYPE_UINT},
+   {"releaseyear",    "releaseyear",    DAT_CONVERTER_RDB_TYPE_UINT},
+   {"rumble",         "rumble",         DAT_CONVERTER_RDB_TYPE_UINT},
+   {"analog",         "analog",         DAT_CONVERTER_RDB_TYPE_UINT},
 
-         dst->values[dst->count].map = *map;
-         new_node->index = dst->count;
-         new_node->hash = map->hash;
-      }
-      break;
-   }
-   case DAT_CONVERTER_LIST_LIST:
+   {"famitsu_rating", "famitsu_rating", DAT_CONVERTER_RDB_TYPE_UINT},
+   {"edge_rating",    "edge_rating",    DAT_CONVERTER_RDB_TYPE_UINT},
+   {"edge_issue",     "edge_issue",     DAT_CONVERTER_RDB_TYPE_UINT},
+   {"edge_review",    "edge_review",    DAT_CONVERTER_RDB_TYPE_STRING},
+
+   {"enhancement_hw", "enhancement_hw", DAT_CONVERTER_RDB_TYPE_STRING},
+   {"barcode",        "barcode",        DAT_CONVERTER_RDB_TYPE_STRING},
+   {"esrb_rating",    "esrb_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
+   {"elspa_rating",   "elspa_rating",   DAT_CONVERTER_RDB_TYPE_STRING},
+   {"pegi_rating",    "pegi_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
+   {"cero_rating",    "cero_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
+   {"franchise",      "franchise",      DAT_CONVERTER_RDB_TYPE_STRING},
+
+   {"developer",      "developer",      DAT_CONVERTER_RDB_TYPE_STRING},
+   {"publisher",      "publisher",      DAT_CONVERTER_RDB_TYPE_STRING},
+   {"origin",         "origin",         DAT_CONVERTER_RDB_TYPE_STRING},
+
+   {"coop",           "coop",           DAT_CONVERTER_RDB_TYPE_UINT},
+   {"tgdb_rating",    "tgdb_rating",    DAT_CONVERTER_RDB_TYPE_UINT},
+
+   {"rom.crc",        "crc",            DAT_CONVERTER_RDB_TYPE_HEX},
+   {"rom.md5",        "md5",            DAT_CONVERTER_RDB_TYPE_HEX},
+   {"rom.sha1",       "sha1",           DAT_CONVERTER_RDB_TYPE_HEX},
+   {"serial",         "serial",         DAT_CONVERTER_RDB_TYPE_BINARY},
+   {"rom.serial",     "serial",         DAT_CONVERTER_RDB_TYPE_BINARY}
+};
+
+#define RDB_MAPPINGS_COUNT (sizeof(rdb_mappings) / sizeof(*rdb_mappings))
+
+#define RDB_MAPPINGS_BUCKETS 64
+
+dat_converter_match_key_t* rdb_mappings_mk[RDB_MAPPINGS_COUNT] = {0};
+
+/* Mappings by the hash of the last part of their path, -1 ends
+ * a chain. */
+static int rdb_mappings_buckets[RDB_MAPPINGS_BUCKETS];
+static int rdb_mappings_next[RDB_MAPPINGS_COUNT];
+
+static void dat_converter_value_provider_init(void)
+{
+   int i;
+
+   for (i = 0; i < RDB_MAPPINGS_BUCKETS; i++)
+      rdb_mappings_buckets[i] = -1;
+
+   for (i = RDB_MAPPINGS_COUNT - 1; i >= 0; i--)
    {
-      dat_converter_list_t* list = (dat_converter_list_t*) item;
-      dst->values[dst->count].list = list;
-      break;
+      dat_converter_match_key_t* mk = dat_converter_match_key_create(
+            rdb_mappings[i].dat_key);
+      uint32_t bucket = mk->hashes[mk->count - 1] % RDB_MAPPINGS_BUCKETS;
+
+      rdb_mappings_mk[i]           = mk;
+      rdb_mappings_next[i]         = rdb_mappings_buckets[bucket];
+      rdb_mappings_buckets[bucket] = i;
    }
-   default:
-      return;
+}
+static void dat_converter_value_provider_free(void)
+{
+   int i;
+   for (i = 0; i < RDB_MAPPINGS_COUNT; i++)
+   {
+      dat_converter_match_key_free(rdb_mappings_mk[i]);
+      rdb_mappings_mk[i] = NULL;
    }
-   dst->count++;
 }
 
-static dat_converter_list_t* dat_converter_lexer(
-      char* src, const char* dat_path)
+/* Splits the DAT like the format wants it: on blanks outside of
+ * quotes, line ends and quotes. Returns false at the end. */
+static bool dat_converter_lexer_next(dat_converter_lexer_t* lexer,
+      dat_converter_token_t* token)
 {
-   dat_converter_list_t* token_list = 
-      dat_converter_list_create(DAT_CONVERTER_TOKEN_LIST);
-   dat_converter_token_t token      = {NULL, 1, 1, dat_path};
-   bool quoted_token                = false;
+   const char* src = lexer->src;
 
-   while (*src)
+   while (src < lexer->end && *src)
    {
-      if ((!quoted_token && (*src == '\t' || *src == ' ')) || (*src == '\r'))
+      if ((!lexer->quoted && (*src == '\t' || *src == ' ')) || *src == '\r')
       {
-         *src = '\0';
          src++;
-         token.column++;
-         token.label = NULL;
-         quoted_token = false;
+         lexer->column++;
+         lexer->quoted = false;
          continue;
       }
 
       if (*src == '\n')
       {
-         *src = '\0';
          src++;
-         token.column = 1;
-         token.line_no++;
-         token.label = NULL;
-         quoted_token = false;
+         lexer->column = 1;
+         lexer->line_no++;
+         lexer->quoted = false;
          continue;
       }
 
       if (*src == '\"')
       {
-         *src = '\0';
          src++;
-         token.column++;
-         quoted_token = !quoted_token;
-         token.label = NULL;
-
-         if (quoted_token)
-         {
-            token.label = src;
-            dat_converter_list_append(token_list, &token);
-         }
+         lexer->column++;
+         lexer->quoted = !lexer->quoted;
 
-         continue;
+         if (!lexer->quoted)
+            continue;
       }
 
-      if (!token.label)
+      token->label   = src;
+      token->line_no = lexer->line_no;
+      token->column  = lexer->column;
+
+      while (src < lexer->end && *src && *src != '\"'
+            && *src != '\r' && *src != '\n'
+            && (lexer->quoted || (*src != ' ' && *src != '\t')))
       {
-         token.label = src;
-         dat_converter_list_append(token_list, &token);
+         src++;
+         lexer->column++;
       }
 
-      src++;
-      token.column++;
+      token->len = src - token->label;
+      lexer->src = src;
+      return true;
    }
 
-   token.label = NULL;
-   dat_converter_list_append(token_list, &token);
+   token->label   = NULL;
+   token->len     = 0;
+   token->line_no = lexer->line_no;
+   token->column  = lexer->column;
+   lexer->src     = src;
+   return false;
+}
 
-   return token_list;
+static void dat_converter_parser_error(const dat_converter_parser_t* parser,
+      const dat_converter_token_t* token, const char* error)
+{
+   printf("%s:%d:%d: fatal error: %s\n",
+         parser->lexer.fname, token->line_no, token->column, error);
+   dat_converter_exit(1);
 }
 
-static dat_converter_list_t* dat_parser_table(
-      dat_converter_list_item_t** start_token)
+static void dat_converter_parser_field(dat_converter_parser_t* parser,
+      const dat_converter_token_t* key, const dat_converter_token_t* value)
 {
-   dat_converter_list_t* parsed_table = 
-      dat_converter_list_create(DAT_CONVERTER_MAP_LIST);
-   dat_converter_map_t map            = {0};
-   dat_converter_list_item_t* current = *start_token;
+   int i;
+   uint32_t hash                = dat_converter_hash(key->label, key->len);
+   dat_converter_file_t* file   = parser->file;
 
-   while (current->token.label)
+   if (parser->match_key
+         && dat_converter_match_key_is(parser->match_key, parser, key, hash))
    {
-
-      if (!map.key)
-      {
-         if (!strcmp(current->token.label, ")"))
-         {
-            current++;
-            *start_token = current;
-            return parsed_table;
-         }
-         else if (!strcmp(current->token.label, "("))
-         {
-            printf("%s:%d:%d: fatal error: Unexpected '(' instead of key\n",
-                   current->token.fname,
-                   current->token.line_no,
-                   current->token.column);
-            dat_converter_exit(1);
-         }
-         else
-         {
-            map.key = current->token.label;
-            current++;
-         }
-      }
-      else
-      {
-         if (!strcmp(current->token.label, "("))
-         {
-            current++;
-            map.type = DAT_CONVERTER_LIST_MAP;
-            map.value.list = dat_parser_table(&current);
-            dat_converter_list_append(parsed_table, &map);
-         }
-         else if (!strcmp(current->token.label, ")"))
-         {
-            printf("%s:%d:%d: fatal error: Unexpected ')' instead of value\n",
-                   current->token.fname,
-                   current->token.line_no,
-                   current->token.column);
-            dat_converter_exit(1);
-         }
-         else
-         {
-            map.type = DAT_CONVERTER_STRING_MAP;
-            map.value.string = current->token.label;
-            dat_converter_list_append(parsed_table, &map);
-            current++;
-         }
-         map.key = NULL;
-      }
+      parser->record->key     = value->label;
+      parser->record->key_len = value->len;
    }
 
-   printf("%s:%d:%d: fatal error: Missing ')' for '('\n",
-          (*start_token)->token.fname,
-          (*start_token)->token.line_no,
-          (*start_token)->token.column);
-   dat_converter_exit(1);
+   for (i = rdb_mappings_buckets[hash % RDB_MAPPINGS_BUCKETS];
+         i >= 0; i = rdb_mappings_next[i])
+   {
+      dat_converter_field_t* field;
+
+      if (!dat_converter_match_key_is(rdb_mappings_mk[i], parser, key, hash))
+         continue;
 
-   /* unreached */
-   dat_converter_list_free(parsed_table);
-   return NULL;
+      file->fields = dat_converter_grow(file->fields, &file->field_capacity,
+            file->field_count, sizeof(*file->fields));
+
+      field          = &file->fields[file->field_count++];
+      field->mapping = i;
+      field->len     = value->len;
+      field->value   = value->label;
+      parser->record->field_count++;
+   }
 }
 
-typedef struct dat_converter_match_key_t dat_converter_match_key_t;
-struct dat_converter_match_key_t
+/* Reads the table after a '(' up to its ')'. Fields of a game go
+ * into the current record, other tables are only checked. */
+static void dat_converter_parse_table(dat_converter_parser_t* parser,
+      bool keep)
 {
-   char* value;
-   uint32_t hash;
-   dat_converter_match_key_t* next;
-};
+   dat_converter_token_t token;
+   dat_converter_token_t key   = {0};
+   dat_converter_token_t start = {0};
+   bool started                = false;
 
-static dat_converter_match_key_t* dat_converter_match_key_create(
-      const char* format)
-{
-   dat_converter_match_key_t* match_key;
-   dat_converter_match_key_t* current_mk;
-   char* dot;
+   while (dat_converter_lexer_next(&parser->lexer, &token))
+   {
+      if (!started)
+      {
+         start   = token;
+         started = true;
+      }
 
-   match_key = malloc(sizeof(*match_key));
-   match_key->value = strdup(format);
-   match_key->next = NULL;
-   current_mk = match_key;
+      if (!key.label)
+      {
+         if (dat_converter_token_is(&token, ")"))
+            return;
+         else if (dat_converter_token_is(&token, "("))
+            dat_converter_parser_error(parser, &token,
+                  "Unexpected '(' instead of key");
 
-   dot = match_key->value;
-   while (*dot++)
-   {
-      if (*dot == '.')
+         key = token;
+         continue;
+      }
+
+      if (dat_converter_token_is(&token, "("))
       {
-         *dot++ = '\0';
-         current_mk->hash = djb2_calculate(current_mk->value);
-         current_mk->next = malloc(sizeof(*match_key));
-         current_mk = current_mk->next;
-         current_mk->value = dot;
-         current_mk->next = NULL;
+         if (parser->depth < DAT_CONVERTER_MAX_DEPTH)
+         {
+            parser->keys[parser->depth]   = key;
+            parser->hashes[parser->depth] = dat_converter_hash(
+                  key.label, key.len);
+         }
+
+         parser->depth++;
+         dat_converter_parse_table(parser,
+               keep && parser->depth < DAT_CONVERTER_MAX_DEPTH);
+         parser->depth--;
       }
+      else if (dat_converter_token_is(&token, ")"))
+         dat_converter_parser_error(parser, &token,
+               "Unexpected ')' instead of value");
+      else if (keep)
+         dat_converter_parser_field(parser, &key, &token);
+
+      key.label = NULL;
    }
-   current_mk->hash = djb2_calculate(current_mk->value);
 
-   return match_key;
+   dat_converter_parser_error(parser, started ? &start : &token,
+         "Missing ')' for '('");
 }
 
-static void dat_converter_match_key_free(dat_converter_match_key_t* match_key)
+static void dat_converter_parse_file(dat_converter_file_t* file,
+      const dat_converter_match_key_t* match_key)
 {
-   if (!match_key)
-      return;
+   dat_converter_token_t token;
+   dat_converter_parser_t parser = {{0}};
 
-   free(match_key->value);
+   parser.lexer.src     = file->data;
+   parser.lexer.end     = file->data + file->size;
+   parser.lexer.fname   = file->path;
+   parser.lexer.line_no = 1;
+   parser.lexer.column  = 1;
+   parser.file          = file;
+   parser.match_key     = match_key;
 
-   while (match_key)
+   while (dat_converter_lexer_next(&parser.lexer, &token))
    {
-      dat_converter_match_key_t* next = match_key->next;
-      free(match_key);
-      match_key = next;
-   }
-}
-
-static const char* dat_converter_get_match(
-      dat_converter_list_t* list,
-      dat_converter_match_key_t* match_key)
-{
-   int i;
+      bool game = dat_converter_token_is(&token, "game");
 
-   assert(match_key);
+      /* A key left without a table at the end is ignored. */
+      if (!dat_converter_lexer_next(&parser.lexer, &token))
+         break;
 
-   if (list->type != DAT_CONVERTER_MAP_LIST)
-      return NULL;
+      if (!dat_converter_token_is(&token, "("))
+      {
+         printf("%s:%d:%d: fatal error: Expected '(' found '%.*s'\n",
+               file->path, token.line_no, token.column,
+               (int)token.len, token.label);
+         dat_converter_exit(1);
+      }
 
-   for (i = 0; i < list->count; i++)
-   {
-      if (list->values[i].map.hash == match_key->hash)
+      if (!game)
       {
-         assert(!strcmp(list->values[i].map.key, match_key->value));
+         dat_converter_parse_table(&parser, false);
+         continue;
+      }
+
+      file->records = dat_converter_grow(file->records,
+            &file->record_capacity, file->record_count,
+            sizeof(*file->records));
 
-         if (match_key->next)
-            return dat_converter_get_match(
-                  list->values[i].map.value.list, match_key->next);
-         else  if ((list->values[i].map.type == DAT_CONVERTER_STRING_MAP))
-            return list->values[i].map.value.string;
-         else
-            return NULL;
+      parser.record = &file->records[file->record_count];
+      memset(parser.record, 0, sizeof(*parser.record));
+      parser.record->file        = file;
+      parser.record->first_field = file->field_count;
 
+      dat_converter_parse_table(&parser, true);
+
+      if (match_key)
+      {
+         if (!parser.record->key)
+         {
+            int i;
+            printf("missing match key '");
+            for (i = 0; i < match_key->count - 1; i++)
+               printf("%s.", match_key->parts[i]);
+            printf("%s' in one of the entries\n",
+                  match_key->parts[match_key->count - 1]);
+            dat_converter_exit(1);
+         }
+
+         parser.record->key_hash = dat_converter_hash(
+               parser.record->key, parser.record->key_len);
       }
+
+      file->record_count++;
    }
-   return NULL;
 }
 
-static dat_converter_list_t* dat_converter_parser(
-      dat_converter_list_t* target,
-      dat_converter_list_t* lexer_list,
-      dat_converter_match_key_t* match_key)
+/* Maps the DAT file, it is only read from and the tokens point
+ * into it until the database is written. */
+static void dat_converter_file_load(dat_converter_file_t* file)
 {
-   bool skip = true;
-   dat_converter_list_item_t* current = lexer_list->values;
-   dat_converter_map_t map;
-
-   map.key = NULL;
-   map.type = DAT_CONVERTER_LIST_MAP;
+   struct stat st;
+   int fd = open(file->path, O_RDONLY);
 
-   if (!target)
+   if (fd < 0 || fstat(fd, &st) != 0)
    {
-      dat_converter_map_t map;
-      target = dat_converter_list_create(DAT_CONVERTER_MAP_LIST);
-      map.key = NULL;
-      map.type = DAT_CONVERTER_LIST_MAP;
-      map.value.list = NULL;
-      dat_converter_list_append(target, &map);
+      printf("could not open dat file '%s': %s\n",
+            file->path, strerror(errno));
+      dat_converter_exit(1);
    }
 
-   while (current->token.label)
+   file->size = st.st_size;
+
+   if (file->size)
    {
-      if (!map.key)
+      file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (file->data != MAP_FAILED)
       {
-         if (!strcmp(current->token.label, "game"))
-            skip = false;
-         map.key = current->token.label;
-         current++;
+         file->mapped = true;
+#ifdef MADV_SEQUENTIAL
+         madvise(file->data, file->size, MADV_SEQUENTIAL);
+#endif
       }
       else
       {
-         if (!strcmp(current->token.label, "("))
-         {
-            current++;
-            map.value.list = dat_parser_table(&current);
-            if (!skip)
-            {
-               if (match_key)
-               {
-                  map.key = dat_converter_get_match(map.value.list, match_key);
-                  if (!map.key)
-                  {
-                     printf("missing match key '");
-                     while (match_key->next)
-                     {
-                        printf("%s.", match_key->value);
-                        match_key = match_key->next;
-                     }
-                     printf("%s' in one of the entries\n", match_key->value);
-                     dat_converter_exit(1);
-                  }
-               }
-               else
-                  map.key = NULL;
+         size_t total = 0;
 
-               dat_converter_list_append(target, &map);
-               skip = true;
-            }
-            else
-               dat_converter_list_free(map.value.list);
-
-            map.key = NULL;
-         }
-         else
+         file->data = (char*)malloc(file->size);
+         while (file->data && total < file->size)
          {
-            printf("%s:%d:%d: fatal error: Expected '(' found '%s'\n",
-                   current->token.fname,
-                   current->token.line_no,
-                   current->token.column,
-                   current->token.label);
-            dat_converter_exit(1);
+            ssize_t rv = read(fd, file->data + total, file->size - total);
+            if (rv <= 0)
+               break;
+            total += rv;
          }
+         file->size = total;
       }
    }
-   return target;
+
+   close(fd);
 }
 
-typedef enum
+static void dat_converter_file_free(dat_converter_file_t* file)
 {
-   DAT_CONVERTER_RDB_TYPE_STRING,
-   DAT_CONVERTER_RDB_TYPE_UINT,
-   DAT_CONVERTER_RDB_TYPE_BINARY,
-   DAT_CONVERTER_RDB_TYPE_HEX
-} dat_converter_rdb_format_enum;
+   if (file->mapped)
+      munmap(file->data, file->size);
+   else
+      free(file->data);
 
-typedef struct
-{
-   const char* dat_key;
-   const char* rdb_key;
-   dat_converter_rdb_format_enum format;
-} dat_converter_rdb_mappings_t;
+   free(file->records);
+   free(file->fields);
+}
 
-dat_converter_rdb_mappings_t rdb_mappings[] =
+static void dat_converter_worker(void* data)
 {
-   {"name",           "name",           DAT_CONVERTER_RDB_TYPE_STRING},
-   {"description",    "description",    DAT_CONVERTER_RDB_TYPE_STRING},
-   {"genre",          "genre",          DAT_CONVERTER_RDB_TYPE_STRING},
-   {"rom.name",       "rom_name",       DAT_CONVERTER_RDB_TYPE_STRING},
-   {"rom.size",       "size",           DAT_CONVERTER_RDB_TYPE_UINT},
-   {"users",          "users",          DAT_CONVERTER_RDB_TYPE_UINT},
-   {"releasemonth",   "releasemonth",   DAT_CONVERTER_RDB_TYPE_UINT},
-   {"releaseyear",    "releaseyear",    DAT_CONVERTER_RDB_TYPE_UINT},
-   {"rumble",         "rumble",         DAT_CONVERTER_RDB_TYPE_UINT},
-   {"analog",         "analog",         DAT_CONVERTER_RDB_TYPE_UINT},
+   dat_converter_jobs_t* jobs = (dat_converter_jobs_t*)data;
 
-   {"famitsu_rating", "famitsu_rating", DAT_CONVERTER_RDB_TYPE_UINT},
-   {"edge_rating",    "edge_rating",    DAT_CONVERTER_RDB_TYPE_UINT},
-   {"edge_issue",     "edge_issue",     DAT_CONVERTER_RDB_TYPE_UINT},
-   {"edge_review",    "edge_review",    DAT_CONVERTER_RDB_TYPE_STRING},
+   for (;;)
+   {
+      unsigned i;
 
-   {"enhancement_hw", "enhancement_hw", DAT_CONVERTER_RDB_TYPE_STRING},
-   {"barcode",        "barcode",        DAT_CONVERTER_RDB_TYPE_STRING},
-   {"esrb_rating",    "esrb_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
-   {"elspa_rating",   "elspa_rating",   DAT_CONVERTER_RDB_TYPE_STRING},
-   {"pegi_rating",    "pegi_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
-   {"cero_rating",    "cero_rating",    DAT_CONVERTER_RDB_TYPE_STRING},
-   {"franchise",      "franchise",      DAT_CONVERTER_RDB_TYPE_STRING},
+      slock_lock(jobs->lock);
+      i = jobs->next++;
+      slock_unlock(jobs->lock);
 
-   {"developer",      "developer",      DAT_CONVERTER_RDB_TYPE_STRING},
-   {"publisher",      "publisher",      DAT_CONVERTER_RDB_TYPE_STRING},
-   {"origin",         "origin",         DAT_CONVERTER_RDB_TYPE_STRING},
+      if (i >= jobs->count)
+         break;
 
-   {"coop",           "coop",           DAT_CONVERTER_RDB_TYPE_UINT},
-   {"tgdb_rating",    "tgdb_rating",    DAT_CONVERTER_RDB_TYPE_UINT},
+      dat_converter_file_load(&jobs->files[i]);
+      dat_converter_parse_file(&jobs->files[i], jobs->match_key);
+   }
+}
 
-   {"rom.crc",        "crc",            DAT_CONVERTER_RDB_TYPE_HEX},
-   {"rom.md5",        "md5",            DAT_CONVERTER_RDB_TYPE_HEX},
-   {"rom.sha1",       "sha1",           DAT_CONVERTER_RDB_TYPE_HEX},
-   {"serial",         "serial",         DAT_CONVERTER_RDB_TYPE_BINARY},
-   {"rom.serial",     "serial",         DAT_CONVERTER_RDB_TYPE_BINARY}
-};
+/* Parses the DAT files on as many threads as there are cores, each
+ * file on its own. */
+static void dat_converter_parse_files(dat_converter_file_t* files,
+      unsigned count, const dat_converter_match_key_t* match_key)
+{
+   unsigned i;
+   sthread_t* threads[DAT_CONVERTER_MAX_THREADS];
+   dat_converter_jobs_t jobs;
+   unsigned thread_count = 1;
+   long cores            = sysconf(_SC_NPROCESSORS_ONLN);
+
+   if (cores > 1)
+      thread_count = cores;
+   if (thread_count > DAT_CONVERTER_MAX_THREADS)
+      thread_count = DAT_CONVERTER_MAX_THREADS;
+   if (thread_count > count)
+      thread_count = count;
+
+   jobs.files     = files;
+   jobs.count     = count;
+   jobs.next      = 0;
+   jobs.lock      = slock_new();
+   jobs.match_key = match_key;
+
+   if (!jobs.lock)
+   {
+      printf("out of memory\n");
+      dat_converter_exit(1);
+   }
 
-dat_converter_match_key_t* rdb_mappings_mk[(sizeof(rdb_mappings) 
-      / sizeof(*rdb_mappings))] = {0};
+   /* This thread is one of them. */
+   for (i = 1; i < thread_count; i++)
+      threads[i] = sthread_create(dat_converter_worker, &jobs);
 
-static void dat_converter_value_provider_init(void)
-{
-   int i;
-   for (i = 0; i < (sizeof(rdb_mappings) / sizeof(*rdb_mappings)); i++)
-      rdb_mappings_mk[i] = dat_converter_match_key_create(rdb_mappings[i].dat_key);
+   dat_converter_worker(&jobs);
+
+   for (i = 1; i < thread_count; i++)
+   {
+      if (threads[i])
+         sthread_join(threads[i]);
+   }
+
+   slock_free(jobs.lock);
 }
-static void dat_converter_value_provider_free(void)
+
+/* Merges the games found in several files by their match key, in
+ * file order so later files win, keeping where a game was first
+ * seen. */
+static dat_converter_entry_t* dat_converter_merge(dat_converter_file_t* files,
+      unsigned count, bool by_key, size_t* entry_count)
 {
-   int i;
-   for (i = 0; i < (sizeof(rdb_mappings) / sizeof(*rdb_mappings)); i++)
+   unsigned f;
+   size_t i, total    = 0;
+   size_t mask        = 0;
+   size_t* buckets    = NULL;
+   dat_converter_entry_t* entries;
+
+   for (f = 0; f < count; f++)
+      total += files[f].record_count;
+
+   entries      = (dat_converter_entry_t*)malloc(
+         (total ? total : 1) * sizeof(*entries));
+   *entry_count = 0;
+
+   if (by_key)
    {
-      dat_converter_match_key_free(rdb_mappings_mk[i]);
-      rdb_mappings_mk[i] = NULL;
+      size_t size = 16;
+      while (size < total * 2)
+         size <<= 1;
+
+      mask    = size - 1;
+      buckets = (size_t*)calloc(size, sizeof(*buckets));
+   }
+
+   if (!entries || (by_key && !buckets))
+   {
+      printf("out of memory\n");
+      dat_converter_exit(1);
+   }
+
+   for (f = 0; f < count; f++)
+   {
+      for (i = 0; i < files[f].record_count; i++)
+      {
+         dat_converter_record_t* record = &files[f].records[i];
+         size_t slot                    = 0;
+
+         if (by_key)
+         {
+            for (slot = record->key_hash & mask; buckets[slot];
+                  slot = (slot + 1) & mask)
+            {
+               dat_converter_record_t* first =
+                  entries[buckets[slot] - 1].first;
+
+               if (first->key_hash == record->key_hash
+                     && first->key_len == record->key_len
+                     && !memcmp(first->key, record->key, record->key_len))
+                  break;
+            }
+
+            if (buckets[slot])
+            {
+               dat_converter_entry_t* entry = &entries[buckets[slot] - 1];
+               entry->last->next            = record;
+               entry->last                  = record;
+               continue;
+            }
+
+            buckets[slot] = *entry_count + 1;
+         }
+
+         entries[*entry_count].first = record;
+         entries[*entry_count].last  = record;
+         (*entry_count)++;
+      }
    }
+
+   free(buckets);
+   return entries;
 }
+
+static char* dat_converter_strndup(const char* str, size_t len)
+{
+   char* copy = (char*)malloc(len + 1);
+
+   memcpy(copy, str, len);
+   copy[len] = '\0';
+   return copy;
+}
+
+/* Writes the games last seen first, the last value of a field in
+ * the files wins. */
 static int dat_converter_value_provider(
-      dat_converter_list_item_t** current_item, struct rmsgpack_dom_value* out)
+      dat_converter_provider_t* provider, struct rmsgpack_dom_value* out)
 {
    int i;
-   out->type          = RDT_MAP;
-   out->val.map.len   = 0;
-   out->val.map.items = calloc((sizeof(rdb_mappings) / sizeof(*rdb_mappings)),
-         sizeof(struct rmsgpack_dom_pair));
+   dat_converter_record_t* record;
+   struct rmsgpack_dom_pair* current;
+   const dat_converter_field_t* values[RDB_MAPPINGS_COUNT];
+   dat_converter_entry_t* entry;
 
-   (*current_item)--;
+   if (!provider->count)
+   {
+      out->type = RDT_NULL;
+      return 1;
+   }
 
-   assert((*current_item)->map.type == DAT_CONVERTER_LIST_MAP);
+   entry = &provider->entries[--provider->count];
+   memset(values, 0, sizeof(values));
 
-   dat_converter_list_t* list = (*current_item)->map.value.list;
+   for (record = entry->first; record; record = record->next)
+   {
+      size_t j;
+      const dat_converter_field_t* fields =
+         record->file->fields + record->first_field;
 
-   if (!list)
-      return 1;
+      for (j = 0; j < record->field_count; j++)
+         values[fields[j].mapping] = &fields[j];
+   }
 
-   assert(list->type == DAT_CONVERTER_MAP_LIST);
+   out->type          = RDT_MAP;
+   out->val.map.len   = 0;
+   out->val.map.items = calloc(RDB_MAPPINGS_COUNT,
+         sizeof(struct rmsgpack_dom_pair));
 
-   struct rmsgpack_dom_pair* current = out->val.map.items;
+   current = out->val.map.items;
 
-   for (i = 0; i < (sizeof(rdb_mappings) / sizeof(*rdb_mappings)); i++)
+   for (i = 0; i < RDB_MAPPINGS_COUNT; i++)
    {
-      const char* value = dat_converter_get_match(list, rdb_mappings_mk[i]);
-      if (!value)
+      const char* value;
+      uint32_t len;
+
+      if (!values[i])
          continue;
 
+      value = values[i]->value;
+      len   = values[i]->len;
+
       current->key.type = RDT_STRING;
       current->key.val.string.len = strlen(rdb_mappings[i].rdb_key);
       current->key.val.string.buff = strdup(rdb_mappings[i].rdb_key);
@@ -669,32 +834,37 @@ static int dat_converter_value_provider(
       {
       case DAT_CONVERTER_RDB_TYPE_STRING:
          current->value.type = RDT_STRING;
-         current->value.val.string.len = strlen(value);
-         current->value.val.string.buff = strdup(value);
+         current->value.val.string.len = len;
+         current->value.val.string.buff = dat_converter_strndup(value, len);
          break;
       case DAT_CONVERTER_RDB_TYPE_UINT:
          current->value.type = RDT_UINT;
-         if (value[strlen(value) - 1] == '\?')
+         if (len && value[len - 1] == '\?')
          {
             free(current->key.val.string.buff);
             continue;
          }
-         current->value.val.uint_ = (uint64_t)atoll(value);
+         {
+            char* str = dat_converter_strndup(value, len);
+            current->value.val.uint_ = (uint64_t)atoll(str);
+            free(str);
+         }
          break;
       case DAT_CONVERTER_RDB_TYPE_BINARY:
          current->value.type = RDT_BINARY;
-         current->value.val.binary.len = strlen(value);
-         current->value.val.binary.buff = strdup(value);
+         current->value.val.binary.len = len;
+         current->value.val.binary.buff = dat_converter_strndup(value, len);
          break;
       case DAT_CONVERTER_RDB_TYPE_HEX:
          current->value.type = RDT_BINARY;
-         current->value.val.binary.len  = strlen(value) / 2;
+         current->value.val.binary.len  = len / 2;
          current->value.val.binary.buff = 
             malloc(current->value.val.binary.len);
          {
             const char* hex_char = value;
+            const char* hex_end  = value + len;
             char* out_buff       = current->value.val.binary.buff;
-            while (*hex_char && *(hex_char + 1))
+            while (hex_char + 1 < hex_end)
             {
                char val = 0;
                if (*hex_char >= 'A' && *hex_char <= 'F')
@@ -730,9 +900,24 @@ static int dat_converter_value_provider(
    return 0;
 }
 
+static double dat_converter_time(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 int main(int argc, char** argv)
 {
+   int i;
    const char* rdb_path;
+   double start, elapsed;
+   size_t entry_count;
+   dat_converter_provider_t provider;
+   dat_converter_entry_t* entries;
+   dat_converter_file_t* dat_files;
+   int dat_count;
+   uint64_t dat_bytes                   = 0;
    dat_converter_match_key_t* match_key = NULL;
    RFILE* rdb_file;
 
@@ -755,44 +940,23 @@ int main(int argc, char** argv)
       argv++;
    }
 
-   int dat_count                         = argc;
-   char** dat_buffers                    = (char**)
-      malloc(dat_count * sizeof(*dat_buffers));
-   char** dat_buffer                     = dat_buffers;
-   dat_converter_list_t* dat_parser_list = NULL;
+   dat_count = argc;
+   dat_files = (dat_converter_file_t*)calloc(dat_count ? dat_count : 1,
+         sizeof(*dat_files));
 
-   while (argc)
+   for (i = 0; i < dat_count; i++)
    {
-      size_t dat_file_size;
-      dat_converter_list_t* dat_lexer_list = NULL;
-      FILE* dat_file                       = fopen(*argv, "r");
-
-      if (!dat_file)
-      {
-         printf("could not open dat file '%s': %s\n",
-               *argv, strerror(errno));
-         dat_converter_exit(1);
-      }
-
-      fseek(dat_file, 0, SEEK_END);
-      dat_file_size = ftell(dat_file);
-      fseek(dat_file, 0, SEEK_SET);
-      *dat_buffer = (char*)malloc(dat_file_size + 1);
-      fread(*dat_buffer, 1, dat_file_size, dat_file);
-      fclose(dat_file);
-      (*dat_buffer)[dat_file_size] = '\0';
+      dat_files[i].path = argv[i];
+      printf("Parsing dat file '%s'...\n", argv[i]);
+   }
 
-      printf("Parsing dat file '%s'...\n", *argv);
-      dat_lexer_list  = dat_converter_lexer(*dat_buffer, *argv);
-      dat_parser_list = dat_converter_parser(
-            dat_parser_list, dat_lexer_list, match_key);
+   start = dat_converter_time();
 
-      dat_converter_list_free(dat_lexer_list);
+   dat_converter_value_provider_init();
+   dat_converter_parse_files(dat_files, dat_count, match_key);
 
-      argc--;
-      argv++;
-      dat_buffer++;
-   }
+   entries = dat_converter_merge(dat_files, dat_count,
+         match_key != NULL, &entry_count);
 
    rdb_file = filestream_open(rdb_path, RFILE_MODE_WRITE, -1);
 
@@ -806,25 +970,34 @@ int main(int argc, char** argv)
       dat_converter_exit(1);
    }
 
-   dat_converter_list_item_t* current_item = 
-      &dat_parser_list->values[dat_parser_list->count];
+   provider.entries = entries;
+   provider.count   = entry_count;
 
-   dat_converter_value_provider_init();
    libretrodb_create(rdb_file, 
          (libretrodb_value_provider)&dat_converter_value_provider,
-         &current_item);
+         &provider);
    dat_converter_value_provider_free();
 
    filestream_close(rdb_file);
 
-   dat_converter_list_free(dat_parser_list);
+   elapsed = dat_converter_time() - start;
 
-   while (dat_count--)
-      free(dat_buffers[dat_count]);
-   free(dat_buffers);
+   for (i = 0; i < dat_count; i++)
+   {
+      dat_bytes += dat_files[i].size;
+      dat_converter_file_free(&dat_files[i]);
+   }
+
+   printf("Converted %u entries from %.1f MB in %.2f s "
+         "(%.1f MB/s, %.0f records/s)\n",
+         (unsigned)entry_count, dat_bytes / 1000000.0, elapsed,
+         elapsed > 0.0 ? dat_bytes / 1000000.0 / elapsed : 0.0,
+         elapsed > 0.0 ? entry_count / elapsed : 0.0);
+
+   free(entries);
+   free(dat_files);
 
    dat_converter_match_key_free(match_key);
 
    return 0;
 }
-
@@ -35,20 +35,62 @@
 #include <streams/file_stream.h>
 #include <retro_endianness.h>
 #include <compat/strl.h>
+#include <retro_miscellaneous.h>
 
 #include "libretrodb.h"
 #include "rmsgpack_dom.h"
 #include "rmsgpack.h"
-#include "bintree.h"
 #include "query.h"
 #include "libretrodb.h"
 
 #define MAGIC_NUMBER "RARCHDB"
 
-struct node_iter_ctx
+/* Records are read this much at a time when filtering. */
+#define LIBRETRODB_CURSOR_BUFFER_SIZE (64 * 1024)
+
+/* And this much at a time from where an index points to. */
+#define LIBRETRODB_CURSOR_INDEX_READ_SIZE (4 * 1024)
+
+#define LIBRETRODB_INDEX_MAX_FIELDS 8
+#define LIBRETRODB_INDEX_FIELDS_LEN 256
+
+/* Each field of an index key starts with one of these, the tags
+ * and what follows them are laid out so that memcmp() sorts keys
+ * like the values they were made from. */
+enum libretrodb_key_tag
 {
-	libretrodb_t *db;
-	libretrodb_index_t *idx;
+   LIBRETRODB_KEY_NIL = 0,
+   LIBRETRODB_KEY_BOOL,
+   LIBRETRODB_KEY_INT,
+   /* Above INT64_MAX. */
+   LIBRETRODB_KEY_UINT,
+   LIBRETRODB_KEY_STRING,
+   LIBRETRODB_KEY_BINARY,
+   /* Maps and arrays, all the same to an index. */
+   LIBRETRODB_KEY_OTHER
+};
+
+struct libretrodb_key
+{
+   uint8_t *data;
+   size_t len;
+   size_t size;
+};
+
+struct libretrodb_plan
+{
+   char index[50];
+   /* Keys starting with anything from lo to hi are wanted. */
+   struct libretrodb_key lo;
+   struct libretrodb_key hi;
+};
+
+struct libretrodb_index_entry
+{
+   const uint8_t *key;
+   size_t key_pos;
+   size_t key_len;
+   uint64_t offset;
 };
 
 struct libretrodb
@@ -58,13 +100,26 @@ struct libretrodb
 	uint64_t count;
 	uint64_t first_index_offset;
    char path[1024];
+   libretrodb_index_t *indexes;
+   unsigned index_count;
 };
 
+/* An index is a header followed by its body: count big endian
+ * 32-bit offsets into the keys that come after them, sorted, each
+ * key followed by the big endian 64-bit offset of its record. */
 struct libretrodb_index
 {
 	char name[50];
+   /* Comma separated, the values of these make up a key. */
+   char fields[LIBRETRODB_INDEX_FIELDS_LEN];
+   /* Size of every key of a single binary field index, else 0. */
 	uint64_t key_size;
+   uint64_t count;
+   /* Size of the body. */
 	uint64_t next;
+   uint64_t offset;
+   /* Read on first use. */
+   uint8_t *body;
 };
 
 typedef struct libretrodb_metadata
@@ -85,6 +140,20 @@ struct libretrodb_cursor
 	int eof;
 	libretrodb_query_t *query;
 	libretrodb_t *db;
+   /* Raw records waiting to be filtered. */
+   uint8_t *buff;
+   size_t buff_size;
+   size_t buff_pos;
+   size_t buff_len;
+   /* Where in the file buff starts. */
+   uint64_t buff_offset;
+   size_t read_size;
+   int buff_eof;
+   /* Records an index lookup found, in file order. */
+   uint64_t *offsets;
+   size_t offset_count;
+   size_t offset_pos;
+   int use_index;
 };
 
 static struct rmsgpack_dom_value sentinal;
@@ -142,7 +211,7 @@ int libretrodb_create(RFILE *fd, libretrodb_value_provider value_provider,
    struct rmsgpack_dom_value item;
    uint64_t item_count        = 0;
    libretrodb_header_t header = {{0}};
-   ssize_t root = filestream_seek(fd, 0, SEEK_CUR);
+   ssize_t root = filestream_tell(fd);
 
    memcpy(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)-1);
 
@@ -171,7 +240,7 @@ int libretrodb_create(RFILE *fd, libretrodb_value_provider value_provider,
    if ((rv = rmsgpack_dom_write(fd, &sentinal)) < 0)
       goto clean;
 
-   header.metadata_offset = swap_if_little64(filestream_seek(fd, 0, SEEK_CUR));
+   header.metadata_offset = swap_if_little64(filestream_tell(fd));
    md.count = item_count;
    libretrodb_write_metadata(fd, &md);
    filestream_seek(fd, root, SEEK_SET);
@@ -181,31 +250,421 @@ clean:
    return rv;
 }
 
+static void libretrodb_put_u32(uint8_t *dst, uint32_t val)
+{
+   dst[0] = (uint8_t)(val >> 24);
+   dst[1] = (uint8_t)(val >> 16);
+   dst[2] = (uint8_t)(val >>  8);
+   dst[3] = (uint8_t)(val >>  0);
+}
+
+static uint32_t libretrodb_get_u32(const uint8_t *src)
+{
+   return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16)
+      | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+static void libretrodb_put_u64(uint8_t *dst, uint64_t val)
+{
+   libretrodb_put_u32(dst,     (uint32_t)(val >> 32));
+   libretrodb_put_u32(dst + 4, (uint32_t)val);
+}
+
+static uint64_t libretrodb_get_u64(const uint8_t *src)
+{
+   return ((uint64_t)libretrodb_get_u32(src) << 32)
+      | libretrodb_get_u32(src + 4);
+}
+
+static int libretrodb_key_reserve(struct libretrodb_key *key, size_t len)
+{
+   uint8_t *data;
+   size_t size = key->size ? key->size : 64;
+
+   if (key->len + len <= key->size)
+      return 0;
+
+   while (size < key->len + len)
+      size *= 2;
+
+   data = (uint8_t*)realloc(key->data, size);
+   if (!data)
+      return -ENOMEM;
+
+   key->data = data;
+   key->size = size;
+   return 0;
+}
+
+/* Appends @value to @key. Strings and binaries have their zeroes
+ * escaped and, if @whole, a terminator that sorts below any byte
+ * so they stay ordered when more fields follow. Without it the key
+ * is a prefix of every longer string. */
+static int libretrodb_key_append(struct libretrodb_key *key,
+      const struct rmsgpack_dom_value *value, int whole)
+{
+   uint32_t i, len;
+   uint64_t num;
+   const uint8_t *buff;
+   uint8_t *dst;
+
+   switch (value->type)
+   {
+      case RDT_NULL:
+         if (libretrodb_key_reserve(key, 1) < 0)
+            return -ENOMEM;
+         key->data[key->len++] = LIBRETRODB_KEY_NIL;
+         break;
+      case RDT_BOOL:
+         if (libretrodb_key_reserve(key, 2) < 0)
+            return -ENOMEM;
+         key->data[key->len++] = LIBRETRODB_KEY_BOOL;
+         key->data[key->len++] = value->val.bool_ ? 1 : 0;
+         break;
+      case RDT_INT:
+      case RDT_UINT:
+         if (libretrodb_key_reserve(key, 9) < 0)
+            return -ENOMEM;
+
+         /* Signed and unsigned values that are equal get the same
+          * key, with the sign bit flipped negative ones come first. */
+         if (value->type == RDT_UINT && (value->val.uint_ >> 63))
+         {
+            key->data[key->len++] = LIBRETRODB_KEY_UINT;
+            num = value->val.uint_;
+         }
+         else
+         {
+            key->data[key->len++] = LIBRETRODB_KEY_INT;
+            num = (value->type == RDT_INT
+                  ? (uint64_t)value->val.int_ : value->val.uint_)
+               ^ ((uint64_t)1 << 63);
+         }
+
+         libretrodb_put_u64(key->data + key->len, num);
+         key->len += 8;
+         break;
+      case RDT_STRING:
+      case RDT_BINARY:
+         len  = value->val.string.len;
+         buff = (const uint8_t*)value->val.string.buff;
+
+         if (value->type == RDT_BINARY)
+         {
+            len  = value->val.binary.len;
+            buff = (const uint8_t*)value->val.binary.buff;
+         }
+
+         if (libretrodb_key_reserve(key, 1 + (size_t)len * 2 + 2) < 0)
+            return -ENOMEM;
+
+         dst    = key->data + key->len;
+         *dst++ = value->type == RDT_STRING
+            ? LIBRETRODB_KEY_STRING : LIBRETRODB_KEY_BINARY;
+
+         for (i = 0; i < len; i++)
+         {
+            *dst++ = buff[i];
+            if (!buff[i])
+               *dst++ = 0xff;
+         }
+
+         if (whole)
+         {
+            *dst++ = 0;
+            *dst++ = 0;
+         }
+
+         key->len = dst - key->data;
+         break;
+      default:
+         if (libretrodb_key_reserve(key, 1) < 0)
+            return -ENOMEM;
+         key->data[key->len++] = LIBRETRODB_KEY_OTHER;
+         break;
+   }
+
+   return 0;
+}
+
+/* Compares @key to @bound as if @key was cut to the length of
+ * @bound, keys that start with @bound are equal to it. */
+static int libretrodb_key_cmp_prefix(const uint8_t *key, size_t key_len,
+      const uint8_t *bound, size_t bound_len)
+{
+   int rv = memcmp(key, bound, key_len < bound_len ? key_len : bound_len);
+
+   if (rv == 0 && key_len < bound_len)
+      return -1;
+   return rv;
+}
+
+/* Copies the next field name of the comma separated list @fields
+ * into @field. Returns 0 once there are none left. */
+static int libretrodb_next_field(const char **fields,
+      char *field, size_t len)
+{
+   const char *end;
+   size_t field_len;
+
+   while (**fields == ',' || **fields == ' ')
+      (*fields)++;
+
+   if (!**fields)
+      return 0;
+
+   end = strchr(*fields, ',');
+   if (!end)
+      end = *fields + strlen(*fields);
+
+   field_len = end - *fields;
+   while (field_len && (*fields)[field_len - 1] == ' ')
+      field_len--;
+
+   if (field_len >= len)
+      field_len = len - 1;
+
+   memcpy(field, *fields, field_len);
+   field[field_len] = '\0';
+   *fields          = end;
+   return 1;
+}
+
+static const struct rmsgpack_dom_value *libretrodb_map_get(
+      const struct rmsgpack_dom_value *map, const char *name)
+{
+   struct rmsgpack_dom_value key;
+
+   key.type            = RDT_STRING;
+   key.val.string.len  = strlen(name);
+   key.val.string.buff = (char*)name;
+
+   return rmsgpack_dom_value_map_value(map, &key);
+}
+
+static uint64_t libretrodb_map_get_uint(
+      const struct rmsgpack_dom_value *map, const char *name)
+{
+   const struct rmsgpack_dom_value *value = libretrodb_map_get(map, name);
+
+   if (value && (value->type == RDT_UINT || value->type == RDT_INT))
+      return value->val.uint_;
+   return 0;
+}
+
+static void libretrodb_map_get_string(
+      const struct rmsgpack_dom_value *map, const char *name,
+      char *s, size_t len)
+{
+   const struct rmsgpack_dom_value *value = libretrodb_map_get(map, name);
+   size_t copy_len                        = 0;
+
+   if (value && value->type == RDT_STRING)
+   {
+      copy_len = value->val.string.len;
+      if (copy_len >= len)
+         copy_len = len - 1;
+      memcpy(s, value->val.string.buff, copy_len);
+   }
+
+   s[copy_len] = '\0';
+}
+
+/* Indexes written before composite keys have no fields and are
+ * left alone. */
 static int libretrodb_read_index_header(RFILE *fd, libretrodb_index_t *idx)
 {
-   uint64_t name_len = 50;
-   return rmsgpack_dom_read_into(fd,
-         "name", idx->name, &name_len,
-         "key_size", &idx->key_size,
-         "next", &idx->next, NULL);
+   struct rmsgpack_dom_value map;
+   int rv = rmsgpack_dom_read(fd, &map);
+
+   if (rv < 0)
+      return rv;
+
+   memset(idx, 0, sizeof(*idx));
+
+   if (map.type != RDT_MAP)
+   {
+      rmsgpack_dom_value_free(&map);
+      return -EINVAL;
+   }
+
+   libretrodb_map_get_string(&map, "name", idx->name, sizeof(idx->name));
+   libretrodb_map_get_string(&map, "fields",
+         idx->fields, sizeof(idx->fields));
+   idx->key_size = libretrodb_map_get_uint(&map, "key_size");
+   idx->count    = libretrodb_map_get_uint(&map, "count");
+   idx->next     = libretrodb_map_get_uint(&map, "next");
+
+   rmsgpack_dom_value_free(&map);
+   return 0;
 }
 
-static void libretrodb_write_index_header(RFILE *fd, libretrodb_index_t *idx)
+static int libretrodb_write_index_header(RFILE *fd, libretrodb_index_t *idx)
 {
-   rmsgpack_write_map_header(fd, 3);
+   rmsgpack_write_map_header(fd, 5);
    rmsgpack_write_string(fd, "name", strlen("name"));
    rmsgpack_write_string(fd, idx->name, strlen(idx->name));
+   rmsgpack_write_string(fd, "fields", strlen("fields"));
+   rmsgpack_write_string(fd, idx->fields, strlen(idx->fields));
    rmsgpack_write_string(fd, "key_size", strlen("key_size"));
    rmsgpack_write_uint(fd, idx->key_size);
+   rmsgpack_write_string(fd, "count", strlen("count"));
+   rmsgpack_write_uint(fd, idx->count);
    rmsgpack_write_string(fd, "next", strlen("next"));
-   rmsgpack_write_uint(fd, idx->next);
+   return rmsgpack_write_uint(fd, idx->next);
+}
+
+static int libretrodb_add_index(libretrodb_t *db, const libretrodb_index_t *idx)
+{
+   libretrodb_index_t *indexes = (libretrodb_index_t*)realloc(db->indexes,
+         (db->index_count + 1) * sizeof(*indexes));
+
+   if (!indexes)
+      return -ENOMEM;
+
+   indexes[db->index_count++] = *idx;
+   db->indexes                = indexes;
+   return 0;
+}
+
+/* Indexes only make lookups faster, one that can't be read is
+ * skipped along with the ones after it. */
+static void libretrodb_read_indexes(libretrodb_t *db)
+{
+   libretrodb_index_t idx;
+   ssize_t eof;
+   uint64_t offset = db->first_index_offset;
+
+   filestream_seek(db->fd, 0, SEEK_END);
+   eof = filestream_tell(db->fd);
+   filestream_seek(db->fd, (ssize_t)offset, SEEK_SET);
+
+   while ((ssize_t)offset < eof)
+   {
+      if (libretrodb_read_index_header(db->fd, &idx) < 0)
+         break;
+
+      idx.offset = filestream_tell(db->fd);
+      if (idx.next > (uint64_t)eof - idx.offset)
+         break;
+
+      if (libretrodb_add_index(db, &idx) < 0)
+         break;
+
+      offset = idx.offset + idx.next;
+      filestream_seek(db->fd, (ssize_t)offset, SEEK_SET);
+   }
+}
+
+static libretrodb_index_t *libretrodb_get_index(libretrodb_t *db,
+      const char *index_name)
+{
+   unsigned i;
+
+   for (i = 0; i < db->index_count; i++)
+   {
+      if (!strcmp(db->indexes[i].name, index_name))
+         return &db->indexes[i];
+   }
+
+   return NULL;
+}
+
+static const uint8_t *libretrodb_index_key(const libretrodb_index_t *idx,
+      uint64_t i, size_t *len)
+{
+   const uint8_t *keys = idx->body + idx->count * 4;
+   uint64_t keys_len   = idx->next - idx->count * 4;
+   uint32_t start      = libretrodb_get_u32(idx->body + i * 4);
+   uint64_t end        = (i + 1 < idx->count)
+      ? libretrodb_get_u32(idx->body + (i + 1) * 4) : keys_len;
+
+   *len = (size_t)(end - start - sizeof(uint64_t));
+   return keys + start;
+}
+
+static int libretrodb_index_load(libretrodb_t *db, libretrodb_index_t *idx)
+{
+   uint64_t i, keys_len;
+   uint64_t prev = 0;
+   uint8_t *body = NULL;
+
+   if (idx->body)
+      return 0;
+
+   if (!*idx->fields || idx->count > idx->next / 4
+         || idx->next != (size_t)idx->next)
+      return -EINVAL;
+
+   body = (uint8_t*)malloc(idx->next ? (size_t)idx->next : 1);
+   if (!body)
+      return -ENOMEM;
+
+   filestream_seek(db->fd, (ssize_t)idx->offset, SEEK_SET);
+   if (filestream_read(db->fd, body, (ssize_t)idx->next)
+         != (ssize_t)idx->next)
+      goto error;
+
+   /* Every key has to hold at least its record offset. */
+   keys_len = idx->next - idx->count * 4;
+   for (i = 0; i < idx->count; i++)
+   {
+      uint32_t start = libretrodb_get_u32(body + i * 4);
+      uint64_t end   = (i + 1 < idx->count)
+         ? libretrodb_get_u32(body + (i + 1) * 4) : keys_len;
+
+      if (start < prev || end > keys_len || end < start + sizeof(uint64_t))
+         goto error;
+      prev = start;
+   }
+
+   idx->body = body;
+   return 0;
+
+error:
+   free(body);
+   return -EINVAL;
+}
+
+/* First entry of @idx that isn't below @bound, or with @upper, the
+ * first one above it. */
+static uint64_t libretrodb_index_search(const libretrodb_index_t *idx,
+      const struct libretrodb_key *bound, int upper)
+{
+   uint64_t lo = 0;
+   uint64_t hi = idx->count;
+
+   while (lo < hi)
+   {
+      size_t len;
+      uint64_t mid       = lo + (hi - lo) / 2;
+      const uint8_t *key = libretrodb_index_key(idx, mid, &len);
+      int rv             = libretrodb_key_cmp_prefix(key, len,
+            bound->data, bound->len);
+
+      if (rv < 0 || (upper && rv == 0))
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   return lo;
 }
 
 void libretrodb_close(libretrodb_t *db)
 {
+   unsigned i;
+
    if (db->fd)
       filestream_close(db->fd);
    db->fd = NULL;
+
+   for (i = 0; i < db->index_count; i++)
+      free(db->indexes[i].body);
+   free(db->indexes);
+
+   db->indexes     = NULL;
+   db->index_count = 0;
 }
 
 int libretrodb_open(const char *path, libretrodb_t *db)
@@ -219,7 +678,7 @@ int libretrodb_open(const char *path, libretrodb_t *db)
       return -errno;
 
    strlcpy(db->path, path, sizeof(db->path));
-   db->root = filestream_seek(fd, 0, SEEK_CUR);
+   db->root = filestream_tell(fd);
 
    if ((rv = filestream_read(fd, &header, sizeof(header))) == -1)
    {
@@ -227,7 +686,8 @@ int libretrodb_open(const char *path, libretrodb_t *db)
       goto error;
    }
 
-   if (strncmp(header.magic_number, MAGIC_NUMBER, sizeof(MAGIC_NUMBER)) != 0)
+   if (memcmp(header.magic_number, MAGIC_NUMBER,
+            sizeof(header.magic_number)) != 0)
    {
       rv = -EINVAL;
       goto error;
@@ -243,8 +703,9 @@ int libretrodb_open(const char *path, libretrodb_t *db)
    }
 
    db->count = md.count;
-   db->first_index_offset = filestream_seek(fd, 0, SEEK_CUR);
+   db->first_index_offset = filestream_tell(fd);
    db->fd = fd;
+   libretrodb_read_indexes(db);
    return 0;
 
 error:
@@ -253,109 +714,219 @@ error:
    return rv;
 }
 
-static int libretrodb_find_index(libretrodb_t *db, const char *index_name,
-      libretrodb_index_t *idx)
+int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
+      const void *key, struct rmsgpack_dom_value *out)
 {
-   ssize_t eof    = filestream_seek(db->fd, 0, SEEK_END);
-   ssize_t offset = filestream_seek(db->fd,
-         (ssize_t)db->first_index_offset, SEEK_SET);
+   uint64_t i;
+   size_t len;
+   struct rmsgpack_dom_value value;
+   struct libretrodb_key bound = {0};
+   const uint8_t *entry        = NULL;
+   libretrodb_index_t *idx     = libretrodb_get_index(db, index_name);
+   int rv                      = -1;
+
+   if (!idx || !idx->key_size || libretrodb_index_load(db, idx) < 0)
+      return -1;
 
-   while (offset < eof)
-   {
-      libretrodb_read_index_header(db->fd, idx);
+   value.type            = RDT_BINARY;
+   value.val.binary.len  = (uint32_t)idx->key_size;
+   value.val.binary.buff = (char*)key;
 
-      if (strncmp(index_name, idx->name, strlen(idx->name)) == 0)
-         return 0;
+   if (libretrodb_key_append(&bound, &value, 1) < 0)
+      return -ENOMEM;
 
-      offset = filestream_seek(db->fd, (ssize_t)idx->next, SEEK_CUR);
+   i = libretrodb_index_search(idx, &bound, 0);
+
+   if (i < idx->count)
+      entry = libretrodb_index_key(idx, i, &len);
+
+   if (entry && len == bound.len && !memcmp(entry, bound.data, len))
+   {
+      filestream_seek(db->fd, (ssize_t)libretrodb_get_u64(entry + len),
+            SEEK_SET);
+      rv = rmsgpack_dom_read(db->fd, out);
    }
 
-   return -1;
+   free(bound.data);
+   return rv;
 }
 
-static int node_compare(const void *a, const void *b, void *ctx)
+/**
+ * libretrodb_cursor_reset:
+ * @cursor              : Handle to database cursor.
+ *
+ * Resets cursor.
+ *
+ * Returns: ???.
+ **/
+int libretrodb_cursor_reset(libretrodb_cursor_t *cursor)
 {
-   return memcmp(a, b, *(uint8_t *)ctx);
+   cursor->eof         = 0;
+   cursor->buff_pos    = 0;
+   cursor->buff_len    = 0;
+   cursor->buff_offset = cursor->db->root + sizeof(libretrodb_header_t);
+   cursor->buff_eof    = 0;
+   cursor->offset_pos  = 0;
+   return filestream_seek(cursor->fd,
+         (ssize_t)(cursor->db->root + sizeof(libretrodb_header_t)),
+         SEEK_SET);
 }
 
-static int binsearch(const void *buff, const void *item,
-      uint64_t count, uint8_t field_size, uint64_t *offset)
+/* Reads more of the file after what's left in the buffer,
+ * growing it if a record doesn't fit. */
+static int libretrodb_cursor_fill(libretrodb_cursor_t *cursor)
 {
-   int mid            = count / 2;
-   int item_size      = field_size + sizeof(uint64_t);
-   uint64_t *current  = (uint64_t *)buff + (mid * item_size);
-   int rv             = node_compare(current, item, &field_size);
+   ssize_t rv;
+   size_t left = cursor->buff_len - cursor->buff_pos;
 
-   if (rv == 0)
+   if (cursor->buff_eof)
+      return -EINVAL;
+
+   if (left && cursor->buff_pos)
+      memmove(cursor->buff, cursor->buff + cursor->buff_pos, left);
+
+   cursor->buff_offset += cursor->buff_pos;
+   cursor->buff_pos     = 0;
+   cursor->buff_len     = left;
+
+   if (left == cursor->buff_size)
    {
-      *offset = *(uint64_t *)(current + field_size);
-      return 0;
+      size_t size   = cursor->buff_size
+         ? cursor->buff_size * 2 : LIBRETRODB_CURSOR_BUFFER_SIZE;
+      uint8_t *buff = (uint8_t*)realloc(cursor->buff, size);
+
+      if (!buff)
+         return -ENOMEM;
+
+      cursor->buff      = buff;
+      cursor->buff_size = size;
    }
 
-   if (count == 0)
-      return -1;
+   rv = filestream_read(cursor->fd, cursor->buff + left,
+         MIN(cursor->buff_size - left, cursor->read_size));
 
-   if (rv > 0)
-      return binsearch(buff, item, mid, field_size, offset);
+   if (rv < 0)
+      return -errno;
+   if (rv == 0)
+      cursor->buff_eof = 1;
 
-   return binsearch(current + item_size, item,
-         count - mid, field_size, offset);
+   cursor->buff_len += rv;
+   return 0;
 }
 
-int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
-      const void *key, struct rmsgpack_dom_value *out)
+/* Points @record at the next record, still encoded, and @offset
+ * at where it is in the file. The record stays valid until the
+ * next call. */
+static int libretrodb_cursor_next_raw(libretrodb_cursor_t *cursor,
+      const uint8_t **record, int *len, uint64_t *offset)
 {
-   libretrodb_index_t idx;
-   int rv;
-   void *buff;
-   uint64_t offset;
-   ssize_t bufflen, nread = 0;
+   for (;;)
+   {
+      int rv;
+      const uint8_t *data = cursor->buff + cursor->buff_pos;
+      size_t left         = cursor->buff_len - cursor->buff_pos;
 
-   if (libretrodb_find_index(db, index_name, &idx) < 0)
-      return -1;
+      if ((rv = rmsgpack_dom_skip(data, left)) < 0)
+         return rv;
 
-   bufflen = idx.next;
-   buff = malloc(bufflen);
+      if (rv == 0)
+      {
+         if ((rv = libretrodb_cursor_fill(cursor)) < 0)
+            return rv;
+         continue;
+      }
 
-   if (!buff)
-      return -ENOMEM;
+      if (offset)
+         *offset = cursor->buff_offset + cursor->buff_pos;
+      cursor->buff_pos += rv;
 
-   while (nread < bufflen)
-   {
-      void *buff_ = (uint64_t *)buff + nread;
-      rv = filestream_read(db->fd, buff_, bufflen - nread);
-
-      if (rv <= 0)
+      if (*data == _MPF_NIL)
       {
-         free(buff);
-         return -errno;
+         cursor->eof = 1;
+         return EOF;
       }
-      nread += rv;
+
+      *record = data;
+      *len    = rv;
+      return 0;
    }
+}
 
-   rv = binsearch(buff, key, db->count, (ssize_t)idx.key_size, &offset);
-   free(buff);
+/* Runs the query on the records as they are in the file, only
+ * the ones that match get decoded. */
+static int libretrodb_cursor_read_filtered(libretrodb_cursor_t *cursor,
+      struct rmsgpack_dom_value *out)
+{
+   for (;;)
+   {
+      int rv, len, match;
+      const uint8_t *record = NULL;
 
-   if (rv == 0)
-      filestream_seek(db->fd, (ssize_t)offset, SEEK_SET);
+      if ((rv = libretrodb_cursor_next_raw(cursor, &record, &len, NULL)) != 0)
+         return rv;
 
-   return rmsgpack_dom_read(db->fd, out);
+      if ((match = libretrodb_query_filter_raw(cursor->query,
+                  record, len)) == 0)
+         continue;
+
+      if ((rv = rmsgpack_dom_read_buf(record, len, out)) < 0)
+         return rv;
+
+      if (match < 0 && !libretrodb_query_filter(cursor->query, out))
+      {
+         rmsgpack_dom_value_free(out);
+         continue;
+      }
+
+      return 0;
+   }
 }
 
-/**
- * libretrodb_cursor_reset:
- * @cursor              : Handle to database cursor.
- *
- * Resets cursor.
- *
- * Returns: ???.
- **/
-int libretrodb_cursor_reset(libretrodb_cursor_t *cursor)
+/* Reads the records the index found, the index only narrows them
+ * down so each one still goes through the query. They are in file
+ * order, so most are already in the buffer. */
+static int libretrodb_cursor_read_indexed(libretrodb_cursor_t *cursor,
+      struct rmsgpack_dom_value *out)
 {
-   cursor->eof = 0;
-   return filestream_seek(cursor->fd,
-         (ssize_t)(cursor->db->root + sizeof(libretrodb_header_t)),
-         SEEK_SET);
+   while (cursor->offset_pos < cursor->offset_count)
+   {
+      int rv, len, match;
+      const uint8_t *record = NULL;
+      uint64_t offset       = cursor->offsets[cursor->offset_pos++];
+
+      if (offset >= cursor->buff_offset
+            && offset - cursor->buff_offset <= cursor->buff_len)
+         cursor->buff_pos    = (size_t)(offset - cursor->buff_offset);
+      else
+      {
+         filestream_seek(cursor->fd, (ssize_t)offset, SEEK_SET);
+         cursor->buff_offset = offset;
+         cursor->buff_pos    = 0;
+         cursor->buff_len    = 0;
+         cursor->buff_eof    = 0;
+      }
+
+      if ((rv = libretrodb_cursor_next_raw(cursor, &record, &len, NULL)) != 0)
+         return rv;
+
+      if ((match = libretrodb_query_filter_raw(cursor->query,
+                  record, len)) == 0)
+         continue;
+
+      if ((rv = rmsgpack_dom_read_buf(record, len, out)) < 0)
+         return rv;
+
+      if (match < 0 && !libretrodb_query_filter(cursor->query, out))
+      {
+         rmsgpack_dom_value_free(out);
+         continue;
+      }
+
+      return 0;
+   }
+
+   cursor->eof = 1;
+   return EOF;
 }
 
 int libretrodb_cursor_read_item(libretrodb_cursor_t *cursor,
@@ -366,7 +937,12 @@ int libretrodb_cursor_read_item(libretrodb_cursor_t *cursor,
    if (cursor->eof)
       return EOF;
 
-retry:
+   if (cursor->use_index)
+      return libretrodb_cursor_read_indexed(cursor, out);
+
+   if (cursor->query)
+      return libretrodb_cursor_read_filtered(cursor, out);
+
    rv = rmsgpack_dom_read(cursor->fd, out);
    if (rv < 0)
       return rv;
@@ -377,15 +953,6 @@ retry:
       return EOF;
    }
 
-   if (cursor->query)
-   {
-      if (!libretrodb_query_filter(cursor->query, out))
-      {
-         rmsgpack_dom_value_free(out);
-         goto retry;
-      }
-   }
-
    return 0;
 }
 
@@ -406,6 +973,14 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
    if (cursor->query)
       libretrodb_query_free(cursor->query);
 
+   free(cursor->buff);
+   free(cursor->offsets);
+
+   cursor->buff         = NULL;
+   cursor->buff_size    = 0;
+   cursor->offsets      = NULL;
+   cursor->offset_count = 0;
+   cursor->use_index    = 0;
    cursor->is_valid = 0;
    cursor->eof      = 1;
    cursor->fd       = NULL;
@@ -413,6 +988,53 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
    cursor->query    = NULL;
 }
 
+static int libretrodb_offset_cmp(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t*)a;
+   uint64_t y = *(const uint64_t*)b;
+
+   return (x > y) - (x < y);
+}
+
+/* Looks up the records within the bounds of @plan, sorted so they
+ * are read in one pass over the file. */
+static int libretrodb_cursor_plan(libretrodb_cursor_t *cursor,
+      const struct libretrodb_plan *plan)
+{
+   uint64_t first, last, i;
+   libretrodb_index_t *idx = libretrodb_get_index(cursor->db, plan->index);
+
+   if (!idx || libretrodb_index_load(cursor->db, idx) < 0)
+      return -EINVAL;
+
+   first = libretrodb_index_search(idx, &plan->lo, 0);
+   last  = libretrodb_index_search(idx, &plan->hi, 1);
+   if (last < first)
+      last = first;
+
+   cursor->offsets = (uint64_t*)malloc(
+         (size_t)(last - first + 1) * sizeof(uint64_t));
+   if (!cursor->offsets)
+      return -ENOMEM;
+
+   for (i = first; i < last; i++)
+   {
+      size_t len;
+      const uint8_t *key = libretrodb_index_key(idx, i, &len);
+      cursor->offsets[i - first] = libretrodb_get_u64(key + len);
+   }
+
+   cursor->offset_count = (size_t)(last - first);
+   cursor->offset_pos   = 0;
+   cursor->use_index    = 1;
+   cursor->read_size    = LIBRETRODB_CURSOR_INDEX_READ_SIZE;
+
+   qsort(cursor->offsets, cursor->offset_count, sizeof(uint64_t),
+         libretrodb_offset_cmp);
+
+   return 0;
+}
+
 /**
  * libretrodb_cursor_open:
  * @db                  : Handle to database.
@@ -426,6 +1048,8 @@ void libretrodb_cursor_close(libretrodb_cursor_t *cursor)
 int libretrodb_cursor_open(libretrodb_t *db, libretrodb_cursor_t *cursor,
       libretrodb_query_t *q)
 {
+   const struct libretrodb_plan *plan = NULL;
+
    cursor->fd = filestream_open(db->path, RFILE_MODE_READ | RFILE_HINT_MMAP, -1);
 
    if (!cursor->fd)
@@ -433,142 +1057,326 @@ int libretrodb_cursor_open(libretrodb_t *db, libretrodb_cursor_t *cursor,
 
    cursor->db = db;
    cursor->is_valid = 1;
+   cursor->read_size = LIBRETRODB_CURSOR_BUFFER_SIZE;
    libretrodb_cursor_reset(cursor);
    cursor->query = q;
 
    if (q)
       libretrodb_query_inc_ref(q);
 
-   return 0;
-}
-
-static int node_iter(void *value, void *ctx)
-{
-   struct node_iter_ctx *nictx = (struct node_iter_ctx*)ctx;
+   /* Without the index the whole file gets scanned instead. */
+   if (q && (plan = libretrodb_query_get_plan(q)))
+      libretrodb_cursor_plan(cursor, plan);
 
-   if (filestream_write(nictx->db->fd, value,
-            (ssize_t)(nictx->idx->key_size + sizeof(uint64_t))) > 0)
-      return 0;
-
-   return -1;
+   return 0;
 }
 
-static uint64_t libretrodb_tell(libretrodb_t *db)
+static int libretrodb_index_entry_cmp(const void *a, const void *b)
 {
-   return filestream_seek(db->fd, 0, SEEK_CUR);
+   const struct libretrodb_index_entry *x =
+      (const struct libretrodb_index_entry*)a;
+   const struct libretrodb_index_entry *y =
+      (const struct libretrodb_index_entry*)b;
+   int rv = memcmp(x->key, y->key,
+         x->key_len < y->key_len ? x->key_len : y->key_len);
+
+   if (rv)
+      return rv;
+   if (x->key_len != y->key_len)
+      return x->key_len < y->key_len ? -1 : 1;
+   return (x->offset > y->offset) - (x->offset < y->offset);
 }
 
+/**
+ * libretrodb_create_index:
+ * @db                  : Handle to database.
+ * @name                : Name of the new index.
+ * @field_name          : Field, or comma separated fields, to index.
+ *
+ * Collects the key of every record, sorts them and appends the
+ * index to the database file. Records missing a field are indexed
+ * as if it was nil.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
 int libretrodb_create_index(libretrodb_t *db,
       const char *name, const char *field_name)
 {
-   struct node_iter_ctx nictx;
-   struct rmsgpack_dom_value key;
+   int len, rv;
+   unsigned i;
+   uint64_t offset;
+   size_t pos, keys_len;
    libretrodb_index_t idx;
-   uint64_t idx_header_offset;
-   struct rmsgpack_dom_value item;
-   libretrodb_cursor_t cur          = {0};
-   struct rmsgpack_dom_value *field = NULL;
-   void *buff                       = NULL;
-   uint64_t *buff_u64               = NULL;
-   uint8_t field_size               = 0;
-   uint64_t item_loc                = libretrodb_tell(db);
-   bintree_t *tree                  = bintree_new(node_compare, &field_size);
-
-   if (!tree || (libretrodb_cursor_open(db, &cur, NULL) != 0))
-      goto clean;
+   struct rmsgpack_dom_value item, nil_value;
+   struct rmsgpack_dom_value keys[LIBRETRODB_INDEX_MAX_FIELDS];
+   char fields[LIBRETRODB_INDEX_MAX_FIELDS][LIBRETRODB_INDEX_FIELDS_LEN];
+   libretrodb_cursor_t cur                 = {0};
+   struct libretrodb_key arena             = {0};
+   struct libretrodb_index_entry *entries  = NULL;
+   size_t entry_count                      = 0;
+   size_t entries_size                     = 0;
+   unsigned field_count                    = 0;
+   int64_t key_size                        = -1;
+   const char *next                        = field_name;
+   const uint8_t *record                   = NULL;
+   uint8_t *body                           = NULL;
+   RFILE *fd                               = NULL;
+
+   item.type      = RDT_NULL;
+   nil_value.type = RDT_NULL;
+
+   if (libretrodb_get_index(db, name))
+      return -EEXIST;
+
+   if (strlen(field_name) >= sizeof(idx.fields))
+      return -EINVAL;
 
-   key.type = RDT_STRING;
-   key.val.string.len = strlen(field_name);
+   while (field_count < LIBRETRODB_INDEX_MAX_FIELDS
+         && libretrodb_next_field(&next, fields[field_count],
+            sizeof(fields[field_count])))
+   {
+      keys[field_count].type            = RDT_STRING;
+      keys[field_count].val.string.len  = strlen(fields[field_count]);
+      keys[field_count].val.string.buff = fields[field_count];
+      field_count++;
+   }
 
-   /* We know we aren't going to change it */
-   key.val.string.buff = (char *) field_name;
-   item.type           = RDT_NULL;
+   if (!field_count || libretrodb_next_field(&next,
+            fields[0], sizeof(fields[0])))
+      return -EINVAL;
 
-   while (libretrodb_cursor_read_item(&cur, &item) == 0)
-   {
-      if (item.type != RDT_MAP)
-      {
-         printf("Only map keys are supported\n");
-         goto clean;
-      }
+   memset(&idx, 0, sizeof(idx));
+   strlcpy(idx.name, name, sizeof(idx.name));
+   strlcpy(idx.fields, field_name, sizeof(idx.fields));
 
-      field = rmsgpack_dom_value_map_value(&item, &key);
+   if ((rv = libretrodb_cursor_open(db, &cur, NULL)) != 0)
+      goto clean;
 
-      if (!field)
-      {
-         printf("field not found in item\n");
-         goto clean;
-      }
+   while ((rv = libretrodb_cursor_next_raw(&cur, &record, &len, &offset)) == 0)
+   {
+      struct libretrodb_index_entry *entry = NULL;
 
-      if (field->type != RDT_BINARY)
-      {
-         printf("field is not binary\n");
+      if ((rv = rmsgpack_dom_read_buf(record, len, &item)) < 0)
          goto clean;
-      }
 
-      if (field->val.binary.len == 0)
+      if (item.type != RDT_MAP)
       {
-         printf("field is empty\n");
+         rv = -EINVAL;
          goto clean;
       }
 
-      if (field_size == 0)
-         field_size = field->val.binary.len;
-      else if (field->val.binary.len != field_size)
+      if (entry_count == entries_size)
       {
-         printf("field is not of correct size\n");
-         goto clean;
+         size_t size = entries_size ? entries_size * 2 : 1024;
+         struct libretrodb_index_entry *tmp =
+            (struct libretrodb_index_entry*)
+            realloc(entries, size * sizeof(*entries));
+
+         if (!tmp)
+         {
+            rv = -ENOMEM;
+            goto clean;
+         }
+
+         entries      = tmp;
+         entries_size = size;
       }
 
-      buff = malloc(field_size + sizeof(uint64_t));
-      if (!buff)
+      entry          = &entries[entry_count++];
+      entry->key_pos = arena.len;
+      entry->offset  = offset;
+
+      for (i = 0; i < field_count; i++)
       {
-         goto clean;
+         const struct rmsgpack_dom_value *value =
+            rmsgpack_dom_value_map_value(&item, &keys[i]);
+
+         if (!value)
+            value = &nil_value;
+
+         if ((rv = libretrodb_key_append(&arena, value, 1)) < 0)
+            goto clean;
+
+         /* Lookups by a bare key need the size of all of them. */
+         if (field_count == 1)
+         {
+            if (value->type != RDT_BINARY || !value->val.binary.len)
+               key_size = 0;
+            else if (key_size < 0)
+               key_size = value->val.binary.len;
+            else if (key_size != value->val.binary.len)
+               key_size = 0;
+         }
       }
 
-      memcpy(buff, field->val.binary.buff, field_size);
+      entry->key_len = arena.len - entry->key_pos;
+      rmsgpack_dom_value_free(&item);
+      item.type      = RDT_NULL;
+   }
+
+   if (rv != EOF)
+      goto clean;
 
-      buff_u64 = (uint64_t *)buff + field_size;
+   for (pos = 0; pos < entry_count; pos++)
+      entries[pos].key = arena.data + entries[pos].key_pos;
 
-      memcpy(buff_u64, &item_loc, sizeof(uint64_t));
+   qsort(entries, entry_count, sizeof(*entries), libretrodb_index_entry_cmp);
 
-      if (bintree_insert(tree, buff) != 0)
-      {
-         printf("Value is not unique: ");
-         rmsgpack_dom_value_print(field);
-         printf("\n");
-         goto clean;
-      }
-      buff = NULL;
-      rmsgpack_dom_value_free(&item);
-      item_loc = libretrodb_tell(db);
+   keys_len = arena.len + entry_count * sizeof(uint64_t);
+   if (keys_len > 0xffffffff)
+   {
+      rv = -EFBIG;
+      goto clean;
    }
 
-   idx_header_offset = filestream_seek(db->fd, 0, SEEK_END);
+   idx.key_size = key_size > 0 ? key_size : 0;
+   idx.count    = entry_count;
+   idx.next     = entry_count * 4 + keys_len;
 
-   (void)idx_header_offset;
+   body = (uint8_t*)malloc(idx.next ? (size_t)idx.next : 1);
+   if (!body)
+   {
+      rv = -ENOMEM;
+      goto clean;
+   }
 
-   strncpy(idx.name, name, 50);
+   for (pos = 0, offset = 0; pos < entry_count; pos++)
+   {
+      uint8_t *dst = body + entry_count * 4 + offset;
 
-   idx.name[49] = '\0';
-   idx.key_size = field_size;
-   idx.next = db->count * (field_size + sizeof(uint64_t));
-   libretrodb_write_index_header(db->fd, &idx);
+      libretrodb_put_u32(body + pos * 4, (uint32_t)offset);
+      memcpy(dst, entries[pos].key, entries[pos].key_len);
+      libretrodb_put_u64(dst + entries[pos].key_len, entries[pos].offset);
+      offset += entries[pos].key_len + sizeof(uint64_t);
+   }
 
-   nictx.db = db;
-   nictx.idx = &idx;
-   bintree_iterate(tree, node_iter, &nictx);
+   /* The buffered modes would truncate the file. */
+   fd = filestream_open(db->path,
+         RFILE_MODE_READ_WRITE | RFILE_HINT_UNBUFFERED, -1);
+   if (!fd)
+   {
+      rv = -errno;
+      goto clean;
+   }
+
+   filestream_seek(fd, 0, SEEK_END);
+   if ((rv = libretrodb_write_index_header(fd, &idx)) < 0)
+      goto clean;
+
+   idx.offset = filestream_tell(fd);
+   if (filestream_write(fd, body, (ssize_t)idx.next) != (ssize_t)idx.next)
+   {
+      rv = -EIO;
+      goto clean;
+   }
+
+   idx.body = body;
+   if ((rv = libretrodb_add_index(db, &idx)) < 0)
+      goto clean;
+
+   body = NULL;
+   rv   = 0;
 
 clean:
    rmsgpack_dom_value_free(&item);
-   if (buff)
-      free(buff);
+   if (fd)
+      filestream_close(fd);
    if (cur.is_valid)
       libretrodb_cursor_close(&cur);
-   if (tree)
-      bintree_free(tree);
-   free(tree);
-   return 0;
+   free(arena.data);
+   free(entries);
+   free(body);
+   return rv;
+}
+
+/* Builds the range of keys of @idx that @q can match, each field
+ * the query pins down narrows it, up to the first one it merely
+ * bounds. Returns how selective the range is, 0 if it isn't. */
+static int libretrodb_plan_index(const libretrodb_index_t *idx,
+      libretrodb_query_t *q, struct libretrodb_plan *plan)
+{
+   char field[LIBRETRODB_INDEX_FIELDS_LEN];
+   const char *next = idx->fields;
+   int score        = 0;
+
+   while (libretrodb_next_field(&next, field, sizeof(field)))
+   {
+      struct rmsgpack_dom_value lo, hi;
+      int bound = libretrodb_query_bounds(q, field, &lo, &hi);
+
+      if (bound == QUERY_BOUND_NONE)
+         break;
+
+      if (libretrodb_key_append(&plan->lo, &lo,
+               bound != QUERY_BOUND_PREFIX) < 0
+            || libretrodb_key_append(&plan->hi, &hi,
+               bound != QUERY_BOUND_PREFIX) < 0)
+         return 0;
+
+      if (bound != QUERY_BOUND_EQUAL)
+      {
+         score++;
+         break;
+      }
+
+      score += 2;
+   }
+
+   strlcpy(plan->index, idx->name, sizeof(plan->index));
+   return score;
+}
+
+struct libretrodb_plan *libretrodb_plan_new(libretrodb_t *db,
+      libretrodb_query_t *q)
+{
+   unsigned i;
+   struct libretrodb_plan *best = NULL;
+   int best_score               = 0;
+
+   for (i = 0; i < db->index_count; i++)
+   {
+      int score;
+      struct libretrodb_plan *plan = NULL;
+
+      if (!*db->indexes[i].fields)
+         continue;
+
+      plan = (struct libretrodb_plan*)calloc(1, sizeof(*plan));
+      if (!plan)
+         break;
+
+      score = libretrodb_plan_index(&db->indexes[i], q, plan);
+
+      if (score > best_score)
+      {
+         libretrodb_plan_free(best);
+         best       = plan;
+         best_score = score;
+      }
+      else
+         libretrodb_plan_free(plan);
+   }
+
+   return best;
+}
+
+void libretrodb_plan_free(struct libretrodb_plan *plan)
+{
+   if (!plan)
+      return;
+
+   free(plan->lo.data);
+   free(plan->hi.data);
+   free(plan);
+}
+
+const char *libretrodb_query_index(libretrodb_query_t *q)
+{
+   const struct libretrodb_plan *plan = libretrodb_query_get_plan(q);
+
+   if (!plan)
+      return NULL;
+   return plan->index;
 }
 
 libretrodb_cursor_t *libretrodb_cursor_new(void)
@@ -590,6 +1398,11 @@ void libretrodb_cursor_free(libretrodb_cursor_t *dbc)
    free(dbc);
 }
 
+uint64_t libretrodb_count(libretrodb_t *db)
+{
+   return db->count;
+}
+
 libretrodb_t *libretrodb_new(void)
 {
    libretrodb_t *db = (libretrodb_t*)calloc(1, sizeof(*db));
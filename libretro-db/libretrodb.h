@@ -43,6 +43,8 @@ typedef struct libretrodb_cursor libretrodb_cursor_t;
 
 typedef struct libretrodb_index libretrodb_index_t;
 
+struct libretrodb_plan;
+
 typedef int (*libretrodb_value_provider)(void *ctx, struct rmsgpack_dom_value *out);
 
 int libretrodb_create(RFILE *fd, libretrodb_value_provider value_provider, void *ctx);
@@ -51,12 +53,52 @@ void libretrodb_close(libretrodb_t *db);
 
 int libretrodb_open(const char *path, libretrodb_t *db);
 
+/**
+ * libretrodb_create_index:
+ * @db                  : Handle to database.
+ * @name                : Name of the new index.
+ * @field_name          : Field, or comma separated fields, to index.
+ *
+ * Appends an index on @field_name to the database file. Queries
+ * compiled afterwards use it when they pin the first fields down.
+ *
+ * Returns: 0 if successful, otherwise negative.
+ **/
 int libretrodb_create_index(libretrodb_t *db, const char *name,
       const char *field_name);
 
+/**
+ * libretrodb_find_entry:
+ * @db                  : Handle to database.
+ * @index_name          : Index on a single binary field.
+ * @key                 : Value of the field, as big as every key.
+ * @out                 : The record.
+ *
+ * Returns: 0 if a record has @key, otherwise negative.
+ **/
 int libretrodb_find_entry(libretrodb_t *db, const char *index_name,
         const void *key, struct rmsgpack_dom_value *out);
 
+/**
+ * libretrodb_plan_new:
+ * @db                  : Handle to database.
+ * @q                   : Query to plan.
+ *
+ * Picks the index that narrows @q down the most.
+ *
+ * Returns: key range to look up, NULL if @q has to scan.
+ **/
+struct libretrodb_plan *libretrodb_plan_new(libretrodb_t *db,
+      libretrodb_query_t *q);
+
+void libretrodb_plan_free(struct libretrodb_plan *plan);
+
+/* Returns the name of the index @q uses, NULL if it scans. */
+const char *libretrodb_query_index(libretrodb_query_t *q);
+
+/* Returns the number of records in @db. */
+uint64_t libretrodb_count(libretrodb_t *db);
+
 libretrodb_t *libretrodb_new(void);
 
 void libretrodb_free(libretrodb_t *db);
@@ -22,10 +22,82 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "libretrodb.h"
 #include "rmsgpack_dom.h"
 
+#define BENCH_RUNS 5
+
+/* Queries faster than this are repeated within a run. */
+#define BENCH_MIN_TIME 0.05
+
+/* A pattern match, an exact match and a range. */
+static const char *bench_queries[] = {
+   "{'name':glob('*Mario*')}",
+   "{'crc':b'DEADBEEF'}",
+   "{'releaseyear':between(1990,1999)}"
+};
+
+static int bench_query(libretrodb_t *db, libretrodb_cursor_t *cur,
+      const char *query_exp)
+{
+   unsigned i;
+   struct rmsgpack_dom_value item;
+   double best                = 0.0;
+   unsigned matches           = 0;
+   const char *error          = NULL;
+   libretrodb_query_t *q      = libretrodb_query_compile(db,
+         query_exp, strlen(query_exp), &error);
+
+   if (error)
+   {
+      printf("%s\n", error);
+      return -1;
+   }
+
+   for (i = 0; i < BENCH_RUNS; i++)
+   {
+      double elapsed;
+      unsigned repeat = 0;
+      clock_t start   = clock();
+
+      do
+      {
+         /* Lookups include opening the cursor. */
+         if (libretrodb_cursor_open(db, cur, q) != 0)
+         {
+            libretrodb_query_free(q);
+            return -1;
+         }
+
+         matches = 0;
+
+         while (libretrodb_cursor_read_item(cur, &item) == 0)
+         {
+            matches++;
+            rmsgpack_dom_value_free(&item);
+         }
+
+         libretrodb_cursor_close(cur);
+         repeat++;
+         elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+      } while (elapsed < BENCH_MIN_TIME);
+
+      elapsed /= repeat;
+      if (i == 0 || elapsed < best)
+         best = elapsed;
+   }
+
+   printf("%-40s %8u matches %10.3f ms %12.0f records/s  %s\n",
+         query_exp, matches, best * 1000.0,
+         best > 0.0 ? (double)libretrodb_count(db) / best : 0.0,
+         libretrodb_query_index(q) ? libretrodb_query_index(q) : "scan");
+
+   libretrodb_query_free(q);
+   return 0;
+}
+
 int main(int argc, char ** argv)
 {
    int rv;
@@ -40,8 +112,9 @@ int main(int argc, char ** argv)
       printf("Usage: %s <db file> <command> [extra args...]\n", argv[0]);
       printf("Available Commands:\n");
       printf("\tlist\n");
-      printf("\tcreate-index <index name> <field name>\n");
+      printf("\tcreate-index <index name> <field name>[,<field name>...]\n");
       printf("\tfind <query expression>\n");
+      printf("\tbench [query expression...]\n");
       return 1;
    }
 
@@ -111,20 +184,44 @@ int main(int argc, char ** argv)
          rmsgpack_dom_value_free(&item);
       }
    }
+   else if (!strcmp(command, "bench"))
+   {
+      int i;
+
+      if (argc == 3)
+      {
+         for (i = 0; i < (int)(sizeof(bench_queries) / sizeof(*bench_queries)); i++)
+            bench_query(db, cur, bench_queries[i]);
+      }
+
+      for (i = 3; i < argc; i++)
+         bench_query(db, cur, argv[i]);
+   }
    else if (!strcmp(command, "create-index"))
    {
+      clock_t start;
       const char * index_name, * field_name;
 
       if (argc != 5)
       {
-         printf("Usage: %s <db file> create-index <index name> <field name>\n", argv[0]);
+         printf("Usage: %s <db file> create-index <index name> <field name>[,<field name>...]\n", argv[0]);
          goto error;
       }
 
       index_name = argv[3];
       field_name = argv[4];
 
-      libretrodb_create_index(db, index_name, field_name);
+      start      = clock();
+
+      if ((rv = libretrodb_create_index(db, index_name, field_name)) != 0)
+      {
+         printf("Could not create index: %s\n", strerror(-rv));
+         goto error;
+      }
+
+      printf("Indexed %u records in %.3f s\n",
+            (unsigned)libretrodb_count(db),
+            (double)(clock() - start) / CLOCKS_PER_SEC);
    }
    else
    {
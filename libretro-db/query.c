@@ -40,6 +40,9 @@
 #define MAX_ERROR_LEN   256
 #define QUERY_MAX_ARGS  50
 
+/* Strings shorter than this are matched without allocating. */
+#define QUERY_RAW_STRING_LEN 256
+
 struct buffer
 {
    const char *data;
@@ -82,6 +85,7 @@ struct query
 {
    unsigned ref_count;
    struct invocation root;
+   struct libretrodb_plan *plan;
 };
 
 struct registered_func
@@ -788,6 +792,23 @@ success:
    return buff;
 }
 
+static int query_match_value(const struct argument *arg,
+      struct rmsgpack_dom_value value)
+{
+   struct rmsgpack_dom_value res;
+
+   if (arg->type == AT_VALUE)
+      res = func_equals(value, 1, arg);
+   else
+      res = query_func_is_true(arg->a.invocation.func(
+               value,
+               arg->a.invocation.argc,
+               arg->a.invocation.argv
+               ), 0, NULL);
+
+   return res.val.bool_;
+}
+
 static struct rmsgpack_dom_value query_func_all_map(
       struct rmsgpack_dom_value input,
       unsigned argc, const struct argument *argv)
@@ -823,18 +844,7 @@ static struct rmsgpack_dom_value query_func_all_map(
       value = rmsgpack_dom_value_map_value(&input, &arg.a.value);
       if (!value) /* All missing fields are nil */
          value = &nil_value;
-      arg = argv[i + 1];
-      if (arg.type == AT_VALUE)
-         res = func_equals(*value, 1, &arg);
-      else
-      {
-         res = query_func_is_true(arg.a.invocation.func(
-                  *value,
-                  arg.a.invocation.argc,
-                  arg.a.invocation.argv
-                  ), 0, NULL);
-         value = NULL;
-      }
+      res.val.bool_ = query_match_value(&argv[i + 1], *value);
       if (!res.val.bool_)
          break;
    }
@@ -969,6 +979,7 @@ void libretrodb_query_free(void *q)
    free(real_q->root.argv);
    real_q->root.argv = NULL;
    real_q->root.argc = 0;
+   libretrodb_plan_free(real_q->plan);
    free(real_q);
 }
 
@@ -1008,6 +1019,9 @@ void *libretrodb_query_compile(libretrodb_t *db,
       libretrodb_query_free(q);
       return NULL;
    }
+
+   if (db)
+      q->plan = libretrodb_plan_new(db, (libretrodb_query_t*)q);
    goto success;
 clean:
    if (q)
@@ -1030,3 +1044,189 @@ int libretrodb_query_filter(libretrodb_query_t *q,
    struct rmsgpack_dom_value res = inv.func(*v, inv.argc, inv.argv);
    return (res.type == RDT_BOOL && res.val.bool_);
 }
+
+/* Matches the scalar @value of a record against the entries of
+ * the query's table waiting for @key, as query_func_all_map()
+ * would. */
+static int query_filter_raw_field(const struct invocation *inv,
+      char *seen, const struct rmsgpack_dom_value *key,
+      struct rmsgpack_dom_value value, unsigned *remaining)
+{
+   unsigned j;
+   char str[QUERY_RAW_STRING_LEN];
+   char *copy = NULL;
+   int ret    = 1;
+
+   /* Functions like glob() want a terminated string. */
+   if (value.type == RDT_STRING)
+   {
+      copy = str;
+      if (value.val.string.len >= sizeof(str))
+         copy = (char*)malloc(value.val.string.len + 1);
+      if (!copy)
+         return -1;
+
+      memcpy(copy, value.val.string.buff, value.val.string.len);
+      copy[value.val.string.len] = '\0';
+      value.val.string.buff      = copy;
+   }
+
+   for (j = 0; j < inv->argc / 2; j++)
+   {
+      if (seen[j] || rmsgpack_dom_value_cmp(key,
+               &inv->argv[j * 2].a.value) != 0)
+         continue;
+
+      seen[j] = 1;
+      (*remaining)--;
+
+      if (!query_match_value(&inv->argv[j * 2 + 1], value))
+      {
+         ret = 0;
+         break;
+      }
+   }
+
+   if (copy && copy != str)
+      free(copy);
+
+   return ret;
+}
+
+int libretrodb_query_filter_raw(libretrodb_query_t *q,
+      const void *data, size_t len)
+{
+   unsigned i, remaining;
+   struct rmsgpack_dom_value map, key, value, nil_value;
+   char seen[QUERY_MAX_ARGS / 2];
+   size_t pos                   = 0;
+   const uint8_t *buff          = (const uint8_t*)data;
+   const struct invocation *inv = &((struct query*)q)->root;
+   int rv                       = 0;
+
+   /* Only the table at the top, like {name:glob('*')}, knows
+    * which fields it needs. */
+   if (inv->func != query_func_all_map || inv->argc % 2 != 0)
+      return -1;
+
+   for (i = 0; i < inv->argc; i += 2)
+   {
+      if (inv->argv[i].type != AT_VALUE)
+         return -1;
+   }
+
+   if ((rv = rmsgpack_dom_peek(buff, len, &map)) <= 0
+         || map.type != RDT_MAP)
+      return -1;
+
+   pos       = rv;
+   remaining = inv->argc / 2;
+   memset(seen, 0, sizeof(seen));
+
+   for (i = 0; i < map.val.map.len && remaining; i++)
+   {
+      int key_len, value_len;
+
+      if ((key_len = rmsgpack_dom_skip(buff + pos, len - pos)) <= 0)
+         return -1;
+      rmsgpack_dom_peek(buff + pos, len - pos, &key);
+      pos += key_len;
+
+      if ((value_len = rmsgpack_dom_skip(buff + pos, len - pos)) <= 0)
+         return -1;
+
+      if (key.type == RDT_STRING || key.type == RDT_BINARY)
+      {
+         rmsgpack_dom_peek(buff + pos, len - pos, &value);
+
+         /* Nested values need the DOM. */
+         if (value.type == RDT_MAP || value.type == RDT_ARRAY)
+            return -1;
+
+         if ((rv = query_filter_raw_field(inv, seen, &key,
+                     value, &remaining)) <= 0)
+            return rv;
+      }
+
+      pos += value_len;
+   }
+
+   /* All missing fields are nil */
+   nil_value.type = RDT_NULL;
+
+   for (i = 0; i < inv->argc / 2; i++)
+   {
+      if (!seen[i] && !query_match_value(&inv->argv[i * 2 + 1], nil_value))
+         return 0;
+   }
+
+   return 1;
+}
+
+int libretrodb_query_bounds(libretrodb_query_t *q, const char *field,
+      struct rmsgpack_dom_value *lo, struct rmsgpack_dom_value *hi)
+{
+   unsigned i;
+   const struct invocation *inv = &((struct query*)q)->root;
+   size_t field_len             = strlen(field);
+
+   if (inv->func != query_func_all_map || inv->argc % 2 != 0)
+      return QUERY_BOUND_NONE;
+
+   for (i = 0; i < inv->argc; i += 2)
+   {
+      const struct argument *key = &inv->argv[i];
+      const struct argument *arg = &inv->argv[i + 1];
+
+      if (key->type != AT_VALUE || key->a.value.type != RDT_STRING
+            || key->a.value.val.string.len != field_len
+            || memcmp(key->a.value.val.string.buff, field, field_len))
+         continue;
+
+      if (arg->type == AT_VALUE)
+      {
+         if (arg->a.value.type == RDT_MAP || arg->a.value.type == RDT_ARRAY)
+            return QUERY_BOUND_NONE;
+
+         *lo = *hi = arg->a.value;
+         return QUERY_BOUND_EQUAL;
+      }
+
+      if (arg->a.invocation.func == query_func_between
+            && arg->a.invocation.argc == 2
+            && arg->a.invocation.argv[0].type == AT_VALUE
+            && arg->a.invocation.argv[1].type == AT_VALUE
+            && arg->a.invocation.argv[0].a.value.type == RDT_INT
+            && arg->a.invocation.argv[1].a.value.type == RDT_INT)
+      {
+         *lo = arg->a.invocation.argv[0].a.value;
+         *hi = arg->a.invocation.argv[1].a.value;
+         return QUERY_BOUND_RANGE;
+      }
+
+      /* The part of the pattern before any wildcard. */
+      if (arg->a.invocation.func == query_func_glob
+            && arg->a.invocation.argc == 1
+            && arg->a.invocation.argv[0].type == AT_VALUE
+            && arg->a.invocation.argv[0].a.value.type == RDT_STRING)
+      {
+         *lo                = arg->a.invocation.argv[0].a.value;
+         lo->val.string.len = strcspn(lo->val.string.buff, "*?[\\");
+         *hi                = *lo;
+
+         if (!lo->val.string.len)
+            return QUERY_BOUND_NONE;
+         return QUERY_BOUND_PREFIX;
+      }
+
+      return QUERY_BOUND_NONE;
+   }
+
+   return QUERY_BOUND_NONE;
+}
+
+const struct libretrodb_plan *libretrodb_query_get_plan(
+      libretrodb_query_t *q)
+{
+   return ((struct query*)q)->plan;
+}
@@ -32,12 +32,61 @@ RETRO_BEGIN_DECLS
 
 typedef struct libretrodb_query libretrodb_query_t;
 
+struct libretrodb_plan;
+
+enum query_bound_type
+{
+   QUERY_BOUND_NONE = 0,
+   /* The field equals lo. */
+   QUERY_BOUND_EQUAL,
+   /* The field is a number from lo to hi. */
+   QUERY_BOUND_RANGE,
+   /* The field is a string starting with lo. */
+   QUERY_BOUND_PREFIX
+};
+
 void libretrodb_query_inc_ref(libretrodb_query_t *q);
 
 void libretrodb_query_dec_ref(libretrodb_query_t *q);
 
 int libretrodb_query_filter(libretrodb_query_t *q, struct rmsgpack_dom_value *v);
 
+/**
+ * libretrodb_query_filter_raw:
+ * @q                   : compiled query
+ * @data                : msgpack encoded record
+ * @len                 : size of @data
+ *
+ * Matches the record without decoding it, only the fields the
+ * query looks at are read.
+ *
+ * Returns: 1 if the record matches, 0 if it doesn't, -1 if the
+ * query has to be run on the decoded record instead.
+ **/
+int libretrodb_query_filter_raw(libretrodb_query_t *q,
+      const void *data, size_t len);
+
+/**
+ * libretrodb_query_bounds:
+ * @q                   : compiled query
+ * @field               : field name
+ * @lo                  : lowest value the field can have
+ * @hi                  : highest value the field can have
+ *
+ * Tells the planner what the query needs @field to be. Records
+ * within the bounds may still not match. @lo and @hi point into
+ * the query.
+ *
+ * Returns: one of enum query_bound_type.
+ **/
+int libretrodb_query_bounds(libretrodb_query_t *q, const char *field,
+      struct rmsgpack_dom_value *lo, struct rmsgpack_dom_value *hi);
+
+/* Returns the index lookup libretrodb_query_compile() planned,
+ * NULL if the query scans the database. */
+const struct libretrodb_plan *libretrodb_query_get_plan(
+      libretrodb_query_t *q);
+
 RETRO_END_DECLS
 
 #endif
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 
 #include "rmsgpack.h"
 
@@ -511,3 +512,294 @@ clean:
    rmsgpack_dom_value_free(&map);
    return 0;
 }
+
+static uint64_t dom_buf_uint(const uint8_t *buff, unsigned size)
+{
+   unsigned i;
+   uint64_t value = 0;
+
+   for (i = 0; i < size; i++)
+      value = (value << 8) | buff[i];
+
+   return value;
+}
+
+int rmsgpack_dom_peek(const void *data, size_t len,
+      struct rmsgpack_dom_value *out)
+{
+   uint64_t value;
+   unsigned size;
+   const uint8_t *buff = (const uint8_t*)data;
+   uint8_t type;
+
+   if (len < 1)
+      return 0;
+
+   type = buff[0];
+
+   if (type < _MPF_FIXMAP)
+   {
+      out->type     = RDT_INT;
+      out->val.int_ = type;
+      return 1;
+   }
+   else if (type < _MPF_FIXARRAY)
+   {
+      out->type          = RDT_MAP;
+      out->val.map.len   = type - _MPF_FIXMAP;
+      out->val.map.items = NULL;
+      return 1;
+   }
+   else if (type < _MPF_FIXSTR)
+   {
+      out->type            = RDT_ARRAY;
+      out->val.array.len   = type - _MPF_FIXARRAY;
+      out->val.array.items = NULL;
+      return 1;
+   }
+   else if (type < _MPF_NIL)
+   {
+      value = type - _MPF_FIXSTR;
+      if (len - 1 < value)
+         return 0;
+
+      out->type            = RDT_STRING;
+      out->val.string.len  = (uint32_t)value;
+      out->val.string.buff = (char*)buff + 1;
+      return 1 + (int)value;
+   }
+   else if (type > _MPF_MAP32)
+   {
+      out->type     = RDT_INT;
+      out->val.int_ = (int8_t)type;
+      return 1;
+   }
+
+   switch (type)
+   {
+      case _MPF_NIL:
+         out->type = RDT_NULL;
+         return 1;
+      case _MPF_FALSE:
+      case _MPF_TRUE:
+         out->type      = RDT_BOOL;
+         out->val.bool_ = type == _MPF_TRUE;
+         return 1;
+      case _MPF_BIN8:
+      case _MPF_BIN16:
+      case _MPF_BIN32:
+      case _MPF_STR8:
+      case _MPF_STR16:
+      case _MPF_STR32:
+         if (type >= _MPF_STR8)
+            size = 1 << (type - _MPF_STR8);
+         else
+            size = 1 << (type - _MPF_BIN8);
+
+         if (len - 1 < size)
+            return 0;
+
+         value = dom_buf_uint(buff + 1, size);
+         if (value > INT_MAX - 1 - size)
+            return -EINVAL;
+         if (len - 1 - size < value)
+            return 0;
+
+         /* Strings and binaries share their layout. */
+         out->type            = type >= _MPF_STR8 ? RDT_STRING : RDT_BINARY;
+         out->val.string.len  = (uint32_t)value;
+         out->val.string.buff = (char*)buff + 1 + size;
+         return 1 + size + (int)value;
+      case _MPF_UINT8:
+      case _MPF_UINT16:
+      case _MPF_UINT32:
+      case _MPF_UINT64:
+         size = 1 << (type - _MPF_UINT8);
+         if (len - 1 < size)
+            return 0;
+
+         out->type      = RDT_UINT;
+         out->val.uint_ = dom_buf_uint(buff + 1, size);
+         return 1 + size;
+      case _MPF_INT8:
+      case _MPF_INT16:
+      case _MPF_INT32:
+      case _MPF_INT64:
+         size = 1 << (type - _MPF_INT8);
+         if (len - 1 < size)
+            return 0;
+
+         value     = dom_buf_uint(buff + 1, size);
+         out->type = RDT_INT;
+
+         switch (size)
+         {
+            case 1:
+               out->val.int_ = (int8_t)value;
+               break;
+            case 2:
+               out->val.int_ = (int16_t)value;
+               break;
+            case 4:
+               out->val.int_ = (int32_t)value;
+               break;
+            default:
+               out->val.int_ = (int64_t)value;
+               break;
+         }
+         return 1 + size;
+      case _MPF_ARRAY16:
+      case _MPF_ARRAY32:
+         size = 2 << (type - _MPF_ARRAY16);
+         if (len - 1 < size)
+            return 0;
+
+         out->type            = RDT_ARRAY;
+         out->val.array.len   = (uint32_t)dom_buf_uint(buff + 1, size);
+         out->val.array.items = NULL;
+         return 1 + size;
+      case _MPF_MAP16:
+      case _MPF_MAP32:
+         size = 2 << (type - _MPF_MAP16);
+         if (len - 1 < size)
+            return 0;
+
+         out->type          = RDT_MAP;
+         out->val.map.len   = (uint32_t)dom_buf_uint(buff + 1, size);
+         out->val.map.items = NULL;
+         return 1 + size;
+   }
+
+   return -EINVAL;
+}
+
+int rmsgpack_dom_skip(const void *data, size_t len)
+{
+   size_t pos          = 0;
+   uint64_t pending    = 1;
+   const uint8_t *buff = (const uint8_t*)data;
+
+   while (pending)
+   {
+      struct rmsgpack_dom_value value;
+      int rv = rmsgpack_dom_peek(buff + pos, len - pos, &value);
+
+      if (rv <= 0)
+         return rv;
+
+      pos += rv;
+      if (pos > INT_MAX)
+         return -EINVAL;
+
+      pending--;
+
+      if (value.type == RDT_MAP)
+         pending += 2 * (uint64_t)value.val.map.len;
+      else if (value.type == RDT_ARRAY)
+         pending += value.val.array.len;
+   }
+
+   return (int)pos;
+}
+
+static int dom_read_buf(const uint8_t *buff, size_t len,
+      struct rmsgpack_dom_value *out, unsigned depth)
+{
+   int rv;
+   unsigned i;
+   size_t pos;
+   char *copy = NULL;
+
+   if (depth == MAX_DEPTH)
+   {
+      out->type = RDT_NULL;
+      return -ENOMEM;
+   }
+
+   rv = rmsgpack_dom_peek(buff, len, out);
+   if (rv <= 0)
+   {
+      out->type = RDT_NULL;
+      return rv == 0 ? -EINVAL : rv;
+   }
+
+   pos = rv;
+
+   switch (out->type)
+   {
+      case RDT_STRING:
+      case RDT_BINARY:
+         copy = (char*)malloc(out->val.string.len + 1);
+         if (!copy)
+         {
+            out->type = RDT_NULL;
+            return -ENOMEM;
+         }
+
+         memcpy(copy, out->val.string.buff, out->val.string.len);
+         copy[out->val.string.len] = '\0';
+         out->val.string.buff      = copy;
+         break;
+      case RDT_MAP:
+         if (!out->val.map.len)
+            break;
+
+         out->val.map.items = (struct rmsgpack_dom_pair*)
+            calloc(out->val.map.len, sizeof(*out->val.map.items));
+         if (!out->val.map.items)
+         {
+            out->type = RDT_NULL;
+            return -ENOMEM;
+         }
+
+         /* Last item first, as rmsgpack_dom_read() does. */
+         for (i = out->val.map.len; i-- > 0; )
+         {
+            if ((rv = dom_read_buf(buff + pos, len - pos,
+                        &out->val.map.items[i].key, depth + 1)) < 0)
+               goto error;
+            pos += rv;
+
+            if ((rv = dom_read_buf(buff + pos, len - pos,
+                        &out->val.map.items[i].value, depth + 1)) < 0)
+               goto error;
+            pos += rv;
+         }
+         break;
+      case RDT_ARRAY:
+         if (!out->val.array.len)
+            break;
+
+         out->val.array.items = (struct rmsgpack_dom_value*)
+            calloc(out->val.array.len, sizeof(*out->val.array.items));
+         if (!out->val.array.items)
+         {
+            out->type = RDT_NULL;
+            return -ENOMEM;
+         }
+
+         for (i = out->val.array.len; i-- > 0; )
+         {
+            if ((rv = dom_read_buf(buff + pos, len - pos,
+                        &out->val.array.items[i], depth + 1)) < 0)
+               goto error;
+            pos += rv;
+         }
+         break;
+      default:
+         break;
+   }
+
+   return (int)pos;
+
+error:
+   rmsgpack_dom_value_free(out);
+   out->type = RDT_NULL;
+   return rv;
+}
+
+int rmsgpack_dom_read_buf(const void *data, size_t len,
+      struct rmsgpack_dom_value *out)
+{
+   return dom_read_buf((const uint8_t*)data, len, out, 0);
+}
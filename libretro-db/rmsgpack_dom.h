@@ -23,6 +23,7 @@
 #ifndef __LIBRETRODB_MSGPACK_DOM_H__
 #define __LIBRETRODB_MSGPACK_DOM_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <retro_common_api.h>
@@ -95,6 +96,47 @@ int rmsgpack_dom_write(RFILE *fd, const struct rmsgpack_dom_value *obj);
 
 int rmsgpack_dom_read_into(RFILE *fd, ...);
 
+/**
+ * rmsgpack_dom_peek:
+ * @data                : msgpack encoded data
+ * @len                 : size of @data
+ * @out                 : the value at the start of @data
+ *
+ * Decodes the value at the start of @data in place, without
+ * allocating. Strings and binaries point into @data and aren't
+ * NUL terminated; maps and arrays only get their length, their
+ * items follow.
+ *
+ * Returns: bytes taken by the value, not counting map and array
+ * items; 0 if @data is too short, negative on error.
+ **/
+int rmsgpack_dom_peek(const void *data, size_t len,
+      struct rmsgpack_dom_value *out);
+
+/**
+ * rmsgpack_dom_skip:
+ * @data                : msgpack encoded data
+ * @len                 : size of @data
+ *
+ * Returns: bytes taken by the value at the start of @data, map
+ * and array items included; 0 if @data is too short, negative
+ * on error.
+ **/
+int rmsgpack_dom_skip(const void *data, size_t len);
+
+/**
+ * rmsgpack_dom_read_buf:
+ * @data                : msgpack encoded data
+ * @len                 : size of @data
+ * @out                 : the value at the start of @data
+ *
+ * rmsgpack_dom_read() from memory.
+ *
+ * Returns: bytes read, negative on error.
+ **/
+int rmsgpack_dom_read_buf(const void *data, size_t len,
+      struct rmsgpack_dom_value *out);
+
 RETRO_END_DECLS
 
 #endif
@@ -17,23 +17,41 @@
 #include <string.h>
 
 #include <file/config_file.h>
+#include <file/file_path.h>
 #include <lists/dir_list.h>
 #include <lists/string_list.h>
 #include <compat/posix_string.h>
 #include <compat/strl.h>
+#include <features/features_cpu.h>
 #include <retro_miscellaneous.h>
+#include <streams/file_stream.h>
 #include <string/stdstring.h>
+#include <rhash.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include <libretro.h>
 
 #include "core_option_manager.h"
 
+/* Changes are written to the options file once no other change
+ * came in for this long. */
+#define CORE_OPTION_FLUSH_DELAY_USEC 1000000
+
 struct core_option
 {
    char *desc;
    char *key;
    struct string_list *vals;
    size_t index;
+
+   uint32_t hash;
+   /* Bumped whenever the value changes. */
+   unsigned version;
+   /* Version the core last read. */
+   unsigned read_version;
 };
 
 struct core_option_manager
@@ -44,8 +62,263 @@ struct core_option_manager
    struct core_option *opts;
    size_t size;
    bool updated;
+
+   /* Option index + 1 by key hash, 0 for empty slots. */
+   size_t *hash_index;
+   size_t hash_mask;
+
+   /* Version of the last change to any option. */
+   unsigned version;
+   /* Version of the values in the options file, guarded by
+    * flush_lock while the flush thread runs. */
+   unsigned saved_version;
+
+#ifdef HAVE_THREADS
+   /* Writes the options file in the background. */
+   sthread_t *flush_thread;
+   slock_t *flush_lock;
+   scond_t *flush_cond;
+   /* Held while the options file is being written. */
+   slock_t *write_lock;
+   /* Contents waiting to be written, newer ones replace it. */
+   char *flush_data;
+   unsigned flush_version;
+   retro_time_t flush_time;
+   bool flush_quit;
+#endif
 };
 
+static struct core_option *core_option_manager_find(
+      core_option_manager_t *opt, const char *key)
+{
+   uint32_t hash = djb2_calculate(key);
+   size_t i      = hash & opt->hash_mask;
+
+   for (; opt->hash_index[i]; i = (i + 1) & opt->hash_mask)
+   {
+      struct core_option *option = &opt->opts[opt->hash_index[i] - 1];
+
+      if (option->hash == hash && string_is_equal(option->key, key))
+         return option;
+   }
+
+   return NULL;
+}
+
+static bool core_option_manager_build_index(core_option_manager_t *opt)
+{
+   size_t i;
+   size_t slots = next_pow2(opt->size * 2 + 1);
+
+   opt->hash_index = (size_t*)calloc(slots, sizeof(*opt->hash_index));
+   if (!opt->hash_index)
+      return false;
+
+   opt->hash_mask  = slots - 1;
+
+   for (i = 0; i < opt->size; i++)
+   {
+      size_t slot;
+      struct core_option *option = &opt->opts[i];
+
+      if (string_is_empty(option->key))
+         continue;
+
+      /* The first option wins if a core declares a key twice. */
+      if (core_option_manager_find(opt, option->key))
+         continue;
+
+      for (slot = option->hash & opt->hash_mask; opt->hash_index[slot];
+            slot = (slot + 1) & opt->hash_mask);
+
+      opt->hash_index[slot] = i + 1;
+   }
+
+   return true;
+}
+
+/* Puts the current values into the config. */
+static void core_option_manager_update_conf(core_option_manager_t *opt)
+{
+   size_t i;
+
+   for (i = 0; i < opt->size; i++)
+      config_set_string(opt->conf, opt->opts[i].key,
+            core_option_manager_get_val(opt, i));
+}
+
+#ifdef HAVE_THREADS
+static void core_option_manager_flush_thread(void *data)
+{
+   core_option_manager_t *opt = (core_option_manager_t*)data;
+
+   slock_lock(opt->flush_lock);
+
+   for (;;)
+   {
+      char *flush_data;
+      unsigned version;
+      retro_time_t now;
+
+      if (!opt->flush_data)
+      {
+         if (opt->flush_quit)
+            break;
+         scond_wait(opt->flush_cond, opt->flush_lock);
+         continue;
+      }
+
+      /* Let the changes settle, unless shutting down. */
+      now = cpu_features_get_time_usec();
+      if (!opt->flush_quit
+            && now < opt->flush_time + CORE_OPTION_FLUSH_DELAY_USEC)
+      {
+         scond_wait_timeout(opt->flush_cond, opt->flush_lock,
+               opt->flush_time + CORE_OPTION_FLUSH_DELAY_USEC - now);
+         continue;
+      }
+
+      /* Take the data with write_lock held, so a flush on the
+       * main thread can't get in between and be overwritten. */
+      slock_unlock(opt->flush_lock);
+      slock_lock(opt->write_lock);
+      slock_lock(opt->flush_lock);
+
+      flush_data      = opt->flush_data;
+      version         = opt->flush_version;
+      opt->flush_data = NULL;
+
+      slock_unlock(opt->flush_lock);
+
+      if (flush_data)
+      {
+         bool ret = filestream_write_file(opt->conf_path,
+               flush_data, strlen(flush_data));
+
+         free(flush_data);
+
+         if (ret)
+         {
+            slock_lock(opt->flush_lock);
+            opt->saved_version = version;
+            slock_unlock(opt->flush_lock);
+         }
+      }
+
+      slock_unlock(opt->write_lock);
+      slock_lock(opt->flush_lock);
+   }
+
+   slock_unlock(opt->flush_lock);
+}
+
+/**
+ * core_option_manager_flush_async:
+ * @opt              : options manager handle
+ *
+ * Hands the current values to the flush thread, which writes
+ * them once no other change came in for a while.
+ **/
+static void core_option_manager_flush_async(core_option_manager_t *opt)
+{
+   char *data = NULL;
+
+   if (string_is_empty(opt->conf_path))
+      return;
+
+   if (!opt->flush_thread)
+   {
+      if (!opt->flush_lock)
+         opt->flush_lock = slock_new();
+      if (!opt->flush_cond)
+         opt->flush_cond = scond_new();
+      if (!opt->write_lock)
+         opt->write_lock = slock_new();
+
+      if (!opt->flush_lock || !opt->flush_cond || !opt->write_lock)
+         return;
+
+      opt->flush_thread = sthread_create(
+            core_option_manager_flush_thread, opt);
+      if (!opt->flush_thread)
+         return;
+   }
+
+   core_option_manager_update_conf(opt);
+
+   data = config_file_dump_to_buffer(opt->conf);
+   if (!data)
+      return;
+
+   slock_lock(opt->flush_lock);
+   free(opt->flush_data);
+   opt->flush_data    = data;
+   opt->flush_version = opt->version;
+   opt->flush_time    = cpu_features_get_time_usec();
+   scond_signal(opt->flush_cond);
+   slock_unlock(opt->flush_lock);
+}
+#endif
+
+static void core_option_manager_changed_value(core_option_manager_t *opt,
+      struct core_option *option)
+{
+   option->version = ++opt->version;
+   opt->updated    = true;
+
+#ifdef HAVE_THREADS
+   core_option_manager_flush_async(opt);
+#endif
+}
+
+/**
+ * core_option_manager_write:
+ * @opt              : options manager handle
+ * @path             : options file to write
+ *
+ * Writes the current values right away, dropping the ones
+ * waiting for the flush thread.
+ *
+ * Returns: true (1) if the file was written, otherwise false (0).
+ **/
+static bool core_option_manager_write(core_option_manager_t *opt,
+      const char *path)
+{
+   bool ret = false;
+
+#ifdef HAVE_THREADS
+   if (opt->flush_thread)
+   {
+      slock_lock(opt->write_lock);
+      slock_lock(opt->flush_lock);
+      free(opt->flush_data);
+      opt->flush_data = NULL;
+      slock_unlock(opt->flush_lock);
+   }
+#endif
+
+   core_option_manager_update_conf(opt);
+
+   ret = config_file_write(opt->conf, path);
+
+#ifdef HAVE_THREADS
+   if (opt->flush_thread)
+   {
+      slock_lock(opt->flush_lock);
+      if (ret && string_is_equal(path, opt->conf_path))
+         opt->saved_version = opt->version;
+      slock_unlock(opt->flush_lock);
+      slock_unlock(opt->write_lock);
+      return ret;
+   }
+#endif
+
+   if (ret && string_is_equal(path, opt->conf_path))
+      opt->saved_version = opt->version;
+
+   return ret;
+}
+
 static bool core_option_manager_parse_variable(core_option_manager_t *opt, size_t idx,
       const struct retro_variable *var)
 {
@@ -55,8 +328,11 @@ static bool core_option_manager_parse_variable(core_option_manager_t *opt, size_
    char *config_val           = NULL;
    struct core_option *option = (struct core_option*)&opt->opts[idx];
 
-   option->key = strdup(var->key);
-   value       = strdup(var->value);
+   option->key          = strdup(var->key);
+   option->hash         = djb2_calculate(var->key);
+   option->version      = 1;
+   option->read_version = 0;
+   value                = strdup(var->value);
    desc_end    = strstr(value, "; ");
 
    if (!desc_end)
@@ -92,6 +368,8 @@ static bool core_option_manager_parse_variable(core_option_manager_t *opt, size_
 
       free(config_val);
    }
+   else /* Not in the options file yet. */
+      opt->saved_version = 0;
 
    free(value);
 
@@ -111,6 +389,27 @@ void core_option_manager_free(core_option_manager_t *opt)
    if (!opt)
       return;
 
+#ifdef HAVE_THREADS
+   if (opt->flush_thread)
+   {
+      /* Writes what is still waiting right away. */
+      slock_lock(opt->flush_lock);
+      opt->flush_quit = true;
+      scond_signal(opt->flush_cond);
+      slock_unlock(opt->flush_lock);
+
+      sthread_join(opt->flush_thread);
+   }
+
+   free(opt->flush_data);
+   if (opt->flush_cond)
+      scond_free(opt->flush_cond);
+   if (opt->flush_lock)
+      slock_free(opt->flush_lock);
+   if (opt->write_lock)
+      slock_free(opt->write_lock);
+#endif
+
    for (i = 0; i < opt->size; i++)
    {
       if (opt->opts[i].desc)
@@ -128,33 +427,61 @@ void core_option_manager_free(core_option_manager_t *opt)
 
    if (opt->conf)
       config_file_free(opt->conf);
+   free(opt->hash_index);
    free(opt->opts);
    free(opt);
 }
 
-void core_option_manager_get(core_option_manager_t *opt, void *data)
+/**
+ * core_option_manager_get:
+ * @opt              : options manager handle
+ * @data             : struct retro_variable, the key to look up
+ *
+ * Gets the value of an option for the core, and clears the
+ * updated state.
+ *
+ * Returns: true (1) if the value changed since the core last
+ * read it, otherwise false (0).
+ **/
+bool core_option_manager_get(core_option_manager_t *opt, void *data)
 {
-   size_t i;
+   struct core_option *option = NULL;
    struct retro_variable *var = (struct retro_variable*)data;
+   bool changed               = false;
 
    if (!opt)
-      return;
+      return false;
 
    opt->updated = false;
+   var->value   = NULL;
 
-   for (i = 0; i < opt->size; i++)
-   {
-      if (string_is_empty(opt->opts[i].key))
-         continue;
+   if (string_is_empty(var->key))
+      return false;
 
-      if (string_is_equal(opt->opts[i].key, var->key))
-      {
-         var->value = core_option_manager_get_val(opt, i);
-         return;
-      }
-   }
+   option = core_option_manager_find(opt, var->key);
+   if (!option)
+      return false;
+
+   var->value           = option->vals->elems[option->index].data;
+   changed              = option->read_version != option->version;
+   option->read_version = option->version;
+
+   return changed;
+}
 
-   var->value = NULL;
+/**
+ * core_option_manager_changed:
+ * @opt              : options manager handle
+ * @idx              : index identifier of the option
+ *
+ * Returns: true (1) if the value of the option changed since
+ * the core last read it, otherwise false (0).
+ **/
+bool core_option_manager_changed(core_option_manager_t *opt, size_t idx)
+{
+   if (!opt || idx >= opt->size)
+      return false;
+   return opt->opts[idx].read_version != opt->opts[idx].version;
 }
 
 
@@ -189,6 +516,9 @@ core_option_manager_t *core_option_manager_new(const char *conf_path,
    if (!opt->conf)
       goto error;
 
+   opt->version       = 1;
+   opt->saved_version = 1;
+
    for (var = vars; var->key && var->value; var++)
       size++;
 
@@ -205,6 +535,9 @@ core_option_manager_t *core_option_manager_new(const char *conf_path,
          goto error;
    }
 
+   if (!core_option_manager_build_index(opt))
+      goto error;
+
    return opt;
 
 error:
@@ -232,25 +565,30 @@ bool core_option_manager_updated(core_option_manager_t *opt)
  * core_option_manager_flush:
  * @opt              : options manager handle
  *
- * Writes core option key-pair values to file.
+ * Writes core option key-pair values to file, if they
+ * changed since they were last written.
  *
  * Returns: true (1) if core option values could be
  * successfully saved to disk, otherwise false (0).
  **/
 bool core_option_manager_flush(core_option_manager_t *opt)
 {
-   size_t i;
-
-   for (i = 0; i < opt->size; i++)
-   {
-      struct core_option *option = (struct core_option*)&opt->opts[i];
-
-      if (option)
-         config_set_string(opt->conf, option->key,
-               core_option_manager_get_val(opt, i));
-   }
-
-   return config_file_write(opt->conf, opt->conf_path);
+   bool saved = false;
+
+#ifdef HAVE_THREADS
+   if (opt->flush_lock)
+      slock_lock(opt->flush_lock);
+#endif
+   saved = opt->saved_version == opt->version;
+#ifdef HAVE_THREADS
+   if (opt->flush_lock)
+      slock_unlock(opt->flush_lock);
+#endif
+
+   if (saved && path_file_exists(opt->conf_path))
+      return true;
+
+   return core_option_manager_write(opt, opt->conf_path);
 }
 
 /**
@@ -266,17 +604,39 @@ bool core_option_manager_flush(core_option_manager_t *opt)
 bool core_option_manager_flush_game_specific(
       core_option_manager_t *opt, char* path)
 {
-   size_t i;
-   for (i = 0; i < opt->size; i++)
-   {
-      struct core_option *option = (struct core_option*)&opt->opts[i];
-
-      if (option)
-         config_set_string(opt->conf, option->key,
-               core_option_manager_get_val(opt, i));
+   return core_option_manager_write(opt, path);
 }
 
-   return config_file_write(opt->conf, path);
+/**
+ * core_option_manager_set_path:
+ * @opt              : options manager handle
+ * @path             : path for the core options file
+ *
+ * Makes @path the options file, e.g. once a game-specific one
+ * got created. Changes still waiting for the flush thread are
+ * dropped, all the values go to @path instead.
+ **/
+void core_option_manager_set_path(core_option_manager_t *opt,
+      const char *path)
+{
+#ifdef HAVE_THREADS
+   /* The flush thread writes conf_path with write_lock held. */
+   if (opt->flush_thread)
+   {
+      slock_lock(opt->write_lock);
+      slock_lock(opt->flush_lock);
+      free(opt->flush_data);
+      opt->flush_data    = NULL;
+      strlcpy(opt->conf_path, path, sizeof(opt->conf_path));
+      opt->saved_version = 0;
+      slock_unlock(opt->flush_lock);
+      slock_unlock(opt->write_lock);
+      return;
+   }
+#endif
+
+   strlcpy(opt->conf_path, path, sizeof(opt->conf_path));
+   opt->saved_version = 0;
 }
 
 /**
@@ -339,7 +699,7 @@ void core_option_manager_set_val(core_option_manager_t *opt,
    option        = (struct core_option*)&opt->opts[idx];
    option->index = val_idx % option->vals->size;
 
-   opt->updated  = true;
+   core_option_manager_changed_value(opt, option);
 }
 
 /**
@@ -360,7 +720,7 @@ void core_option_manager_next(core_option_manager_t *opt, size_t idx)
    option        = (struct core_option*)&opt->opts[idx];
 
    option->index = (option->index + 1) % option->vals->size;
-   opt->updated  = true;
+   core_option_manager_changed_value(opt, option);
 }
 
 /**
@@ -383,7 +743,7 @@ void core_option_manager_prev(core_option_manager_t *opt, size_t idx)
    option->index = (option->index + option->vals->size - 1) %
       option->vals->size;
 
-   opt->updated  = true;
+   core_option_manager_changed_value(opt, option);
 }
 
 /**
@@ -399,5 +759,5 @@ void core_option_manager_set_default(core_option_manager_t *opt, size_t idx)
       return;
 
    opt->opts[idx].index = 0;
-   opt->updated         = true;
+   core_option_manager_changed_value(opt, &opt->opts[idx]);
 }
@@ -53,7 +53,9 @@ bool core_option_manager_updated(core_option_manager_t *opt);
  * core_option_manager_flush:
  * @opt              : options manager handle
  *
- * Writes core option key-pair values to file.
+ * Writes core option key-pair values to file, if they
+ * changed since they were last written. Changes are also
+ * written in the background a second after they are made.
  *
  * Returns: true (1) if core option values could be
  * successfully saved to disk, otherwise false (0).
@@ -73,6 +75,17 @@ bool core_option_manager_flush(core_option_manager_t *opt);
 bool core_option_manager_flush_game_specific(
       core_option_manager_t *opt, char* path);
 
+/**
+ * core_option_manager_set_path:
+ * @opt              : options manager handle
+ * @path             : path for the core options file
+ *
+ * Makes @path the file the options are written to, including
+ * the writes done in the background.
+ **/
+void core_option_manager_set_path(core_option_manager_t *opt,
+      const char *path);
+
 /**
  * core_option_manager_free:
  * @opt              : options manager handle
@@ -81,7 +94,28 @@ bool core_option_manager_flush_game_specific(
  **/
 void core_option_manager_free(core_option_manager_t *opt);
 
-void core_option_manager_get(core_option_manager_t *opt,  void *data);
+/**
+ * core_option_manager_get:
+ * @opt              : options manager handle
+ * @data             : struct retro_variable, the key to look up
+ *
+ * Gets the value of an option for the core, and clears the
+ * updated state.
+ *
+ * Returns: true (1) if the value changed since the core last
+ * read it, otherwise false (0).
+ **/
+bool core_option_manager_get(core_option_manager_t *opt,  void *data);
+
+/**
+ * core_option_manager_changed:
+ * @opt              : options manager handle
+ * @idx              : idx identifier of the option
+ *
+ * Returns: true (1) if the value of the option changed since
+ * the core last read it, otherwise false (0).
+ **/
+bool core_option_manager_changed(core_option_manager_t *opt, size_t idx);
 
 /**
  * core_option_manager_size:
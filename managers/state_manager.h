@@ -28,6 +28,25 @@ RETRO_BEGIN_DECLS
 
 typedef struct state_manager state_manager_t;
 
+/* Delta kernels shared with the netplay frame history.
+ * See state_manager.c for the patch format. */
+
+/* Returns the maximum size of a patch for a state of 'uncomp' bytes. */
+size_t state_manager_raw_maxsize(size_t uncomp);
+
+/* Allocates a state buffer the kernels can scan without bounds checks.
+ * Buffers compared against each other need a different 'uniq'. */
+void *state_manager_raw_alloc(size_t len, uint16_t uniq);
+
+/* Writes a patch that turns 'dst' back into 'src'.
+ * Returns the number of bytes written to 'patch'. */
+size_t state_manager_raw_compress(const void *src,
+      const void *dst, size_t len, void *patch);
+
+/* Applies a patch from state_manager_raw_compress() to 'data'. */
+void state_manager_raw_decompress(const void *patch,
+      size_t patchlen, void *data, size_t datalen);
+
 bool state_manager_frame_is_reversed(void);
 
 void state_manager_event_deinit(void);
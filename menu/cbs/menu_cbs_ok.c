@@ -32,6 +32,7 @@
 #include "../../frontend/frontend_driver.h"
 #include "../../defaults.h"
 #include "../../managers/cheat_manager.h"
+#include "../../managers/core_option_manager.h"
 #include "../../general.h"
 #include "../../tasks/tasks_internal.h"
 #include "../../input/input_remapping.h"
@@ -1670,6 +1671,48 @@ static void cb_generic_dir_download(void *task_data,
 }
 #endif
 
+/* Moves a download streamed to the cache directory to its
+ * destination, copying it when they're on different file systems. */
+static bool download_move_file(const char *src, const char *dst)
+{
+   char *buf  = NULL;
+   RFILE *in  = NULL;
+   RFILE *out = NULL;
+   bool ret   = false;
+
+   remove(dst);
+   if (rename(src, dst) == 0)
+      return true;
+
+   in  = filestream_open(src, RFILE_MODE_READ, -1);
+   out = filestream_open(dst, RFILE_MODE_WRITE, -1);
+   buf = (char*)malloc(64 * 1024);
+
+   if (in && out && buf)
+   {
+      ssize_t len;
+
+      ret = true;
+      while ((len = filestream_read(in, buf, 64 * 1024)) > 0)
+      {
+         if (filestream_write(out, buf, len) != len)
+         {
+            ret = false;
+            break;
+         }
+      }
+   }
+
+   free(buf);
+   if (out)
+      filestream_close(out);
+   if (in)
+      filestream_close(in);
+
+   remove(ret ? src : dst);
+   return ret;
+}
+
 /* expects http_transfer_t*, menu_file_transfer_t* */
 static void cb_generic_download(void *task_data,
       void *user_data, const char *err)
@@ -1681,7 +1724,7 @@ static void cb_generic_download(void *task_data,
    settings_t              *settings     = config_get_ptr();
    http_transfer_data_t        *data     = (http_transfer_data_t*)task_data;
 
-   if (!data || !data->data | !transf)
+   if (!data || (!data->data && !data->path) || !transf)
       goto finish;
 
    /* we have to determine dir_path at the time of writting or else
@@ -1773,7 +1816,15 @@ static void cb_generic_download(void *task_data,
    }
 #endif
 
-   if (!filestream_write_file(output_path, data->data, data->len))
+   if (data->path)
+   {
+      if (!download_move_file(data->path, output_path))
+      {
+         err = "Write failed.";
+         goto finish;
+      }
+   }
+   else if (!filestream_write_file(output_path, data->data, data->len))
    {
       err = "Write failed.";
       goto finish;
@@ -1812,6 +1863,12 @@ finish:
 
    if (data)
    {
+      if (data->path)
+      {
+         /* Only left behind if it couldn't be moved. */
+         remove(data->path);
+         free(data->path);
+      }
       if (data->data)
          free(data->data);
       free(data);
@@ -1894,6 +1951,25 @@ static int action_ok_download_generic(const char *path,
    transf->enum_idx = enum_idx;
    strlcpy(transf->path, path, sizeof(transf->path));
 
+   /* Stream the download through the cache directory rather
+    * than holding it in memory; the destination is only
+    * known once it completes. */
+   if (cb == cb_generic_download && !string_is_empty(settings->directory.cache)
+         && path_is_directory(settings->directory.cache))
+   {
+      char tmp_name[64]                 = {0};
+      char tmp_path[PATH_MAX_LENGTH]    = {0};
+
+      snprintf(tmp_name, sizeof(tmp_name), "download_%08x.tmp",
+            msg_hash_calculate(s3));
+      fill_pathname_join(tmp_path, settings->directory.cache,
+            tmp_name, sizeof(tmp_path));
+
+      if (task_push_http_transfer_file(s3, tmp_path, false,
+               msg_hash_to_str(enum_idx), cb, transf))
+         return 0;
+   }
+
    task_push_http_transfer(s3, false, msg_hash_to_str(enum_idx), cb, transf);
 #endif
    return 0;
@@ -2035,12 +2111,18 @@ static int action_ok_option_create(const char *path,
    if(config_file_write(conf, game_path))
    {
       global_t                 *global  = global_get_ptr();
+      core_option_manager_t    *coreopts = NULL;
 
       runloop_msg_queue_push("Core options file created successfully",
             1, 100, true);
 
       strlcpy(global->path.core_options_path,
             game_path, sizeof(global->path.core_options_path));
+
+      /* Further changes go to the new file, not the global one. */
+      if (runloop_ctl(RUNLOOP_CTL_CORE_OPTIONS_LIST_GET, &coreopts)
+            && coreopts)
+         core_option_manager_set_path(coreopts, game_path);
    }
    config_file_free(conf);
 
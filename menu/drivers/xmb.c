@@ -36,6 +36,7 @@
 #include "../menu_display.h"
 #include "../menu_display.h"
 #include "../menu_navigation.h"
+#include "../menu_thumbnail_cache.h"
 
 #include "../menu_cbs.h"
 
@@ -672,35 +673,82 @@ end:
    string_list_free(list);
 }
 
-static void xmb_update_thumbnail_path(void *data, unsigned i)
+static void xmb_thumbnail_path(xmb_handle_t *xmb, unsigned i,
+      char *s, size_t len)
 {
    menu_entry_t entry;
    char         *tmp    = NULL;
    settings_t *settings = config_get_ptr();
-   xmb_handle_t *xmb    = (xmb_handle_t*)data;
-   if (!xmb)
-      return;
 
    menu_entry_get(&entry, 0, i, NULL, true);
 
-   fill_pathname_join(
-         xmb->thumbnail_file_path,
-         settings->directory.thumbnails,
-         xmb->title_name,
-         sizeof(xmb->thumbnail_file_path));
-   fill_pathname_join(xmb->thumbnail_file_path, xmb->thumbnail_file_path,
-         xmb_thumbnails_ident(), sizeof(xmb->thumbnail_file_path));
+   fill_pathname_join(s, settings->directory.thumbnails,
+         xmb->title_name, len);
+   fill_pathname_join(s, s, xmb_thumbnails_ident(), len);
 
    tmp = string_replace_substring(entry.path, "/", "-");
 
    if (tmp)
    {
-      fill_pathname_join(xmb->thumbnail_file_path, xmb->thumbnail_file_path,
-            tmp, sizeof(xmb->thumbnail_file_path));
+      fill_pathname_join(s, s, tmp, len);
       free(tmp);
    }
 
-   strlcat(xmb->thumbnail_file_path, ".png", sizeof(xmb->thumbnail_file_path));
+   strlcat(s, ".png", len);
+}
+
+static void xmb_update_thumbnail_path(void *data, unsigned i)
+{
+   xmb_handle_t *xmb    = (xmb_handle_t*)data;
+   if (!xmb)
+      return;
+
+   xmb_thumbnail_path(xmb, i, xmb->thumbnail_file_path,
+         sizeof(xmb->thumbnail_file_path));
+}
+
+static void xmb_thumbnail_loaded(void *userdata,
+      uintptr_t texture, unsigned width, unsigned height)
+{
+   xmb_handle_t *xmb = (xmb_handle_t*)userdata;
+
+   xmb->thumbnail    = texture;
+   if (width)
+      xmb->thumbnail_height = xmb->thumbnail_width
+         * (float)height / (float)width;
+}
+
+/* Queues the thumbnails of the entries around the cursor,
+ * nearest first, so that they are ready when scrolled to. */
+static void xmb_prefetch_thumbnails(xmb_handle_t *xmb)
+{
+   unsigned i;
+   size_t selection;
+   char path[PATH_MAX_LENGTH];
+   settings_t *settings = config_get_ptr();
+   size_t end           = menu_entries_get_end();
+
+   if (xmb_list_get_size(xmb, MENU_LIST_PLAIN) != 1)
+      return;
+   if (!menu_navigation_ctl(MENU_NAVIGATION_CTL_GET_SELECTION, &selection))
+      return;
+
+   for (i = 1; i <= settings->menu.thumbnail_prefetch; i++)
+   {
+      if (selection + i < end)
+      {
+         xmb_thumbnail_path(xmb, (unsigned)(selection + i),
+               path, sizeof(path));
+         menu_thumbnail_cache_prefetch(path);
+      }
+
+      if (selection >= i)
+      {
+         xmb_thumbnail_path(xmb, (unsigned)(selection - i),
+               path, sizeof(path));
+         menu_thumbnail_cache_prefetch(path);
+      }
+   }
 }
 
 static void xmb_update_thumbnail_image(void *data)
@@ -709,12 +757,13 @@ static void xmb_update_thumbnail_image(void *data)
    if (!xmb)
       return;
 
-   if (path_file_exists(xmb->thumbnail_file_path))
-      task_push_image_load(xmb->thumbnail_file_path,
-            MENU_ENUM_LABEL_CB_MENU_THUMBNAIL,
-            menu_display_handle_thumbnail_upload, NULL);
-   else if (xmb->depth == 1)
+   menu_thumbnail_cache_set_width((unsigned)xmb->thumbnail_width);
+
+   if (!menu_thumbnail_cache_want(xmb->thumbnail_file_path,
+            xmb_thumbnail_loaded, xmb) && xmb->depth == 1)
       xmb->thumbnail = 0;
+
+   xmb_prefetch_thumbnails(xmb);
 }
 
 static void xmb_selection_pointer_changed(
@@ -2545,6 +2594,8 @@ static void xmb_free(void *data)
       xmb->horizontal_list = NULL;
 
       video_coord_array_free(&xmb->raster_block.carr);
+
+      menu_thumbnail_cache_clear();
    }
 
    font_driver_bind_block(NULL, NULL);
@@ -3022,6 +3073,9 @@ static void xmb_context_destroy(void *data)
    xmb_context_destroy_horizontal_list(xmb);
    xmb_context_bg_destroy(xmb);
 
+   menu_thumbnail_cache_clear();
+   xmb->thumbnail = 0;
+
    menu_display_font_main_deinit();
 }
 
@@ -57,6 +57,10 @@
 #include "../frontend/drivers/platform_linux.h"
 #endif
 
+/* Number of subdirectories listed ahead of time
+ * when browsing a directory. */
+#define MENU_DISPLAYLIST_PREFETCH_DIRS 8
+
 #ifdef HAVE_NETWORKING
 static void print_buf_lines(file_list_t *list, char *buf,
       const char *label, int buf_size,
@@ -3199,6 +3203,31 @@ static int menu_displaylist_parse_generic(
 
    list_size = str_list->size;
 
+   if (!path_is_compressed)
+   {
+      /* Directories are sorted first, so the ones the user is
+       * most likely to enter next are listed in the background. */
+      union string_list_elem_attr attr;
+      struct string_list *subdirs = string_list_new();
+
+      attr.i = 0;
+
+      for (i = 0; subdirs && i < list_size
+            && subdirs->size < MENU_DISPLAYLIST_PREFETCH_DIRS; i++)
+      {
+         if (str_list->elems[i].attr.i != RARCH_DIRECTORY)
+            break;
+         string_list_append(subdirs, str_list->elems[i].data, attr);
+      }
+
+      if (subdirs)
+      {
+         dir_list_prefetch(subdirs,
+               filter_ext ? info->exts : NULL, true, true);
+         string_list_free(subdirs);
+      }
+   }
+
    if (list_size == 0)
    {
       if (!(info->flags & SL_FLAG_ALLOW_EMPTY_LIST))
@@ -4134,6 +4163,9 @@ bool menu_displaylist_ctl(enum menu_displaylist_ctl_state type, void *data)
          menu_displaylist_parse_settings_enum(menu, info,
                MENU_ENUM_LABEL_VIDEO_FRAME_DELAY,
                PARSE_ONLY_UINT, false);
+         menu_displaylist_parse_settings_enum(menu, info,
+               MENU_ENUM_LABEL_VIDEO_FRAME_DELAY_AUTO,
+               PARSE_ONLY_BOOL, false);
          menu_displaylist_parse_settings_enum(menu, info,
                MENU_ENUM_LABEL_VIDEO_BLACK_FRAME_INSERTION,
                PARSE_ONLY_BOOL, false);
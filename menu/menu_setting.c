@@ -5329,6 +5329,23 @@ static bool setting_append_list(
          settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
          menu_settings_list_current_add_enum_idx(list, list_info, MENU_ENUM_LABEL_VIDEO_FRAME_DELAY);
 
+         CONFIG_BOOL(
+               list, list_info,
+               &settings->video.frame_delay_auto,
+               msg_hash_to_str(MENU_ENUM_LABEL_VIDEO_FRAME_DELAY_AUTO),
+               msg_hash_to_str(MENU_ENUM_LABEL_VALUE_VIDEO_FRAME_DELAY_AUTO),
+               frame_delay_auto,
+               msg_hash_to_str(MENU_ENUM_LABEL_VALUE_OFF),
+               msg_hash_to_str(MENU_ENUM_LABEL_VALUE_ON),
+               &group_info,
+               &subgroup_info,
+               parent_group,
+               general_write_handler,
+               general_read_handler,
+               SD_FLAG_ADVANCED
+               );
+         menu_settings_list_current_add_enum_idx(list, list_info, MENU_ENUM_LABEL_VIDEO_FRAME_DELAY_AUTO);
+
 #if !defined(RARCH_MOBILE)
          CONFIG_BOOL(
                list, list_info,
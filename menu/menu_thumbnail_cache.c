@@ -0,0 +1,446 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <compat/strl.h>
+#include <file/file_path.h>
+#include <formats/image.h>
+#include <retro_miscellaneous.h>
+#include <retro_stat.h>
+#include <rhash.h>
+
+#include "menu_thumbnail_cache.h"
+
+#include "../configuration.h"
+#include "../gfx/video_driver.h"
+#include "../tasks/tasks_internal.h"
+#include "../verbosity.h"
+
+/* Decodes running at once. Few, so that a thumbnail wanted after
+ * fast scrolling doesn't wait behind a long queue. */
+#define THUMBNAIL_MAX_LOADING    2
+#define THUMBNAIL_MAX_PREFETCH   64
+#define THUMBNAIL_MIN_ENTRIES    2
+
+typedef struct thumbnail_entry
+{
+   char *path;
+   uint32_t hash;
+   uintptr_t texture;
+   unsigned width;
+   unsigned height;
+   uint64_t used;
+   /* No usable image at this path, remembered so it's not
+    * tried again while scrolling. */
+   bool missing;
+   /* Loaded ahead of time, counted once it's first wanted. */
+   bool prefetched;
+} thumbnail_entry_t;
+
+typedef struct thumbnail_request
+{
+   char path[PATH_MAX_LENGTH];
+   unsigned generation;
+   bool prefetch;
+} thumbnail_request_t;
+
+typedef struct thumbnail_cache
+{
+   thumbnail_entry_t *entries;
+   unsigned num_entries;
+   unsigned cap_entries;
+   uint64_t tick;
+   unsigned width;
+
+   /* Bumped on every clear, so that loads finishing
+    * afterwards are thrown away. */
+   unsigned generation;
+
+   char loading[THUMBNAIL_MAX_LOADING][PATH_MAX_LENGTH];
+   unsigned num_loading;
+
+   char wanted[PATH_MAX_LENGTH];
+   menu_thumbnail_cb_t cb;
+   void *userdata;
+   uintptr_t shown;
+
+   char *prefetch[THUMBNAIL_MAX_PREFETCH];
+   unsigned num_prefetch;
+   unsigned next_prefetch;
+
+   menu_thumbnail_cache_stats_t stats;
+} thumbnail_cache_t;
+
+static thumbnail_cache_t thumbnail_cache;
+
+static thumbnail_entry_t *thumbnail_cache_find(const char *path)
+{
+   unsigned i;
+   uint32_t hash = djb2_calculate(path);
+
+   for (i = 0; i < thumbnail_cache.num_entries; i++)
+   {
+      thumbnail_entry_t *entry = &thumbnail_cache.entries[i];
+
+      if (entry->hash == hash && !strcmp(entry->path, path))
+         return entry;
+   }
+
+   return NULL;
+}
+
+static bool thumbnail_cache_is_loading(const char *path)
+{
+   unsigned i;
+
+   for (i = 0; i < thumbnail_cache.num_loading; i++)
+      if (!strcmp(thumbnail_cache.loading[i], path))
+         return true;
+
+   return false;
+}
+
+static void thumbnail_cache_entry_free(thumbnail_entry_t *entry)
+{
+   if (entry->texture)
+      video_driver_texture_unload(&entry->texture);
+   free(entry->path);
+}
+
+/* Makes room for one more entry. The texture on screen is never
+ * evicted, the caller still draws it. */
+static void thumbnail_cache_evict(void)
+{
+   unsigned i;
+   unsigned capacity        = THUMBNAIL_MIN_ENTRIES;
+   thumbnail_entry_t *least = NULL;
+   settings_t *settings     = config_get_ptr();
+
+   if (settings && settings->menu.thumbnail_cache_size > capacity)
+      capacity = settings->menu.thumbnail_cache_size;
+
+   if (thumbnail_cache.num_entries < capacity)
+      return;
+
+   for (i = 0; i < thumbnail_cache.num_entries; i++)
+   {
+      thumbnail_entry_t *entry = &thumbnail_cache.entries[i];
+
+      if (entry->texture && entry->texture == thumbnail_cache.shown)
+         continue;
+
+      if (!least || entry->used < least->used)
+         least = entry;
+   }
+
+   if (!least)
+      return;
+
+   if (!least->missing)
+      thumbnail_cache.stats.evictions++;
+
+   thumbnail_cache_entry_free(least);
+   *least = thumbnail_cache.entries[--thumbnail_cache.num_entries];
+}
+
+static thumbnail_entry_t *thumbnail_cache_insert(const char *path)
+{
+   thumbnail_entry_t *entry = NULL;
+
+   thumbnail_cache_evict();
+
+   if (thumbnail_cache.num_entries == thumbnail_cache.cap_entries)
+   {
+      unsigned cap = thumbnail_cache.cap_entries
+         ? thumbnail_cache.cap_entries * 2 : 16;
+      thumbnail_entry_t *entries = (thumbnail_entry_t*)realloc(
+            thumbnail_cache.entries, cap * sizeof(*entries));
+
+      if (!entries)
+         return NULL;
+
+      thumbnail_cache.entries     = entries;
+      thumbnail_cache.cap_entries = cap;
+   }
+
+   entry = &thumbnail_cache.entries[thumbnail_cache.num_entries];
+   memset(entry, 0, sizeof(*entry));
+
+   entry->path = strdup(path);
+   if (!entry->path)
+      return NULL;
+
+   entry->hash = djb2_calculate(path);
+   entry->used = ++thumbnail_cache.tick;
+   thumbnail_cache.num_entries++;
+
+   return entry;
+}
+
+static void thumbnail_cache_show(thumbnail_entry_t *entry)
+{
+   menu_thumbnail_cb_t cb = thumbnail_cache.cb;
+
+   entry->used            = ++thumbnail_cache.tick;
+   thumbnail_cache.shown  = entry->texture;
+   thumbnail_cache.cb     = NULL;
+   *thumbnail_cache.wanted = '\0';
+
+   if (cb)
+      cb(thumbnail_cache.userdata,
+            entry->missing ? 0 : entry->texture,
+            entry->width, entry->height);
+}
+
+static void thumbnail_cache_load_cb(void *task_data,
+      void *user_data, const char *err);
+
+static bool thumbnail_cache_load(const char *path, bool prefetch)
+{
+   char cache_dir[PATH_MAX_LENGTH];
+   thumbnail_request_t *request = NULL;
+   settings_t *settings         = config_get_ptr();
+
+   *cache_dir = '\0';
+
+   if (settings && settings->menu.thumbnail_disk_cache
+         && *settings->directory.cache)
+      fill_pathname_join(cache_dir, settings->directory.cache,
+            "thumbnails", sizeof(cache_dir));
+
+   request = (thumbnail_request_t*)calloc(1, sizeof(*request));
+   if (!request)
+      return false;
+
+   strlcpy(request->path, path, sizeof(request->path));
+   request->generation = thumbnail_cache.generation;
+   request->prefetch   = prefetch;
+
+   if (!task_push_image_thumbnail(path, cache_dir, thumbnail_cache.width,
+            thumbnail_cache_load_cb, request))
+   {
+      free(request);
+      return false;
+   }
+
+   strlcpy(thumbnail_cache.loading[thumbnail_cache.num_loading++],
+         path, sizeof(thumbnail_cache.loading[0]));
+
+   return true;
+}
+
+/* Starts loads while there are free slots, the wanted
+ * thumbnail first, then the prefetch list in order. */
+static void thumbnail_cache_pump(void)
+{
+   if (thumbnail_cache.num_loading == THUMBNAIL_MAX_LOADING)
+      return;
+
+   if (*thumbnail_cache.wanted
+         && !thumbnail_cache_is_loading(thumbnail_cache.wanted)
+         && !thumbnail_cache_load(thumbnail_cache.wanted, false))
+      return;
+
+   while (thumbnail_cache.num_loading < THUMBNAIL_MAX_LOADING
+         && thumbnail_cache.next_prefetch < thumbnail_cache.num_prefetch)
+   {
+      const char *path = thumbnail_cache.prefetch[
+         thumbnail_cache.next_prefetch++];
+
+      if (thumbnail_cache_find(path) || thumbnail_cache_is_loading(path))
+         continue;
+
+      if (!thumbnail_cache_load(path, true))
+         break;
+   }
+}
+
+static void thumbnail_cache_load_cb(void *task_data,
+      void *user_data, const char *err)
+{
+   unsigned i;
+   thumbnail_entry_t *entry     = NULL;
+   image_thumbnail_t *thumbnail = (image_thumbnail_t*)task_data;
+   thumbnail_request_t *request = (thumbnail_request_t*)user_data;
+
+   if (request->generation != thumbnail_cache.generation)
+      goto end;
+
+   for (i = 0; i < thumbnail_cache.num_loading; i++)
+   {
+      if (!strcmp(thumbnail_cache.loading[i], request->path))
+      {
+         memmove(thumbnail_cache.loading[i], thumbnail_cache.loading[i + 1],
+               (thumbnail_cache.num_loading - i - 1)
+               * sizeof(thumbnail_cache.loading[0]));
+         thumbnail_cache.num_loading--;
+         break;
+      }
+   }
+
+   entry = thumbnail_cache_insert(request->path);
+   if (!entry)
+      goto pump;
+
+   if (thumbnail && thumbnail->image.pixels)
+   {
+      if (thumbnail->from_cache)
+         thumbnail_cache.stats.disk_hits++;
+      else
+         thumbnail_cache.stats.decodes++;
+
+      entry->width      = thumbnail->image.width;
+      entry->height     = thumbnail->image.height;
+      entry->prefetched = request->prefetch;
+      video_driver_texture_load(&thumbnail->image,
+            TEXTURE_FILTER_MIPMAP_LINEAR, &entry->texture);
+   }
+   else
+      entry->missing = true;
+
+   if (!strcmp(thumbnail_cache.wanted, request->path))
+   {
+      entry->prefetched = false;
+      thumbnail_cache_show(entry);
+   }
+
+pump:
+   thumbnail_cache_pump();
+
+end:
+   if (thumbnail)
+   {
+      image_texture_free(&thumbnail->image);
+      free(thumbnail);
+   }
+   free(request);
+}
+
+static void thumbnail_cache_prefetch_clear(void)
+{
+   unsigned i;
+
+   for (i = 0; i < thumbnail_cache.num_prefetch; i++)
+      free(thumbnail_cache.prefetch[i]);
+
+   thumbnail_cache.num_prefetch  = 0;
+   thumbnail_cache.next_prefetch = 0;
+}
+
+void menu_thumbnail_cache_set_width(unsigned width)
+{
+   if (width == thumbnail_cache.width)
+      return;
+
+   menu_thumbnail_cache_clear();
+   thumbnail_cache.width = width;
+}
+
+bool menu_thumbnail_cache_want(const char *path,
+      menu_thumbnail_cb_t cb, void *userdata)
+{
+   thumbnail_entry_t *entry = NULL;
+
+   thumbnail_cache_prefetch_clear();
+
+   thumbnail_cache.cb       = cb;
+   thumbnail_cache.userdata = userdata;
+   thumbnail_cache.stats.requests++;
+
+   entry = thumbnail_cache_find(path);
+
+   if (entry)
+   {
+      thumbnail_cache.stats.hits++;
+      if (entry->prefetched)
+         thumbnail_cache.stats.prefetch_hits++;
+      entry->prefetched = false;
+
+      if (entry->missing)
+      {
+         thumbnail_cache.cb      = NULL;
+         *thumbnail_cache.wanted = '\0';
+         return false;
+      }
+
+      thumbnail_cache_show(entry);
+      return true;
+   }
+
+   if (!path_file_exists(path))
+   {
+      thumbnail_cache.cb      = NULL;
+      *thumbnail_cache.wanted = '\0';
+      return false;
+   }
+
+   strlcpy(thumbnail_cache.wanted, path, sizeof(thumbnail_cache.wanted));
+   thumbnail_cache_pump();
+
+   return true;
+}
+
+void menu_thumbnail_cache_prefetch(const char *path)
+{
+   char *copy = NULL;
+
+   if (thumbnail_cache.num_prefetch == THUMBNAIL_MAX_PREFETCH)
+      return;
+
+   if (!(copy = strdup(path)))
+      return;
+
+   thumbnail_cache.prefetch[thumbnail_cache.num_prefetch++] = copy;
+   thumbnail_cache_pump();
+}
+
+void menu_thumbnail_cache_clear(void)
+{
+   unsigned i;
+   menu_thumbnail_cache_stats_t *stats = &thumbnail_cache.stats;
+
+   if (stats->requests)
+      RARCH_LOG("[thumbnails] %u requests, %u%% hits (%u prefetched), "
+            "%u decoded, %u from disk, %u evicted.\n",
+            stats->requests, stats->hits * 100 / stats->requests,
+            stats->prefetch_hits, stats->decodes, stats->disk_hits,
+            stats->evictions);
+
+   for (i = 0; i < thumbnail_cache.num_entries; i++)
+      thumbnail_cache_entry_free(&thumbnail_cache.entries[i]);
+
+   free(thumbnail_cache.entries);
+   thumbnail_cache_prefetch_clear();
+
+   thumbnail_cache.entries     = NULL;
+   thumbnail_cache.num_entries = 0;
+   thumbnail_cache.cap_entries = 0;
+   thumbnail_cache.num_loading = 0;
+   thumbnail_cache.cb          = NULL;
+   thumbnail_cache.userdata    = NULL;
+   thumbnail_cache.shown       = 0;
+   *thumbnail_cache.wanted     = '\0';
+   thumbnail_cache.generation++;
+
+   memset(stats, 0, sizeof(*stats));
+}
+
+void menu_thumbnail_cache_get_stats(menu_thumbnail_cache_stats_t *stats)
+{
+   if (stats)
+      *stats = thumbnail_cache.stats;
+}
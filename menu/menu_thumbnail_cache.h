@@ -0,0 +1,91 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __MENU_THUMBNAIL_CACHE_H__
+#define __MENU_THUMBNAIL_CACHE_H__
+
+#include <stdint.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Thumbnail textures of the entries around the cursor.
+ *
+ * Thumbnails are decoded and downscaled to the size they are shown
+ * at on the task thread, then uploaded on the main thread and kept
+ * in a least recently used cache of textures
+ * (menu_thumbnail_cache_size). With menu_thumbnail_disk_cache the
+ * downscaled pixels are also kept in the cache directory, so a
+ * playlist scrolled through before doesn't need decoding again.
+ *
+ * Everything here must be called from the main thread. */
+
+typedef void (*menu_thumbnail_cb_t)(void *userdata,
+      uintptr_t texture, unsigned width, unsigned height);
+
+typedef struct menu_thumbnail_cache_stats
+{
+   unsigned requests;
+   unsigned hits;
+   unsigned prefetch_hits;
+   unsigned disk_hits;
+   unsigned decodes;
+   unsigned evictions;
+} menu_thumbnail_cache_stats_t;
+
+/**
+ * menu_thumbnail_cache_set_width:
+ * @width                : width thumbnails are shown at
+ *
+ * Thumbnails wider than @width are downscaled. Changing it
+ * flushes the cache.
+ **/
+void menu_thumbnail_cache_set_width(unsigned width);
+
+/**
+ * menu_thumbnail_cache_want:
+ * @path                 : thumbnail to show
+ * @cb                   : gets the texture
+ * @userdata             : passed to @cb
+ *
+ * Calls @cb right away if @path is cached, once it's loaded
+ * otherwise. The texture stays valid until the next texture is
+ * handed out or the cache is cleared. Replaces the previous
+ * request and the prefetch list.
+ *
+ * Returns: false if @path doesn't exist, @cb won't be called.
+ **/
+bool menu_thumbnail_cache_want(const char *path,
+      menu_thumbnail_cb_t cb, void *userdata);
+
+/**
+ * menu_thumbnail_cache_prefetch:
+ * @path                 : thumbnail likely to be wanted soon
+ *
+ * Queues @path to be loaded after the wanted thumbnail and the
+ * ones queued before it.
+ **/
+void menu_thumbnail_cache_prefetch(const char *path);
+
+/* Unloads every texture and drops the pending requests. */
+void menu_thumbnail_cache_clear(void);
+
+void menu_thumbnail_cache_get_stats(menu_thumbnail_cache_stats_t *stats);
+
+RETRO_END_DECLS
+
+#endif
@@ -190,6 +190,7 @@ enum msg_hash_enums
    MSG_MOVIE_PLAYBACK_ENDED,
    MSG_TAKING_SCREENSHOT,
    MSG_FAILED_TO_TAKE_SCREENSHOT,
+   MSG_SCREENSHOT_SAVED,
    MSG_CUSTOM_TIMING_GIVEN,
    MSG_SAVING_STATE,
    MSG_LOADING_STATE,
@@ -364,6 +365,7 @@ enum msg_hash_enums
    MENU_ENUM_LABEL_VIDEO_BLACK_FRAME_INSERTION,
    MENU_ENUM_LABEL_VIDEO_HARD_SYNC_FRAMES,
    MENU_ENUM_LABEL_VIDEO_FRAME_DELAY,
+   MENU_ENUM_LABEL_VIDEO_FRAME_DELAY_AUTO,
    MENU_ENUM_LABEL_VIDEO_THREADED,
    MENU_ENUM_LABEL_VIDEO_VSYNC,
    MENU_ENUM_LABEL_VIDEO_HARD_SYNC,
@@ -398,6 +400,7 @@ enum msg_hash_enums
    MENU_ENUM_LABEL_VALUE_VIDEO_BLACK_FRAME_INSERTION,
    MENU_ENUM_LABEL_VALUE_VIDEO_HARD_SYNC_FRAMES,
    MENU_ENUM_LABEL_VALUE_VIDEO_FRAME_DELAY,
+   MENU_ENUM_LABEL_VALUE_VIDEO_FRAME_DELAY_AUTO,
    MENU_ENUM_LABEL_VALUE_VIDEO_ROTATION,
    MENU_ENUM_LABEL_VALUE_VIDEO_THREADED,
    MENU_ENUM_LABEL_VALUE_VIDEO_VSYNC,
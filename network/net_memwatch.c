@@ -0,0 +1,882 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <net/net_compat.h>
+#include <features/features_cpu.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "net_memwatch.h"
+
+#include "../core.h"
+#include "../runloop.h"
+#include "../system.h"
+#include "../verbosity.h"
+
+#ifdef HAVE_CHEEVOS
+#include "../cheevos.h"
+#endif
+
+#define MEMWATCH_MAX_CLIENTS     8
+#define MEMWATCH_MAX_RANGES      256
+#define MEMWATCH_MAX_BYTES       (64 * 1024)
+
+/* Keeps datagrams below the usual MTU. */
+#define MEMWATCH_DATAGRAM_SIZE   1400
+#define MEMWATCH_HEADER_SIZE     10
+#define MEMWATCH_VARINT_MAX      5
+
+/* Unchanged bytes between two changes that are sent anyway,
+ * starting a new run costs about as much. */
+#define MEMWATCH_MERGE_GAP       2
+
+#define MEMWATCH_DEFAULT_RATE    (1024 * 1024)
+/* Clients that don't send a command for this long are dropped. */
+#define MEMWATCH_TIMEOUT_USEC    (60 * 1000000)
+
+typedef struct memwatch_range
+{
+   enum net_memwatch_space space;
+   unsigned bank;
+   unsigned offset;
+   unsigned size;
+} memwatch_range_t;
+
+typedef struct memwatch_client
+{
+   struct sockaddr_storage addr;
+   socklen_t addr_len;
+   retro_time_t last_seen;
+
+   memwatch_range_t *ranges;
+   unsigned num_ranges;
+   size_t size;
+
+   unsigned interval;
+   unsigned countdown;
+   unsigned rate;
+
+   /* Filled on the main thread, handed to the worker. */
+   uint8_t *snap;
+   uint32_t snap_frame;
+   bool pending;
+   bool resync;
+   /* The worker is encoding, buffers must not change. */
+   bool busy;
+
+   /* Only touched by the worker. */
+   uint8_t *work;
+   uint8_t *shadow;
+   bool shadow_valid;
+   uint16_t seq;
+   retro_time_t rate_time;
+   int64_t tokens;
+
+   uint8_t *datagrams;
+   size_t *datagram_sizes;
+   unsigned datagrams_cap;
+
+   uint64_t updates_sent;
+   uint64_t updates_held;
+   uint64_t bytes_sent;
+} memwatch_client_t;
+
+struct net_memwatch
+{
+   int fd;
+   uint32_t frame;
+
+   memwatch_client_t *clients[MEMWATCH_MAX_CLIENTS];
+   unsigned num_clients;
+   unsigned next_client;
+
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *work_cond;
+   scond_t *idle_cond;
+   sthread_t *thread;
+   bool stop;
+#endif
+};
+
+static void memwatch_lock(net_memwatch_t *watch)
+{
+#ifdef HAVE_THREADS
+   slock_lock(watch->lock);
+#endif
+}
+
+static void memwatch_unlock(net_memwatch_t *watch)
+{
+#ifdef HAVE_THREADS
+   slock_unlock(watch->lock);
+#endif
+}
+
+/* Must be called with the lock held. Returns with the
+ * client's buffers free to change. */
+static void memwatch_wait_idle(net_memwatch_t *watch,
+      memwatch_client_t *client)
+{
+#ifdef HAVE_THREADS
+   while (client->busy)
+      scond_wait(watch->idle_cond, watch->lock);
+#endif
+}
+
+/**
+ * memwatch_resolve:
+ * @range                : watched range
+ *
+ * Looks up the range in the core's memory. Done every time the
+ * range is read, cores may move their memory around.
+ *
+ * Returns: pointer to the first byte of the range, NULL if it's
+ * not mapped or only partially.
+ **/
+static const uint8_t *memwatch_resolve(const memwatch_range_t *range)
+{
+   rarch_system_info_t *system = NULL;
+
+   runloop_ctl(RUNLOOP_CTL_SYSTEM_INFO_GET, &system);
+
+   if (range->space == NET_MEMWATCH_SPACE_DESCRIPTOR)
+   {
+      const struct retro_memory_descriptor *desc = NULL;
+
+      if (!system || range->bank >= system->mmaps.num_descriptors)
+         return NULL;
+
+      desc = &system->mmaps.descriptors[range->bank];
+
+      if (!desc->ptr || (size_t)range->offset + range->size > desc->len)
+         return NULL;
+
+      return (const uint8_t*)desc->ptr + desc->offset + range->offset;
+   }
+
+#ifdef HAVE_CHEEVOS
+   {
+      cheevos_var_t var;
+      size_t bank_size      = 0;
+      const uint8_t *memory = NULL;
+
+      cheevos_parse_guest_addr(&var, range->offset);
+      memory = cheevos_get_memory(&var);
+
+      if (!memory)
+         return NULL;
+
+      if (system && system->mmaps.num_descriptors)
+      {
+         const struct retro_memory_descriptor *desc =
+            &system->mmaps.descriptors[var.bank_id];
+         bank_size = desc->offset + desc->len;
+      }
+      else
+      {
+         /* Same banks, in the same order, as the achievements. */
+         static const unsigned ids[] = {
+            RETRO_MEMORY_SYSTEM_RAM,
+            RETRO_MEMORY_SAVE_RAM,
+            RETRO_MEMORY_VIDEO_RAM,
+            RETRO_MEMORY_RTC
+         };
+         retro_ctx_memory_info_t info;
+
+         if ((unsigned)var.bank_id >= sizeof(ids) / sizeof(ids[0]))
+            return NULL;
+
+         info.id   = ids[var.bank_id];
+         info.data = NULL;
+         info.size = 0;
+         core_get_memory(&info);
+         bank_size = info.size;
+      }
+
+      if ((size_t)var.value + range->size > bank_size)
+         return NULL;
+
+      return memory;
+   }
+#else
+   return NULL;
+#endif
+}
+
+static size_t memwatch_put_varint(uint8_t *out, size_t value)
+{
+   size_t len = 0;
+
+   while (value >= 0x80)
+   {
+      out[len++] = (uint8_t)(value | 0x80);
+      value    >>= 7;
+   }
+
+   out[len++] = (uint8_t)value;
+   return len;
+}
+
+static void memwatch_put_u16(uint8_t *out, uint16_t value)
+{
+   out[0] = (uint8_t)value;
+   out[1] = (uint8_t)(value >> 8);
+}
+
+static void memwatch_put_u32(uint8_t *out, uint32_t value)
+{
+   memwatch_put_u16(out, (uint16_t)value);
+   memwatch_put_u16(out + 2, (uint16_t)(value >> 16));
+}
+
+typedef struct memwatch_encoder
+{
+   memwatch_client_t *client;
+   unsigned count;
+   uint8_t *datagram;
+   size_t size;
+   /* Watch buffer offset the current datagram's runs got to. */
+   size_t cursor;
+   size_t total;
+} memwatch_encoder_t;
+
+static bool memwatch_encoder_next(memwatch_encoder_t *enc)
+{
+   memwatch_client_t *client = enc->client;
+
+   if (enc->datagram)
+   {
+      client->datagram_sizes[enc->count - 1] = enc->size;
+      enc->total += enc->size;
+   }
+
+   if (enc->count == client->datagrams_cap)
+   {
+      unsigned cap    = client->datagrams_cap ? client->datagrams_cap * 2 : 8;
+      uint8_t *data   = (uint8_t*)realloc(client->datagrams,
+            cap * MEMWATCH_DATAGRAM_SIZE);
+      size_t *sizes   = NULL;
+
+      if (!data)
+         return false;
+      client->datagrams = data;
+
+      sizes = (size_t*)realloc(client->datagram_sizes, cap * sizeof(*sizes));
+      if (!sizes)
+         return false;
+      client->datagram_sizes = sizes;
+
+      client->datagrams_cap  = cap;
+   }
+
+   enc->datagram = client->datagrams + enc->count * MEMWATCH_DATAGRAM_SIZE;
+   enc->size     = MEMWATCH_HEADER_SIZE;
+   enc->cursor   = 0;
+   enc->count++;
+   return true;
+}
+
+static bool memwatch_encode_run(memwatch_encoder_t *enc,
+      const uint8_t *data, size_t start, size_t end)
+{
+   while (start < end)
+   {
+      size_t len;
+      size_t room = MEMWATCH_DATAGRAM_SIZE - enc->size;
+
+      if (!enc->datagram || room <= 2 * MEMWATCH_VARINT_MAX)
+      {
+         if (!memwatch_encoder_next(enc))
+            return false;
+         continue;
+      }
+
+      len = end - start;
+      if (len > room - 2 * MEMWATCH_VARINT_MAX)
+         len = room - 2 * MEMWATCH_VARINT_MAX;
+
+      enc->size += memwatch_put_varint(enc->datagram + enc->size,
+            start - enc->cursor);
+      enc->size += memwatch_put_varint(enc->datagram + enc->size, len);
+      memcpy(enc->datagram + enc->size, data + start, len);
+      enc->size   += len;
+      enc->cursor  = start + len;
+      start       += len;
+   }
+
+   return true;
+}
+
+/* Encodes the bytes of @work that differ from @shadow, or all of
+ * them when @shadow is NULL. Returns false if out of memory. */
+static bool memwatch_encode(memwatch_encoder_t *enc,
+      const uint8_t *work, const uint8_t *shadow, size_t size)
+{
+   size_t pos = 0;
+
+   if (!shadow)
+      return memwatch_encode_run(enc, work, 0, size);
+
+   while (pos < size)
+   {
+      size_t end;
+
+      while (pos + 8 <= size && !memcmp(work + pos, shadow + pos, 8))
+         pos += 8;
+      while (pos < size && work[pos] == shadow[pos])
+         pos++;
+
+      if (pos == size)
+         break;
+
+      end = pos;
+      for (;;)
+      {
+         size_t gap;
+
+         while (end < size && work[end] != shadow[end])
+            end++;
+
+         gap = end;
+         while (gap < size && gap - end < MEMWATCH_MERGE_GAP
+               && work[gap] == shadow[gap])
+            gap++;
+
+         if (gap < size && work[gap] != shadow[gap])
+         {
+            end = gap;
+            continue;
+         }
+
+         break;
+      }
+
+      if (!memwatch_encode_run(enc, work, pos, end))
+         return false;
+
+      pos = end;
+   }
+
+   return true;
+}
+
+/* Diffs, encodes and sends the client's latest snapshot.
+ * Returns false if the update was held back. */
+static bool memwatch_client_update(net_memwatch_t *watch,
+      memwatch_client_t *client, uint32_t frame, bool full)
+{
+   unsigned i;
+   memwatch_encoder_t enc = {0};
+   uint8_t flags          = full ? NET_MEMWATCH_FLAG_FULL : 0;
+
+   enc.client = client;
+
+   if (!memwatch_encode(&enc, client->work,
+            full ? NULL : client->shadow, client->size)
+         || !enc.datagram)
+      goto end;
+
+   client->datagram_sizes[enc.count - 1] = enc.size;
+   enc.total += enc.size;
+
+   if (client->rate)
+   {
+      retro_time_t now = cpu_features_get_time_usec();
+
+      client->tokens   += (now - client->rate_time) * client->rate / 1000000;
+      client->rate_time = now;
+      if (client->tokens > (int64_t)client->rate)
+         client->tokens = client->rate;
+
+      /* Hold the update back; the changes are sent with a later one.
+       * Updates larger than a second's worth go out once the
+       * budget is full. */
+      if ((int64_t)enc.total > client->tokens
+            && client->tokens < (int64_t)client->rate)
+      {
+         client->updates_held++;
+         return false;
+      }
+
+      client->tokens -= enc.total;
+   }
+
+   for (i = 0; i < enc.count; i++)
+   {
+      uint8_t *datagram = client->datagrams + i * MEMWATCH_DATAGRAM_SIZE;
+
+      datagram[0] = 'M';
+      datagram[1] = 'W';
+      datagram[2] = NET_MEMWATCH_VERSION;
+      datagram[3] = flags | ((i == enc.count - 1) ? NET_MEMWATCH_FLAG_LAST : 0);
+      memwatch_put_u32(datagram + 4, frame);
+      memwatch_put_u16(datagram + 8, client->seq++);
+
+      sendto(watch->fd, (const char*)datagram, client->datagram_sizes[i], 0,
+            (struct sockaddr*)&client->addr, client->addr_len);
+   }
+
+   client->updates_sent++;
+   client->bytes_sent += enc.total;
+
+end:
+   memcpy(client->shadow, client->work, client->size);
+   client->shadow_valid = true;
+   return true;
+}
+
+#ifdef HAVE_THREADS
+static void memwatch_thread(void *data)
+{
+   net_memwatch_t *watch = (net_memwatch_t*)data;
+
+   slock_lock(watch->lock);
+
+   while (!watch->stop)
+   {
+      unsigned i;
+      uint8_t *tmp;
+      bool full, sent;
+      uint32_t frame;
+      memwatch_client_t *client = NULL;
+
+      /* Round robin, so a busy client doesn't starve the others. */
+      for (i = 0; i < watch->num_clients; i++)
+      {
+         unsigned idx = (watch->next_client + i) % watch->num_clients;
+
+         if (watch->clients[idx]->pending)
+         {
+            client             = watch->clients[idx];
+            watch->next_client = idx + 1;
+            break;
+         }
+      }
+
+      if (!client)
+      {
+         scond_wait(watch->work_cond, watch->lock);
+         continue;
+      }
+
+      tmp             = client->work;
+      client->work    = client->snap;
+      client->snap    = tmp;
+      client->pending = false;
+      client->busy    = true;
+      full            = client->resync || !client->shadow_valid;
+      client->resync  = false;
+      frame           = client->snap_frame;
+
+      slock_unlock(watch->lock);
+
+      sent = memwatch_client_update(watch, client, frame, full);
+
+      slock_lock(watch->lock);
+
+      /* A held back resync is still owed. */
+      if (full && !sent)
+         client->resync = true;
+
+      client->busy = false;
+      scond_broadcast(watch->idle_cond);
+   }
+
+   slock_unlock(watch->lock);
+}
+#endif
+
+static memwatch_client_t *memwatch_find(net_memwatch_t *watch,
+      const void *addr, size_t addr_len, bool create)
+{
+   unsigned i;
+   memwatch_client_t *client = NULL;
+
+   if (addr_len > sizeof(client->addr))
+      return NULL;
+
+   for (i = 0; i < watch->num_clients; i++)
+   {
+      client = watch->clients[i];
+
+      if (client->addr_len == addr_len
+            && !memcmp(&client->addr, addr, addr_len))
+      {
+         client->last_seen = cpu_features_get_time_usec();
+         return client;
+      }
+   }
+
+   if (!create || watch->num_clients == MEMWATCH_MAX_CLIENTS)
+      return NULL;
+
+   client = (memwatch_client_t*)calloc(1, sizeof(*client));
+   if (!client)
+      return NULL;
+
+   memcpy(&client->addr, addr, addr_len);
+   client->addr_len  = (socklen_t)addr_len;
+   client->last_seen = cpu_features_get_time_usec();
+   client->interval  = 1;
+   client->countdown = 1;
+   client->rate      = MEMWATCH_DEFAULT_RATE;
+   client->rate_time = client->last_seen;
+   client->tokens    = client->rate;
+
+   memwatch_lock(watch);
+   watch->clients[watch->num_clients++] = client;
+   memwatch_unlock(watch);
+
+   RARCH_LOG("[memwatch] Client %u subscribed.\n", watch->num_clients);
+
+   return client;
+}
+
+static void memwatch_client_free(memwatch_client_t *client)
+{
+   RARCH_LOG("[memwatch] Client unsubscribed after %llu updates "
+         "(%llu held back), %llu bytes.\n",
+         (unsigned long long)client->updates_sent,
+         (unsigned long long)client->updates_held,
+         (unsigned long long)client->bytes_sent);
+
+   free(client->ranges);
+   free(client->snap);
+   free(client->work);
+   free(client->shadow);
+   free(client->datagrams);
+   free(client->datagram_sizes);
+   free(client);
+}
+
+/* Must be called with the lock held. */
+static void memwatch_remove(net_memwatch_t *watch, unsigned idx)
+{
+   memwatch_client_t *client = watch->clients[idx];
+
+   memwatch_wait_idle(watch, client);
+
+   watch->clients[idx] = watch->clients[--watch->num_clients];
+   memwatch_client_free(client);
+}
+
+net_memwatch_t *net_memwatch_new(int fd)
+{
+   net_memwatch_t *watch = (net_memwatch_t*)calloc(1, sizeof(*watch));
+
+   if (!watch)
+      return NULL;
+
+   watch->fd = fd;
+
+#ifdef HAVE_THREADS
+   watch->lock      = slock_new();
+   watch->work_cond = scond_new();
+   watch->idle_cond = scond_new();
+
+   if (!watch->lock || !watch->work_cond || !watch->idle_cond)
+      goto error;
+
+   watch->thread    = sthread_create(memwatch_thread, watch);
+   if (!watch->thread)
+      goto error;
+#endif
+
+   return watch;
+
+#ifdef HAVE_THREADS
+error:
+   net_memwatch_free(watch);
+   return NULL;
+#endif
+}
+
+void net_memwatch_free(net_memwatch_t *watch)
+{
+   unsigned i;
+
+   if (!watch)
+      return;
+
+#ifdef HAVE_THREADS
+   if (watch->thread)
+   {
+      slock_lock(watch->lock);
+      watch->stop = true;
+      scond_signal(watch->work_cond);
+      slock_unlock(watch->lock);
+
+      sthread_join(watch->thread);
+   }
+
+   if (watch->lock)
+      slock_free(watch->lock);
+   if (watch->work_cond)
+      scond_free(watch->work_cond);
+   if (watch->idle_cond)
+      scond_free(watch->idle_cond);
+#endif
+
+   for (i = 0; i < watch->num_clients; i++)
+      memwatch_client_free(watch->clients[i]);
+
+   free(watch);
+}
+
+int net_memwatch_add(net_memwatch_t *watch,
+      const void *addr, size_t addr_len,
+      enum net_memwatch_space space, unsigned bank,
+      unsigned offset, unsigned size)
+{
+   unsigned i;
+   int ret                   = -1;
+   uint8_t *buffers[3]       = {NULL};
+   memwatch_range_t *ranges  = NULL;
+   memwatch_client_t *client = NULL;
+   size_t new_size;
+
+   if (!watch || !size)
+      return -1;
+
+   client = memwatch_find(watch, addr, addr_len, true);
+   if (!client)
+      return -1;
+
+   new_size = client->size + size;
+
+   if (client->num_ranges == MEMWATCH_MAX_RANGES
+         || new_size > MEMWATCH_MAX_BYTES)
+      return -1;
+
+   for (i = 0; i < 3; i++)
+      if (!(buffers[i] = (uint8_t*)calloc(1, new_size)))
+         goto error;
+
+   memwatch_lock(watch);
+   memwatch_wait_idle(watch, client);
+
+   ranges = (memwatch_range_t*)realloc(client->ranges,
+         (client->num_ranges + 1) * sizeof(*ranges));
+   if (!ranges)
+   {
+      memwatch_unlock(watch);
+      goto error;
+   }
+   client->ranges = ranges;
+
+   if (client->size)
+      memcpy(buffers[0], client->snap, client->size);
+
+   free(client->snap);
+   free(client->work);
+   free(client->shadow);
+   client->snap   = buffers[0];
+   client->work   = buffers[1];
+   client->shadow = buffers[2];
+
+   ranges[client->num_ranges].space  = space;
+   ranges[client->num_ranges].bank   = bank;
+   ranges[client->num_ranges].offset = offset;
+   ranges[client->num_ranges].size   = size;
+   client->num_ranges++;
+
+   ret                  = (int)client->size;
+   client->size         = new_size;
+   client->pending      = false;
+   client->shadow_valid = false;
+
+   memwatch_unlock(watch);
+   return ret;
+
+error:
+   for (i = 0; i < 3; i++)
+      free(buffers[i]);
+   return -1;
+}
+
+bool net_memwatch_set_interval(net_memwatch_t *watch,
+      const void *addr, size_t addr_len, unsigned frames)
+{
+   memwatch_client_t *client = NULL;
+
+   if (!watch || !frames)
+      return false;
+
+   client = memwatch_find(watch, addr, addr_len, false);
+   if (!client)
+      return false;
+
+   memwatch_lock(watch);
+   client->interval  = frames;
+   client->countdown = 1;
+   memwatch_unlock(watch);
+
+   return true;
+}
+
+bool net_memwatch_set_rate(net_memwatch_t *watch,
+      const void *addr, size_t addr_len, unsigned bytes_per_sec)
+{
+   memwatch_client_t *client = NULL;
+
+   if (!watch)
+      return false;
+
+   client = memwatch_find(watch, addr, addr_len, false);
+   if (!client)
+      return false;
+
+   memwatch_lock(watch);
+   memwatch_wait_idle(watch, client);
+   client->rate      = bytes_per_sec;
+   client->tokens    = bytes_per_sec;
+   client->rate_time = cpu_features_get_time_usec();
+   memwatch_unlock(watch);
+
+   return true;
+}
+
+bool net_memwatch_sync(net_memwatch_t *watch,
+      const void *addr, size_t addr_len)
+{
+   memwatch_client_t *client = NULL;
+
+   if (!watch)
+      return false;
+
+   client = memwatch_find(watch, addr, addr_len, false);
+   if (!client)
+      return false;
+
+   memwatch_lock(watch);
+   client->resync = true;
+   memwatch_unlock(watch);
+
+   return true;
+}
+
+void net_memwatch_clear(net_memwatch_t *watch,
+      const void *addr, size_t addr_len)
+{
+   unsigned i;
+   memwatch_client_t *client = NULL;
+
+   if (!watch)
+      return;
+
+   client = memwatch_find(watch, addr, addr_len, false);
+   if (!client)
+      return;
+
+   memwatch_lock(watch);
+   for (i = 0; i < watch->num_clients; i++)
+   {
+      if (watch->clients[i] == client)
+      {
+         memwatch_remove(watch, i);
+         break;
+      }
+   }
+   memwatch_unlock(watch);
+}
+
+void net_memwatch_frame(net_memwatch_t *watch)
+{
+   unsigned i;
+   retro_time_t now;
+#ifdef HAVE_THREADS
+   bool work = false;
+#endif
+
+   /* The client list only changes on this thread. */
+   if (!watch || !watch->num_clients)
+      return;
+
+   watch->frame++;
+   now = cpu_features_get_time_usec();
+
+   memwatch_lock(watch);
+
+   for (i = 0; i < watch->num_clients; )
+   {
+      unsigned j;
+      uint8_t *out              = NULL;
+      memwatch_client_t *client = watch->clients[i];
+
+      if (now - client->last_seen > MEMWATCH_TIMEOUT_USEC)
+      {
+         RARCH_LOG("[memwatch] Client timed out.\n");
+         memwatch_remove(watch, i);
+         continue;
+      }
+
+      i++;
+
+      if (!client->size || --client->countdown)
+         continue;
+
+      client->countdown = client->interval;
+
+      /* Copy the watched memory out; the core changes it
+       * during the next frame. */
+      out = client->snap;
+      for (j = 0; j < client->num_ranges; j++)
+      {
+         const memwatch_range_t *range = &client->ranges[j];
+         const uint8_t *memory         = memwatch_resolve(range);
+
+         if (memory)
+            memcpy(out, memory, range->size);
+         else
+            memset(out, 0, range->size);
+
+         out += range->size;
+      }
+
+      client->snap_frame = watch->frame;
+      client->pending    = true;
+
+#ifdef HAVE_THREADS
+      work               = true;
+#else
+      {
+         uint8_t *tmp     = client->work;
+         bool full        = client->resync || !client->shadow_valid;
+
+         client->work     = client->snap;
+         client->snap     = tmp;
+         client->pending  = false;
+         client->resync   = false;
+
+         if (!memwatch_client_update(watch, client,
+                  client->snap_frame, full) && full)
+            client->resync = true;
+      }
+#endif
+   }
+
+#ifdef HAVE_THREADS
+   if (work)
+      scond_signal(watch->work_cond);
+#endif
+
+   memwatch_unlock(watch);
+}
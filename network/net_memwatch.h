@@ -0,0 +1,133 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NET_MEMWATCH_H
+#define __RARCH_NET_MEMWATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+RETRO_BEGIN_DECLS
+
+/* Core memory subscriptions for the network command interface.
+ *
+ * A client registers memory ranges; their bytes are laid out one after
+ * the other, in registration order, into the client's watch buffer.
+ * Every few frames the watched bytes are copied out on the main thread
+ * and compared against what the client was last sent, and only the
+ * changed bytes are sent to the client as UDP datagrams.
+ *
+ * Every datagram starts with a 10 byte header:
+ *
+ *   u8     'M', 'W'
+ *   u8     NET_MEMWATCH_VERSION
+ *   u8     flags (NET_MEMWATCH_FLAG_*)
+ *   u32le  frame
+ *   u16le  datagram sequence number, per client
+ *
+ * followed by runs of changed bytes, up to the end of the datagram:
+ *
+ *   varint skip    bytes left untouched since the end of the previous
+ *                  run (since the start of the watch buffer for the
+ *                  first run of the datagram)
+ *   varint length
+ *   u8     data[length]
+ *
+ * Varints are LEB128: 7 bits per byte, least significant first, the top
+ * bit set on all but the last byte. Frames without changes send nothing.
+ * A client that misses a datagram (sequence gap) should ask for a
+ * resync, which gets it every watched byte again. */
+
+#define NET_MEMWATCH_VERSION     1
+
+/* Every watched byte is sent, the client's copy is replaced. */
+#define NET_MEMWATCH_FLAG_FULL   1
+/* Last datagram of this frame's update. */
+#define NET_MEMWATCH_FLAG_LAST   2
+
+enum net_memwatch_space
+{
+   /* Guest address, mapped like READ_CORE_RAM. */
+   NET_MEMWATCH_SPACE_ADDRESS = 0,
+   /* Offset into a memory map descriptor. */
+   NET_MEMWATCH_SPACE_DESCRIPTOR
+};
+
+typedef struct net_memwatch net_memwatch_t;
+
+/**
+ * net_memwatch_new:
+ * @fd                   : UDP socket to send from, still owned by the caller.
+ *
+ * Returns: new memory watch handle, NULL on error.
+ **/
+net_memwatch_t *net_memwatch_new(int fd);
+
+void net_memwatch_free(net_memwatch_t *watch);
+
+/**
+ * net_memwatch_add:
+ * @watch                : memory watch handle
+ * @addr                 : client address
+ * @addr_len             : size of @addr
+ * @space                : how @bank and @offset are interpreted
+ * @bank                 : memory map descriptor index
+ * @offset               : guest address or offset into the descriptor
+ * @size                 : number of bytes to watch
+ *
+ * Adds a range to the client's subscription, creating the client
+ * if needed. The client gets every watched byte on the next update.
+ *
+ * Returns: offset of the range in the client's watch buffer,
+ * -1 on error.
+ **/
+int net_memwatch_add(net_memwatch_t *watch,
+      const void *addr, size_t addr_len,
+      enum net_memwatch_space space, unsigned bank,
+      unsigned offset, unsigned size);
+
+/* Sends an update every @frames frames (default 1). */
+bool net_memwatch_set_interval(net_memwatch_t *watch,
+      const void *addr, size_t addr_len, unsigned frames);
+
+/* Caps what's sent to the client, 0 means no limit. Updates over the
+ * limit are held back and merged into the next ones. */
+bool net_memwatch_set_rate(net_memwatch_t *watch,
+      const void *addr, size_t addr_len, unsigned bytes_per_sec);
+
+/* Sends every watched byte again on the next update. */
+bool net_memwatch_sync(net_memwatch_t *watch,
+      const void *addr, size_t addr_len);
+
+/* Drops the client's subscription. */
+void net_memwatch_clear(net_memwatch_t *watch,
+      const void *addr, size_t addr_len);
+
+/**
+ * net_memwatch_frame:
+ * @watch                : memory watch handle
+ *
+ * Call once per frame, after the core ran. Copies the watched memory
+ * of the clients due for an update; diffing, encoding and sending is
+ * done by a worker thread.
+ **/
+void net_memwatch_frame(net_memwatch_t *watch);
+
+RETRO_END_DECLS
+
+#endif
@@ -674,7 +674,7 @@ static int init_tcp_connection(const struct addrinfo *res,
    else
    {
       if (  !socket_bind(fd, (void*)res) || 
-            listen(fd, spectate ? MAX_SPECTATORS : 1) < 0)
+            listen(fd, spectate ? SOMAXCONN : 1) < 0)
       {
          ret = false;
          goto end;
@@ -972,6 +972,12 @@ void netplay_free(netplay_t *netplay)
 {
    unsigned i;
 
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+   /* Stop the I/O thread before its listening socket goes away. */
+   if (netplay->spectate.server)
+      netplay_spectate_server_free(netplay->spectate.server);
+#endif
+
    socket_close(netplay->fd);
 
    if (netplay->spectate.enabled)
@@ -986,10 +992,7 @@ void netplay_free(netplay_t *netplay)
    {
       socket_close(netplay->udp_fd);
 
-      for (i = 0; i < netplay->buffer_size; i++)
-         free(netplay->buffer[i].state);
-
-      free(netplay->buffer);
+      netplay_net_free_buffers(netplay);
    }
 
    if (netplay->addr)
@@ -14,21 +14,142 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "netplay_private.h"
+
+#include "../../managers/state_manager.h"
+#include "../../performance_counters.h"
+
+static size_t netplay_net_keyframe_slot(netplay_t *netplay, uint32_t frame)
+{
+   return (frame / NETPLAY_KEYFRAME_INTERVAL) % netplay->keyframes_size;
+}
+
 /**
- * pre_frame:   
+ * netplay_net_save_state:
  * @netplay              : pointer to netplay object
+ * @ptr                  : frame history slot
+ * @frame                : frame number of the slot
  *
- * Pre-frame for Netplay (normal version).
+ * Serializes the current state into the frame history.
  **/
-static void netplay_net_pre_frame(netplay_t *netplay)
+static void netplay_net_save_state(netplay_t *netplay,
+      size_t ptr, uint32_t frame)
+{
+   retro_ctx_serialize_info_t serial_info;
+   static struct retro_perf_counter netplay_serialize = {0};
+   static struct retro_perf_counter netplay_history_size = {0};
+   struct delta_frame *delta = &netplay->buffer[ptr];
+   size_t slot               = netplay_net_keyframe_slot(netplay, frame);
+   uint8_t *keyframe         = netplay->keyframes[slot];
+
+   performance_counter_init(&netplay_serialize, "netplay_serialize");
+   performance_counter_init(&netplay_history_size, "netplay_history_size");
+   performance_counter_start(&netplay_serialize);
+
+   delta->keyframe  = slot;
+   delta->has_state = false;
+
+   if (frame % NETPLAY_KEYFRAME_INTERVAL == 0)
+   {
+      serial_info.data  = keyframe;
+      serial_info.size  = netplay->state_size;
+      delta->has_state  = core_serialize(&serial_info);
+      delta->patch_size = 0;
+   }
+   else
+   {
+      size_t patch_size;
+
+      serial_info.data = netplay->state_scratch;
+      serial_info.size = netplay->state_size;
+
+      if (core_serialize(&serial_info))
+      {
+         patch_size = state_manager_raw_compress(netplay->state_scratch,
+               keyframe, netplay->state_size, netplay->patch_scratch);
+
+         /* On failure the old patch is kept, but the
+          * frame is marked as having no state. */
+         if (patch_size > delta->patch_capacity)
+         {
+            uint8_t *patch = (uint8_t*)realloc(delta->patch, patch_size);
+
+            if (patch)
+            {
+               netplay->stats.history_size +=
+                  patch_size - delta->patch_capacity;
+               delta->patch          = patch;
+               delta->patch_capacity = patch_size;
+            }
+         }
+
+         if (patch_size <= delta->patch_capacity)
+         {
+            memcpy(delta->patch, netplay->patch_scratch, patch_size);
+            delta->patch_size = patch_size;
+            delta->has_state  = true;
+         }
+      }
+
+      if (netplay->stats.history_size > netplay->stats.max_history_size)
+         netplay->stats.max_history_size = netplay->stats.history_size;
+   }
+
+   if (!delta->has_state)
+      RARCH_ERR("Netplay: failed to store state of frame %u.\n",
+            (unsigned)frame);
+
+   performance_counter_stop(&netplay_serialize);
+
+   performance_counter_add_value(&netplay_history_size,
+         netplay->stats.history_size);
+}
+
+/**
+ * netplay_net_load_state:
+ * @netplay              : pointer to netplay object
+ * @ptr                  : frame history slot
+ *
+ * Restores the core to the state stored in the frame history.
+ *
+ * Returns: false if the frame has no state to restore.
+ **/
+static bool netplay_net_load_state(netplay_t *netplay, size_t ptr)
 {
    retro_ctx_serialize_info_t serial_info;
+   const struct delta_frame *delta = &netplay->buffer[ptr];
+   const uint8_t *keyframe         = netplay->keyframes[delta->keyframe];
 
-   serial_info.data = netplay->buffer[netplay->self_ptr].state;
-   serial_info.size = netplay->state_size;
+   if (!delta->has_state)
+      return false;
 
-   core_serialize(&serial_info);
+   serial_info.data       = NULL;
+   serial_info.data_const = keyframe;
+   serial_info.size       = netplay->state_size;
+
+   if (delta->patch_size)
+   {
+      memcpy(netplay->state_scratch, keyframe, netplay->state_size);
+      state_manager_raw_decompress(delta->patch, delta->patch_size,
+            netplay->state_scratch, netplay->state_size);
+      serial_info.data_const = netplay->state_scratch;
+   }
+
+   return core_unserialize(&serial_info);
+}
+
+/**
+ * pre_frame:   
+ * @netplay              : pointer to netplay object
+ *
+ * Pre-frame for Netplay (normal version).
+ **/
+static void netplay_net_pre_frame(netplay_t *netplay)
+{
+   netplay_net_save_state(netplay, netplay->self_ptr, netplay->frame_count);
 
    netplay->can_poll = true;
 
@@ -66,26 +187,38 @@ static void netplay_net_post_frame(netplay_t *netplay)
 
    if (netplay->other_frame_count < netplay->read_frame_count)
    {
-      retro_ctx_serialize_info_t serial_info;
-      bool first = true;
+      static struct retro_perf_counter netplay_replay = {0};
+      static struct retro_perf_counter netplay_replay_depth = {0};
+      uint32_t depth = 0;
+      bool first     = true;
+
+      if (!netplay_net_load_state(netplay, netplay->other_ptr))
+      {
+         RARCH_ERR("Netplay: no state to replay frame %u from, "
+               "the session may desync.\n",
+               (unsigned)netplay->other_frame_count);
+
+         netplay->other_ptr = netplay->read_ptr;
+         netplay->other_frame_count = netplay->read_frame_count;
+         return;
+      }
+
+      performance_counter_init(&netplay_replay, "netplay_replay");
+      performance_counter_init(&netplay_replay_depth, "netplay_replay_depth");
+      performance_counter_start(&netplay_replay);
 
       /* Replay frames. */
       netplay->is_replay = true;
       netplay->tmp_ptr = netplay->other_ptr;
       netplay->tmp_frame_count = netplay->other_frame_count;
 
-      serial_info.data_const = netplay->buffer[netplay->other_ptr].state;
-      serial_info.size       = netplay->state_size;
-
-      core_unserialize(&serial_info);
-
       while (first || (netplay->tmp_ptr != netplay->self_ptr))
       {
-         serial_info.data       = netplay->buffer[netplay->tmp_ptr].state;
-         serial_info.size       = netplay->state_size;
-         serial_info.data_const = NULL;
-
-         core_serialize(&serial_info);
+         /* The first frame's state was just restored
+          * from the history, no need to store it again. */
+         if (!first)
+            netplay_net_save_state(netplay,
+                  netplay->tmp_ptr, netplay->tmp_frame_count);
 
 #if defined(HAVE_THREADS)
          autosave_lock();
@@ -97,13 +230,23 @@ static void netplay_net_post_frame(netplay_t *netplay)
          netplay->tmp_ptr = NEXT_PTR(netplay->tmp_ptr);
          netplay->tmp_frame_count++;
          first = false;
+         depth++;
       }
 
       netplay->other_ptr = netplay->read_ptr;
       netplay->other_frame_count = netplay->read_frame_count;
       netplay->is_replay = false;
+
+      performance_counter_stop(&netplay_replay);
+      performance_counter_add_value(&netplay_replay_depth, depth);
+
+      netplay->stats.replays++;
+      netplay->stats.replayed_frames += depth;
+      if (depth > netplay->stats.max_replay_depth)
+         netplay->stats.max_replay_depth = depth;
    }
 }
+
 static bool netplay_net_init_buffers(netplay_t *netplay)
 {
    unsigned i;
@@ -123,18 +266,86 @@ static bool netplay_net_init_buffers(netplay_t *netplay)
    netplay->state_size = info.size;
 
    for (i = 0; i < netplay->buffer_size; i++)
+      netplay->buffer[i].is_simulated = true;
+
+   /* Enough keyframes that the oldest frame in the
+    * history still has its keyframe around. */
+   netplay->keyframes_size = netplay->buffer_size
+      / NETPLAY_KEYFRAME_INTERVAL + 2;
+   netplay->keyframes      = (uint8_t**)calloc(netplay->keyframes_size,
+         sizeof(*netplay->keyframes));
+
+   if (!netplay->keyframes)
+      return false;
+
+   /* The delta kernels scan past the end of the state,
+    * compared buffers need different end markers. */
+   for (i = 0; i < netplay->keyframes_size; i++)
    {
-      netplay->buffer[i].state = malloc(netplay->state_size);
+      netplay->keyframes[i] = (uint8_t*)state_manager_raw_alloc(
+            netplay->state_size, 0);
 
-      if (!netplay->buffer[i].state)
+      if (!netplay->keyframes[i])
          return false;
-
-      netplay->buffer[i].is_simulated = true;
    }
 
+   netplay->state_scratch = (uint8_t*)state_manager_raw_alloc(
+         netplay->state_size, 0xffff);
+   netplay->patch_scratch = (uint8_t*)malloc(
+         state_manager_raw_maxsize(netplay->state_size));
+
+   if (!netplay->state_scratch || !netplay->patch_scratch)
+      return false;
+
+   netplay->stats.history_size     = netplay->keyframes_size
+      * netplay->state_size;
+   netplay->stats.max_history_size = netplay->stats.history_size;
+
    return true;
 }
 
+/**
+ * netplay_net_free_buffers:
+ * @netplay              : pointer to netplay object
+ *
+ * Frees the frame history and logs its statistics.
+ **/
+void netplay_net_free_buffers(netplay_t *netplay)
+{
+   size_t i;
+
+   if (netplay->stats.replays)
+      RARCH_LOG("Netplay: %u replays, %.1f frames on average, "
+            "%u at most.\n",
+            (unsigned)netplay->stats.replays,
+            (double)netplay->stats.replayed_frames / netplay->stats.replays,
+            (unsigned)netplay->stats.max_replay_depth);
+
+   if (netplay->state_size)
+      RARCH_LOG("Netplay: frame history used up to %u KB "
+            "(%u KB as full states).\n",
+            (unsigned)(netplay->stats.max_history_size / 1024),
+            (unsigned)(netplay->buffer_size * netplay->state_size / 1024));
+
+   if (netplay->buffer)
+      for (i = 0; i < netplay->buffer_size; i++)
+         free(netplay->buffer[i].patch);
+   free(netplay->buffer);
+
+   if (netplay->keyframes)
+      for (i = 0; i < netplay->keyframes_size; i++)
+         free(netplay->keyframes[i]);
+   free(netplay->keyframes);
+
+   free(netplay->state_scratch);
+   free(netplay->patch_scratch);
+
+   netplay->buffer        = NULL;
+   netplay->keyframes     = NULL;
+   netplay->state_scratch = NULL;
+   netplay->patch_scratch = NULL;
+}
+
 static bool netplay_net_info_cb(netplay_t* netplay, unsigned frames)
 {
    if (netplay_is_server(netplay))
@@ -18,6 +18,7 @@
 #define __RARCH_NETPLAY_PRIVATE_H
 
 #include "netplay.h"
+#include "netplay_spectate_server.h"
 
 #include <net/net_compat.h>
 #include <retro_endianness.h>
@@ -41,12 +42,23 @@
 #define MAX_SPECTATORS 16
 #define RARCH_DEFAULT_PORT 55435
 
+/* Every Nth frame of the history keeps a full savestate,
+ * the frames in between are stored as patches against it. */
+#define NETPLAY_KEYFRAME_INTERVAL 8
+
 #define PREV_PTR(x) ((x) == 0 ? netplay->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % netplay->buffer_size)
 
 struct delta_frame
 {
-   void *state;
+   /* Savestate at the start of the frame, as a patch against
+    * keyframe 'keyframe'. Keyframes themselves have no patch. */
+   uint8_t *patch;
+   size_t patch_size;
+   size_t patch_capacity;
+   size_t keyframe;
+   /* False if the state couldn't be stored. */
+   bool has_state;
 
    uint32_t real_input_state[UDP_WORDS_PER_FRAME - 1];
    uint32_t simulated_input_state[UDP_WORDS_PER_FRAME - 1];
@@ -92,6 +104,22 @@ struct netplay
 
    size_t state_size;
 
+   /* Full savestates the frame history is patched against. */
+   uint8_t **keyframes;
+   size_t keyframes_size;
+   /* Serialization target for frames stored as patches. */
+   uint8_t *state_scratch;
+   uint8_t *patch_scratch;
+
+   struct
+   {
+      uint64_t replays;
+      uint64_t replayed_frames;
+      uint32_t max_replay_depth;
+      size_t history_size;
+      size_t max_history_size;
+   } stats;
+
    /* Are we replaying old frames? */
    bool is_replay;
    /* We don't want to poll several times on a frame. */
@@ -117,6 +145,10 @@ struct netplay
       uint16_t *input;
       size_t input_ptr;
       size_t input_sz;
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+      netplay_spectate_server_t *server;
+      netplay_spectate_server_stats_t stats;
+#endif
    } spectate;
    bool is_server;
    /* User flipping
@@ -139,6 +171,7 @@ extern void *netplay_data;
 
 struct netplay_callbacks* netplay_get_cbs_net(void);
 struct netplay_callbacks* netplay_get_cbs_spectate(void);
+void   netplay_net_free_buffers(netplay_t *netplay);
 void   netplay_log_connection(const struct sockaddr_storage *their_addr,
       unsigned slot, const char *nick);
 
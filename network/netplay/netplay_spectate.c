@@ -44,6 +44,27 @@ static void netplay_spectate_pre_frame(netplay_t *netplay)
    if (!netplay_is_server(netplay))
       return;
 
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+   if (netplay->spectate.server)
+   {
+      /* One savestate serves every spectator that joined
+       * since the last keyframe. */
+      if (netplay_spectate_server_wants_keyframe(netplay->spectate.server))
+      {
+         header = netplay_bsv_header_generate(&header_size,
+               netplay_impl_magic());
+
+         if (header)
+            netplay_spectate_server_push_keyframe(netplay->spectate.server,
+                  header, header_size);
+         else
+            RARCH_ERR("%s\n",
+                  msg_hash_to_str(MSG_FAILED_TO_GENERATE_BSV_HEADER));
+      }
+      return;
+   }
+#endif
+
    FD_ZERO(&fds);
    FD_SET(netplay->fd, &fds);
 
@@ -122,6 +143,30 @@ static void netplay_spectate_pre_frame(netplay_t *netplay)
 #endif
 }
 
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+static void netplay_spectate_log_viewers(netplay_t *netplay)
+{
+   char msg[128];
+   netplay_spectate_server_stats_t stats;
+   netplay_spectate_server_stats_t *old = &netplay->spectate.stats;
+
+   netplay_spectate_server_get_stats(netplay->spectate.server, &stats);
+
+   if (stats.viewers == old->viewers && stats.dropped == old->dropped)
+      return;
+
+   if (stats.dropped != old->dropped)
+      RARCH_WARN("Dropped %u spectator(s) that fell behind.\n",
+            (unsigned)(stats.dropped - old->dropped));
+
+   snprintf(msg, sizeof(msg), "%u spectator(s) watching.", stats.viewers);
+   RARCH_LOG("%s\n", msg);
+   runloop_msg_queue_push(msg, 1, 180, false);
+
+   *old = stats;
+}
+#endif
+
 /**
  * netplay_post_frame_spectate:   
  * @netplay              : pointer to netplay object
@@ -136,6 +181,19 @@ static void netplay_spectate_post_frame(netplay_t *netplay)
    if (!netplay_is_server(netplay))
       return;
 
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+   if (netplay->spectate.server)
+   {
+      netplay_spectate_server_push_frame(netplay->spectate.server,
+            netplay->spectate.input,
+            netplay->spectate.input_ptr * sizeof(int16_t));
+      netplay->spectate.input_ptr = 0;
+
+      netplay_spectate_log_viewers(netplay);
+      return;
+   }
+#endif
+
    for (i = 0; i < MAX_SPECTATORS; i++)
    {
       char msg[128];
@@ -162,17 +220,82 @@ static void netplay_spectate_post_frame(netplay_t *netplay)
    netplay->spectate.input_ptr = 0;
 }
 
-static bool netplay_spectate_info_cb(netplay_t *netplay, unsigned frames)
+/**
+ * netplay_spectate_get_header:
+ * @netplay              : pointer to netplay object
+ *
+ * Handshake of a spectator with the host, starting
+ * from the savestate the host sends.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool netplay_spectate_get_header(netplay_t *netplay)
 {
-   unsigned i;
-   if(netplay_is_server(netplay))
+   retro_ctx_serialize_info_t serial_info;
+   uint32_t header[4];
+   bool ret     = false;
+   size_t size  = 0;
+   void *state  = NULL;
+
+   if (!netplay_send_nickname(netplay, netplay->fd))
+   {
+      RARCH_ERR("%s\n",
+            msg_hash_to_str(MSG_FAILED_TO_SEND_NICKNAME_TO_HOST));
+      return false;
+   }
+
+   if (!netplay_get_nickname(netplay, netplay->fd))
+   {
+      RARCH_ERR("%s\n",
+            msg_hash_to_str(MSG_FAILED_TO_RECEIVE_NICKNAME_FROM_HOST));
+      return false;
+   }
+
+   if (!socket_receive_all_blocking(netplay->fd, header, sizeof(header)))
+   {
+      RARCH_ERR("Failed to receive header from host.\n");
+      return false;
+   }
+
+   if (!netplay_bsv_parse_header(header, netplay_impl_magic()))
+      return false;
+
+   size = swap_if_big32(header[STATE_SIZE_INDEX]);
+
+   if (!size)
+      return true;
+
+   state = malloc(size);
+
+   if (state && socket_receive_all_blocking(netplay->fd, state, size))
    {
-      if(!netplay_get_info(netplay))
-         return false;
+      serial_info.data_const = state;
+      serial_info.size       = size;
+      ret                    = core_unserialize(&serial_info);
    }
 
+   free(state);
+   return ret;
+}
+
+static bool netplay_spectate_info_cb(netplay_t *netplay, unsigned frames)
+{
+   unsigned i;
+
    for (i = 0; i < MAX_SPECTATORS; i++)
       netplay->spectate.fds[i] = -1;
+
+   if (!netplay_is_server(netplay))
+      return netplay_spectate_get_header(netplay);
+
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+   netplay->spectate.server = netplay_spectate_server_new(netplay->fd,
+         netplay->nick);
+
+   if (!netplay->spectate.server)
+      return false;
+#endif
+
    return true;
 }
 
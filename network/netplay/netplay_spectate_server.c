@@ -0,0 +1,748 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "netplay_spectate_server.h"
+
+#ifdef HAVE_NETPLAY_SPECTATE_SERVER
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <compat/strl.h>
+#include <rthreads/rthreads.h>
+
+/* Frame data a spectator may fall behind by before it is dropped.
+ * Must be a power of two. */
+#define SPECTATE_RING_SIZE   (64 * 1024)
+#define SPECTATE_MAX_EVENTS  64
+#define SPECTATE_NICK_SIZE   32
+
+enum spectate_client_state
+{
+   SPECTATE_CLIENT_NICK_SIZE = 0,
+   SPECTATE_CLIENT_NICK,
+   /* Handshake done, waiting for a keyframe. */
+   SPECTATE_CLIENT_WAITING,
+   SPECTATE_CLIENT_STREAMING
+};
+
+typedef struct spectate_keyframe
+{
+   uint8_t *data;
+   size_t size;
+   unsigned refs;
+} spectate_keyframe_t;
+
+typedef struct spectate_client
+{
+   int fd;
+   enum spectate_client_state state;
+   bool dead;
+   bool want_write;
+
+   uint8_t nick_size;
+   size_t nick_pos;
+   char nick[SPECTATE_NICK_SIZE];
+
+   /* Nickname reply, sent before anything else. */
+   uint8_t hello[SPECTATE_NICK_SIZE + 1];
+   size_t hello_size;
+   size_t hello_pos;
+
+   spectate_keyframe_t *keyframe;
+   size_t keyframe_pos;
+
+   uint8_t *ring;
+   size_t ring_head;
+   size_t ring_tail;
+} spectate_client_t;
+
+struct netplay_spectate_server
+{
+   int listen_fd;
+   int epoll_fd;
+   int wake_fd;
+   sthread_t *thread;
+   char nick[SPECTATE_NICK_SIZE];
+
+   /* Owned by the I/O thread. */
+   spectate_client_t **clients;
+   size_t clients_size;
+   size_t clients_capacity;
+   uint8_t *batch;
+   size_t batch_capacity;
+   netplay_spectate_server_stats_t thread_stats;
+
+   /* Shared with the host, guarded by lock. */
+   slock_t *lock;
+   bool quit;
+   bool wants_keyframe;
+   uint8_t *pending;
+   size_t pending_size;
+   size_t pending_capacity;
+   spectate_keyframe_t *keyframe;
+   /* Offset into pending data the keyframe was taken at. */
+   size_t keyframe_offset;
+   netplay_spectate_server_stats_t stats;
+};
+
+/* epoll tags for the listening socket and the wakeup eventfd. */
+static char spectate_tag_listen;
+static char spectate_tag_wake;
+
+static void spectate_keyframe_release(spectate_keyframe_t *keyframe)
+{
+   if (!keyframe || --keyframe->refs)
+      return;
+
+   free(keyframe->data);
+   free(keyframe);
+}
+
+static size_t spectate_ring_used(const spectate_client_t *client)
+{
+   return client->ring_tail - client->ring_head;
+}
+
+static bool spectate_ring_push(spectate_client_t *client,
+      const uint8_t *data, size_t size)
+{
+   size_t offset, first;
+
+   if (SPECTATE_RING_SIZE - spectate_ring_used(client) < size)
+      return false;
+
+   offset = client->ring_tail & (SPECTATE_RING_SIZE - 1);
+   first  = SPECTATE_RING_SIZE - offset;
+   if (first > size)
+      first = size;
+
+   memcpy(client->ring + offset, data, first);
+   memcpy(client->ring, data + first, size - first);
+   client->ring_tail += size;
+
+   return true;
+}
+
+static void spectate_client_set_write(netplay_spectate_server_t *server,
+      spectate_client_t *client, bool want_write)
+{
+   struct epoll_event event;
+
+   if (client->want_write == want_write)
+      return;
+
+   event.events   = EPOLLIN | (want_write ? EPOLLOUT : 0);
+   event.data.ptr = client;
+
+   if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event) == 0)
+      client->want_write = want_write;
+}
+
+static void spectate_client_close(netplay_spectate_server_t *server,
+      spectate_client_t *client)
+{
+   if (client->dead)
+      return;
+
+   epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+   close(client->fd);
+
+   client->dead = true;
+   client->fd   = -1;
+}
+
+/* Returns the next chunk of data queued for the spectator. */
+static const uint8_t *spectate_client_next(spectate_client_t *client,
+      size_t *size)
+{
+   if (client->hello_pos < client->hello_size)
+   {
+      *size = client->hello_size - client->hello_pos;
+      return client->hello + client->hello_pos;
+   }
+
+   if (client->keyframe)
+   {
+      *size = client->keyframe->size - client->keyframe_pos;
+      return client->keyframe->data + client->keyframe_pos;
+   }
+
+   if (client->state == SPECTATE_CLIENT_STREAMING
+         && spectate_ring_used(client))
+   {
+      size_t offset = client->ring_head & (SPECTATE_RING_SIZE - 1);
+
+      *size = SPECTATE_RING_SIZE - offset;
+      if (*size > spectate_ring_used(client))
+         *size = spectate_ring_used(client);
+      return client->ring + offset;
+   }
+
+   *size = 0;
+   return NULL;
+}
+
+static void spectate_client_consume(spectate_client_t *client, size_t size)
+{
+   if (client->hello_pos < client->hello_size)
+      client->hello_pos += size;
+   else if (client->keyframe)
+   {
+      client->keyframe_pos += size;
+      if (client->keyframe_pos == client->keyframe->size)
+      {
+         spectate_keyframe_release(client->keyframe);
+         client->keyframe = NULL;
+      }
+   }
+   else
+      client->ring_head += size;
+}
+
+static void spectate_client_flush(netplay_spectate_server_t *server,
+      spectate_client_t *client)
+{
+   for (;;)
+   {
+      ssize_t ret;
+      size_t size;
+      const uint8_t *data = spectate_client_next(client, &size);
+
+      if (!data)
+         break;
+
+      ret = send(client->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+      if (ret < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+         {
+            spectate_client_set_write(server, client, true);
+            return;
+         }
+         spectate_client_close(server, client);
+         return;
+      }
+
+      spectate_client_consume(client, ret);
+      server->thread_stats.bytes_sent += ret;
+   }
+
+   spectate_client_set_write(server, client, false);
+}
+
+static void spectate_client_read(netplay_spectate_server_t *server,
+      spectate_client_t *client)
+{
+   for (;;)
+   {
+      ssize_t ret;
+      uint8_t discard[256];
+      uint8_t *dst = discard;
+      size_t size  = sizeof(discard);
+
+      if (client->state == SPECTATE_CLIENT_NICK_SIZE)
+      {
+         dst  = &client->nick_size;
+         size = 1;
+      }
+      else if (client->state == SPECTATE_CLIENT_NICK)
+      {
+         dst  = (uint8_t*)client->nick + client->nick_pos;
+         size = client->nick_size - client->nick_pos;
+      }
+
+      ret = size ? recv(client->fd, dst, size, MSG_DONTWAIT) : 0;
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         return;
+      if (ret <= 0 && size)
+      {
+         spectate_client_close(server, client);
+         return;
+      }
+
+      switch (client->state)
+      {
+         case SPECTATE_CLIENT_NICK_SIZE:
+            if (client->nick_size >= SPECTATE_NICK_SIZE)
+            {
+               spectate_client_close(server, client);
+               return;
+            }
+            client->state = SPECTATE_CLIENT_NICK;
+            break;
+         case SPECTATE_CLIENT_NICK:
+            client->nick_pos += ret;
+            break;
+         default:
+            /* Spectators have nothing to say. */
+            break;
+      }
+
+      if (client->state == SPECTATE_CLIENT_NICK
+            && client->nick_pos == client->nick_size)
+      {
+         size_t nick_size   = strlen(server->nick);
+
+         client->nick[client->nick_size] = '\0';
+         client->hello[0]   = (uint8_t)nick_size;
+         memcpy(client->hello + 1, server->nick, nick_size);
+         client->hello_size = nick_size + 1;
+         client->state      = SPECTATE_CLIENT_WAITING;
+
+         server->thread_stats.joined++;
+
+         slock_lock(server->lock);
+         server->wants_keyframe = true;
+         slock_unlock(server->lock);
+
+         spectate_client_flush(server, client);
+         if (client->dead)
+            return;
+      }
+   }
+}
+
+static void spectate_server_accept(netplay_spectate_server_t *server)
+{
+   for (;;)
+   {
+      struct epoll_event event;
+      spectate_client_t *client = NULL;
+      int sndbuf                = SPECTATE_RING_SIZE;
+      int fd = accept(server->listen_fd, NULL, NULL);
+
+      if (fd < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return;
+      }
+
+      if (server->clients_size == server->clients_capacity)
+      {
+         size_t capacity            = server->clients_capacity
+            ? server->clients_capacity * 2 : 16;
+         spectate_client_t **clients = (spectate_client_t**)realloc(
+               server->clients, capacity * sizeof(*clients));
+
+         if (!clients)
+         {
+            close(fd);
+            continue;
+         }
+
+         server->clients          = clients;
+         server->clients_capacity = capacity;
+      }
+
+      client = (spectate_client_t*)calloc(1, sizeof(*client));
+      if (client)
+         client->ring = (uint8_t*)malloc(SPECTATE_RING_SIZE);
+
+      if (!client || !client->ring)
+      {
+         if (client)
+            free(client);
+         close(fd);
+         continue;
+      }
+
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+      /* Keep the kernel from buffering far more than the ring,
+       * so a stalled spectator is noticed. */
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+      client->fd     = fd;
+      event.events   = EPOLLIN;
+      event.data.ptr = client;
+
+      if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+      {
+         free(client->ring);
+         free(client);
+         close(fd);
+         continue;
+      }
+
+      server->clients[server->clients_size++] = client;
+   }
+}
+
+/* Hands the data pushed by the host to the spectators. */
+static void spectate_server_distribute(netplay_spectate_server_t *server,
+      const uint8_t *data, size_t size,
+      spectate_keyframe_t *keyframe, size_t keyframe_offset)
+{
+   size_t i;
+
+   for (i = 0; i < server->clients_size; i++)
+   {
+      spectate_client_t *client = server->clients[i];
+      const uint8_t *frames     = data;
+      size_t frames_size        = size;
+
+      if (client->dead)
+         continue;
+
+      if (client->state == SPECTATE_CLIENT_WAITING && keyframe)
+      {
+         keyframe->refs++;
+         client->keyframe     = keyframe;
+         client->keyframe_pos = 0;
+         client->state        = SPECTATE_CLIENT_STREAMING;
+         frames              += keyframe_offset;
+         frames_size         -= keyframe_offset;
+      }
+      else if (client->state != SPECTATE_CLIENT_STREAMING)
+         continue;
+
+      if (!spectate_ring_push(client, frames, frames_size))
+      {
+         server->thread_stats.dropped++;
+         spectate_client_close(server, client);
+         continue;
+      }
+
+      spectate_client_flush(server, client);
+   }
+}
+
+/* Frees closed spectators, only safe between event batches. */
+static void spectate_server_sweep(netplay_spectate_server_t *server)
+{
+   size_t i;
+   bool waiting = false;
+
+   for (i = 0; i < server->clients_size; )
+   {
+      spectate_client_t *client = server->clients[i];
+
+      if (client->dead)
+      {
+         spectate_keyframe_release(client->keyframe);
+         free(client->ring);
+         free(client);
+         server->clients[i] = server->clients[--server->clients_size];
+         continue;
+      }
+
+      if (client->state == SPECTATE_CLIENT_WAITING)
+         waiting = true;
+      i++;
+   }
+
+   server->thread_stats.viewers = (unsigned)server->clients_size;
+
+   slock_lock(server->lock);
+   server->stats = server->thread_stats;
+   if (waiting)
+      server->wants_keyframe = true;
+   slock_unlock(server->lock);
+}
+
+static bool spectate_server_wake(netplay_spectate_server_t *server)
+{
+   uint64_t count;
+   size_t size, capacity, keyframe_offset;
+   uint8_t *swap                  = NULL;
+   spectate_keyframe_t *keyframe  = NULL;
+
+   while (read(server->wake_fd, &count, sizeof(count)) > 0);
+
+   slock_lock(server->lock);
+
+   if (server->quit)
+   {
+      slock_unlock(server->lock);
+      return false;
+   }
+
+   /* Swap buffers, so the host can keep pushing while we send. */
+   swap                     = server->batch;
+   server->batch            = server->pending;
+   server->pending          = swap;
+   size                     = server->pending_size;
+   server->pending_size     = 0;
+   capacity                 = server->batch_capacity;
+   server->batch_capacity   = server->pending_capacity;
+   server->pending_capacity = capacity;
+
+   keyframe                 = server->keyframe;
+   keyframe_offset          = server->keyframe_offset;
+   server->keyframe         = NULL;
+
+   slock_unlock(server->lock);
+
+   if (size || keyframe)
+      spectate_server_distribute(server, server->batch, size,
+            keyframe, keyframe_offset);
+
+   spectate_keyframe_release(keyframe);
+
+   return true;
+}
+
+static void spectate_server_thread(void *data)
+{
+   netplay_spectate_server_t *server = (netplay_spectate_server_t*)data;
+
+   for (;;)
+   {
+      int i;
+      struct epoll_event events[SPECTATE_MAX_EVENTS];
+      int count = epoll_wait(server->epoll_fd, events,
+            SPECTATE_MAX_EVENTS, -1);
+
+      if (count < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         break;
+      }
+
+      for (i = 0; i < count; i++)
+      {
+         spectate_client_t *client = NULL;
+
+         if (events[i].data.ptr == &spectate_tag_listen)
+         {
+            spectate_server_accept(server);
+            continue;
+         }
+
+         if (events[i].data.ptr == &spectate_tag_wake)
+         {
+            if (!spectate_server_wake(server))
+               return;
+            continue;
+         }
+
+         client = (spectate_client_t*)events[i].data.ptr;
+
+         if (client->dead)
+            continue;
+
+         if (events[i].events & (EPOLLERR | EPOLLHUP))
+         {
+            spectate_client_close(server, client);
+            continue;
+         }
+
+         if (events[i].events & EPOLLIN)
+            spectate_client_read(server, client);
+
+         if (!client->dead && (events[i].events & EPOLLOUT))
+            spectate_client_flush(server, client);
+      }
+
+      spectate_server_sweep(server);
+   }
+}
+
+netplay_spectate_server_t *netplay_spectate_server_new(int fd,
+      const char *nick)
+{
+   struct epoll_event event;
+   netplay_spectate_server_t *server = (netplay_spectate_server_t*)
+      calloc(1, sizeof(*server));
+
+   if (!server)
+      return NULL;
+
+   server->listen_fd = fd;
+   server->epoll_fd  = -1;
+   server->wake_fd   = -1;
+   strlcpy(server->nick, nick, sizeof(server->nick));
+
+   server->lock      = slock_new();
+   server->epoll_fd  = epoll_create1(EPOLL_CLOEXEC);
+   server->wake_fd   = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   if (!server->lock || server->epoll_fd < 0 || server->wake_fd < 0)
+      goto error;
+
+   fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+   event.events   = EPOLLIN;
+   event.data.ptr = &spectate_tag_listen;
+   if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+      goto error;
+
+   event.events   = EPOLLIN;
+   event.data.ptr = &spectate_tag_wake;
+   if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD,
+            server->wake_fd, &event) < 0)
+      goto error;
+
+   server->thread = sthread_create(spectate_server_thread, server);
+   if (!server->thread)
+      goto error;
+
+   return server;
+
+error:
+   if (server->lock)
+      slock_free(server->lock);
+   if (server->epoll_fd >= 0)
+      close(server->epoll_fd);
+   if (server->wake_fd >= 0)
+      close(server->wake_fd);
+   free(server);
+   return NULL;
+}
+
+static void spectate_server_wakeup(netplay_spectate_server_t *server)
+{
+   uint64_t one = 1;
+
+   if (write(server->wake_fd, &one, sizeof(one)) < 0)
+   {
+      /* The counter is already non-zero, the thread will wake up. */
+   }
+}
+
+void netplay_spectate_server_free(netplay_spectate_server_t *server)
+{
+   size_t i;
+
+   if (!server)
+      return;
+
+   slock_lock(server->lock);
+   server->quit = true;
+   slock_unlock(server->lock);
+
+   spectate_server_wakeup(server);
+   sthread_join(server->thread);
+
+   for (i = 0; i < server->clients_size; i++)
+   {
+      spectate_client_t *client = server->clients[i];
+
+      if (!client->dead)
+         close(client->fd);
+      spectate_keyframe_release(client->keyframe);
+      free(client->ring);
+      free(client);
+   }
+
+   spectate_keyframe_release(server->keyframe);
+
+   close(server->epoll_fd);
+   close(server->wake_fd);
+   slock_free(server->lock);
+
+   free(server->clients);
+   free(server->pending);
+   free(server->batch);
+   free(server);
+}
+
+bool netplay_spectate_server_wants_keyframe(netplay_spectate_server_t *server)
+{
+   bool ret;
+
+   slock_lock(server->lock);
+   ret = server->wants_keyframe;
+   slock_unlock(server->lock);
+
+   return ret;
+}
+
+void netplay_spectate_server_push_keyframe(netplay_spectate_server_t *server,
+      void *data, size_t size)
+{
+   spectate_keyframe_t *keyframe = (spectate_keyframe_t*)
+      calloc(1, sizeof(*keyframe));
+
+   if (!keyframe)
+   {
+      free(data);
+      return;
+   }
+
+   keyframe->data = (uint8_t*)data;
+   keyframe->size = size;
+   keyframe->refs = 1;
+
+   slock_lock(server->lock);
+   /* A keyframe the thread didn't pick up yet is superseded. */
+   spectate_keyframe_release(server->keyframe);
+   server->keyframe        = keyframe;
+   server->keyframe_offset = server->pending_size;
+   server->wants_keyframe  = false;
+   slock_unlock(server->lock);
+
+   spectate_server_wakeup(server);
+}
+
+void netplay_spectate_server_push_frame(netplay_spectate_server_t *server,
+      const void *data, size_t size)
+{
+   bool ok = true;
+
+   slock_lock(server->lock);
+
+   if (server->pending_size + size > server->pending_capacity)
+   {
+      size_t capacity = (server->pending_size + size) * 2;
+      uint8_t *buf    = (uint8_t*)realloc(server->pending, capacity);
+
+      if (buf)
+      {
+         server->pending          = buf;
+         server->pending_capacity = capacity;
+      }
+      else
+         ok = false;
+   }
+
+   if (ok)
+   {
+      memcpy(server->pending + server->pending_size, data, size);
+      server->pending_size += size;
+   }
+
+   slock_unlock(server->lock);
+
+   if (ok)
+      spectate_server_wakeup(server);
+}
+
+void netplay_spectate_server_get_stats(netplay_spectate_server_t *server,
+      netplay_spectate_server_stats_t *stats)
+{
+   slock_lock(server->lock);
+   *stats = server->stats;
+   slock_unlock(server->lock);
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RARCH_NETPLAY_SPECTATE_SERVER_H
+#define __RARCH_NETPLAY_SPECTATE_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <boolean.h>
+#include <retro_common_api.h>
+
+#if defined(HAVE_THREADS) && defined(__linux__)
+#define HAVE_NETPLAY_SPECTATE_SERVER
+#endif
+
+RETRO_BEGIN_DECLS
+
+/* Spectator broadcast server.
+ *
+ * Spectators are served by a dedicated I/O thread with non-blocking
+ * sockets, so the cost for the host's frame loop doesn't depend on
+ * the number of spectators. Every spectator has a bounded send ring;
+ * spectators that can't keep up with the stream are dropped.
+ *
+ * The stream sent to a spectator is its nickname reply, the most
+ * recent keyframe (BSV header and savestate) pushed after it joined
+ * and the frame data pushed after that keyframe. */
+
+typedef struct netplay_spectate_server netplay_spectate_server_t;
+
+typedef struct netplay_spectate_server_stats
+{
+   /* Spectators currently connected. */
+   unsigned viewers;
+   /* Spectators that completed the handshake. */
+   uint64_t joined;
+   /* Spectators dropped because they fell behind. */
+   uint64_t dropped;
+   uint64_t bytes_sent;
+} netplay_spectate_server_stats_t;
+
+/**
+ * netplay_spectate_server_new:
+ * @fd                   : listening socket, still owned by the caller.
+ * @nick                 : nickname sent to spectators.
+ *
+ * Starts accepting spectators on @fd.
+ *
+ * Returns: new server handle, NULL on error.
+ **/
+netplay_spectate_server_t *netplay_spectate_server_new(int fd,
+      const char *nick);
+
+/**
+ * netplay_spectate_server_free:
+ * @server               : spectator server
+ *
+ * Stops the I/O thread and disconnects all spectators.
+ **/
+void netplay_spectate_server_free(netplay_spectate_server_t *server);
+
+/**
+ * netplay_spectate_server_wants_keyframe:
+ * @server               : spectator server
+ *
+ * Returns: true (1) if spectators are waiting for a keyframe.
+ **/
+bool netplay_spectate_server_wants_keyframe(netplay_spectate_server_t *server);
+
+/**
+ * netplay_spectate_server_push_keyframe:
+ * @server               : spectator server
+ * @data                 : keyframe allocated with malloc(),
+ *                         ownership is taken over by the server.
+ * @size                 : size of keyframe
+ *
+ * Queues a keyframe for the spectators waiting for one.
+ * Must be pushed on a frame boundary.
+ **/
+void netplay_spectate_server_push_keyframe(netplay_spectate_server_t *server,
+      void *data, size_t size);
+
+/**
+ * netplay_spectate_server_push_frame:
+ * @server               : spectator server
+ * @data                 : frame data
+ * @size                 : size of frame data
+ *
+ * Queues frame data for all streaming spectators.
+ **/
+void netplay_spectate_server_push_frame(netplay_spectate_server_t *server,
+      const void *data, size_t size);
+
+void netplay_spectate_server_get_stats(netplay_spectate_server_t *server,
+      netplay_spectate_server_stats_t *stats);
+
+RETRO_END_DECLS
+
+#endif
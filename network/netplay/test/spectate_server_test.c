@@ -0,0 +1,366 @@
+/* Load test for the spectator broadcast server.
+ *
+ * Attaches hundreds of loopback spectators plus a few that never read,
+ * streams frames to them and checks that every healthy spectator gets
+ * an intact stream, that the stalled ones get dropped and that the
+ * host's per-frame cost doesn't depend on the number of spectators. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <rthreads/rthreads.h>
+
+#include "../netplay_spectate_server.h"
+
+#define HOST_NICK    "host"
+#define FRAME_WORDS  32
+#define FRAMES       5000
+
+typedef struct viewer
+{
+   int fd;
+   uint32_t frame;
+   uint32_t frames;
+   bool done;
+   bool failed;
+   uint8_t buf[4096];
+   size_t buf_size;
+   int stage;
+} viewer_t;
+
+static int64_t now_usec(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int listen_loopback(uint16_t *port)
+{
+   struct sockaddr_in addr;
+   socklen_t len = sizeof(addr);
+   int fd        = socket(AF_INET, SOCK_STREAM, 0);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family      = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+         || listen(fd, SOMAXCONN) < 0
+         || getsockname(fd, (struct sockaddr*)&addr, &len) < 0)
+      return -1;
+
+   *port = ntohs(addr.sin_port);
+   return fd;
+}
+
+static int connect_viewer(uint16_t port, int rcvbuf, unsigned idx)
+{
+   char nick[33];
+   struct sockaddr_in addr;
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+   if (fd < 0)
+      return -1;
+
+   if (rcvbuf)
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family      = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port        = htons(port);
+
+   if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+   {
+      close(fd);
+      return -1;
+   }
+
+   nick[0] = (char)snprintf(nick + 1, sizeof(nick) - 1, "viewer%u", idx);
+   if (send(fd, nick, nick[0] + 1, 0) != nick[0] + 1)
+   {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+/* Stream: [u8 size][nick] [u32 keyframe frame] [FRAME_WORDS x u16]... */
+static void viewer_parse(viewer_t *viewer)
+{
+   for (;;)
+   {
+      size_t need;
+
+      switch (viewer->stage)
+      {
+         case 0:
+            need = 1 + strlen(HOST_NICK);
+            break;
+         case 1:
+            need = 4;
+            break;
+         default:
+            need = FRAME_WORDS * 2;
+            break;
+      }
+
+      if (viewer->buf_size < need)
+         return;
+
+      switch (viewer->stage)
+      {
+         case 0:
+            if (viewer->buf[0] != strlen(HOST_NICK)
+                  || memcmp(viewer->buf + 1, HOST_NICK, viewer->buf[0]))
+               viewer->failed = true;
+            viewer->stage = 1;
+            break;
+         case 1:
+            memcpy(&viewer->frame, viewer->buf, 4);
+            viewer->stage = 2;
+            break;
+         default:
+         {
+            unsigned i;
+            uint16_t words[FRAME_WORDS];
+
+            memcpy(words, viewer->buf, sizeof(words));
+            for (i = 0; i < FRAME_WORDS; i++)
+               if (words[i] != (uint16_t)viewer->frame)
+                  viewer->failed = true;
+
+            viewer->frame++;
+            viewer->frames++;
+            if (viewer->frame == FRAMES)
+               viewer->done = true;
+            break;
+         }
+      }
+
+      memmove(viewer->buf, viewer->buf + need, viewer->buf_size - need);
+      viewer->buf_size -= need;
+   }
+}
+
+typedef struct reader_state
+{
+   viewer_t *viewers;
+   unsigned count;
+   volatile bool stop;
+} reader_state_t;
+
+static void reader_thread(void *data)
+{
+   reader_state_t *state = (reader_state_t*)data;
+   struct pollfd *fds    = (struct pollfd*)calloc(state->count, sizeof(*fds));
+   unsigned remaining    = state->count;
+
+   while (remaining && !state->stop)
+   {
+      unsigned i;
+
+      for (i = 0; i < state->count; i++)
+      {
+         viewer_t *viewer = &state->viewers[i];
+         fds[i].fd        = (viewer->done || viewer->failed) ? -1 : viewer->fd;
+         fds[i].events    = POLLIN;
+         fds[i].revents   = 0;
+      }
+
+      if (poll(fds, state->count, 100) <= 0)
+         continue;
+
+      for (i = 0; i < state->count; i++)
+      {
+         ssize_t ret;
+         viewer_t *viewer = &state->viewers[i];
+
+         if (!fds[i].revents)
+            continue;
+
+         ret = recv(viewer->fd, viewer->buf + viewer->buf_size,
+               sizeof(viewer->buf) - viewer->buf_size, MSG_DONTWAIT);
+
+         if (ret <= 0)
+         {
+            if (ret < 0 && errno == EAGAIN)
+               continue;
+            viewer->failed = true;
+            remaining--;
+            continue;
+         }
+
+         viewer->buf_size += ret;
+         viewer_parse(viewer);
+
+         if (viewer->done || viewer->failed)
+            remaining--;
+      }
+   }
+
+   free(fds);
+}
+
+static bool run(unsigned viewers, unsigned slow)
+{
+   unsigned i, frame, verified = 0;
+   uint16_t port;
+   int64_t host_total = 0, host_max = 0;
+   reader_state_t reader;
+   sthread_t *thread  = NULL;
+   netplay_spectate_server_stats_t stats;
+   netplay_spectate_server_t *server = NULL;
+   int *slow_fds      = (int*)calloc(slow + 1, sizeof(int));
+   int listen_fd      = listen_loopback(&port);
+   bool ret           = true;
+   int64_t start;
+
+   reader.viewers = (viewer_t*)calloc(viewers, sizeof(*reader.viewers));
+   reader.count   = viewers;
+   reader.stop    = false;
+
+   if (listen_fd < 0 || !reader.viewers || !slow_fds)
+      return false;
+
+   server = netplay_spectate_server_new(listen_fd, HOST_NICK);
+   if (!server)
+      return false;
+
+   for (i = 0; i < viewers; i++)
+   {
+      reader.viewers[i].fd = connect_viewer(port, 0, i);
+      if (reader.viewers[i].fd < 0)
+      {
+         printf("Failed to connect viewer %u: %s\n", i, strerror(errno));
+         return false;
+      }
+   }
+
+   for (i = 0; i < slow; i++)
+      slow_fds[i] = connect_viewer(port, 4096, viewers + i);
+
+   /* Wait for the handshakes. */
+   start = now_usec();
+   do
+   {
+      netplay_spectate_server_get_stats(server, &stats);
+      usleep(1000);
+   } while (stats.joined < viewers + slow && now_usec() - start < 5000000);
+
+   thread = sthread_create(reader_thread, &reader);
+
+   for (frame = 0; frame < FRAMES; frame++)
+   {
+      int64_t t;
+      uint16_t words[FRAME_WORDS];
+
+      for (i = 0; i < FRAME_WORDS; i++)
+         words[i] = (uint16_t)frame;
+
+      t = now_usec();
+
+      if (netplay_spectate_server_wants_keyframe(server))
+      {
+         uint32_t *keyframe = (uint32_t*)malloc(sizeof(*keyframe));
+         *keyframe          = frame;
+         netplay_spectate_server_push_keyframe(server,
+               keyframe, sizeof(*keyframe));
+      }
+
+      netplay_spectate_server_push_frame(server, words, sizeof(words));
+
+      t = now_usec() - t;
+      host_total += t;
+      if (t > host_max)
+         host_max = t;
+
+      /* Roughly 1000 frames per second. */
+      usleep(1000);
+   }
+
+   /* Let the readers drain. */
+   start = now_usec();
+   for (;;)
+   {
+      unsigned done = 0;
+      for (i = 0; i < viewers; i++)
+         if (reader.viewers[i].done || reader.viewers[i].failed)
+            done++;
+      if (done == viewers || now_usec() - start > 10000000)
+         break;
+      usleep(10000);
+   }
+
+   reader.stop = true;
+   sthread_join(thread);
+
+   netplay_spectate_server_get_stats(server, &stats);
+
+   for (i = 0; i < viewers; i++)
+   {
+      if (reader.viewers[i].done && !reader.viewers[i].failed)
+         verified++;
+      close(reader.viewers[i].fd);
+   }
+
+   for (i = 0; i < slow; i++)
+      if (slow_fds[i] >= 0)
+         close(slow_fds[i]);
+
+   printf("%4u viewers + %u stalled: host %.2f us/frame avg, %lld us max; "
+         "%u/%u streams intact, %u dropped, %.1f MB sent\n",
+         viewers, slow,
+         (double)host_total / FRAMES, (long long)host_max,
+         verified, viewers, (unsigned)stats.dropped,
+         stats.bytes_sent / (1024.0 * 1024.0));
+
+   if (verified != viewers)
+   {
+      puts("ERROR: not every viewer got an intact stream");
+      ret = false;
+   }
+
+   if (stats.dropped != slow)
+   {
+      puts("ERROR: stalled viewers were not dropped");
+      ret = false;
+   }
+
+   netplay_spectate_server_free(server);
+   close(listen_fd);
+   free(reader.viewers);
+   free(slow_fds);
+
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   struct rlimit limit;
+   unsigned viewers = argc > 1 ? (unsigned)atoi(argv[1]) : 400;
+   bool ok          = true;
+
+   /* Both ends of every connection live in this process. */
+   if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+   {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+   }
+
+   ok &= run(1, 0);
+   ok &= run(viewers, 4);
+
+   return ok ? 0 : 1;
+}
@@ -615,6 +615,40 @@ static bool try_ips_patch(uint8_t **buf, ssize_t *size)
          ips_apply_patch);
 }
 
+/**
+ * patch_content_is_pending:
+ *
+ * Checks whether patch_content() would attempt to apply a
+ * soft patch, without touching the content file itself.
+ *
+ * Returns: true if an IPS/BPS/UPS patch file is present
+ * and not ruled out by the patch preferences.
+ **/
+bool patch_content_is_pending(void)
+{
+   global_t *global = global_get_ptr();
+
+   if (    global->patch.ips_pref 
+         + global->patch.bps_pref 
+         + global->patch.ups_pref > 1)
+      return false;
+
+   if (!global->patch.ups_pref && !global->patch.bps_pref
+         && !string_is_empty(global->name.ips)
+         && path_file_exists(global->name.ips))
+      return true;
+   if (!global->patch.ups_pref && !global->patch.ips_pref
+         && !string_is_empty(global->name.bps)
+         && path_file_exists(global->name.bps))
+      return true;
+   if (!global->patch.bps_pref && !global->patch.ips_pref
+         && !string_is_empty(global->name.ups)
+         && path_file_exists(global->name.ups))
+      return true;
+
+   return false;
+}
+
 /**
  * patch_content:
  * @buf          : buffer of the content file.
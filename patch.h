@@ -20,6 +20,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <boolean.h>
+
 #include <retro_common_api.h>
 
 RETRO_BEGIN_DECLS
@@ -38,6 +40,14 @@ RETRO_BEGIN_DECLS
  **/
 void patch_content(uint8_t **buf, ssize_t *size);
 
+/**
+ * patch_content_is_pending:
+ *
+ * Returns: true if patch_content() would attempt to apply
+ * a soft patch to the content file.
+ **/
+bool patch_content_is_pending(void);
+
 RETRO_END_DECLS
 
 #endif
@@ -15,6 +15,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 
 #ifdef _WIN32
@@ -24,6 +26,9 @@
 #endif
 
 #include <features/features_cpu.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "performance_counters.h"
 
@@ -37,11 +42,467 @@
 #define PERF_LOG_FMT "[PERF]: Avg (%s): %llu ticks, %llu runs.\n"
 #endif
 
+#define PERF_TRACE_LOG_FMT "[PERF]: Time (%s): p50 %lld us, p99 %lld us, max %lld us, %u traced runs.\n"
+
+/* Events each thread keeps, the oldest ones get overwritten. */
+#define PERF_TRACE_RING_SIZE     32768
+#define PERF_TRACE_RING_MASK     (PERF_TRACE_RING_SIZE - 1)
+#define PERF_TRACE_MAX_THREADS   16
+#define PERF_TRACE_MAX_COUNTERS  256
+/* Deepest nesting of counters matched up on a thread. */
+#define PERF_TRACE_MAX_DEPTH     32
+
+/* Each thread records into its own ring, found through a thread
+ * local pointer, so recording takes no lock. The head is published
+ * with release semantics for a dump running on another thread. */
+#if !defined(HAVE_THREADS)
+#define PERF_TRACE_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define PERF_TRACE_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define PERF_TRACE_THREAD_LOCAL __thread
+#endif
+
+#if defined(HAVE_THREADS) && defined(__GNUC__)
+#define PERF_TRACE_LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define PERF_TRACE_STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#else
+#define PERF_TRACE_LOAD(ptr)       (*(ptr))
+#define PERF_TRACE_STORE(ptr, val) (*(ptr) = (val))
+#endif
+
+/* Thread local storage with a destructor tells when a thread
+ * exits, so its ring can be handed to another thread. */
+#if defined(HAVE_THREADS) && defined(PERF_TRACE_THREAD_LOCAL)
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0600
+#define PERF_TRACE_THREAD_EXIT_FLS
+#endif
+#else
+#define PERF_TRACE_THREAD_EXIT_PTHREAD
+#endif
+#endif
+
+#if defined(PERF_TRACE_THREAD_EXIT_FLS)
+#include <windows.h>
+#elif defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+#include <pthread.h>
+#endif
+
 static struct retro_perf_counter *perf_counters_rarch[MAX_COUNTERS];
 static struct retro_perf_counter *perf_counters_libretro[MAX_COUNTERS];
 static unsigned perf_ptr_rarch;
 static unsigned perf_ptr_libretro;
 
+#ifdef PERF_TRACE_THREAD_LOCAL
+typedef struct perf_trace_event
+{
+   const struct retro_perf_counter *perf;
+   retro_time_t time;
+   /* Counters of an unloaded core may get the address
+    * of another one, generations tell them apart. */
+   unsigned generation;
+   bool begin;
+} perf_trace_event_t;
+
+typedef struct perf_trace_ring
+{
+   perf_trace_event_t *events;
+   /* Trace thread ID, see perf_trace_ring_new. */
+   unsigned id;
+   /* Owned by a running thread, otherwise free to reuse. */
+   bool in_use;
+   /* Total events recorded, only written by the owning thread. */
+   volatile unsigned head;
+} perf_trace_ring_t;
+
+/* Name of a counter for the span of generations it was valid. */
+typedef struct perf_trace_counter
+{
+   const struct retro_perf_counter *perf;
+   char *ident;
+   unsigned first_generation;
+   unsigned last_generation;
+} perf_trace_counter_t;
+
+typedef struct perf_trace_span
+{
+   int counter;
+   retro_time_t duration;
+} perf_trace_span_t;
+
+static bool perf_trace_enable;
+static unsigned perf_trace_generation;
+static retro_time_t perf_trace_start_time;
+
+static perf_trace_ring_t *perf_trace_rings[PERF_TRACE_MAX_THREADS];
+static unsigned perf_trace_ring_count;
+static unsigned perf_trace_ring_next_id;
+static PERF_TRACE_THREAD_LOCAL perf_trace_ring_t *perf_trace_ring_self;
+static PERF_TRACE_THREAD_LOCAL bool perf_trace_ring_failed;
+
+static perf_trace_counter_t perf_trace_counters[PERF_TRACE_MAX_COUNTERS];
+static unsigned perf_trace_counter_count;
+
+#ifdef HAVE_THREADS
+static slock_t *perf_trace_lock;
+#endif
+
+#if defined(PERF_TRACE_THREAD_EXIT_FLS)
+static DWORD perf_trace_ring_key = FLS_OUT_OF_INDEXES;
+#elif defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+static pthread_key_t perf_trace_ring_key;
+static bool perf_trace_ring_key_valid;
+#endif
+
+static void perf_trace_lock_acquire(void)
+{
+#ifdef HAVE_THREADS
+   if (perf_trace_lock)
+      slock_lock(perf_trace_lock);
+#endif
+}
+
+static void perf_trace_lock_release(void)
+{
+#ifdef HAVE_THREADS
+   if (perf_trace_lock)
+      slock_unlock(perf_trace_lock);
+#endif
+}
+
+static void perf_trace_register(const struct retro_perf_counter *perf)
+{
+   perf_trace_counter_t *counter = NULL;
+
+   if (!perf_trace_enable)
+      return;
+
+   perf_trace_lock_acquire();
+
+   if (perf_trace_counter_count < PERF_TRACE_MAX_COUNTERS)
+   {
+      counter                   = &perf_trace_counters[perf_trace_counter_count++];
+      counter->perf             = perf;
+      counter->ident            = strdup(perf->ident ? perf->ident : "unnamed");
+      counter->first_generation = perf_trace_generation;
+      counter->last_generation  = UINT_MAX;
+   }
+
+   perf_trace_lock_release();
+}
+
+/* Gives the ring of an exited thread back, its events stay
+ * in the trace until another thread takes the ring over. */
+#if defined(PERF_TRACE_THREAD_EXIT_FLS)
+static void WINAPI perf_trace_ring_release(void *data)
+#elif defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+static void perf_trace_ring_release(void *data)
+#endif
+#if defined(PERF_TRACE_THREAD_EXIT_FLS) || defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+{
+   perf_trace_ring_t *ring = (perf_trace_ring_t*)data;
+
+   if (!ring)
+      return;
+
+   perf_trace_lock_acquire();
+   ring->in_use = false;
+   perf_trace_lock_release();
+}
+#endif
+
+/* Hands a ring to the calling thread, reusing the ring of an
+ * exited thread before allocating another one. Every thread
+ * taking a ring gets the next trace thread ID, counting from 1
+ * in the order threads first recorded an event. The IDs aren't
+ * the IDs of the operating system and aren't reused, the events
+ * an exited thread left in a reused ring are dropped. */
+static perf_trace_ring_t *perf_trace_ring_new(void)
+{
+   unsigned i;
+   perf_trace_ring_t *ring = NULL;
+
+   perf_trace_lock_acquire();
+
+   for (i = 0; i < perf_trace_ring_count; i++)
+   {
+      if (!perf_trace_rings[i]->in_use)
+      {
+         ring       = perf_trace_rings[i];
+         ring->head = 0;
+         break;
+      }
+   }
+
+   if (!ring && perf_trace_ring_count < PERF_TRACE_MAX_THREADS)
+   {
+      ring = (perf_trace_ring_t*)calloc(1, sizeof(*ring));
+      if (ring)
+         ring->events = (perf_trace_event_t*)
+            malloc(PERF_TRACE_RING_SIZE * sizeof(*ring->events));
+
+      if (ring && ring->events)
+         perf_trace_rings[perf_trace_ring_count++] = ring;
+      else
+      {
+         free(ring);
+         ring = NULL;
+      }
+   }
+
+   if (ring)
+   {
+      ring->id     = ++perf_trace_ring_next_id;
+      ring->in_use = true;
+   }
+
+   perf_trace_lock_release();
+
+   if (!ring)
+   {
+      RARCH_WARN("[PERF]: Out of trace buffers, not tracing this thread.\n");
+      return NULL;
+   }
+
+#if defined(PERF_TRACE_THREAD_EXIT_FLS)
+   if (perf_trace_ring_key != FLS_OUT_OF_INDEXES)
+      FlsSetValue(perf_trace_ring_key, ring);
+#elif defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+   if (perf_trace_ring_key_valid)
+      pthread_setspecific(perf_trace_ring_key, ring);
+#endif
+
+   return ring;
+}
+
+static void perf_trace_record(const struct retro_perf_counter *perf,
+      bool begin, retro_time_t time)
+{
+   unsigned head;
+   perf_trace_event_t *event = NULL;
+   perf_trace_ring_t *ring   = perf_trace_ring_self;
+
+   if (!ring)
+   {
+      if (perf_trace_ring_failed)
+         return;
+
+      ring = perf_trace_ring_new();
+      if (!ring)
+      {
+         perf_trace_ring_failed = true;
+         return;
+      }
+
+      perf_trace_ring_self = ring;
+   }
+
+   head              = ring->head;
+   event             = &ring->events[head & PERF_TRACE_RING_MASK];
+   event->perf       = perf;
+   event->time       = time;
+   event->generation = perf_trace_generation;
+   event->begin      = begin;
+
+   PERF_TRACE_STORE(&ring->head, head + 1);
+}
+
+/* Copies the events still in @ring, oldest first.
+ * Returns the number of events copied. */
+static unsigned perf_trace_ring_copy(const perf_trace_ring_t *ring,
+      perf_trace_event_t *events)
+{
+   unsigned i, count, first, head;
+   unsigned start = PERF_TRACE_LOAD(&ring->head);
+
+   first = start > PERF_TRACE_RING_SIZE ? start - PERF_TRACE_RING_SIZE : 0;
+   count = start - first;
+
+   for (i = 0; i < count; i++)
+      events[i] = ring->events[(first + i) & PERF_TRACE_RING_MASK];
+
+   /* Whatever the thread wrote over meanwhile is torn, drop it. */
+   head = PERF_TRACE_LOAD(&ring->head);
+   if (head - first > PERF_TRACE_RING_SIZE)
+   {
+      unsigned lost = head - first - PERF_TRACE_RING_SIZE;
+
+      if (lost >= count)
+         return 0;
+
+      memmove(events, events + lost, (count - lost) * sizeof(*events));
+      count -= lost;
+   }
+
+   return count;
+}
+
+/* Returns the index of the counter @event was recorded for, -1 if
+ * it wasn't registered while tracing. */
+static int perf_trace_find_counter(const perf_trace_event_t *event)
+{
+   unsigned i;
+
+   for (i = 0; i < perf_trace_counter_count; i++)
+   {
+      const perf_trace_counter_t *counter = &perf_trace_counters[i];
+
+      if (counter->perf == event->perf
+            && event->generation >= counter->first_generation
+            && event->generation <= counter->last_generation)
+         return i;
+   }
+
+   return -1;
+}
+
+/**
+ * perf_trace_collect:
+ * @spans            : receives the begin/end pairs found
+ * @count            : receives the size of @spans
+ *
+ * Matches up the begin and end events of every thread.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool perf_trace_collect(perf_trace_span_t **spans, size_t *count)
+{
+   unsigned i, j, k;
+   size_t num                 = 0;
+   unsigned rings             = perf_trace_ring_count;
+   perf_trace_event_t *events = NULL;
+   perf_trace_span_t *out     = NULL;
+
+   *spans = NULL;
+   *count = 0;
+
+   events = (perf_trace_event_t*)
+      malloc(PERF_TRACE_RING_SIZE * sizeof(*events));
+   out    = (perf_trace_span_t*)malloc(rings
+         * (PERF_TRACE_RING_SIZE / 2) * sizeof(*out) + 1);
+
+   if (!events || !out)
+   {
+      free(events);
+      free(out);
+      return false;
+   }
+
+   perf_trace_lock_acquire();
+
+   for (i = 0; i < rings; i++)
+   {
+      const perf_trace_event_t *stack[PERF_TRACE_MAX_DEPTH];
+      unsigned depth = 0;
+      unsigned len   = perf_trace_ring_copy(perf_trace_rings[i], events);
+
+      for (j = 0; j < len; j++)
+      {
+         const perf_trace_event_t *event = &events[j];
+
+         if (event->begin)
+         {
+            if (depth < PERF_TRACE_MAX_DEPTH)
+               stack[depth++] = event;
+            continue;
+         }
+
+         /* Begins without an end were left by a counter stopped
+          * early, ends without a begin were cut off by the ring. */
+         for (k = depth; k > 0; k--)
+            if (stack[k - 1]->perf == event->perf)
+               break;
+         if (!k)
+            continue;
+
+         depth = k - 1;
+         out[num].counter  = perf_trace_find_counter(event);
+         out[num].duration = event->time - stack[depth]->time;
+         num++;
+      }
+   }
+
+   perf_trace_lock_release();
+
+   free(events);
+
+   *spans = out;
+   *count = num;
+   return true;
+}
+
+static int perf_trace_span_compare(const void *a, const void *b)
+{
+   const perf_trace_span_t *left  = (const perf_trace_span_t*)a;
+   const perf_trace_span_t *right = (const perf_trace_span_t*)b;
+
+   if (left->counter != right->counter)
+      return left->counter < right->counter ? -1 : 1;
+   if (left->duration != right->duration)
+      return left->duration < right->duration ? -1 : 1;
+   return 0;
+}
+
+static void perf_trace_log_counters(struct retro_perf_counter **counters,
+      unsigned num)
+{
+   size_t i, count;
+   perf_trace_span_t *spans = NULL;
+
+   if (!perf_trace_ring_count || !perf_trace_collect(&spans, &count))
+      return;
+
+   qsort(spans, count, sizeof(*spans), perf_trace_span_compare);
+
+   for (i = 0; i < count; )
+   {
+      size_t n;
+      unsigned k;
+      int counter = spans[i].counter;
+
+      for (n = i; n < count && spans[n].counter == counter; n++);
+
+      if (counter >= 0)
+      {
+         for (k = 0; k < num; k++)
+         {
+            if (counters[k] != perf_trace_counters[counter].perf
+                  || perf_trace_counters[counter].last_generation != UINT_MAX)
+               continue;
+
+            RARCH_LOG(PERF_TRACE_LOG_FMT,
+                  perf_trace_counters[counter].ident,
+                  (long long)spans[i + (n - i) / 2].duration,
+                  (long long)spans[i + (n - i) * 99 / 100].duration,
+                  (long long)spans[n - 1].duration,
+                  (unsigned)(n - i));
+            break;
+         }
+      }
+
+      i = n;
+   }
+
+   free(spans);
+}
+
+static void perf_trace_write_string(FILE *file, const char *str)
+{
+   fputc('"', file);
+
+   for (; *str; str++)
+   {
+      if (*str == '"' || *str == '\\')
+         fputc('\\', file);
+      if ((unsigned char)*str >= 0x20)
+         fputc(*str, file);
+   }
+
+   fputc('"', file);
+}
+#endif
+
 struct retro_perf_counter **retro_get_perf_counter_rarch(void)
 {
    return perf_counters_rarch;
@@ -73,6 +534,10 @@ void rarch_perf_register(struct retro_perf_counter *perf)
 
    perf_counters_rarch[perf_ptr_rarch++] = perf;
    perf->registered = true;
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   perf_trace_register(perf);
+#endif
 }
 
 void performance_counter_register(struct retro_perf_counter *perf)
@@ -82,10 +547,42 @@ void performance_counter_register(struct retro_perf_counter *perf)
 
    perf_counters_libretro[perf_ptr_libretro++] = perf;
    perf->registered = true;
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   perf_trace_register(perf);
+#endif
 }
 
 void performance_counters_clear(void)
 {
+#ifdef PERF_TRACE_THREAD_LOCAL
+   unsigned i, j;
+
+   perf_trace_lock_acquire();
+
+   /* Keep the names of the core's counters for its events. */
+   for (i = 0; i < perf_trace_counter_count; i++)
+   {
+      perf_trace_counter_t *counter = &perf_trace_counters[i];
+
+      if (counter->last_generation != UINT_MAX)
+         continue;
+
+      for (j = 0; j < perf_ptr_libretro; j++)
+      {
+         if (counter->perf == perf_counters_libretro[j])
+         {
+            counter->last_generation = perf_trace_generation;
+            break;
+         }
+      }
+   }
+
+   perf_trace_generation++;
+
+   perf_trace_lock_release();
+#endif
+
    perf_ptr_libretro = 0;
    memset(perf_counters_libretro, 0, sizeof(perf_counters_libretro));
 }
@@ -104,6 +601,10 @@ static void log_counters(struct retro_perf_counter **counters, unsigned num)
                (unsigned long long)counters[i]->call_cnt);
       }
    }
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   perf_trace_log_counters(counters, num);
+#endif
 }
 
 void rarch_perf_log(void)
@@ -137,6 +638,12 @@ void performance_counter_start(struct retro_perf_counter *perf)
       return;
 
    perf->call_cnt++;
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   if (perf_trace_enable)
+      perf_trace_record(perf, true, cpu_features_get_time_usec());
+#endif
+
    perf->start = cpu_features_get_perf_counter();
 }
 
@@ -146,4 +653,151 @@ void performance_counter_stop(struct retro_perf_counter *perf)
       return;
 
    perf->total += cpu_features_get_perf_counter() - perf->start;
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   if (perf_trace_enable)
+      perf_trace_record(perf, false, cpu_features_get_time_usec());
+#endif
+}
+
+void performance_counter_add_span(struct retro_perf_counter *perf,
+      retro_time_t start)
+{
+   retro_time_t now;
+
+   if (!runloop_ctl(RUNLOOP_CTL_IS_PERFCNT_ENABLE, NULL) || !perf)
+      return;
+
+   now = cpu_features_get_time_usec();
+   if (start > now)
+      start = now;
+
+   perf->call_cnt++;
+   perf->total += now - start;
+
+#ifdef PERF_TRACE_THREAD_LOCAL
+   if (perf_trace_enable)
+   {
+      perf_trace_record(perf, true, start);
+      perf_trace_record(perf, false, now);
+   }
+#endif
+}
+
+void performance_counter_add_value(struct retro_perf_counter *perf,
+      retro_perf_tick_t value)
+{
+   if (!runloop_ctl(RUNLOOP_CTL_IS_PERFCNT_ENABLE, NULL) || !perf)
+      return;
+
+   perf->call_cnt++;
+   perf->total += value;
+}
+
+void performance_counters_trace_init(void)
+{
+#ifdef PERF_TRACE_THREAD_LOCAL
+   unsigned i;
+
+   if (perf_trace_enable)
+      return;
+
+#ifdef HAVE_THREADS
+   if (!perf_trace_lock)
+      perf_trace_lock = slock_new();
+#endif
+
+#if defined(PERF_TRACE_THREAD_EXIT_FLS)
+   if (perf_trace_ring_key == FLS_OUT_OF_INDEXES)
+      perf_trace_ring_key = FlsAlloc(perf_trace_ring_release);
+#elif defined(PERF_TRACE_THREAD_EXIT_PTHREAD)
+   if (!perf_trace_ring_key_valid)
+      perf_trace_ring_key_valid = pthread_key_create(
+            &perf_trace_ring_key, perf_trace_ring_release) == 0;
+#endif
+
+   perf_trace_start_time = cpu_features_get_time_usec();
+
+   /* Counters registered before tracing started. */
+   perf_trace_enable = true;
+
+   for (i = 0; i < perf_ptr_rarch; i++)
+      perf_trace_register(perf_counters_rarch[i]);
+   for (i = 0; i < perf_ptr_libretro; i++)
+      perf_trace_register(perf_counters_libretro[i]);
+#else
+   RARCH_WARN("[PERF]: Tracing isn't supported on this platform.\n");
+#endif
+}
+
+bool performance_counters_trace_dump(const char *path)
+{
+#ifdef PERF_TRACE_THREAD_LOCAL
+   unsigned i, j;
+   bool first                 = true;
+   FILE *file                 = NULL;
+   perf_trace_event_t *events = NULL;
+
+   if (!perf_trace_enable || !path || !*path)
+      return false;
+
+   file = fopen(path, "w");
+   if (!file)
+   {
+      RARCH_ERR("[PERF]: Failed to write trace to \"%s\".\n", path);
+      return false;
+   }
+
+   events = (perf_trace_event_t*)
+      malloc(PERF_TRACE_RING_SIZE * sizeof(*events));
+   if (!events)
+   {
+      fclose(file);
+      return false;
+   }
+
+   fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+
+   perf_trace_lock_acquire();
+
+   for (i = 0; i < perf_trace_ring_count; i++)
+   {
+      const perf_trace_ring_t *ring = perf_trace_rings[i];
+      unsigned len                  = perf_trace_ring_copy(ring, events);
+
+      fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+            first ? "" : ",\n", ring->id, ring->id);
+      first = false;
+
+      for (j = 0; j < len; j++)
+      {
+         int counter = perf_trace_find_counter(&events[j]);
+
+         fputs(",\n{\"name\":", file);
+         perf_trace_write_string(file, counter >= 0
+               ? perf_trace_counters[counter].ident : "unknown");
+         fprintf(file, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%lld}",
+               events[j].begin ? 'B' : 'E', ring->id,
+               (long long)(events[j].time - perf_trace_start_time));
+      }
+   }
+
+   perf_trace_lock_release();
+
+   fputs("\n]}\n", file);
+
+   free(events);
+
+   if (fclose(file) != 0)
+   {
+      RARCH_ERR("[PERF]: Failed to write trace to \"%s\".\n", path);
+      return false;
+   }
+
+   RARCH_LOG("[PERF]: Wrote trace to \"%s\".\n", path);
+   return true;
+#else
+   return false;
+#endif
 }
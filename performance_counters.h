@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <boolean.h>
+
 #include <retro_common_api.h>
 #include <libretro.h>
 
@@ -62,6 +64,55 @@ void performance_counter_start(struct retro_perf_counter *perf);
  **/
 void performance_counter_stop(struct retro_perf_counter *perf);
 
+/**
+ * performance_counter_add_span:
+ * @perf               : pointer to performance counter
+ * @start              : when the span began, in microseconds,
+ *                       on the cpu_features_get_time_usec() clock
+ *
+ * Counts a span which began before the counter could be
+ * started, e.g. at the timestamp of an input event, and
+ * ends now. Such counters total microseconds, not ticks.
+ **/
+void performance_counter_add_span(struct retro_perf_counter *perf,
+      retro_time_t start);
+
+/**
+ * performance_counter_add_value:
+ * @perf               : pointer to performance counter
+ * @value              : sample to count
+ *
+ * Counts a sample of something other than time, e.g. a size
+ * or a depth, the logs then show the average of the samples.
+ **/
+void performance_counter_add_value(struct retro_perf_counter *perf,
+      retro_perf_tick_t value);
+
+/**
+ * performance_counters_trace_init:
+ *
+ * Starts recording when every counter starts and stops, along
+ * with the thread it ran on. Each thread keeps its most recent
+ * events, the performance logs then also show percentiles of
+ * the time the counters took.
+ **/
+void performance_counters_trace_init(void);
+
+/**
+ * performance_counters_trace_dump:
+ * @path               : file to write
+ *
+ * Writes the recorded events in the Chrome trace event format,
+ * for chrome://tracing and compatible viewers. The thread IDs
+ * in the trace number the threads in the order they first
+ * recorded an event, they aren't the IDs of the operating
+ * system. Up to 16 threads are traced at once, the buffer of
+ * a thread that exited goes to the next thread to record.
+ *
+ * Returns: true (1) if the trace was written, otherwise false (0).
+ **/
+bool performance_counters_trace_dump(const char *path);
+
 RETRO_END_DECLS
 
 #endif
@@ -33,6 +33,14 @@
 
 #include <compat/strl.h>
 
+#ifdef HAVE_ZLIB
+#include <file/archive_file.h>
+#endif
+
+#ifdef HAVE_NETWORKING
+#include <net/net_http.h>
+#endif
+
 #ifdef HAVE_CHEEVOS
 #include "cheevos.h"
 #endif
@@ -50,13 +58,16 @@
 #include "list_special.h"
 #include "audio/audio_driver.h"
 #include "camera/camera_driver.h"
+#include "gfx/video_driver.h"
 #include "record/record_driver.h"
 #include "input/input_driver.h"
 #include "ui/ui_companion_driver.h"
 #include "core.h"
+#include "performance_counters.h"
 
 #include "msg_hash.h"
 
+#include "input/input_autodetect.h"
 #include "input/input_keyboard.h"
 #include "tasks/tasks_internal.h"
 
@@ -1045,6 +1056,15 @@ bool runloop_ctl(enum runloop_ctl_state state, void *data)
 #ifdef HAVE_THREADS
             threaded_enable = settings->threaded_data_runloop_enable;
 #endif
+#ifdef HAVE_ZLIB
+            /* Before any task can read an archive. */
+            file_archive_init();
+#endif
+#ifdef HAVE_NETWORKING
+            net_http_pool_init();
+#endif
+            input_autoconfigure_index_init();
+            dir_list_cache_init();
             task_queue_ctl(TASK_QUEUE_CTL_DEINIT, NULL);
             task_queue_ctl(TASK_QUEUE_CTL_INIT, &threaded_enable);
          }
@@ -1075,6 +1095,11 @@ bool runloop_ctl(enum runloop_ctl_state state, void *data)
          return runloop_exec;
       case RUNLOOP_CTL_DATA_DEINIT:
          task_queue_ctl(TASK_QUEUE_CTL_DEINIT, NULL);
+#ifdef HAVE_NETWORKING
+         /* No transfers are left, drop the keep-alive connections. */
+         net_http_pool_clear();
+#endif
+         dir_list_cache_deinit();
          break;
       case RUNLOOP_CTL_IS_CORE_OPTION_UPDATED:
          if (!runloop_core_options)
@@ -1107,10 +1132,14 @@ bool runloop_ctl(enum runloop_ctl_state state, void *data)
             if (!runloop_core_options || !var)
                return false;
 
-            RARCH_LOG("Environ GET_VARIABLE %s:\n", var->key);
-            core_option_manager_get(runloop_core_options, var);
-            RARCH_LOG("\t%s\n", var->value ? var->value : 
-                  msg_hash_to_str(MENU_ENUM_LABEL_VALUE_NOT_AVAILABLE));
+            /* Cores read options every frame, only log new values. */
+            if (core_option_manager_get(runloop_core_options, var)
+                  || !var->value)
+            {
+               RARCH_LOG("Environ GET_VARIABLE %s:\n", var->key);
+               RARCH_LOG("\t%s\n", var->value ? var->value :
+                     msg_hash_to_str(MENU_ENUM_LABEL_VALUE_NOT_AVAILABLE));
+            }
          }
          break;
       case RUNLOOP_CTL_CORE_OPTIONS_INIT:
@@ -1302,13 +1331,14 @@ static INLINE int runloop_iterate_time_to_exit(bool quit_key_pressed)
  **/
 int runloop_iterate(unsigned *sleep_ms)
 {
-   unsigned i;
+   unsigned i, frame_delay;
    event_cmd_state_t    cmd;
-   retro_time_t current, target, to_sleep_ms;
+   retro_time_t current, target, to_sleep_ms, core_run_start;
    static retro_input_t last_input              = {0};
    event_cmd_state_t   *cmd_ptr                 = &cmd;
    static retro_time_t frame_limit_minimum_time = 0.0;
    static retro_time_t frame_limit_last_time    = 0.0;
+   static struct retro_perf_counter core_run_frame = {0};
    settings_t *settings                         = config_get_ptr();
 
    cmd.state[1]                                 = last_input;
@@ -1486,16 +1516,33 @@ int runloop_iterate(unsigned *sleep_ms)
             settings->input.analog_dpad_mode[i]);
    }
 
-   if ((settings->video.frame_delay > 0) && 
+   frame_delay = settings->video.frame_delay_auto ?
+      video_driver_frame_delay_auto_get(NULL) : settings->video.frame_delay;
+
+   if ((frame_delay > 0) &&
          !input_driver_is_nonblock_state())
-      retro_sleep(settings->video.frame_delay);
+      retro_sleep(frame_delay);
 
+   core_run_start = cpu_features_get_time_usec();
+
+   performance_counter_init(&core_run_frame, "core_run");
+   performance_counter_start(&core_run_frame);
    core_run();
+   performance_counter_stop(&core_run_frame);
+
+   /* Fast-forwarding says nothing about the time left. */
+   if (settings->video.frame_delay_auto && !input_driver_is_nonblock_state())
+      video_driver_frame_delay_auto_update(
+            cpu_features_get_time_usec() - core_run_start);
 
 #ifdef HAVE_CHEEVOS
    cheevos_test();
 #endif
 
+#if defined(HAVE_COMMAND) && defined(HAVE_NETWORK_CMD) && defined(HAVE_NETPLAY)
+   command_memwatch_frame();
+#endif
+
    for (i = 0; i < settings->input.max_users; i++)
    {
       if (!settings->input.analog_dpad_mode[i])
@@ -0,0 +1,105 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2011-2016 - Daniel De Matteis
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <queues/task_queue.h>
+
+#include "tasks_internal.h"
+#include "../input/input_autodetect.h"
+
+typedef struct autodetect_handle
+{
+   autoconfig_params_t params;
+   config_file_t *conf;
+} autodetect_handle_t;
+
+static void task_autodetect_handler(retro_task_t *task)
+{
+   autodetect_handle_t *handle = (autodetect_handle_t*)task->state;
+
+   if (!task->cancelled)
+      handle->conf = input_autoconfigure_find_profile(&handle->params);
+
+   task->task_data = handle;
+   task->finished  = true;
+}
+
+static void task_autodetect_callback(void *task_data,
+      void *user_data, const char *error)
+{
+   autodetect_handle_t *handle = (autodetect_handle_t*)task_data;
+
+   if (!handle)
+      return;
+
+   input_config_autoconfigure_joypad_apply(handle->conf, &handle->params);
+   handle->conf = NULL;
+}
+
+static void task_autodetect_free(retro_task_t *task)
+{
+   autodetect_handle_t *handle = (autodetect_handle_t*)task->state;
+
+   if (handle->conf)
+      config_file_free(handle->conf);
+   free(handle);
+}
+
+/**
+ * task_push_joypad_autoconfigure:
+ * @params               : the connected pad
+ *
+ * Like input_config_autoconfigure_joypad(), except that looking
+ * up and parsing the profile happens on the task thread. The
+ * binds are applied on the main thread once the profile is in.
+ *
+ * Returns: true if the task was pushed.
+ **/
+bool task_push_joypad_autoconfigure(autoconfig_params_t *params)
+{
+   retro_task_t *t             = NULL;
+   autodetect_handle_t *handle = NULL;
+
+   if (!input_config_autoconfigure_joypad_init(params))
+      return false;
+
+   if (!*params->name)
+      return false;
+
+   handle = (autodetect_handle_t*)calloc(1, sizeof(*handle));
+   if (!handle)
+      return false;
+
+   handle->params = *params;
+
+   t = (retro_task_t*)calloc(1, sizeof(*t));
+   if (!t)
+   {
+      free(handle);
+      return false;
+   }
+
+   t->state    = handle;
+   t->handler  = task_autodetect_handler;
+   t->callback = task_autodetect_callback;
+   t->cleanup  = task_autodetect_free;
+   t->mute     = true;
+
+   task_queue_ctl(TASK_QUEUE_CTL_PUSH, t);
+
+   return true;
+}
@@ -23,13 +23,21 @@
 #include <time.h>
 #include <errno.h>
 
-#include <file/file_path.h>
-#include <string/stdstring.h>
-
 #ifdef HAVE_CONFIG_H
 #include "../config.h"
 #endif
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <file/file_path.h>
+#include <string/stdstring.h>
+
 #ifdef HAVE_MENU
 #include "../menu/menu_driver.h"
 #include "../menu/menu_display.h"
@@ -76,6 +84,12 @@
 
 #include <lists/string_list.h>
 #include <string/stdstring.h>
+#include <features/features_cpu.h>
+#include <queues/task_queue.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "../defaults.h"
 #include "../msg_hash.h"
@@ -108,6 +122,9 @@
 
 #define MAX_ARGS 32
 
+/* Amount of content hashed per iteration of the CRC task. */
+#define CONTENT_CRC_CHUNK_SIZE (4 * 1024 * 1024)
+
 typedef struct content_stream
 {
    uint32_t a;
@@ -122,6 +139,36 @@ static bool _content_is_inited                                = false;
 static bool core_does_not_need_content                        = false;
 static uint32_t content_crc                                   = 0;
 
+/* The CRC of the first content file is only needed by history,
+ * movies, netplay and the like, so it is computed by a task
+ * while the core loads instead of in front of it. The job
+ * owns the content buffer until both the loader is done with
+ * it and the CRC has been computed.
+ *
+ * Cores may modify their content buffer in place, so the task
+ * hashes a read-only mapping of the file of its own. Buffers
+ * which aren't mapped are hashed before the core gets them. */
+typedef struct content_crc_job
+{
+   uint8_t *data;
+   /* What is hashed, either data or a read-only mapping. */
+   const uint8_t *hash;
+   size_t size;
+   size_t pos;
+   uint32_t crc;
+   unsigned generation;
+   bool mapped;
+   bool hash_mapped;
+   bool in_use;
+   bool pending;
+   retro_time_t time_usec;
+} content_crc_job_t;
+
+static content_crc_job_t content_crc_job;
+#ifdef HAVE_THREADS
+static slock_t *content_crc_lock                              = NULL;
+#endif
+
 #ifdef HAVE_COMPRESSION
 
 #ifdef HAVE_7ZIP
@@ -675,6 +722,238 @@ error:
 }
 #endif
 
+#ifdef HAVE_ZLIB
+#define CONTENT_EXTRACT_CACHE_DIR   "extract"
+#define CONTENT_EXTRACT_CACHE_INDEX "index"
+
+/* Entries of the extraction cache are kept in <cache>/extract/<key>/,
+ * where <key> combines the CRC32 of the archive path with the CRC32 of
+ * the member as recorded in the zip central directory. The extracted
+ * file keeps its original name, so cores still see the name they
+ * expect.
+ *
+ * <cache>/extract/index lists one "<key> <size> <name>" line per
+ * entry, least recently used first. */
+
+static bool content_extract_cache_root(char *s, size_t len)
+{
+   settings_t *settings = config_get_ptr();
+
+   if (!settings->extraction_cache_size)
+      return false;
+   if (string_is_empty(settings->directory.cache)
+         || !path_is_directory(settings->directory.cache))
+      return false;
+
+   fill_pathname_join(s, settings->directory.cache,
+         CONTENT_EXTRACT_CACHE_DIR, len);
+
+   if (!path_is_directory(s) && !path_mkdir(s))
+      return false;
+
+   return true;
+}
+
+static void content_extract_cache_remove(const char *root,
+      const char *line)
+{
+   char key[17];
+   char entry_dir[PATH_MAX_LENGTH] = {0};
+   char entry[PATH_MAX_LENGTH]     = {0};
+   const char *name                = strchr(line, ' ');
+
+   if (!name || name - line != 16)
+      return;
+
+   name = strchr(name + 1, ' ');
+   if (!name)
+      return;
+
+   strlcpy(key, line, sizeof(key));
+   fill_pathname_join(entry_dir, root, key, sizeof(entry_dir));
+   fill_pathname_join(entry, entry_dir, name + 1, sizeof(entry));
+
+   RARCH_LOG("Evicting extracted content: %s.\n", entry);
+
+   remove(entry);
+   remove(entry_dir);
+}
+
+/**
+ * content_extract_cache_touch:
+ * @root         : extraction cache directory.
+ * @key          : key of the entry that was used.
+ * @size         : size of the entry.
+ * @name         : file name of the entry.
+ *
+ * Marks the entry as most recently used, then evicts least
+ * recently used entries until the cache fits its size limit.
+ **/
+static void content_extract_cache_touch(const char *root,
+      const char *key, uint64_t size, const char *name)
+{
+   unsigned i;
+   char index_path[PATH_MAX_LENGTH] = {0};
+   char line[PATH_MAX_LENGTH + 64]  = {0};
+   union string_list_elem_attr attr;
+   uint64_t total                   = 0;
+   size_t first                     = 0;
+   void *buf                        = NULL;
+   ssize_t buf_len                  = 0;
+   struct string_list *lines        = NULL;
+   struct string_list *kept         = string_list_new();
+   settings_t *settings             = config_get_ptr();
+   uint64_t budget                  =
+      (uint64_t)settings->extraction_cache_size * 1024 * 1024;
+
+   if (!kept)
+      return;
+
+   attr.i = 0;
+
+   fill_pathname_join(index_path, root, CONTENT_EXTRACT_CACHE_INDEX,
+         sizeof(index_path));
+
+   if (path_file_exists(index_path)
+         && filestream_read_file(index_path, &buf, &buf_len) && buf_len > 0)
+      lines = string_split((const char*)buf, "\n");
+   free(buf);
+
+   for (i = 0; lines && i < lines->size; i++)
+   {
+      const char *elem = lines->elems[i].data;
+
+      if (strlen(elem) < 18 || !strncmp(elem, key, 16))
+         continue;
+
+      total += strtoull(elem + 17, NULL, 10);
+      string_list_append(kept, elem, attr);
+   }
+
+   snprintf(line, sizeof(line), "%s %llu %s",
+         key, (unsigned long long)size, name);
+   string_list_append(kept, line, attr);
+   total += size;
+
+   /* Never evict the entry that is about to be used. */
+   while (total > budget && first + 1 < kept->size)
+   {
+      const char *elem = kept->elems[first++].data;
+      total           -= strtoull(elem + 17, NULL, 10);
+      content_extract_cache_remove(root, elem);
+   }
+
+   {
+      size_t out_len = 0;
+      char *out      = NULL;
+
+      for (i = first; i < kept->size; i++)
+         out_len += strlen(kept->elems[i].data) + 1;
+
+      out = (char*)calloc(out_len + 1, 1);
+
+      if (out)
+      {
+         for (i = first; i < kept->size; i++)
+         {
+            strlcat(out, kept->elems[i].data, out_len + 1);
+            strlcat(out, "\n", out_len + 1);
+         }
+
+         filestream_write_file(index_path, out, strlen(out));
+         free(out);
+      }
+   }
+
+   string_list_free(kept);
+   if (lines)
+      string_list_free(lines);
+}
+
+/**
+ * content_extract_cache_get:
+ * @archive      : path to the zip archive.
+ * @member       : file inside @archive to extract.
+ * @out_path     : set to the path of the extracted file.
+ * @len          : size of @out_path.
+ *
+ * Looks up @member in the extraction cache, extracting it into
+ * the cache on a miss.
+ *
+ * Returns: true if @out_path holds the extracted file and must
+ * not be deleted, false if the cache is unavailable and the
+ * caller should fall back to a temporary extraction.
+ **/
+static bool content_extract_cache_get(const char *archive,
+      const char *member, char *out_path, size_t len)
+{
+   char key[17];
+   uint32_t member_crc                  = 0;
+   uint32_t member_size                 = 0;
+   uint32_t archive_crc                 = 0;
+   ssize_t extracted_len                = 0;
+   char root[PATH_MAX_LENGTH]           = {0};
+   char entry_dir[PATH_MAX_LENGTH]      = {0};
+   char archive_path[PATH_MAX_LENGTH]   = {0};
+   char full_path[PATH_MAX_LENGTH * 2]  = {0};
+   const char *name                     = path_basename(member);
+
+   if (!string_is_equal_noncase(path_get_extension(archive), "zip"))
+      return false;
+   if (!content_extract_cache_root(root, sizeof(root)))
+      return false;
+   if (!file_archive_get_file_crc(archive, member,
+            &member_crc, &member_size))
+      return false;
+
+   if (!stream_backend)
+      stream_backend = file_archive_get_default_file_backend();
+
+   /* Key on the absolute archive path, so relaunching the same
+    * archive through a different relative path still hits. */
+   strlcpy(archive_path, archive, sizeof(archive_path));
+   path_resolve_realpath(archive_path, sizeof(archive_path));
+   archive_crc = stream_backend->stream_crc_calculate(0,
+         (const uint8_t*)archive_path, strlen(archive_path));
+
+   snprintf(key, sizeof(key), "%08x%08x",
+         (unsigned)archive_crc, (unsigned)member_crc);
+
+   fill_pathname_join(entry_dir, root, key, sizeof(entry_dir));
+   fill_pathname_join(out_path, entry_dir, name, len);
+
+   if (path_file_exists(out_path)
+         && (uint32_t)path_get_size(out_path) == member_size)
+   {
+      RARCH_LOG("Reusing extracted content: %s.\n", out_path);
+      content_extract_cache_touch(root, key, member_size, name);
+      return true;
+   }
+
+   if (!path_is_directory(entry_dir) && !path_mkdir(entry_dir))
+      return false;
+
+   /* Drop any partial leftover, content_file_compressed_read()
+    * would otherwise take it as already extracted. */
+   remove(out_path);
+
+   snprintf(full_path, sizeof(full_path), "%s#%s", archive, member);
+
+   RARCH_LOG("Extracting content to cache: %s.\n", out_path);
+
+   if (!content_file_compressed_read(full_path, NULL,
+            out_path, &extracted_len) || extracted_len < 0)
+   {
+      remove(out_path);
+      remove(entry_dir);
+      return false;
+   }
+
+   content_extract_cache_touch(root, key, member_size, name);
+   return true;
+}
+#endif
+
 /**
  * content_file_read:
  * @path             : path to file.
@@ -951,6 +1230,268 @@ error:
    return retval;
 }
 
+#ifdef HAVE_MMAP
+/**
+ * content_file_mmap:
+ * @path             : path to file.
+ * @buf              : set to the mapping of the file.
+ * @length           : size of the mapping.
+ * @writable         : whether the mapping may be written to.
+ *
+ * Maps the content file into memory instead of reading it.
+ * The mapping is private, so cores which modify their
+ * writable content buffer get copy-on-write pages rather
+ * than touching the file.
+ *
+ * Returns: true if the file was mapped, false if it should be
+ * read the regular way.
+ **/
+static bool content_file_mmap(const char *path, void **buf, ssize_t *length,
+      bool writable)
+{
+   struct stat st;
+   void *map = NULL;
+   int fd    = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return false;
+
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+   {
+      close(fd);
+      return false;
+   }
+
+   map = mmap(NULL, (size_t)st.st_size,
+         writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (map == MAP_FAILED)
+      return false;
+
+   *buf    = map;
+   *length = (ssize_t)st.st_size;
+   return true;
+}
+#endif
+
+static void content_crc_job_lock(void)
+{
+#ifdef HAVE_THREADS
+   if (content_crc_lock)
+      slock_lock(content_crc_lock);
+#endif
+}
+
+static void content_crc_job_unlock(void)
+{
+#ifdef HAVE_THREADS
+   if (content_crc_lock)
+      slock_unlock(content_crc_lock);
+#endif
+}
+
+/* Must be called with the job locked. */
+static void content_crc_job_free_hash(void)
+{
+#ifdef HAVE_MMAP
+   if (content_crc_job.hash_mapped)
+      munmap((void*)content_crc_job.hash, content_crc_job.size);
+#endif
+   content_crc_job.hash        = NULL;
+   content_crc_job.hash_mapped = false;
+}
+
+/* Must be called with the job locked. */
+static void content_crc_job_free_data(void)
+{
+   content_crc_job_free_hash();
+
+   if (!content_crc_job.data)
+      return;
+
+#ifdef HAVE_MMAP
+   if (content_crc_job.mapped)
+      munmap(content_crc_job.data, content_crc_job.size);
+   else
+#endif
+      free(content_crc_job.data);
+
+   content_crc_job.data   = NULL;
+   content_crc_job.mapped = false;
+}
+
+/* Hashes up to @len more bytes of the content.
+ * Must be called with the job locked.
+ *
+ * Returns: true once the CRC is known. */
+static bool content_crc_job_iterate(size_t len)
+{
+   retro_time_t start = cpu_features_get_time_usec();
+
+   if (!content_crc_job.pending)
+      return true;
+
+   if (len > content_crc_job.size - content_crc_job.pos)
+      len = content_crc_job.size - content_crc_job.pos;
+
+#ifdef HAVE_ZLIB
+   if (!stream_backend)
+      stream_backend = file_archive_get_default_file_backend();
+   content_crc_job.crc = stream_backend->stream_crc_calculate(
+         content_crc_job.crc,
+         content_crc_job.hash + content_crc_job.pos, len);
+#endif
+   content_crc_job.pos       += len;
+   content_crc_job.time_usec += cpu_features_get_time_usec() - start;
+
+   if (content_crc_job.pos < content_crc_job.size)
+      return false;
+
+   content_crc_job.pending = false;
+   content_crc             = content_crc_job.crc;
+   content_crc_job_free_hash();
+
+#ifdef HAVE_ZLIB
+   RARCH_LOG("CRC32: 0x%x (%u usec).\n",
+         (unsigned)content_crc, (unsigned)content_crc_job.time_usec);
+#endif
+
+   if (!content_crc_job.in_use)
+      content_crc_job_free_data();
+
+   return true;
+}
+
+static void content_crc_task_handler(retro_task_t *task)
+{
+   bool done           = true;
+   unsigned generation = (unsigned)(uintptr_t)task->state;
+
+   content_crc_job_lock();
+   if (content_crc_job.generation == generation && !task->cancelled)
+      done = content_crc_job_iterate(CONTENT_CRC_CHUNK_SIZE);
+   if (content_crc_job.size)
+      task->progress = (int8_t)
+         (content_crc_job.pos * 100 / content_crc_job.size);
+   content_crc_job_unlock();
+
+   if (done)
+      task->finished = true;
+}
+
+/**
+ * content_crc_job_start:
+ * @path         : path of the content file.
+ * @data         : content buffer, ownership passes to the job.
+ * @size         : size of @data.
+ * @mapped       : true if @data was returned by content_file_mmap().
+ *
+ * Hands the first content file to a task which computes its CRC
+ * in the background. content_get_crc() finishes the job on the
+ * calling thread if the CRC is needed before the task is done.
+ * Content which can't be mapped read-only again is hashed right
+ * away instead.
+ **/
+static void content_crc_job_start(const char *path,
+      void *data, size_t size, bool mapped)
+{
+   unsigned generation;
+#ifdef HAVE_MMAP
+   void *hash         = NULL;
+   ssize_t hash_size  = 0;
+#endif
+   bool background    = false;
+   retro_task_t *task = NULL;
+
+#ifdef HAVE_THREADS
+   if (!content_crc_lock)
+      content_crc_lock = slock_new();
+#endif
+
+   content_crc_job_lock();
+   content_crc_job_free_data();
+   content_crc_job.data       = (uint8_t*)data;
+   content_crc_job.hash       = (const uint8_t*)data;
+   content_crc_job.size       = size;
+   content_crc_job.pos        = 0;
+   content_crc_job.crc        = 0;
+   content_crc_job.mapped     = mapped;
+   content_crc_job.in_use     = true;
+   content_crc_job.pending    = true;
+   content_crc_job.time_usec  = 0;
+   generation                 = ++content_crc_job.generation;
+
+#ifdef HAVE_MMAP
+   if (mapped && content_file_mmap(path, &hash, &hash_size, false))
+   {
+      if ((size_t)hash_size == size)
+      {
+         content_crc_job.hash        = (const uint8_t*)hash;
+         content_crc_job.hash_mapped = true;
+      }
+      else
+         munmap(hash, (size_t)hash_size);
+   }
+#endif
+   background = content_crc_job.hash_mapped;
+   content_crc_job_unlock();
+
+   if (background)
+      task = (retro_task_t*)calloc(1, sizeof(*task));
+
+   if (!task)
+   {
+      content_crc_job_lock();
+      content_crc_job_iterate(size);
+      content_crc_job_unlock();
+      return;
+   }
+
+   task->handler = content_crc_task_handler;
+   task->state   = (void*)(uintptr_t)generation;
+   task->mute    = true;
+
+   task_queue_ctl(TASK_QUEUE_CTL_PUSH, task);
+}
+
+/**
+ * content_crc_job_release:
+ * @data         : content buffer the loader is done with.
+ *
+ * Returns: true if @data is owned by the CRC job (and will be
+ * freed by it), false if the caller still has to free it.
+ **/
+static bool content_crc_job_release(const void *data)
+{
+   bool owned = false;
+
+   if (!data)
+      return false;
+
+   content_crc_job_lock();
+   if (content_crc_job.data == data)
+   {
+      owned                  = true;
+      content_crc_job.in_use = false;
+      if (!content_crc_job.pending)
+         content_crc_job_free_data();
+   }
+   content_crc_job_unlock();
+
+   return owned;
+}
+
+static void content_crc_job_cancel(void)
+{
+   content_crc_job_lock();
+   content_crc_job.pending = false;
+   content_crc_job.in_use  = false;
+   content_crc_job_free_data();
+   content_crc_job.generation++;
+   content_crc_job_unlock();
+}
+
 /**
  * read_content_file:
  * @path         : buffer of the content file.
@@ -961,48 +1502,63 @@ error:
  * (see patch_content function) in case soft patching has not been
  * blocked by the enduser.
  *
+ * The first content file is memory-mapped when no soft patch applies,
+ * and its CRC is computed by a task while the core loads.
+ *
  * Returns: true if successful, false on error.
  **/
 static bool read_content_file(unsigned i, const char *path, void **buf,
       ssize_t *length)
 {
-#ifdef HAVE_ZLIB
-   content_stream_t stream_info;
-   uint32_t *content_crc_ptr = NULL;
-#endif
+   retro_time_t io_usec      = 0;
+   retro_time_t patch_usec   = 0;
+   bool mapped               = false;
    uint8_t *ret_buf          = NULL;
    global_t *global          = global_get_ptr();
+   bool do_patch             = !global->patch.block_patch;
 
    RARCH_LOG("%s: %s.\n",
          msg_hash_to_str(MSG_LOADING_CONTENT_FILE), path);
-   if (!content_file_read(path, (void**) &ret_buf, length))
+
+   io_usec = cpu_features_get_time_usec();
+
+#ifdef HAVE_MMAP
+   if (i == 0 && !(do_patch && patch_content_is_pending())
+#ifdef HAVE_COMPRESSION
+         && !path_contains_compressed_file(path)
+#endif
+      )
+      mapped = content_file_mmap(path, (void**)&ret_buf, length, true);
+#endif
+
+   if (!mapped && !content_file_read(path, (void**) &ret_buf, length))
       return false;
 
+   io_usec = cpu_features_get_time_usec() - io_usec;
+
    if (*length < 0)
       return false;
 
    if (i != 0)
+   {
+      *buf = ret_buf;
       return true;
+   }
 
    /* Attempt to apply a patch. */
-   if (!global->patch.block_patch)
+   if (do_patch && !mapped)
+   {
+      patch_usec = cpu_features_get_time_usec();
       patch_content(&ret_buf, length);
+      patch_usec = cpu_features_get_time_usec() - patch_usec;
+   }
 
-#ifdef HAVE_ZLIB
-   content_get_crc(&content_crc_ptr);
+   RARCH_LOG("Content read in %u usec (%s), patched in %u usec.\n",
+         (unsigned)io_usec, mapped ? "mapped" : "buffered",
+         (unsigned)patch_usec);
 
-   stream_info.a = 0;
-   stream_info.b = ret_buf;
-   stream_info.c = *length;
+   content_crc_job_start(path, ret_buf, *length, mapped);
 
-   if (!stream_backend)
-      stream_backend = file_archive_get_default_file_backend();
-   stream_info.crc = stream_backend->stream_crc_calculate(
-         stream_info.a, stream_info.b, stream_info.c);
-   *content_crc_ptr = stream_info.crc;
-
-   RARCH_LOG("CRC32: 0x%x .\n", (unsigned)*content_crc_ptr);
-#endif
    *buf = ret_buf;
 
    return true;
@@ -1087,6 +1643,7 @@ static bool load_content_from_compressed_archive(
    char new_basedir[PATH_MAX_LENGTH] = {0};
    ssize_t new_path_len              = 0;
    bool ret                          = false;
+   bool cached                       = false;
    rarch_system_info_t      *sys_info= NULL;
    settings_t *settings              = config_get_ptr();
 
@@ -1114,24 +1671,40 @@ static bool load_content_from_compressed_archive(
    }
 
    attributes.i = 0;
-   fill_pathname_join(new_path, new_basedir,
-         path_basename(path), sizeof(new_path));
 
-   ret = content_file_compressed_read(path, NULL, new_path, &new_path_len);
+#ifdef HAVE_ZLIB
+   {
+      struct string_list *str_list = string_split(path, "#");
+
+      if (str_list && str_list->size > 1)
+         cached = content_extract_cache_get(str_list->elems[0].data,
+               str_list->elems[1].data, new_path, sizeof(new_path));
+      string_list_free(str_list);
+   }
+#endif
 
-   if (!ret || new_path_len < 0)
+   if (!cached)
    {
-      RARCH_ERR("%s \"%s\".\n",
-            msg_hash_to_str(MSG_COULD_NOT_READ_CONTENT_FILE),
-            path);
-      return false;
+      fill_pathname_join(new_path, new_basedir,
+            path_basename(path), sizeof(new_path));
+
+      ret = content_file_compressed_read(path, NULL, new_path, &new_path_len);
+
+      if (!ret || new_path_len < 0)
+      {
+         RARCH_ERR("%s \"%s\".\n",
+               msg_hash_to_str(MSG_COULD_NOT_READ_CONTENT_FILE),
+               path);
+         return false;
+      }
    }
 
    string_list_append(additional_path_allocs, new_path, attributes);
    info[i].path = 
       additional_path_allocs->elems[additional_path_allocs->size -1 ].data;
 
-   if (!string_list_append(temporary_content, new_path, attributes))
+   if (!cached && !string_list_append(temporary_content,
+            new_path, attributes))
       return false;
 
    return true;
@@ -1156,6 +1729,7 @@ static bool load_content(
       )
 {
    unsigned i;
+   retro_time_t load_usec;
    retro_ctx_load_content_info_t load_info;
 
    if (!info || !additional_path_allocs)
@@ -1184,6 +1758,32 @@ static bool load_content(
       {
          if (!load_content_into_memory(&info[i], i, path))
             return false;
+
+#ifdef HAVE_COMPRESSION
+         /* An archive member inflated into memory has no file of
+          * its own, hand the core the path of the archive. */
+         if (path_contains_compressed_file(path))
+         {
+            union string_list_elem_attr attributes;
+            char archive[PATH_MAX_LENGTH] = {0};
+            char *delim                   = NULL;
+
+            attributes.i = 0;
+            strlcpy(archive, path, sizeof(archive));
+            delim        = strchr(archive, '#');
+            if (delim)
+               *delim    = '\0';
+
+            if (delim && path_is_compressed_file(archive))
+            {
+               if (!string_list_append(additional_path_allocs,
+                        archive, attributes))
+                  return false;
+               info[i].path = additional_path_allocs->elems[
+                  additional_path_allocs->size - 1].data;
+            }
+         }
+#endif
       }
       else
       {
@@ -1204,12 +1804,17 @@ static bool load_content(
    load_info.special = special;
    load_info.info    = info;
 
+   load_usec         = cpu_features_get_time_usec();
+
    if (!core_load_game(&load_info))
    {
       RARCH_ERR("%s.\n", msg_hash_to_str(MSG_FAILED_TO_LOAD_CONTENT));
       return false;
    }
 
+   RARCH_LOG("Core loaded content in %u usec.\n",
+         (unsigned)(cpu_features_get_time_usec() - load_usec));
+
 #ifdef HAVE_CHEEVOS
    if (!special)
    {
@@ -1308,10 +1913,45 @@ static bool init_content_file_extract(
       {
          char new_path[PATH_MAX_LENGTH]     = {0};
          char temp_content[PATH_MAX_LENGTH] = {0};
+         bool need_fullpath                 = content->elems[i].attr.i & 2;
+         struct string_list *members        = NULL;
 
          strlcpy(temp_content, content->elems[i].data,
                sizeof(temp_content));
 
+         if (valid_ext)
+            members = file_archive_get_file_list(temp_content, valid_ext);
+
+         if (members && members->size > 0)
+         {
+            const char *member = members->elems[0].data;
+            bool handled       = false;
+
+            if (!need_fullpath)
+            {
+               /* The content is loaded into memory anyway, let
+                * load_content() inflate it straight into its
+                * buffer instead of going through a temporary file.
+                * The core is given the archive path. */
+               snprintf(new_path, sizeof(new_path), "%s#%s",
+                     temp_content, member);
+               handled = true;
+            }
+            else
+               handled = content_extract_cache_get(temp_content,
+                     member, new_path, sizeof(new_path));
+
+            string_list_free(members);
+
+            if (handled)
+            {
+               string_list_set(content, i, new_path);
+               continue;
+            }
+         }
+         else if (members)
+            string_list_free(members);
+
          if (!file_archive_extract_first_content_file(temp_content,
                   sizeof(temp_content), valid_ext,
                   *settings->directory.cache ?
@@ -1433,7 +2073,10 @@ static bool content_file_init(struct string_list *temporary_content)
          info, content, special, additional_path_allocs); 
 
    for (i = 0; i < content->size; i++)
-      free((void*)info[i].data);
+   {
+      if (!content_crc_job_release(info[i].data))
+         free((void*)info[i].data);
+   }
 
    string_list_free(additional_path_allocs);
    if (info)
@@ -1487,6 +2130,12 @@ bool content_get_crc(uint32_t **content_crc_ptr)
 {
    if (!content_crc_ptr)
       return false;
+
+   /* Don't hand out a CRC that is still being computed. */
+   content_crc_job_lock();
+   content_crc_job_iterate(content_crc_job.size);
+   content_crc_job_unlock();
+
    *content_crc_ptr = &content_crc;
    return true;
 }
@@ -1498,6 +2147,7 @@ bool content_is_inited(void)
 
 void content_deinit(void)
 {
+   content_crc_job_cancel();
    content_file_free(temporary_content);
    temporary_content          = NULL;
    content_crc                = 0;
@@ -407,19 +407,21 @@ static int task_database_iterate_playlist_zip(
       database_state_handle_t *db_state,
       database_info_handle_t *db, const char *name)
 {
-   bool returnerr = true;
 #ifdef HAVE_ZLIB
+   uint32_t crc                  = 0;
+   char member[PATH_MAX_LENGTH]  = {0};
+
    if (db_state->crc != 0)
       return task_database_iterate_crc_lookup(
             db_state, db, db_state->zip_name);
 
-   if (file_archive_parse_file_iterate(&db->state,
-            &returnerr, name, NULL, zlib_compare_crc32,
-            (void*)db_state) != 0)
-      return 0;
+   /* The CRC of each file is recorded in the archive's
+    * central directory, no need to inflate anything. */
+   if (file_archive_get_first_file_crc(name, member, sizeof(member), &crc))
+      zlib_compare_crc32(member, NULL, NULL, 0, 0, 0, crc, db_state);
 
-   if (db_state->crc)
-      file_archive_parse_file_iterate_stop(&db->state);
+   if (!db_state->crc)
+      return 0;
 #endif
 
    return 1;
@@ -57,7 +57,178 @@ static struct magic_entry MAGIC_NUMBERS[] = {
     {NULL,     NULL}
 };
 
-static ssize_t get_token(RFILE *fd, char *token, size_t max_len)
+/* Disc images are read through a window up to this large,
+ * scanning one takes a handful of reads instead of one per byte.
+ * Smaller requests only read the sectors they cover. */
+#define READER_WINDOW_SIZE   (64 * 1024)
+#define READER_ALIGN         2048
+
+/* Serials are searched in the first this many bytes. */
+#define PSP_SERIAL_SCAN_LEN  100000
+
+typedef struct disc_reader
+{
+   RFILE *fd;
+   uint8_t *window;
+   /* File offset of window[0]. */
+   ssize_t window_pos;
+   ssize_t window_len;
+   ssize_t len;
+   /* Offset of the next disc_reader_getc(). */
+   ssize_t pos;
+} disc_reader_t;
+
+static const char *psp_serial_prefixes[] = {
+   "ULES", "ULUS", "ULJS",
+   "ULEM", "ULUM", "ULJM",
+   "UCES", "UCUS", "UCJS", "UCAS",
+   "NPEH", "NPUH", "NPJH",
+   "NPEG", "NPUG", "NPJG", "NPHG",
+   "NPEZ", "NPUZ", "NPJZ"
+};
+
+static bool disc_reader_open(disc_reader_t *reader, const char *path)
+{
+   memset(reader, 0, sizeof(*reader));
+
+   /* The window is the buffer, no need for stdio's too. */
+   reader->fd = filestream_open(path,
+         RFILE_MODE_READ | RFILE_HINT_UNBUFFERED, -1);
+   if (!reader->fd)
+      return false;
+
+   if (filestream_seek(reader->fd, 0, SEEK_END) >= 0)
+      reader->len = filestream_tell(reader->fd);
+   else
+      reader->len = -1;
+   reader->window = (uint8_t*)malloc(READER_WINDOW_SIZE);
+
+   if (reader->len < 0 || !reader->window)
+   {
+      filestream_close(reader->fd);
+      free(reader->window);
+      reader->fd     = NULL;
+      reader->window = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+static void disc_reader_close(disc_reader_t *reader)
+{
+   if (reader->fd)
+      filestream_close(reader->fd);
+   free(reader->window);
+   reader->fd     = NULL;
+   reader->window = NULL;
+}
+
+/**
+ * disc_reader_get:
+ * @reader              : disc reader
+ * @offset              : file offset
+ * @len                 : bytes wanted, at most READER_WINDOW_SIZE
+ * @avail               : receives the bytes available at @offset,
+ *                        fewer than @len at the end of the file
+ *
+ * Moves the window over @offset if it isn't there yet, reading
+ * the sectors @len spans.
+ *
+ * Returns: pointer to the bytes at @offset, NULL if past the end
+ * of the file or on error.
+ **/
+static const uint8_t *disc_reader_get(disc_reader_t *reader,
+      ssize_t offset, size_t len, size_t *avail)
+{
+   ssize_t end;
+
+   *avail = 0;
+
+   if (offset < 0 || offset >= reader->len)
+      return NULL;
+
+   if (len > READER_WINDOW_SIZE)
+      len = READER_WINDOW_SIZE;
+
+   end = offset + (ssize_t)len;
+   if (end > reader->len)
+      end = reader->len;
+
+   if (offset < reader->window_pos
+         || end > reader->window_pos + reader->window_len)
+   {
+      /* Start on a sector if that still fits the request. */
+      ssize_t start = offset - (offset % READER_ALIGN);
+      ssize_t size;
+
+      if (end > start + READER_WINDOW_SIZE)
+         start = offset;
+
+      size = end - start + READER_ALIGN - 1;
+      size = MIN(size - (size % READER_ALIGN), READER_WINDOW_SIZE);
+      size = MIN(size, reader->len - start);
+
+      reader->window_pos = start;
+      reader->window_len = 0;
+
+      if (filestream_seek(reader->fd, start, SEEK_SET) < 0)
+         return NULL;
+
+      while (reader->window_len < size)
+      {
+         ssize_t ret = filestream_read(reader->fd,
+               reader->window + reader->window_len,
+               size - reader->window_len);
+
+         if (ret < 0 && errno == EINTR)
+            continue;
+         if (ret <= 0)
+            break;
+         reader->window_len += ret;
+      }
+
+      if (end > reader->window_pos + reader->window_len)
+         end = reader->window_pos + reader->window_len;
+      if (end <= offset)
+         return NULL;
+   }
+
+   *avail = end - offset;
+   return reader->window + (offset - reader->window_pos);
+}
+
+/* Copies up to @len bytes at @offset, returns how many. */
+static size_t disc_reader_read(disc_reader_t *reader,
+      ssize_t offset, void *data, size_t len)
+{
+   size_t avail;
+   const uint8_t *src = disc_reader_get(reader, offset, len, &avail);
+
+   if (src)
+      memcpy(data, src, avail);
+   return avail;
+}
+
+static int disc_reader_getc(disc_reader_t *reader)
+{
+   size_t avail;
+   const uint8_t *src;
+
+   /* Cheap path for sequential reads out of the window. */
+   if (reader->pos >= reader->window_pos
+         && reader->pos < reader->window_pos + reader->window_len)
+      return reader->window[reader->pos++ - reader->window_pos];
+
+   src = disc_reader_get(reader, reader->pos, READER_WINDOW_SIZE, &avail);
+   if (!src)
+      return EOF;
+
+   reader->pos++;
+   return *src;
+}
+
+static ssize_t get_token(disc_reader_t *reader, char *token, size_t max_len)
 {
    char *c       = token;
    ssize_t len   = 0;
@@ -65,21 +236,11 @@ static ssize_t get_token(RFILE *fd, char *token, size_t max_len)
 
    while (1)
    {
-      int rv = filestream_read(fd, c, 1);
-      if (rv == 0)
+      int ch = disc_reader_getc(reader);
+      if (ch == EOF)
          return 0;
 
-      if (rv < 1)
-      {
-         switch (errno)
-         {
-            case EINTR:
-            case EAGAIN:
-               continue;
-            default:
-               return -errno;
-         }
-      }
+      *c = (char)ch;
 
       switch (*c)
       {
@@ -117,7 +278,7 @@ static ssize_t get_token(RFILE *fd, char *token, size_t max_len)
    }
 }
 
-static int find_token(RFILE *fd, const char *token)
+static int find_token(disc_reader_t *reader, const char *token)
 {
    int     tmp_len = strlen(token);
    char *tmp_token = (char*)calloc(tmp_len+1, 1);
@@ -127,7 +288,7 @@ static int find_token(RFILE *fd, const char *token)
 
    while (strncmp(tmp_token, token, tmp_len) != 0)
    {
-      if (get_token(fd, tmp_token, tmp_len) <= 0)
+      if (get_token(reader, tmp_token, tmp_len) <= 0)
       {
          free(tmp_token);
          return -1;
@@ -140,29 +301,23 @@ static int find_token(RFILE *fd, const char *token)
 }
 
 
-static int detect_ps1_game_sub(const char *track_path,
+static int detect_ps1_game_sub(disc_reader_t *reader,
       char *game_id, int sub_channel_mixed)
 {
    uint8_t* tmp;
    uint8_t* boot_file;
    int skip, frame_size, is_mode1, cd_sector;
    uint8_t buffer[2048 * 2] = {0};
-   RFILE                *fp = 
-      filestream_open(track_path, RFILE_MODE_READ, -1);
-   if (!fp)
-      return 0;
 
    is_mode1 = 0;
-   filestream_seek(fp, 0, SEEK_END);
 
    if (!sub_channel_mixed)
    {
-      if (!(filestream_tell(fp) & 0x7FF))
+      if (!(reader->len & 0x7FF))
       {
          unsigned int mode_test = 0;
 
-         filestream_seek(fp, 0, SEEK_SET);
-         filestream_read(fp, &mode_test, 4);
+         disc_reader_read(reader, 0, &mode_test, 4);
          if (mode_test != MODETEST_VAL)
             is_mode1 = 1;
       }
@@ -171,18 +326,17 @@ static int detect_ps1_game_sub(const char *track_path,
    skip       = is_mode1? 0: 24;
    frame_size = sub_channel_mixed? 2448: is_mode1? 2048: 2352;
 
-   filestream_seek(fp, 156 + skip + 16 * frame_size, SEEK_SET);
-   filestream_read(fp, buffer, 6);
+   disc_reader_read(reader, 156 + skip + 16 * frame_size, buffer, 6);
 
    cd_sector = buffer[2] | (buffer[3] << 8) | (buffer[4] << 16);
-   filestream_seek(fp, skip + cd_sector * frame_size, SEEK_SET);
-   filestream_read(fp, buffer, 2048 * 2);
+   disc_reader_read(reader, skip + cd_sector * frame_size,
+         buffer, 2048 * 2);
 
    tmp = buffer;
    while (tmp < (buffer + 2048 * 2))
    {
       if (!*tmp)
-         goto error;
+         return 0;
 
       if (!strncasecmp((const char*)(tmp + 33), "SYSTEM.CNF;1", 12))
          break;
@@ -191,11 +345,10 @@ static int detect_ps1_game_sub(const char *track_path,
    }
 
    if(tmp >= (buffer + 2048 * 2))
-      goto error;
+      return 0;
 
    cd_sector = tmp[2] | (tmp[3] << 8) | (tmp[4] << 16);
-   filestream_seek(fp, skip + cd_sector * frame_size, SEEK_SET);
-   filestream_read(fp, buffer, 256);
+   disc_reader_read(reader, skip + cd_sector * frame_size, buffer, 256);
    buffer[256] = '\0';
 
    tmp = buffer;
@@ -203,7 +356,7 @@ static int detect_ps1_game_sub(const char *track_path,
       tmp++;
 
    if(!*tmp)
-      goto error;
+      return 0;
 
    boot_file = tmp;
    while(*tmp && *tmp != '\n')
@@ -233,29 +386,46 @@ static int detect_ps1_game_sub(const char *track_path,
 
    *game_id = 0;
 
-   filestream_close(fp);
    return 1;
-
-error:
-   filestream_close(fp);
-   return 0;
 }
 
 int detect_ps1_game(const char *track_path, char *game_id)
 {
-   if (detect_ps1_game_sub(track_path, game_id, 0))
-      return 1;
+   int rv;
+   disc_reader_t reader;
+
+   if (!disc_reader_open(&reader, track_path))
+      return 0;
+
+   rv = detect_ps1_game_sub(&reader, game_id, 0)
+      || detect_ps1_game_sub(&reader, game_id, 1);
+
+   disc_reader_close(&reader);
+   return rv;
+}
+
+/* Returns true if @p starts a PSP serial, e.g. "ULES-". */
+static bool is_psp_serial(const uint8_t *p)
+{
+   unsigned i;
+
+   if (p[4] != '-' || (p[0] != 'U' && p[0] != 'N'))
+      return false;
+
+   for (i = 0; i < ARRAY_SIZE(psp_serial_prefixes); i++)
+      if (!memcmp(p, psp_serial_prefixes[i], 4))
+         return true;
 
-   return detect_ps1_game_sub(track_path, game_id, 1);
+   return false;
 }
 
 int detect_psp_game(const char *track_path, char *game_id)
 {
-   unsigned pos;
-   bool rv   = false;
-   RFILE *fd = filestream_open(track_path, RFILE_MODE_READ, -1);
+   ssize_t pos;
+   ssize_t found = -1;
+   disc_reader_t reader;
 
-   if (!fd)
+   if (!disc_reader_open(&reader, track_path))
    {
       RARCH_LOG("%s: %s\n",
             msg_hash_to_str(MSG_COULD_NOT_OPEN_DATA_TRACK),
@@ -263,60 +433,55 @@ int detect_psp_game(const char *track_path, char *game_id)
       return -errno;
    }
 
-   for (pos = 0; pos < 100000; pos++)
+   /* Every prefix ends in a dash, look for those and check the
+    * four bytes before. Windows overlap by four bytes so that
+    * no serial gets split. */
+   for (pos = 0; pos < PSP_SERIAL_SCAN_LEN && found < 0; )
    {
-      filestream_seek(fd, pos, SEEK_SET);
+      size_t avail;
+      const uint8_t *dash;
+      const uint8_t *buf = disc_reader_get(&reader, pos,
+            READER_WINDOW_SIZE, &avail);
 
-      if (filestream_read(fd, game_id, 5) > 0)
+      if (!buf || avail < 5)
+         break;
+
+      dash = (const uint8_t*)memchr(buf + 4, '-', avail - 4);
+
+      while (dash)
       {
-         game_id[5] = '\0';
-         if (string_is_equal(game_id, "ULES-")
-          || string_is_equal(game_id, "ULUS-")
-          || string_is_equal(game_id, "ULJS-")
-
-          || string_is_equal(game_id, "ULEM-")
-          || string_is_equal(game_id, "ULUM-")
-          || string_is_equal(game_id, "ULJM-")
-
-          || string_is_equal(game_id, "UCES-")
-          || string_is_equal(game_id, "UCUS-")
-          || string_is_equal(game_id, "UCJS-")
-          || string_is_equal(game_id, "UCAS-")
-
-          || string_is_equal(game_id, "NPEH-")
-          || string_is_equal(game_id, "NPUH-")
-          || string_is_equal(game_id, "NPJH-")
-
-          || string_is_equal(game_id, "NPEG-")
-          || string_is_equal(game_id, "NPUG-")
-          || string_is_equal(game_id, "NPJG-")
-          || string_is_equal(game_id, "NPHG-")
-
-          || string_is_equal(game_id, "NPEZ-")
-          || string_is_equal(game_id, "NPUZ-")
-          || string_is_equal(game_id, "NPJZ-")
-         )
+         ssize_t start = pos + (dash - 4 - buf);
+
+         if (start >= PSP_SERIAL_SCAN_LEN)
+            break;
+
+         if (is_psp_serial(dash - 4))
          {
-            filestream_seek(fd, pos, SEEK_SET);
-            if (filestream_read(fd, game_id, 10) > 0)
-            {
-#if 0
-               game_id[4] = '-';
-               game_id[8] = game_id[9];
-               game_id[9] = game_id[10];
-#endif
-               game_id[10] = '\0';
-               rv = true;
-            }
+            found = start;
             break;
          }
+
+         dash = (const uint8_t*)memchr(dash + 1, '-',
+               avail - (dash + 1 - buf));
       }
-      else
-         break;
+
+      pos += avail - 4;
    }
 
-   filestream_close(fd);
-   return rv;
+   if (found >= 0)
+   {
+      size_t len = disc_reader_read(&reader, found, game_id, 10);
+
+#if 0
+      game_id[4] = '-';
+      game_id[8] = game_id[9];
+      game_id[9] = game_id[10];
+#endif
+      game_id[len] = '\0';
+   }
+
+   disc_reader_close(&reader);
+   return found >= 0;
 }
 
 int detect_system(const char *track_path, int32_t offset,
@@ -325,18 +490,16 @@ int detect_system(const char *track_path, int32_t offset,
    int rv;
    char magic[MAGIC_LEN];
    int i;
-   RFILE *fd = filestream_open(track_path, RFILE_MODE_READ, -1);
-   
-   if (!fd)
+   disc_reader_t reader;
+
+   if (!disc_reader_open(&reader, track_path))
    {
       RARCH_LOG("Could not open data track of file '%s': %s\n",
             track_path, strerror(errno));
-      rv = -errno;
-      goto clean;
+      return -errno;
    }
 
-   filestream_seek(fd, offset, SEEK_SET);
-   if (filestream_read(fd, magic, MAGIC_LEN) < MAGIC_LEN)
+   if (disc_reader_read(&reader, offset, magic, MAGIC_LEN) < MAGIC_LEN)
    {
       RARCH_LOG("Could not read data from file '%s' at offset %d: %s\n",
             track_path, offset, strerror(errno));
@@ -355,8 +518,7 @@ int detect_system(const char *track_path, int32_t offset,
       }
    }
 
-   filestream_seek(fd, 0x8008, SEEK_SET);
-   if (filestream_read(fd, magic, 8) > 0)
+   if (disc_reader_read(&reader, 0x8008, magic, 8) > 0)
    {
       magic[8] = '\0';
       if (string_is_equal(magic, "PSP GAME"))
@@ -371,7 +533,7 @@ int detect_system(const char *track_path, int32_t offset,
    rv = -EINVAL;
 
 clean:
-   filestream_close(fd);
+   disc_reader_close(&reader);
    return rv;
 }
 
@@ -379,11 +541,10 @@ int find_first_data_track(const char *cue_path,
       int32_t *offset, char *track_path, size_t max_len)
 {
    int rv;
+   disc_reader_t reader;
    char tmp_token[MAX_TOKEN_LEN] = {0};
-   RFILE *fd                     = 
-      filestream_open(cue_path, RFILE_MODE_READ, -1);
 
-   if (!fd)
+   if (!disc_reader_open(&reader, cue_path))
    {
       RARCH_LOG("Could not open CUE file '%s': %s\n", cue_path,
             strerror(errno));
@@ -392,7 +553,7 @@ int find_first_data_track(const char *cue_path,
 
    RARCH_LOG("Parsing CUE file '%s'...\n", cue_path);
 
-   while (get_token(fd, tmp_token, MAX_TOKEN_LEN) > 0)
+   while (get_token(&reader, tmp_token, MAX_TOKEN_LEN) > 0)
    {
       if (string_is_equal(tmp_token, "FILE"))
       {
@@ -400,26 +561,26 @@ int find_first_data_track(const char *cue_path,
 
          fill_pathname_basedir(cue_dir, cue_path, sizeof(cue_dir));
 
-         get_token(fd, tmp_token, MAX_TOKEN_LEN);
+         get_token(&reader, tmp_token, MAX_TOKEN_LEN);
          fill_pathname_join(track_path, cue_dir, tmp_token, max_len);
 
       }
       else if (string_is_equal_noncase(tmp_token, "TRACK"))
       {
          int m, s, f;
-         get_token(fd, tmp_token, MAX_TOKEN_LEN);
-         get_token(fd, tmp_token, MAX_TOKEN_LEN);
+         get_token(&reader, tmp_token, MAX_TOKEN_LEN);
+         get_token(&reader, tmp_token, MAX_TOKEN_LEN);
          if (string_is_equal_noncase(tmp_token, "AUDIO"))
             continue;
 
-         find_token(fd, "INDEX");
-         get_token(fd, tmp_token, MAX_TOKEN_LEN);
-         get_token(fd, tmp_token, MAX_TOKEN_LEN);
+         find_token(&reader, "INDEX");
+         get_token(&reader, tmp_token, MAX_TOKEN_LEN);
+         get_token(&reader, tmp_token, MAX_TOKEN_LEN);
 
          if (sscanf(tmp_token, "%02d:%02d:%02d", &m, &s, &f) < 3)
          {
             RARCH_LOG("Error parsing time stamp '%s'\n", tmp_token);
-            filestream_close(fd);
+            disc_reader_close(&reader);
             return -errno;
          }
 
@@ -437,6 +598,6 @@ int find_first_data_track(const char *cue_path,
    rv = -EINVAL;
 
 clean:
-   filestream_close(fd);
+   disc_reader_close(&reader);
    return rv;
 }
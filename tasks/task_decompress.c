@@ -23,6 +23,11 @@
 #include <file/archive_file.h>
 #include <retro_miscellaneous.h>
 #include <retro_stat.h>
+#include <features/features_cpu.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 
 #include "tasks_internal.h"
 #include "../verbosity.h"
@@ -39,8 +44,40 @@ typedef struct
    char *callback_error;
 
    file_archive_transfer_t zlib;
+#ifdef HAVE_THREADS
+   /* Files are inflated by a pool of threads when available,
+    * the callbacks below then run concurrently. */
+   file_archive_parallel_t *parallel;
+   slock_t *lock;
+   bool parallel_unavailable;
+#endif
 } decompress_state_t;
 
+/* Upper bound of threads inflating files of one archive. */
+#define DECOMPRESS_MAX_THREADS 8
+
+static void file_decompressed_error(decompress_state_t *dec,
+      const char *path)
+{
+#ifdef HAVE_THREADS
+   if (dec->lock)
+      slock_lock(dec->lock);
+#endif
+
+   /* Only the first error is reported. */
+   if (!dec->callback_error)
+   {
+      dec->callback_error = (char*)malloc(PATH_MAX_LENGTH);
+      snprintf(dec->callback_error,
+            PATH_MAX_LENGTH, "Failed to deflate %s.\n", path);
+   }
+
+#ifdef HAVE_THREADS
+   if (dec->lock)
+      slock_unlock(dec->lock);
+#endif
+}
+
 static int file_decompressed_target_file(const char *name,
       const char *valid_exts,
       const uint8_t *cdata,
@@ -87,9 +124,7 @@ next_file:
    return 1;
 
 error:
-   dec->callback_error = (char*)malloc(PATH_MAX_LENGTH);
-   snprintf(dec->callback_error,
-         PATH_MAX_LENGTH, "Failed to deflate %s.\n", path);
+   file_decompressed_error(dec, path);
 
    return 0;
 }
@@ -124,9 +159,7 @@ next_file:
    return 1;
 
 error:
-   dec->callback_error = (char*)malloc(PATH_MAX_LENGTH);
-   snprintf(dec->callback_error, PATH_MAX_LENGTH,
-         "Failed to deflate %s.\n", path);
+   file_decompressed_error(dec, path);
 
    return 0;
 }
@@ -154,15 +187,92 @@ static void task_decompress_handler_finished(retro_task_t *task,
       free(dec->subdir);
    if (dec->valid_ext)
       free(dec->valid_ext);
+#ifdef HAVE_THREADS
+   if (dec->lock)
+      slock_free(dec->lock);
+#endif
    free(dec->target_dir);
    free(dec);
 }
 
+#ifdef HAVE_THREADS
+/**
+ * task_decompress_parallel_iterate:
+ * @task         : decompression task.
+ * @dec          : state of @task.
+ * @file_cb      : callback run for every file of the archive.
+ *
+ * Inflates the files of the archive on a pool of threads,
+ * and finishes the task once they are done.
+ *
+ * Returns: false if the archive has to be decompressed
+ * sequentially instead.
+ **/
+static bool task_decompress_parallel_iterate(retro_task_t *task,
+      decompress_state_t *dec, file_archive_file_cb file_cb)
+{
+   bool finished = false;
+
+   if (dec->parallel_unavailable)
+      return false;
+
+   if (!dec->parallel)
+   {
+      unsigned threads = cpu_features_get_core_amount();
+
+      if (threads > DECOMPRESS_MAX_THREADS)
+         threads = DECOMPRESS_MAX_THREADS;
+
+      dec->lock     = slock_new();
+      if (dec->lock)
+         dec->parallel = file_archive_parallel_new(dec->source_file,
+               dec->valid_ext, file_cb, dec, threads);
+
+      if (!dec->parallel)
+      {
+         dec->parallel_unavailable = true;
+         return false;
+      }
+
+      RARCH_LOG("[decompress] Inflating '%s' on %u threads.\n",
+            dec->source_file, threads);
+   }
+
+   /* Don't spin the task thread while the pool works, but never
+    * block the main loop when tasks run on the main thread. */
+   finished = file_archive_parallel_iterate(dec->parallel,
+         task_queue_ctl(TASK_QUEUE_CTL_IS_THREADED, NULL) ? 10000 : 0);
+
+   task->progress = file_archive_parallel_progress(dec->parallel);
+
+   if (task->cancelled || finished)
+   {
+      bool ret      = file_archive_parallel_free(dec->parallel);
+      dec->parallel = NULL;
+
+      if (!ret && !task->cancelled && !dec->callback_error)
+         dec->callback_error = strdup("Failed to deflate archive.\n");
+
+      task->error = dec->callback_error;
+      task_decompress_handler_finished(task, dec);
+   }
+
+   return true;
+}
+#endif
+
 static void task_decompress_handler(retro_task_t *task)
 {
+   int ret;
    bool retdec             = false;
    decompress_state_t *dec = (decompress_state_t*)task->state;
-   int ret                 = file_archive_parse_file_iterate(&dec->zlib,
+
+#ifdef HAVE_THREADS
+   if (task_decompress_parallel_iterate(task, dec, file_decompressed))
+      return;
+#endif
+
+   ret                     = file_archive_parse_file_iterate(&dec->zlib,
          &retdec, dec->source_file,
          dec->valid_ext, file_decompressed, dec);
 
@@ -198,9 +308,17 @@ static void task_decompress_handler_target_file(retro_task_t *task)
 
 static void task_decompress_handler_subdir(retro_task_t *task)
 {
+   int ret;
    bool retdec;
    decompress_state_t *dec = (decompress_state_t*)task->state;
-   int ret = file_archive_parse_file_iterate(&dec->zlib,
+
+#ifdef HAVE_THREADS
+   if (task_decompress_parallel_iterate(task, dec,
+            file_decompressed_subdir))
+      return;
+#endif
+
+   ret = file_archive_parse_file_iterate(&dec->zlib,
          &retdec, dec->source_file,
          dec->valid_ext, file_decompressed_subdir, dec);
 
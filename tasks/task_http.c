@@ -24,6 +24,7 @@
 #include <net/net_compat.h>
 #include <retro_stat.h>
 
+#include "../configuration.h"
 #include "../msg_hash.h"
 #include "../verbosity.h"
 #include "tasks_internal.h"
@@ -55,10 +56,40 @@ typedef struct http_handle
    } connection;
    struct http_t *handle;
    transfer_cb_t  cb;
+   char path[PATH_MAX_LENGTH];
    unsigned status;
+   bool active;
    bool error;
 } http_handle_t;
 
+/* Transfers with a request in flight. Only touched by the task
+ * handlers, which all run on the same thread. */
+static unsigned task_http_active = 0;
+
+/* Takes one of the network_http_max_transfers slots.
+ * Returns false if the transfer has to wait for one. */
+static bool task_http_slot_acquire(http_handle_t *http)
+{
+   settings_t *settings = config_get_ptr();
+   unsigned max         = settings ? settings->network.http_max_transfers : 0;
+
+   if (max && task_http_active >= max)
+      return false;
+
+   task_http_active++;
+   http->active = true;
+   return true;
+}
+
+static void task_http_slot_release(http_handle_t *http)
+{
+   if (!http->active)
+      return;
+
+   task_http_active--;
+   http->active = false;
+}
+
 static int task_http_con_iterate_transfer(http_handle_t *http)
 {
    if (!net_http_connection_iterate(http->connection.handle))
@@ -92,7 +123,10 @@ static int cb_http_conn_default(void *data_, size_t len)
    if (!network_init())
       return -1;
 
-   http->handle = net_http_new(http->connection.handle);
+   if (*http->path)
+      http->handle = net_http_new_file(http->connection.handle, http->path);
+   else
+      http->handle = net_http_new(http->connection.handle);
 
    if (!http->handle)
    {
@@ -139,6 +173,9 @@ static void task_http_transfer_handler(retro_task_t *task)
    switch (http->status)
    {
       case HTTP_STATUS_CONNECTION_TRANSFER_PARSE:
+         /* Stay queued until a transfer slot frees up. */
+         if (!task_http_slot_acquire(http))
+            break;
          task_http_conn_iterate_transfer_parse(http);
          http->status = HTTP_STATUS_TRANSFER;
          break;
@@ -164,6 +201,8 @@ static void task_http_transfer_handler(retro_task_t *task)
 task_finished:
    task->finished = true;
 
+   task_http_slot_release(http);
+
    if (http->handle)
    {
       size_t len = 0;
@@ -179,6 +218,9 @@ task_finished:
          if (tmp)
             free(tmp);
 
+         if (*http->path)
+            remove(http->path);
+
          if (task->cancelled)
             task->error = strdup("Task cancelled.");
          else
@@ -190,6 +232,9 @@ task_finished:
          data->data = tmp;
          data->len  = len;
 
+         if (*http->path)
+            data->path = strdup(http->path);
+
          task->task_data = data;
       }
 
@@ -232,7 +277,8 @@ static bool task_http_retriever(retro_task_t *task, void *data)
    return true;
 }
 
-void *task_push_http_transfer(const char *url, bool mute, const char *type,
+static void *task_push_http_transfer_internal(const char *url,
+      const char *path, bool mute, const char *type,
       retro_task_callback_t cb, void *user_data)
 {
    task_finder_data_t find_data;
@@ -272,6 +318,9 @@ void *task_push_http_transfer(const char *url, bool mute, const char *type,
 
    strlcpy(http->connection.url, url, sizeof(http->connection.url));
 
+   if (path)
+      strlcpy(http->path, path, sizeof(http->path));
+
    http->status            = HTTP_STATUS_CONNECTION_TRANSFER;
    t                       = (retro_task_t*)calloc(1, sizeof(*t));
 
@@ -303,6 +352,24 @@ error:
    return NULL;
 }
 
+void *task_push_http_transfer(const char *url, bool mute, const char *type,
+      retro_task_callback_t cb, void *user_data)
+{
+   return task_push_http_transfer_internal(url, NULL, mute, type,
+         cb, user_data);
+}
+
+void *task_push_http_transfer_file(const char *url, const char *path,
+      bool mute, const char *type,
+      retro_task_callback_t cb, void *user_data)
+{
+   if (string_is_empty(path))
+      return NULL;
+
+   return task_push_http_transfer_internal(url, path, mute, type,
+         cb, user_data);
+}
+
 task_retriever_info_t *http_task_get_transfer_list(void)
 {
    task_retriever_data_t retrieve_data;
@@ -14,15 +14,28 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
+#if defined(_WIN32) && !defined(_XBOX)
+#include <sys/utime.h>
+#define HAVE_THUMBNAIL_CACHE_LRU
+#elif defined(__unix__) || defined(__APPLE__)
+#include <utime.h>
+#define HAVE_THUMBNAIL_CACHE_LRU
+#endif
 
 #include <file/nbio.h>
+#include <file/file_path.h>
+#include <streams/file_stream.h>
+#include <retro_stat.h>
 #include <formats/image.h>
 #include <compat/strl.h>
 #include <retro_assert.h>
 #include <retro_miscellaneous.h>
 #include <lists/string_list.h>
+#include <lists/dir_list.h>
 #include <rhash.h>
 
 #ifdef HAVE_MENU
@@ -400,3 +413,474 @@ void task_image_load_free(retro_task_t *task)
       free(nbio);
    }
 }
+
+/* Downscaled thumbnails kept on disk. The pixels are stored
+ * as they are uploaded, so the color shifts are part of the key.
+ * The header is stored field by field in little endian order.
+ * Once the files add up to more than THUMBNAIL_CACHE_MAX_SIZE, the
+ * least recently used ones are deleted; a hit touches the file's
+ * mtime where that is supported, elsewhere the oldest go first. */
+#define THUMBNAIL_CACHE_MAGIC        0x4d485452 /* "RTHM" */
+#define THUMBNAIL_CACHE_VERSION      2
+#define THUMBNAIL_CACHE_HEADER_SIZE  44
+#define THUMBNAIL_CACHE_MAX_SIZE     (128 * 1024 * 1024)
+/* Pruned down to this, so it doesn't run on every write. */
+#define THUMBNAIL_CACHE_PRUNE_SIZE   (THUMBNAIL_CACHE_MAX_SIZE / 4 * 3)
+
+typedef struct thumbnail_cache_header
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t shifts;
+   uint32_t target_width;
+   int64_t  source_mtime;
+   int64_t  source_size;
+   uint32_t width;
+   uint32_t height;
+   uint32_t path_len;
+} thumbnail_cache_header_t;
+
+typedef struct thumbnail_cache_file
+{
+   const char *path;
+   int64_t mtime;
+   int64_t size;
+} thumbnail_cache_file_t;
+
+/* Size of the disk cache as last counted, -1 before the first
+ * write. Only the task thread touches it. */
+static int64_t thumbnail_cache_size = -1;
+
+typedef struct thumbnail_handle
+{
+   char path[PATH_MAX_LENGTH];
+   char cache_path[PATH_MAX_LENGTH];
+   unsigned width;
+   image_thumbnail_t *result;
+} thumbnail_handle_t;
+
+/**
+ * image_thumbnail_downscale:
+ * @image                : image to downscale, replaced on success
+ * @width                : width to downscale to
+ *
+ * Box filters @image down to @width, keeping the aspect ratio.
+ * Works on each 8-bit channel, so it doesn't care about the
+ * channel order.
+ **/
+static void image_thumbnail_downscale(struct texture_image *image,
+      unsigned width)
+{
+   unsigned x, y, height;
+   uint32_t *out = NULL;
+
+   if (!width || image->width <= width)
+      return;
+
+   height = (unsigned)(((uint64_t)image->height * width
+            + image->width / 2) / image->width);
+   if (!height)
+      height = 1;
+
+   out = (uint32_t*)malloc(width * height * sizeof(uint32_t));
+   if (!out)
+      return;
+
+   for (y = 0; y < height; y++)
+   {
+      unsigned y0 = (unsigned)((uint64_t)y * image->height / height);
+      unsigned y1 = (unsigned)((uint64_t)(y + 1) * image->height / height);
+
+      if (y1 <= y0)
+         y1 = y0 + 1;
+
+      for (x = 0; x < width; x++)
+      {
+         unsigned sx, sy, c;
+         uint32_t sum[4] = {0};
+         uint32_t pixel  = 0;
+         unsigned x0     = (unsigned)((uint64_t)x * image->width / width);
+         unsigned x1     = (unsigned)((uint64_t)(x + 1) * image->width / width);
+         unsigned count;
+
+         if (x1 <= x0)
+            x1 = x0 + 1;
+
+         count = (x1 - x0) * (y1 - y0);
+
+         for (sy = y0; sy < y1; sy++)
+         {
+            const uint32_t *row = image->pixels + sy * image->width;
+
+            for (sx = x0; sx < x1; sx++)
+            {
+               uint32_t col = row[sx];
+               sum[0] += col & 0xff;
+               sum[1] += (col >>  8) & 0xff;
+               sum[2] += (col >> 16) & 0xff;
+               sum[3] += col >> 24;
+            }
+         }
+
+         for (c = 0; c < 4; c++)
+            pixel |= ((sum[c] + count / 2) / count) << (c * 8);
+
+         out[y * width + x] = pixel;
+      }
+   }
+
+   free(image->pixels);
+   image->pixels = out;
+   image->width  = width;
+   image->height = height;
+}
+
+static uint32_t image_thumbnail_shifts(void)
+{
+   unsigned r_shift, g_shift, b_shift, a_shift;
+
+   image_texture_set_color_shifts(&r_shift, &g_shift, &b_shift,
+         &a_shift);
+
+   return (r_shift << 24) | (g_shift << 16) | (b_shift << 8) | a_shift;
+}
+
+static void image_thumbnail_put_le(uint8_t *dst, uint64_t val,
+      unsigned size)
+{
+   unsigned i;
+
+   for (i = 0; i < size; i++)
+      dst[i] = (uint8_t)(val >> (i * 8));
+}
+
+static uint64_t image_thumbnail_get_le(const uint8_t *src, unsigned size)
+{
+   unsigned i;
+   uint64_t val = 0;
+
+   for (i = 0; i < size; i++)
+      val |= (uint64_t)src[i] << (i * 8);
+   return val;
+}
+
+static void image_thumbnail_header_pack(
+      const thumbnail_cache_header_t *header, uint8_t *buf)
+{
+   image_thumbnail_put_le(buf +  0, header->magic,                  4);
+   image_thumbnail_put_le(buf +  4, header->version,                4);
+   image_thumbnail_put_le(buf +  8, header->shifts,                 4);
+   image_thumbnail_put_le(buf + 12, header->target_width,           4);
+   image_thumbnail_put_le(buf + 16, (uint64_t)header->source_mtime, 8);
+   image_thumbnail_put_le(buf + 24, (uint64_t)header->source_size,  8);
+   image_thumbnail_put_le(buf + 32, header->width,                  4);
+   image_thumbnail_put_le(buf + 36, header->height,                 4);
+   image_thumbnail_put_le(buf + 40, header->path_len,               4);
+}
+
+static void image_thumbnail_header_unpack(
+      thumbnail_cache_header_t *header, const uint8_t *buf)
+{
+   header->magic        = (uint32_t)image_thumbnail_get_le(buf +  0, 4);
+   header->version      = (uint32_t)image_thumbnail_get_le(buf +  4, 4);
+   header->shifts       = (uint32_t)image_thumbnail_get_le(buf +  8, 4);
+   header->target_width = (uint32_t)image_thumbnail_get_le(buf + 12, 4);
+   header->source_mtime = (int64_t)image_thumbnail_get_le(buf + 16, 8);
+   header->source_size  = (int64_t)image_thumbnail_get_le(buf + 24, 8);
+   header->width        = (uint32_t)image_thumbnail_get_le(buf + 32, 4);
+   header->height       = (uint32_t)image_thumbnail_get_le(buf + 36, 4);
+   header->path_len     = (uint32_t)image_thumbnail_get_le(buf + 40, 4);
+}
+
+static int image_thumbnail_cache_file_cmp(const void *a, const void *b)
+{
+   const thumbnail_cache_file_t *fa = (const thumbnail_cache_file_t*)a;
+   const thumbnail_cache_file_t *fb = (const thumbnail_cache_file_t*)b;
+
+   if (fa->mtime != fb->mtime)
+      return fa->mtime < fb->mtime ? -1 : 1;
+   return 0;
+}
+
+/**
+ * image_thumbnail_cache_prune:
+ * @dir                  : directory of the disk cache
+ *
+ * Adds up the size of the cached thumbnails and, if they take
+ * more than THUMBNAIL_CACHE_MAX_SIZE, deletes the least recently
+ * used ones until THUMBNAIL_CACHE_PRUNE_SIZE is left.
+ **/
+static void image_thumbnail_cache_prune(const char *dir)
+{
+   size_t i;
+   size_t count                  = 0;
+   int64_t total                 = 0;
+   thumbnail_cache_file_t *files = NULL;
+   struct string_list *list      = dir_list_new(dir, "thumb", false, false);
+
+   if (!list)
+      return;
+
+   files = (thumbnail_cache_file_t*)calloc(MAX(list->size, 1),
+         sizeof(*files));
+   if (!files)
+   {
+      string_list_free(list);
+      return;
+   }
+
+   for (i = 0; i < list->size; i++)
+   {
+      struct stat st;
+
+      if (stat(list->elems[i].data, &st) != 0)
+         continue;
+
+      files[count].path  = list->elems[i].data;
+      files[count].mtime = st.st_mtime;
+      files[count].size  = st.st_size;
+      total             += st.st_size;
+      count++;
+   }
+
+   if (total > THUMBNAIL_CACHE_MAX_SIZE)
+   {
+      qsort(files, count, sizeof(*files), image_thumbnail_cache_file_cmp);
+
+      for (i = 0; i < count && total > THUMBNAIL_CACHE_PRUNE_SIZE; i++)
+         if (remove(files[i].path) == 0)
+            total -= files[i].size;
+   }
+
+   thumbnail_cache_size = total;
+
+   free(files);
+   string_list_free(list);
+}
+
+static bool image_thumbnail_cache_read(thumbnail_handle_t *handle,
+      const struct stat *st, struct texture_image *image)
+{
+   thumbnail_cache_header_t header;
+   uint8_t buf[THUMBNAIL_CACHE_HEADER_SIZE];
+   char path[PATH_MAX_LENGTH];
+   size_t pixels_size;
+   RFILE *file = filestream_open(handle->cache_path, RFILE_MODE_READ, -1);
+
+   if (!file)
+      return false;
+
+   if (filestream_read(file, buf, sizeof(buf)) != sizeof(buf))
+      goto error;
+
+   image_thumbnail_header_unpack(&header, buf);
+
+   if (     header.magic        != THUMBNAIL_CACHE_MAGIC
+         || header.version      != THUMBNAIL_CACHE_VERSION
+         || header.shifts       != image_thumbnail_shifts()
+         || header.target_width != handle->width
+         || header.source_mtime != (int64_t)st->st_mtime
+         || header.source_size  != (int64_t)st->st_size
+         || !header.width || !header.height
+         || header.width  > 4096 || header.height > 4096
+         || header.path_len >= sizeof(path))
+      goto error;
+
+   /* Two sources hashing to the same name evict each other. */
+   if (filestream_read(file, path, header.path_len) != header.path_len)
+      goto error;
+   path[header.path_len] = '\0';
+   if (strcmp(path, handle->path))
+      goto error;
+
+   pixels_size   = header.width * header.height * sizeof(uint32_t);
+   image->pixels = (uint32_t*)malloc(pixels_size);
+   if (!image->pixels)
+      goto error;
+
+   if (filestream_read(file, image->pixels, pixels_size)
+         != (ssize_t)pixels_size)
+   {
+      free(image->pixels);
+      image->pixels = NULL;
+      goto error;
+   }
+
+   image->width  = header.width;
+   image->height = header.height;
+   filestream_close(file);
+
+#ifdef HAVE_THUMBNAIL_CACHE_LRU
+   /* Used now, pruned last. */
+   utime(handle->cache_path, NULL);
+#endif
+   return true;
+
+error:
+   filestream_close(file);
+   return false;
+}
+
+static void image_thumbnail_cache_write(thumbnail_handle_t *handle,
+      const struct stat *st, const struct texture_image *image)
+{
+   thumbnail_cache_header_t header;
+   uint8_t buf[THUMBNAIL_CACHE_HEADER_SIZE];
+   /* Room for the suffix. */
+   char tmp[PATH_MAX_LENGTH + 8];
+   char dir[PATH_MAX_LENGTH];
+   size_t pixels_size = image->width * image->height * sizeof(uint32_t);
+   RFILE *file        = NULL;
+   bool ok            = false;
+
+   fill_pathname_basedir(dir, handle->cache_path, sizeof(dir));
+   if (!path_is_directory(dir))
+      path_mkdir(dir);
+
+   /* Written under another name and renamed, so that a reader
+    * never sees half a file. */
+   snprintf(tmp, sizeof(tmp), "%s.tmp", handle->cache_path);
+
+   file = filestream_open(tmp, RFILE_MODE_WRITE, -1);
+   if (!file)
+      return;
+
+   header.magic        = THUMBNAIL_CACHE_MAGIC;
+   header.version      = THUMBNAIL_CACHE_VERSION;
+   header.shifts       = image_thumbnail_shifts();
+   header.target_width = handle->width;
+   header.source_mtime = st->st_mtime;
+   header.source_size  = st->st_size;
+   header.width        = image->width;
+   header.height       = image->height;
+   header.path_len     = (uint32_t)strlen(handle->path);
+
+   image_thumbnail_header_pack(&header, buf);
+
+   ok = filestream_write(file, buf, sizeof(buf)) == sizeof(buf)
+      && filestream_write(file, handle->path, header.path_len)
+         == header.path_len
+      && filestream_write(file, image->pixels, pixels_size)
+         == (ssize_t)pixels_size;
+
+   filestream_close(file);
+
+   if (!ok || rename(tmp, handle->cache_path) != 0)
+   {
+      remove(tmp);
+      return;
+   }
+
+   /* Counted once, then kept up to date by the writes, which
+    * can only overestimate it as replaced files are added again. */
+   if (thumbnail_cache_size >= 0)
+      thumbnail_cache_size += sizeof(buf) + header.path_len + pixels_size;
+
+   if (thumbnail_cache_size < 0
+         || thumbnail_cache_size > THUMBNAIL_CACHE_MAX_SIZE)
+      image_thumbnail_cache_prune(dir);
+}
+
+static void task_image_thumbnail_handler(retro_task_t *task)
+{
+   struct stat st;
+   thumbnail_handle_t *handle = (thumbnail_handle_t*)task->state;
+   image_thumbnail_t *result  = NULL;
+
+   if (task->cancelled)
+      goto end;
+
+   if (stat(handle->path, &st) != 0)
+   {
+      task->error = strdup("Thumbnail not found.");
+      goto end;
+   }
+
+   result = (image_thumbnail_t*)calloc(1, sizeof(*result));
+   if (!result)
+      goto end;
+
+   if (*handle->cache_path
+         && image_thumbnail_cache_read(handle, &st, &result->image))
+      result->from_cache = true;
+   else
+   {
+      if (!image_texture_load(&result->image, handle->path))
+      {
+         free(result);
+         result      = NULL;
+         task->error = strdup("Failed to decode thumbnail.");
+         goto end;
+      }
+
+      image_thumbnail_downscale(&result->image, handle->width);
+
+      if (*handle->cache_path)
+         image_thumbnail_cache_write(handle, &st, &result->image);
+   }
+
+end:
+   task->task_data = result;
+   task->finished  = true;
+}
+
+static void task_image_thumbnail_free(retro_task_t *task)
+{
+   free(task->state);
+}
+
+/**
+ * task_push_image_thumbnail:
+ * @path                 : image to load
+ * @cache_dir            : directory of the disk cache, NULL for none
+ * @width                : width to downscale to, 0 keeps the size
+ * @cb                   : called on the main thread with an
+ *                         image_thumbnail_t, NULL on error
+ * @user_data            : passed to @cb
+ *
+ * Loads, converts and downscales an image in one go on the task
+ * thread, so the result is ready to be uploaded.
+ *
+ * Returns: true if the task was pushed.
+ **/
+bool task_push_image_thumbnail(const char *path, const char *cache_dir,
+      unsigned width, retro_task_callback_t cb, void *user_data)
+{
+   retro_task_t *t            = NULL;
+   thumbnail_handle_t *handle = (thumbnail_handle_t*)
+      calloc(1, sizeof(*handle));
+
+   if (!handle)
+      return false;
+
+   strlcpy(handle->path, path, sizeof(handle->path));
+   handle->width = width;
+
+   if (cache_dir && *cache_dir)
+   {
+      char name[64];
+
+      snprintf(name, sizeof(name), "%08x_%u.thumb",
+            djb2_calculate(path), width);
+      fill_pathname_join(handle->cache_path, cache_dir, name,
+            sizeof(handle->cache_path));
+   }
+
+   t = (retro_task_t*)calloc(1, sizeof(*t));
+   if (!t)
+   {
+      free(handle);
+      return false;
+   }
+
+   t->state     = handle;
+   t->handler   = task_image_thumbnail_handler;
+   t->cleanup   = task_image_thumbnail_free;
+   t->callback  = cb;
+   t->user_data = user_data;
+   t->mute      = true;
+
+   task_queue_ctl(TASK_QUEUE_CTL_PUSH, t);
+
+   return true;
+}
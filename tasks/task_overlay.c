@@ -18,10 +18,15 @@
 #include <retro_miscellaneous.h>
 #include <file/file_path.h>
 #include <file/config_file.h>
+#include <features/features_cpu.h>
 #include <lists/string_list.h>
 #include <string/stdstring.h>
 #include <rhash.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "tasks_internal.h"
 
 #include "../file_path_special.h"
@@ -42,10 +47,93 @@ typedef struct {
    struct overlay *active;
    size_t resolve_pos;
 
+   unsigned generation;
+   /* Spent decoding the images of the first overlay. */
+   retro_time_t active_decode_usec;
+   retro_time_t start_time;
 } overlay_loader_t;
 
+#ifdef HAVE_THREADS
+enum overlay_decode_state
+{
+   OVERLAY_DECODE_NONE = 0,
+   OVERLAY_DECODE_QUEUED,
+   OVERLAY_DECODE_RUNNING,
+   OVERLAY_DECODE_DONE
+};
+#endif
+
+/* Decodes the images of one overlay after the overlay is shown. */
+typedef struct overlay_images_loader
+{
+   struct string_list *paths;
+   struct texture_image *images;
+   size_t index;
+   unsigned generation;
+   retro_time_t decode_usec;
+#ifdef HAVE_THREADS
+   enum overlay_decode_state decode_state;
+   /* Next job in the decoding queue. */
+   struct overlay_images_loader *next;
+#endif
+} overlay_images_loader_t;
+
+/* Upper bound of overlays decoded at the same time. */
+#define OVERLAY_MAX_DECODE_THREADS 8
+
+/* Only the first overlay is shown once the pack is loaded, the
+ * images of the others are decoded in the background. */
+#define OVERLAY_IS_DEFERRED(index) ((index) != 0)
+
+/* Bumped for every overlay load, so images decoded for an
+ * earlier load aren't swapped into the current one. */
+static unsigned overlay_load_generation = 0;
+
+#ifdef HAVE_THREADS
+/* Decoding threads shared by all the overlay images tasks.
+ * The lock is created by the first task handler and kept, the
+ * threads leave once the queue is empty. Everything but the
+ * lock is protected by it. */
+static struct
+{
+   slock_t *lock;
+   /* Signalled whenever a job is done. */
+   scond_t *cond;
+   overlay_images_loader_t *queue;
+   unsigned threads;
+} overlay_decode_pool;
+#endif
+
 static void task_overlay_resolve_iterate(retro_task_t *task);
 
+/* Decodes @path into @image, accounting the time to the first
+ * overlay if it belongs to it. */
+static bool task_overlay_image_load(overlay_loader_t *loader,
+      struct texture_image *image, const char *path)
+{
+   retro_time_t start = cpu_features_get_time_usec();
+   bool ret           = image_texture_load(image, path);
+
+   if (loader->pos == 0)
+      loader->active_decode_usec += cpu_features_get_time_usec() - start;
+
+   return ret;
+}
+
+static bool task_overlay_image_defer(struct overlay *overlay,
+      const char *path, int desc)
+{
+   union string_list_elem_attr attr;
+
+   attr.i = desc;
+
+   if (!overlay->pending_images)
+      overlay->pending_images = string_list_new();
+
+   return overlay->pending_images
+      && string_list_append(overlay->pending_images, path, attr);
+}
+
 static void task_overlay_image_done(struct overlay *overlay)
 {
    overlay->pos = 0;
@@ -75,7 +163,9 @@ static void task_overlay_load_desc_image(
       fill_pathname_resolve_relative(path, loader->overlay_path,
             image_path, sizeof(path));
 
-      if (image_texture_load(&image_tex, path))
+      if (OVERLAY_IS_DEFERRED(ol_idx))
+         task_overlay_image_defer(input_overlay, path, desc_idx);
+      else if (task_overlay_image_load(loader, &image_tex, path))
       {
          input_overlay->load_images[input_overlay->load_images_size++] = image_tex;
          desc->image       = image_tex;
@@ -383,6 +473,29 @@ static void task_overlay_deferred_loading(retro_task_t *task)
    }
 }
 
+static bool task_overlay_needs_base_size(config_file_t *conf,
+      unsigned ol_idx, size_t descs, bool normalized)
+{
+   size_t i;
+
+   if (!normalized)
+      return true;
+
+   for (i = 0; i < descs; i++)
+   {
+      bool tmp_bool = true;
+      char conf_key[64];
+
+      snprintf(conf_key, sizeof(conf_key),
+            "overlay%u_desc%u_normalized", ol_idx, (unsigned)i);
+
+      if (config_get_bool(conf, conf_key, &tmp_bool) && !tmp_bool)
+         return true;
+   }
+
+   return false;
+}
+
 static void task_overlay_deferred_load(retro_task_t *task)
 {
    unsigned i;
@@ -486,16 +599,29 @@ static void task_overlay_deferred_load(retro_task_t *task)
                loader->overlay_path,
                overlay->config.paths.path, sizeof(overlay_resolved_path));
 
-         if (!image_texture_load(&image_tex, overlay_resolved_path))
+         /* Descs placed in pixels need the size of the base image. */
+         if (OVERLAY_IS_DEFERRED(loader->pos)
+               && !task_overlay_needs_base_size(conf, loader->pos,
+                  overlay->size, overlay->config.normalized))
          {
-            RARCH_ERR("[Overlay]: Failed to load image: %s.\n",
-                  overlay_resolved_path);
-            loader->loading_status = OVERLAY_IMAGE_TRANSFER_ERROR;
-            goto error;
+            if (!task_overlay_image_defer(overlay,
+                     overlay_resolved_path, -1))
+               goto error;
          }
+         else
+         {
+            if (!task_overlay_image_load(loader,
+                     &image_tex, overlay_resolved_path))
+            {
+               RARCH_ERR("[Overlay]: Failed to load image: %s.\n",
+                     overlay_resolved_path);
+               loader->loading_status = OVERLAY_IMAGE_TRANSFER_ERROR;
+               goto error;
+            }
 
-         overlay->load_images[overlay->load_images_size++] = image_tex;
-         overlay->image = image_tex;
+            overlay->load_images[overlay->load_images_size++] = image_tex;
+            overlay->image = image_tex;
+         }
       }
 
       snprintf(overlay->config.names.key, sizeof(overlay->config.names.key),
@@ -657,6 +783,267 @@ static void task_overlay_free(retro_task_t *task)
    free(loader);
 }
 
+static void task_overlay_images_decode(overlay_images_loader_t *loader)
+{
+   size_t i;
+   retro_time_t start = cpu_features_get_time_usec();
+
+   for (i = 0; i < loader->paths->size; i++)
+   {
+      const char *path = loader->paths->elems[i].data;
+
+      if (!image_texture_load(&loader->images[i], path))
+         RARCH_ERR("[Overlay]: Failed to load image: %s.\n", path);
+   }
+
+   loader->decode_usec = cpu_features_get_time_usec() - start;
+}
+
+#ifdef HAVE_THREADS
+static void task_overlay_images_thread(void *data)
+{
+   (void)data;
+
+   slock_lock(overlay_decode_pool.lock);
+
+   while (overlay_decode_pool.queue)
+   {
+      overlay_images_loader_t *loader = overlay_decode_pool.queue;
+
+      overlay_decode_pool.queue = loader->next;
+      loader->next              = NULL;
+      loader->decode_state      = OVERLAY_DECODE_RUNNING;
+      slock_unlock(overlay_decode_pool.lock);
+
+      task_overlay_images_decode(loader);
+
+      slock_lock(overlay_decode_pool.lock);
+      loader->decode_state      = OVERLAY_DECODE_DONE;
+      scond_broadcast(overlay_decode_pool.cond);
+   }
+
+   overlay_decode_pool.threads--;
+   slock_unlock(overlay_decode_pool.lock);
+}
+
+/* Unlinks @loader from the decoding queue, with the pool locked.
+ * Returns: false if a thread already picked it up. */
+static bool task_overlay_images_dequeue(overlay_images_loader_t *loader)
+{
+   overlay_images_loader_t **link = &overlay_decode_pool.queue;
+
+   if (loader->decode_state != OVERLAY_DECODE_QUEUED)
+      return false;
+
+   while (*link != loader)
+      link = &(*link)->next;
+
+   *link                = loader->next;
+   loader->next         = NULL;
+   loader->decode_state = OVERLAY_DECODE_NONE;
+   return true;
+}
+
+/**
+ * task_overlay_images_submit:
+ * @loader       : images of one overlay.
+ *
+ * Queues the images on the shared decoding threads, starting
+ * another thread if all the running ones are busy.
+ *
+ * Returns: false if the images have to be decoded on the
+ * task thread instead.
+ **/
+static bool task_overlay_images_submit(overlay_images_loader_t *loader)
+{
+   overlay_images_loader_t **link = NULL;
+   unsigned max_threads           = cpu_features_get_core_amount();
+   bool queued                    = true;
+
+   if (!task_queue_ctl(TASK_QUEUE_CTL_IS_THREADED, NULL))
+      return false;
+
+   /* Handlers run one at a time on the task thread. */
+   if (!overlay_decode_pool.lock)
+      overlay_decode_pool.lock = slock_new();
+   if (!overlay_decode_pool.cond)
+      overlay_decode_pool.cond = scond_new();
+   if (!overlay_decode_pool.lock || !overlay_decode_pool.cond)
+      return false;
+
+   if (max_threads > OVERLAY_MAX_DECODE_THREADS)
+      max_threads = OVERLAY_MAX_DECODE_THREADS;
+
+   slock_lock(overlay_decode_pool.lock);
+
+   for (link = &overlay_decode_pool.queue; *link; link = &(*link)->next);
+   *link                = loader;
+   loader->decode_state = OVERLAY_DECODE_QUEUED;
+
+   if (overlay_decode_pool.threads < max_threads)
+   {
+      sthread_t *thread = sthread_create(task_overlay_images_thread, NULL);
+
+      if (thread)
+      {
+         sthread_detach(thread);
+         overlay_decode_pool.threads++;
+      }
+      /* The running threads get to it eventually. */
+      else if (!overlay_decode_pool.threads)
+         queued = !task_overlay_images_dequeue(loader);
+   }
+
+   slock_unlock(overlay_decode_pool.lock);
+
+   return queued;
+}
+
+/**
+ * task_overlay_images_iterate_threaded:
+ * @loader       : images of one overlay.
+ * @cancelled    : drop the images if they aren't decoded yet.
+ * @finished     : set once the images are decoded.
+ *
+ * Hands the images over to the shared decoding threads and then
+ * only checks on them, the task gets requeued in the meantime.
+ *
+ * Returns: false if the images have to be decoded on the
+ * task thread instead.
+ **/
+static bool task_overlay_images_iterate_threaded(
+      overlay_images_loader_t *loader, bool cancelled, bool *finished)
+{
+   *finished = false;
+
+   if (loader->decode_state == OVERLAY_DECODE_NONE)
+      return task_overlay_images_submit(loader);
+
+   slock_lock(overlay_decode_pool.lock);
+   if (cancelled && task_overlay_images_dequeue(loader))
+      loader->decode_state = OVERLAY_DECODE_DONE;
+   *finished = (loader->decode_state == OVERLAY_DECODE_DONE);
+   slock_unlock(overlay_decode_pool.lock);
+
+   return true;
+}
+#endif
+
+static void task_overlay_images_handler(retro_task_t *task)
+{
+   overlay_images_task_data_t *data = NULL;
+   overlay_images_loader_t  *loader = (overlay_images_loader_t*)task->state;
+   bool finished                    = false;
+
+#ifdef HAVE_THREADS
+   if (!task_overlay_images_iterate_threaded(loader,
+            task->cancelled, &finished))
+#endif
+   {
+      task_overlay_images_decode(loader);
+      finished = true;
+   }
+
+   if (!finished)
+      return;
+
+   task->finished = true;
+
+   if (task->cancelled)
+      return;
+
+   RARCH_LOG("[Overlay]: Overlay #%u decoded in %.1f ms (%u images).\n",
+         (unsigned)loader->index, loader->decode_usec / 1000.0,
+         (unsigned)loader->paths->size);
+
+   data = (overlay_images_task_data_t*)calloc(1, sizeof(*data));
+   if (!data)
+      return;
+
+   data->descs = (int*)calloc(loader->paths->size, sizeof(*data->descs));
+   if (!data->descs)
+   {
+      free(data);
+      return;
+   }
+
+   for (data->count = 0; data->count < loader->paths->size; data->count++)
+      data->descs[data->count] = loader->paths->elems[data->count].attr.i;
+
+   data->images     = loader->images;
+   data->index      = loader->index;
+   data->generation = loader->generation;
+   loader->images   = NULL;
+
+   task->task_data  = data;
+}
+
+static void task_overlay_images_free(retro_task_t *task)
+{
+   size_t i;
+   overlay_images_loader_t *loader = (overlay_images_loader_t*)task->state;
+
+#ifdef HAVE_THREADS
+   if (loader->decode_state != OVERLAY_DECODE_NONE)
+   {
+      slock_lock(overlay_decode_pool.lock);
+      if (!task_overlay_images_dequeue(loader))
+         while (loader->decode_state == OVERLAY_DECODE_RUNNING)
+            scond_wait(overlay_decode_pool.cond, overlay_decode_pool.lock);
+      slock_unlock(overlay_decode_pool.lock);
+   }
+#endif
+
+   if (loader->images)
+   {
+      for (i = 0; i < loader->paths->size; i++)
+         image_texture_free(&loader->images[i]);
+      free(loader->images);
+   }
+
+   string_list_free(loader->paths);
+   free(loader);
+}
+
+/* Takes the pending images of @overlay over. */
+static bool task_push_overlay_images_load(struct overlay *overlay,
+      size_t index, unsigned generation)
+{
+   retro_task_t               *t = NULL;
+   overlay_images_loader_t *loader = (overlay_images_loader_t*)
+      calloc(1, sizeof(*loader));
+
+   if (!loader)
+      return false;
+
+   loader->images = (struct texture_image*)calloc(
+         overlay->pending_images->size, sizeof(*loader->images));
+   t              = (retro_task_t*)calloc(1, sizeof(*t));
+
+   if (!loader->images || !t)
+   {
+      free(loader->images);
+      free(loader);
+      free(t);
+      return false;
+   }
+
+   loader->paths           = overlay->pending_images;
+   loader->index           = index;
+   loader->generation      = generation;
+   overlay->pending_images = NULL;
+
+   t->handler              = task_overlay_images_handler;
+   t->cleanup              = task_overlay_images_free;
+   t->state                = loader;
+   t->callback             = input_overlay_images_loaded;
+   t->mute                 = true;
+
+   task_queue_ctl(TASK_QUEUE_CTL_PUSH, t);
+
+   return true;
+}
+
 static void task_overlay_handler(retro_task_t *task)
 {
    overlay_loader_t *loader  = (overlay_loader_t*)task->state;
@@ -684,14 +1071,33 @@ static void task_overlay_handler(retro_task_t *task)
 
    if (task->finished && !task->cancelled)
    {
+      size_t i;
+      unsigned deferred         = 0;
       overlay_task_data_t *data = (overlay_task_data_t*)
          calloc(1, sizeof(*data));
 
-      data->overlays = loader->overlays;
-      data->size     = loader->size;
-      data->active   = loader->active;
+      data->overlays   = loader->overlays;
+      data->size       = loader->size;
+      data->active     = loader->active;
+      data->generation = loader->generation;
 
       task->task_data = data;
+
+      for (i = 0; i < loader->size; i++)
+      {
+         struct overlay *overlay = &loader->overlays[i];
+
+         if (!overlay->pending_images)
+            continue;
+
+         if (task_push_overlay_images_load(overlay, i, loader->generation))
+            deferred++;
+      }
+
+      RARCH_LOG("[Overlay]: Loaded in %.1f ms, overlay #0 decoded in %.1f ms, "
+            "%u more decoded in the background.\n",
+            (cpu_features_get_time_usec() - loader->start_time) / 1000.0,
+            loader->active_decode_usec / 1000.0, deferred);
    }
 }
 
@@ -748,6 +1154,8 @@ static bool task_push_overlay_load(const char *overlay_path,
 
    loader->overlay_path     = strdup(overlay_path);
    loader->conf             = conf;
+   loader->generation       = ++overlay_load_generation;
+   loader->start_time       = cpu_features_get_time_usec();
    loader->state            = OVERLAY_STATUS_DEFERRED_LOAD;
    loader->pos_increment    = (loader->size / 4) ? (loader->size / 4) : 4;
 
@@ -14,8 +14,6 @@
  *  If not, see <http://www.gnu.org/licenses/>.
  */
 
-/* TODO/FIXME - turn this into actual task */
-
 #ifdef _XBOX1
 #include <xtl.h>
 #include <xgraphics.h>
@@ -32,6 +30,8 @@
 #include <compat/strl.h>
 #include <string/stdstring.h>
 #include <gfx/scaler/scaler.h>
+#include <features/features_cpu.h>
+#include <queues/task_queue.h>
 
 #ifdef HAVE_RBMP
 #include <formats/rbmp.h>
@@ -46,6 +46,7 @@
 
 #include "../general.h"
 #include "../msg_hash.h"
+#include "../runloop.h"
 
 #include "../gfx/video_driver.h"
 #include "../gfx/video_frame.h"
@@ -54,20 +55,184 @@
 #include "../config.h"
 #endif
 
-/* Take frame bottom-up. */
+#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_RPNG) && !defined(_XBOX1)
+#define SCREENSHOT_TASK
+
+/* Screenshots being encoded at most, each one holds a copy
+ * of the frame. */
+#define SCREENSHOT_MAX_PENDING 4
+
+typedef struct
+{
+   char filename[PATH_MAX_LENGTH];
+   char shotname[256];
+   /* BGR24, width * 3 bytes per row. */
+   uint8_t *buffer;
+   unsigned width;
+   unsigned height;
+   bool bottom_up;
+   int level;
+   unsigned threads;
+} screenshot_task_state_t;
+
+static unsigned screenshot_pending;
+
+static void screenshot_flip_rows(uint8_t *buffer,
+      unsigned height, size_t pitch)
+{
+   unsigned y;
+   uint8_t *tmp = (uint8_t*)malloc(pitch);
+
+   if (!tmp)
+      return;
+
+   for (y = 0; y < height / 2; y++)
+   {
+      uint8_t *top    = buffer + y * pitch;
+      uint8_t *bottom = buffer + (height - 1 - y) * pitch;
+
+      memcpy(tmp, top, pitch);
+      memcpy(top, bottom, pitch);
+      memcpy(bottom, tmp, pitch);
+   }
+
+   free(tmp);
+}
+
+static void task_screenshot_handler(retro_task_t *task)
+{
+   screenshot_task_state_t *state = (screenshot_task_state_t*)task->state;
+
+   if (state->bottom_up)
+      screenshot_flip_rows(state->buffer, state->height, state->width * 3);
+
+   if (!rpng_save_image_bgr24_ex(state->filename, state->buffer,
+            state->width, state->height, state->width * 3,
+            state->level, state->threads))
+      task->error = strdup(msg_hash_to_str(MSG_FAILED_TO_TAKE_SCREENSHOT));
+
+   task->finished = true;
+}
+
+static void task_screenshot_callback(void *task_data,
+      void *user_data, const char *error)
+{
+   char msg[PATH_MAX_LENGTH];
+   screenshot_task_state_t *state = (screenshot_task_state_t*)user_data;
+
+   screenshot_pending--;
+
+   if (error)
+   {
+      RARCH_ERR("[Screenshot]: Failed to write \"%s\".\n", state->filename);
+      strlcpy(msg, error, sizeof(msg));
+   }
+   else
+   {
+      RARCH_LOG("[Screenshot]: Saved \"%s\".\n", state->filename);
+      snprintf(msg, sizeof(msg), "%s: %s",
+            msg_hash_to_str(MSG_SCREENSHOT_SAVED), state->shotname);
+   }
+
+   runloop_msg_queue_push(msg, 1, 180, true);
+
+   if (runloop_ctl(RUNLOOP_CTL_IS_PAUSED, NULL))
+      video_driver_cached_frame_render();
+}
+
+static void task_screenshot_free(retro_task_t *task)
+{
+   screenshot_task_state_t *state = (screenshot_task_state_t*)task->state;
+
+   free(state->buffer);
+   free(state);
+}
+
+/**
+ * task_push_screenshot:
+ * @filename             : PNG to write
+ * @shotname             : name shown once it's written
+ * @buffer               : BGR24 frame, width * 3 bytes per row,
+ *                         freed by the task
+ * @width                : width of the frame
+ * @height               : height of the frame
+ * @bottom_up            : rows of @buffer are stored bottom-up
+ *
+ * Encodes and writes the frame on the task thread, the result
+ * is reported on the message queue.
+ *
+ * Returns: true if the task was pushed, @buffer is freed
+ * otherwise as well.
+ **/
+static bool task_push_screenshot(const char *filename,
+      const char *shotname, uint8_t *buffer,
+      unsigned width, unsigned height, bool bottom_up)
+{
+   retro_task_t *t                = NULL;
+   settings_t *settings           = config_get_ptr();
+   screenshot_task_state_t *state = NULL;
+
+   if (screenshot_pending >= SCREENSHOT_MAX_PENDING)
+      goto error;
+
+   state = (screenshot_task_state_t*)calloc(1, sizeof(*state));
+   if (!state)
+      goto error;
+
+   strlcpy(state->filename, filename, sizeof(state->filename));
+   strlcpy(state->shotname, shotname, sizeof(state->shotname));
+   state->buffer    = buffer;
+   state->width     = width;
+   state->height    = height;
+   state->bottom_up = bottom_up;
+   state->level     = MIN(MAX(settings->screenshot_compression, 1), 9);
+   state->threads   = settings->screenshot_threads;
+
+   if (!state->threads)
+      state->threads = cpu_features_get_core_amount();
+
+   t = (retro_task_t*)calloc(1, sizeof(*t));
+   if (!t)
+      goto error;
+
+   t->state     = state;
+   t->handler   = task_screenshot_handler;
+   t->cleanup   = task_screenshot_free;
+   t->callback  = task_screenshot_callback;
+   t->user_data = state;
+   t->mute      = true;
+
+   screenshot_pending++;
+
+   task_queue_ctl(TASK_QUEUE_CTL_PUSH, t);
+
+   return true;
+
+error:
+   free(state);
+   free(buffer);
+   return false;
+}
+#endif
+
+/* Take frame bottom-up.
+ *
+ * @owned_frame is a buffer allocated by the caller holding @frame
+ * that's taken over, the PNG encoder can use it without a copy. */
 static bool screenshot_dump(
       const char *global_name_base,
       const char *folder,
       const void *frame,
       unsigned width,
       unsigned height,
-      int pitch, bool bgr24)
+      int pitch, bool bgr24,
+      void *owned_frame)
 {
    char filename[PATH_MAX_LENGTH] = {0};
    char shotname[256]             = {0};
    bool ret                       = false;
    settings_t *settings           = config_get_ptr();
-#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_RPNG)
+#ifdef SCREENSHOT_TASK
    uint8_t *out_buffer            = NULL;
    struct scaler_ctx scaler       = {0};
 #endif
@@ -91,7 +256,14 @@ static bool screenshot_dump(
    if (XGWriteSurfaceToFile(surf, filename) == S_OK)
       ret = true;
    surf->Release();
-#elif defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_RPNG)
+#elif defined(SCREENSHOT_TASK)
+   /* Only the copy is done here, encoding is left to a task. */
+   if (bgr24 && owned_frame && pitch == (int)width * 3)
+      return task_push_screenshot(filename, shotname,
+            (uint8_t*)owned_frame, width, height, true);
+
+   free(owned_frame);
+
    out_buffer = (uint8_t*)malloc(width * height * 3);
    if (!out_buffer)
       return false;
@@ -106,14 +278,8 @@ static bool screenshot_dump(
 
    scaler_ctx_gen_reset(&scaler);
 
-   ret = rpng_save_image_bgr24(
-         filename,
-         out_buffer,
-         width,
-         height,
-         width * 3
-         );
-   free(out_buffer);
+   return task_push_screenshot(filename, shotname,
+         out_buffer, width, height, false);
 #elif defined(HAVE_RBMP)
    enum rbmp_source_type bmp_type = RBMP_SOURCE_TYPE_DONT_CARE;
 
@@ -130,6 +296,7 @@ static bool screenshot_dump(
          bmp_type);
 #endif
 
+   free(owned_frame);
    return ret;
 }
 
@@ -164,11 +331,9 @@ static bool take_screenshot_viewport(const char *global_name_base)
    }
 
    /* Data read from viewport is in bottom-up order, suitable for BMP. */
-   if (!screenshot_dump(global_name_base, screenshot_dir, buffer, vp.width, vp.height,
-            vp.width * 3, true))
-      goto done;
-
-   retval = true;
+   retval = screenshot_dump(global_name_base, screenshot_dir, buffer,
+         vp.width, vp.height, vp.width * 3, true, buffer);
+   buffer = NULL;
 
 done:
    if (buffer)
@@ -199,7 +364,7 @@ static bool take_screenshot_raw(const char *global_name_base)
     */
    return screenshot_dump(global_name_base, screenshot_dir,
          (const uint8_t*)data + (height - 1) * pitch,
-         width, height, -pitch, false);
+         width, height, -pitch, false, NULL);
 }
 
 static bool take_screenshot_choice(const char *global_name_base)
@@ -28,6 +28,7 @@
 #include "../content.h"
 #include "../core_type.h"
 #include "../msg_hash.h"
+#include "../input/input_autodetect.h"
 
 RETRO_BEGIN_DECLS
 
@@ -63,6 +64,8 @@ typedef struct
 {
     char *data;
     size_t len;
+    /* Set instead of data for transfers streamed to a file. */
+    char *path;
 } http_transfer_data_t;
 #endif
 
@@ -83,6 +86,12 @@ typedef struct nbio_handle
 void *task_push_http_transfer(const char *url, bool mute, const char *type,
       retro_task_callback_t cb, void *userdata);
 
+/* Like task_push_http_transfer, but writes the body to 'path' as it
+ * arrives. The transfer data handed to 'cb' has 'path' set. */
+void *task_push_http_transfer_file(const char *url, const char *path,
+      bool mute, const char *type,
+      retro_task_callback_t cb, void *userdata);
+
 task_retriever_info_t *http_task_get_transfer_list(void);
 #endif
 
@@ -90,6 +99,18 @@ bool task_push_image_load(const char *fullpath,
       enum msg_hash_enums enum_idx,
       retro_task_callback_t cb, void *userdata);
 
+typedef struct
+{
+   struct texture_image image;
+   /* Read back from the disk cache instead of decoded. */
+   bool from_cache;
+} image_thumbnail_t;
+
+bool task_push_image_thumbnail(const char *path, const char *cache_dir,
+      unsigned width, retro_task_callback_t cb, void *user_data);
+
+bool task_push_joypad_autoconfigure(autoconfig_params_t *params);
+
 #ifdef HAVE_LIBRETRODB
 bool task_push_dbscan(const char *fullpath,
       bool directory, retro_task_callback_t cb);
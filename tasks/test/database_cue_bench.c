@@ -0,0 +1,243 @@
+/* Benchmark for the serial detection of the content scanner.
+ *
+ * Writes synthetic PSP ISOs and PS1 CUE/BIN pairs to a temporary
+ * directory, runs them through the same calls the scanner makes
+ * and reports how many images per second get identified. Every
+ * serial found is checked against the one written. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <compat/strl.h>
+#include <file/file_path.h>
+#include <string/stdstring.h>
+
+#include "../tasks_internal.h"
+#include "../../msg_hash.h"
+
+#define IMAGES      64
+#define PASSES      20
+
+#define PSP_SECTORS 512
+#define PS1_SECTORS 64
+#define PS1_FRAME   2352
+
+static int64_t now_usec(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* The scanner logs through these, keep the benchmark quiet. */
+void RARCH_LOG(const char *fmt, ...)
+{
+   (void)fmt;
+}
+
+const char *msg_hash_to_str(enum msg_hash_enums msg)
+{
+   (void)msg;
+   return "";
+}
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+   FILE *file = fopen(path, "wb");
+   bool ret   = file && fwrite(data, 1, len, file) == len;
+
+   if (file && fclose(file) != 0)
+      ret = false;
+   return ret;
+}
+
+/* Serial late in the scanned range, behind plenty of dashes. */
+static bool make_psp_iso(const char *path, unsigned idx, char *serial)
+{
+   size_t i;
+   bool ret;
+   size_t len    = PSP_SECTORS * 2048;
+   uint8_t *data = (uint8_t*)calloc(1, len);
+
+   if (!data)
+      return false;
+
+   for (i = 0; i < len; i++)
+      data[i] = (i % 7) ? 'A' + (i % 23) : '-';
+
+   memcpy(data + 0x8008, "PSP GAME", 8);
+   snprintf(serial, 11, "ULUS-%05u", 10000 + idx);
+   memcpy(data + 90000 + idx, serial, 10);
+
+   ret = write_file(path, data, len);
+   free(data);
+   return ret;
+}
+
+static void ps1_sector(uint8_t *data, unsigned sector)
+{
+   uint8_t *s = data + sector * PS1_FRAME;
+
+   memset(s + 1, 0xff, 10);
+   s[13] = 0x02;
+   s[15] = 0x02;
+}
+
+static bool make_ps1_bin(const char *path, unsigned idx, char *serial)
+{
+   unsigned i;
+   bool ret;
+   uint8_t *rec;
+   char cnf[64];
+   size_t len    = PS1_SECTORS * PS1_FRAME;
+   uint8_t *data = (uint8_t*)calloc(1, len);
+
+   if (!data)
+      return false;
+
+   for (i = 0; i < PS1_SECTORS; i++)
+      ps1_sector(data, i);
+
+   /* Primary volume descriptor, root directory on sector 22. */
+   data[16 * PS1_FRAME + 24 + 156 + 2] = 22;
+
+   /* Root directory, SYSTEM.CNF on sector 23. */
+   rec    = data + 22 * PS1_FRAME + 24;
+   rec[0] = 34;
+   rec   += 34;
+   rec[0] = 46;
+   rec[2] = 23;
+   memcpy(rec + 33, "SYSTEM.CNF;1", 12);
+
+   snprintf(cnf, sizeof(cnf),
+         "BOOT = cdrom:\\SLUS_%03u.%02u;1\r\nTCB = 4\r\n",
+         idx / 100, idx % 100);
+   memcpy(data + 23 * PS1_FRAME + 24, cnf, strlen(cnf));
+   snprintf(serial, 11, "SLUS-%03u%02u", idx / 100, idx % 100);
+
+   ret = write_file(path, data, len);
+   free(data);
+   return ret;
+}
+
+static bool make_cue(const char *path, const char *bin)
+{
+   char cue[PATH_MAX_LENGTH];
+
+   snprintf(cue, sizeof(cue),
+         "FILE \"%s\" BINARY\r\n"
+         "  TRACK 01 MODE2/2352\r\n"
+         "    INDEX 01 00:00:00\r\n"
+         "  TRACK 02 AUDIO\r\n"
+         "    INDEX 00 01:02:03\r\n"
+         "    INDEX 01 01:04:03\r\n",
+         path_basename(bin));
+
+   return write_file(path, cue, strlen(cue));
+}
+
+/* What the scanner does for an ISO, see iso_get_serial(). */
+static bool scan_iso(const char *path, char *serial)
+{
+   const char *system_name = NULL;
+
+   if (detect_system(path, 0, &system_name) < 0)
+      return false;
+   if (string_is_equal(system_name, "psp"))
+      return detect_psp_game(path, serial) > 0;
+   if (string_is_equal(system_name, "ps1"))
+      return detect_ps1_game(path, serial) > 0;
+   return false;
+}
+
+static bool scan_cue(const char *path, char *serial)
+{
+   int32_t offset                   = 0;
+   char track_path[PATH_MAX_LENGTH] = {0};
+
+   if (find_first_data_track(path, &offset,
+            track_path, sizeof(track_path)) < 0)
+      return false;
+   return scan_iso(track_path, serial);
+}
+
+static bool bench(const char *name, char paths[][PATH_MAX_LENGTH],
+      char serials[][16], bool (*scan)(const char*, char*))
+{
+   unsigned i, pass;
+   int64_t start = now_usec();
+   int64_t elapsed;
+
+   for (pass = 0; pass < PASSES; pass++)
+   {
+      for (i = 0; i < IMAGES; i++)
+      {
+         char serial[64] = {0};
+
+         if (!scan(paths[i], serial) || !string_is_equal(serial, serials[i]))
+         {
+            fprintf(stderr, "%s: got \"%s\" instead of \"%s\" for %s\n",
+                  name, serial, serials[i], paths[i]);
+            return false;
+         }
+      }
+   }
+
+   elapsed = now_usec() - start;
+   printf("%-8s %6u images in %8.1f ms, %10.0f images/s\n", name,
+         IMAGES * PASSES, elapsed / 1000.0,
+         IMAGES * PASSES * 1000000.0 / (elapsed ? elapsed : 1));
+   return true;
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   bool ret = true;
+   char dir[]                                 = "/tmp/database_cue_benchXXXXXX";
+   static char iso_paths[IMAGES][PATH_MAX_LENGTH];
+   static char cue_paths[IMAGES][PATH_MAX_LENGTH];
+   static char bin_paths[IMAGES][PATH_MAX_LENGTH];
+   static char iso_serials[IMAGES][16];
+   static char cue_serials[IMAGES][16];
+
+   if (!mkdtemp(dir))
+   {
+      perror("mkdtemp");
+      return 1;
+   }
+
+   for (i = 0; i < IMAGES; i++)
+   {
+      snprintf(iso_paths[i], PATH_MAX_LENGTH, "%s/psp%u.iso", dir, i);
+      snprintf(bin_paths[i], PATH_MAX_LENGTH, "%s/ps1_%u.bin", dir, i);
+      snprintf(cue_paths[i], PATH_MAX_LENGTH, "%s/ps1_%u.cue", dir, i);
+
+      if (!make_psp_iso(iso_paths[i], i, iso_serials[i])
+            || !make_ps1_bin(bin_paths[i], i, cue_serials[i])
+            || !make_cue(cue_paths[i], bin_paths[i]))
+      {
+         fprintf(stderr, "Failed to write fixtures to %s\n", dir);
+         ret = false;
+         goto end;
+      }
+   }
+
+   ret = bench("PSP ISO", iso_paths, iso_serials, scan_iso)
+      && bench("PS1 CUE", cue_paths, cue_serials, scan_cue);
+
+end:
+   for (i = 0; i < IMAGES; i++)
+   {
+      unlink(iso_paths[i]);
+      unlink(bin_paths[i]);
+      unlink(cue_paths[i]);
+   }
+   rmdir(dir);
+
+   return ret ? 0 : 1;
+}